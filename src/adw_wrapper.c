@@ -362,8 +362,12 @@ pref_menu_cb(G_GNUC_UNUSED GSimpleAction *simple_action,
   GtkWidget *webrtc_pref_group;
   GtkStringList *codec_options;
   GtkStringList *boolean_options;
+  GtkStringList *latency_options;
+  GtkStringList *video_codec_options;
   const gchar *audio_codec_list[] = AUDIO_CODEC_LIST;
   const gchar *boolean_options_list[] = BOOLEAN_LIST;
+  const gchar *latency_profile_list[] = LATENCY_PROFILE_LIST;
+  const gchar *video_codec_list[] = VIDEO_CODEC_LIST;
 
   boolean_options = gtk_string_list_new(boolean_options_list);
 
@@ -388,6 +392,16 @@ pref_menu_cb(G_GNUC_UNUSED GSimpleAction *simple_action,
 
   video_pref_group = adw_preferences_group_new();
 
+  video_codec_options = gtk_string_list_new(video_codec_list);
+
+  add_pref_dropdown(ADW_PREFERENCES_GROUP(video_pref_group),
+                    G_LIST_MODEL(video_codec_options),
+                    "Preferred codec",
+                    WEBRTC_SETTINGS_VIDEO_CODEC,
+                    webrtc_settings_selected(settings,
+                                             WEBRTC_SETTINGS_VIDEO_CODEC),
+                    data);
+
   add_pref_dropdown(ADW_PREFERENCES_GROUP(video_pref_group),
                     G_LIST_MODEL(boolean_options),
                     "Adaptive Bitrate",
@@ -430,6 +444,30 @@ pref_menu_cb(G_GNUC_UNUSED GSimpleAction *simple_action,
                                              WEBRTC_SETTINGS_FORCE_TURN),
                     data);
 
+  add_pref_dropdown(ADW_PREFERENCES_GROUP(webrtc_pref_group),
+                    G_LIST_MODEL(boolean_options),
+                    "Forward error correction",
+                    WEBRTC_SETTINGS_FEC,
+                    webrtc_settings_selected(settings, WEBRTC_SETTINGS_FEC),
+                    data);
+
+  add_pref_number(ADW_PREFERENCES_GROUP(webrtc_pref_group),
+                  "Receive budget (Kbps)",
+                  WEBRTC_SETTINGS_BANDWIDTH,
+                  webrtc_settings_bandwidth(settings),
+                  20000000,
+                  data);
+
+  latency_options = gtk_string_list_new(latency_profile_list);
+
+  add_pref_dropdown(ADW_PREFERENCES_GROUP(webrtc_pref_group),
+                    G_LIST_MODEL(latency_options),
+                    "Latency profile",
+                    WEBRTC_SETTINGS_LATENCY_PROFILE,
+                    webrtc_settings_selected(settings,
+                                             WEBRTC_SETTINGS_LATENCY_PROFILE),
+                    data);
+
   adw_preferences_group_set_title(ADW_PREFERENCES_GROUP(webrtc_pref_group),
                                   "WebRTC settings");
 
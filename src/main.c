@@ -3,17 +3,25 @@
 #include <gst/gst.h>
 #include <gdk/gdk.h>
 
+#include "webrtc_bandwidth.h"
 #include "webrtc_client.h"
+#include "webrtc_cpu.h"
 #include "webrtc_gui.h"
+#include "webrtc_log.h"
 #include "webrtc_session.h"
 #include "webrtc_settings.h"
+#include "webrtc_tracer.h"
 #include "adw_wrapper.h"
 
+/* From this many tiles on they are too small to show the full resolution */
+#define LOW_LAYER_TILES 4
+
 struct app_ctx {
   WebrtcGui *gui;
   GtkApplication *app;
   GHashTable *sessions;
   WebrtcSettings *settings;
+  WebrtcBandwidth *bandwidth;
 };
 static void
 new_peer(G_GNUC_UNUSED GObject *source,
@@ -48,6 +56,45 @@ new_video_sink(struct app_ctx *ctx, const gchar *id)
   return video_sink;
 }
 
+static void
+select_layers(struct app_ctx *ctx)
+{
+  GHashTableIter iter;
+  gpointer sess;
+  enum webrtc_session_layer layer = WEBRTC_SESSION_LAYER_HIGH;
+
+  if (g_hash_table_size(ctx->sessions) >= LOW_LAYER_TILES) {
+    layer = WEBRTC_SESSION_LAYER_LOW;
+  }
+
+  g_hash_table_iter_init(&iter, ctx->sessions);
+  while (g_hash_table_iter_next(&iter, NULL, &sess)) {
+    webrtc_session_select_layer(WEBRTC_SESSION(sess), layer);
+  }
+}
+
+static void
+on_health_changed(WebrtcSession *sess,
+                  guint health,
+                  const gchar *reason,
+                  struct app_ctx *ctx)
+{
+  const gchar *session_id = webrtc_session_get_id(sess);
+
+  if (health != WEBRTC_SESSION_HEALTH_FAILED ||
+      g_hash_table_lookup(ctx->sessions, session_id) != sess) {
+    return;
+  }
+
+  g_warning("Closing failed session %s: %s", session_id, reason);
+  webrtc_gui_remove_paintable(ctx->gui, session_id);
+  webrtc_bandwidth_remove_session(ctx->bandwidth, sess);
+  webrtc_session_stop(sess);
+
+  g_hash_table_remove(ctx->sessions, session_id);
+  select_layers(ctx);
+}
+
 static void
 on_new_stream(G_GNUC_UNUSED GObject *source,
               WebrtcClient *c,
@@ -58,17 +105,38 @@ on_new_stream(G_GNUC_UNUSED GObject *source,
   GstElement *video_sink;
   GstElement *audio_sink;
   WebrtcSession *sess;
+  WebrtcSettings *settings;
+  gint64 kbps;
+
+  /* The user asked for this stream, degrade rather than make them wait */
+  webrtc_bandwidth_request(ctx->bandwidth,
+                           session_id,
+                           target,
+                           NULL,
+                           FALSE,
+                           &kbps);
+  settings = webrtc_settings_dup(ctx->settings);
+  if (kbps > 0) {
+    g_object_set(settings, "max_bitrate", kbps, NULL);
+  }
 
-  sess = webrtc_session_new(c, ctx->settings, session_id, target);
+  sess = webrtc_session_new(c, settings, session_id, target);
+  g_object_unref(settings);
   video_sink = new_video_sink(ctx, session_id);
   audio_sink = gst_element_factory_make("autoaudiosink", "audio-output");
 
   webrtc_session_add_element(sess, WEBRTC_SESSION_ELEM_VIDEO, video_sink);
   webrtc_session_add_element(sess, WEBRTC_SESSION_ELEM_AUDIO, audio_sink);
 
-  webrtc_session_start(sess, FALSE);
-
   g_hash_table_insert(ctx->sessions, g_strdup(session_id), sess);
+  g_signal_connect(sess,
+                   "health-changed",
+                   G_CALLBACK(on_health_changed),
+                   ctx);
+  select_layers(ctx);
+
+  webrtc_session_start(sess, FALSE);
+  webrtc_bandwidth_add_session(ctx->bandwidth, session_id, sess);
 }
 
 static void
@@ -89,9 +157,11 @@ on_close_stream(G_GNUC_UNUSED GObject *source,
   }
 
   webrtc_gui_remove_paintable(ctx->gui, session_id);
+  webrtc_bandwidth_remove_session(ctx->bandwidth, sess);
   webrtc_session_stop(sess);
 
   g_hash_table_remove(ctx->sessions, session_id);
+  select_layers(ctx);
 }
 
 static void
@@ -109,9 +179,11 @@ on_remove_stream(G_GNUC_UNUSED GObject *source,
 
   g_message("Stopping session id: %s", info->session_id);
 
+  webrtc_bandwidth_remove_session(ctx->bandwidth, sess);
   webrtc_session_stop(sess);
   g_hash_table_remove(ctx->sessions, info->session_id);
   webrtc_gui_remove_paintable(ctx->gui, info->session_id);
+  select_layers(ctx);
 }
 
 static void
@@ -137,6 +209,7 @@ int
 main(int argc, char **argv)
 {
   struct app_ctx ctx = { 0 };
+  GError *lerr = NULL;
   gint code;
   gst_init(&argc, &argv);
 
@@ -153,12 +226,27 @@ main(int argc, char **argv)
     goto out;
   }
 
+  webrtc_log_set_trace(webrtc_settings_get_trace(ctx.settings),
+                       WEBRTC_LOG_LEVEL_DEBUG);
+  if (!webrtc_log_set_levels(webrtc_settings_get_log(ctx.settings), &lerr)) {
+    g_print("Invalid log levels: %s\n", lerr->message);
+    g_clear_error(&lerr);
+    code = 1;
+    goto out;
+  }
+
+  webrtc_cpu_start(WEBRTC_CPU_SAMPLE_INTERVAL, WEBRTC_CPU_LOG_INTERVAL);
+  if (webrtc_settings_get_telemetry(ctx.settings)) {
+    webrtc_tracer_enable();
+  }
+
   ctx.sessions = g_hash_table_new_full(g_str_hash,
                                        g_str_equal,
                                        g_free,
                                        g_object_unref);
 
   ctx.gui = webrtc_gui_new(ctx.settings);
+  ctx.bandwidth = webrtc_bandwidth_new(ctx.settings);
 
   g_signal_connect(ctx.gui, "new-stream", G_CALLBACK(on_new_stream), &ctx);
   g_signal_connect(ctx.gui, "close-stream", G_CALLBACK(on_close_stream), &ctx);
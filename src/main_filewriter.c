@@ -3,17 +3,121 @@
 #include <gst/gst.h>
 #include <glib-unix.h>
 
+#include "webrtc_admission.h"
+#include "webrtc_bandwidth.h"
+#include "webrtc_catalog.h"
 #include "webrtc_client.h"
+#include "webrtc_cpu.h"
+#include "webrtc_disk.h"
+#include "webrtc_filter.h"
+#include "webrtc_log.h"
+#include "webrtc_reaper.h"
 #include "webrtc_session.h"
 #include "webrtc_settings.h"
+#include "webrtc_threads.h"
+#include "webrtc_tracer.h"
+
+#define DISK_THREADS    4
+#define DISK_BLOCK_SIZE (1 << 20)
+/* Rebuilds of a failed session before its recording is given up, counted
+ * since media last arrived */
+#define MAX_REBUILDS 3
+
+/* Seconds between writing out the keyframes of the recordings */
+#define CATALOG_FLUSH_INTERVAL 5
 
 struct app_ctx {
-  WebrtcClient *c;
-  GHashTable *sessions;
+  GPtrArray *clients; /* one per server */
+  GHashTable *sessions; /* "server/session id" -> WebrtcSession */
   GMainLoop *loop;
   WebrtcSettings *settings;
+  WebrtcAdmission *admission;
+  WebrtcBandwidth *bandwidth;
+  WebrtcDiskWriter *disk;
+  GHashTable *pending; /* "server/session id" -> struct pending */
+  GHashTable *recordings; /* "server/session id" -> struct recording */
+  struct webrtc_filter *filter;
+  struct webrtc_catalog *catalog; /* NULL without --catalog */
+};
+
+/* A stream that is not recorded yet */
+struct pending {
+  WebrtcClient *c;
+  struct stream_started *info; /* owned, also for the catalog */
+};
+
+/* Where a running session writes to */
+struct recording {
+  struct pending *source; /* to start the session again */
+  gchar *dir;
+  guint priority;
+  guint part;         /* rebuilds continue in a new output file */
+  guint rebuilds;     /* since media last arrived */
+  gint64 failed_time; /* monotonic, 0 unless rebuilding */
+  guint64 catalog_id; /* 0 if not in the catalog */
 };
 
+static void
+pending_free(struct pending *p)
+{
+  g_clear_object(&p->c);
+  stream_started_free(p->info);
+  g_free(p);
+}
+
+static void
+recording_free(struct recording *r)
+{
+  pending_free(r->source);
+  g_free(r->dir);
+  g_free(r);
+}
+
+/* Takes p out of the pending table */
+static struct pending *
+take_pending(struct app_ctx *ctx, const gchar *key)
+{
+  gpointer stolen_key = NULL;
+  gpointer p = NULL;
+
+  if (g_hash_table_steal_extended(ctx->pending, key, &stolen_key, &p)) {
+    g_free(stolen_key);
+  }
+
+  return p;
+}
+
+/* The rules of the filter file plus the target as a subject prefix */
+static struct webrtc_filter *
+load_filter(WebrtcSettings *settings, GError **error)
+{
+  struct webrtc_filter *filter;
+  const gchar *path;
+  const gchar *target;
+
+  path = webrtc_settings_get_filter(settings);
+  if (path != NULL) {
+    filter = webrtc_filter_new_from_file(path, error);
+  } else {
+    filter = webrtc_filter_new();
+  }
+
+  target = webrtc_settings_get_target(settings);
+  if (filter != NULL && target != NULL) {
+    gchar *rule = g_strdup_printf("subject:%s*", target);
+
+    webrtc_filter_add(filter, rule, NULL);
+    g_free(rule);
+  }
+
+  if (filter != NULL) {
+    g_message("Recording streams matching %u rules",
+              webrtc_filter_size(filter));
+  }
+
+  return filter;
+}
+
 static void
 new_peer(G_GNUC_UNUSED GObject *source,
          const gchar *s,
@@ -23,70 +127,575 @@ new_peer(G_GNUC_UNUSED GObject *source,
   g_message("New client connected: %s -> %s", s, subject);
 }
 
-static void
-on_new_stream(G_GNUC_UNUSED GObject *source,
-              struct stream_started *info,
-              struct app_ctx *ctx)
+/* Session ids are only unique per server, and a host may be listed once per
+ * user */
+static gchar *
+session_key(WebrtcClient *c, const gchar *session_id)
 {
-  GstElement *mux;
-  GstElement *filesink;
-  WebrtcSession *sess;
-  const gchar *target;
-  const gchar *output;
+  const gchar *user = webrtc_client_get_user(c);
 
-  g_print("New stream: %p, %p\n", info, ctx);
+  if (user == NULL) {
+    return g_strdup_printf("%s/%s", webrtc_client_get_name(c), session_id);
+  }
+
+  return g_strdup_printf("%s@%s/%s",
+                         user,
+                         webrtc_client_get_name(c),
+                         session_id);
+}
+
+/* The directory of the output and the file name in it, parts after the
+ * first get their number before the extension */
+static gchar *
+output_name(struct app_ctx *ctx, struct pending *p, guint part, gchar **dir)
+{
+  const gchar *output;
+  gchar *name;
 
-  target = webrtc_settings_get_target(ctx->settings);
   output = webrtc_settings_get_output(ctx->settings);
-  if (target != NULL &&
-      g_ascii_strncasecmp(info->subject, target, strlen(target)) != 0) {
-    g_message("Device %s connected, waiting for %s", info->subject, target);
+  name = g_strdup_printf("%s-%s.mkv",
+                         p->info->subject,
+                         p->info->session_id);
+
+  if (output == NULL) {
+    *dir = g_strdup(".");
+  } else if (g_file_test(output, G_FILE_TEST_IS_DIR)) {
+    *dir = g_strdup(output);
+  } else {
+    *dir = g_path_get_dirname(output);
+    g_free(name);
+    name = g_path_get_basename(output);
+  }
+
+  if (part > 0) {
+    const gchar *ext = strrchr(name, '.');
+    gchar *numbered;
+
+    if (ext == NULL) {
+      ext = name + strlen(name);
+    }
+    numbered = g_strdup_printf("%.*s-%u%s",
+                               (gint) (ext - name),
+                               name,
+                               part,
+                               ext);
+    g_free(name);
+    name = numbered;
+  }
+
+  return name;
+}
+
+/* New recordings go to the fallback directory while the output volume is
+ * low on space. NULL if the chosen directory is full, dir is set anyway. */
+static gchar *
+choose_location(struct app_ctx *ctx,
+                struct pending *p,
+                guint part,
+                gchar **dir)
+{
+  const gchar *fallback;
+  enum webrtc_disk_state state;
+  gchar *name;
+  gchar *location;
+  gchar *given;
+
+  /* As the disk writer names it in state-changed */
+  name = output_name(ctx, p, part, &given);
+  *dir = webrtc_disk_canonical_dir(given);
+  g_free(given);
+  state = webrtc_disk_writer_watch(ctx->disk, *dir);
+
+  fallback = webrtc_settings_get_fallback_output(ctx->settings);
+  if (state >= WEBRTC_DISK_STATE_LOW && fallback != NULL &&
+      webrtc_disk_writer_watch(ctx->disk, fallback) < state) {
+    g_message("Output %s is %s, using %s",
+              *dir,
+              webrtc_disk_state_name(state),
+              fallback);
+    g_free(*dir);
+    *dir = webrtc_disk_canonical_dir(fallback);
+    state = webrtc_disk_writer_watch(ctx->disk, fallback);
+  }
+
+  if (state == WEBRTC_DISK_STATE_FULL) {
+    g_free(name);
+    return NULL;
+  }
+
+  location = g_build_filename(*dir, name, NULL);
+  g_free(name);
+
+  return location;
+}
+
+/* Audio of sessions without a raised priority goes first, then whole
+ * sessions. FALSE if the session should stop. */
+static gboolean
+degrade_recording(WebrtcSession *sess,
+                  struct recording *rec,
+                  enum webrtc_disk_state state)
+{
+  gboolean priority = rec->priority > 1;
+
+  switch (state) {
+  case WEBRTC_DISK_STATE_OK:
+    webrtc_session_drop_audio(sess, FALSE);
+    return TRUE;
+  case WEBRTC_DISK_STATE_SLOW:
+  case WEBRTC_DISK_STATE_LOW:
+    webrtc_session_drop_audio(sess, !priority);
+    return TRUE;
+  case WEBRTC_DISK_STATE_FULL:
+    webrtc_session_drop_audio(sess, TRUE);
+    return priority;
+  }
+
+  return TRUE;
+}
+
+/* Adds the next part of rec to the catalog, the recording itself with the
+ * first one */
+static void
+catalog_part(struct app_ctx *ctx,
+             struct recording *rec,
+             const gchar *location,
+             GstElement *sink)
+{
+  if (ctx->catalog == NULL) {
     return;
   }
 
-  sess = webrtc_session_new(ctx->c,
-                            ctx->settings,
-                            info->session_id,
-                            info->subject);
-  g_hash_table_insert(ctx->sessions, g_strdup(info->session_id), sess);
+  if (rec->catalog_id == 0) {
+    rec->catalog_id = webrtc_catalog_add_recording(ctx->catalog,
+                                                   rec->source->info);
+  }
 
-  mux = gst_element_factory_make("matroskamux", "mux");
-  filesink = gst_element_factory_make("filesink", "filesink");
+  webrtc_catalog_add_part(ctx->catalog, rec->catalog_id, location, sink);
+}
 
-  g_object_set(G_OBJECT(mux), "streamable", TRUE, NULL);
+static void
+end_catalog_recording(G_GNUC_UNUSED gpointer key,
+                      gpointer value,
+                      gpointer user_data)
+{
+  struct recording *rec = value;
+  struct app_ctx *ctx = user_data;
 
-  if (output == NULL) {
-    gchar *tmp;
-    tmp = g_strdup_printf("%s-%s.mkv", info->subject, info->session_id);
-    g_object_set(G_OBJECT(filesink), "location", tmp, NULL);
-    g_free(tmp);
+  if (ctx->catalog != NULL && rec != NULL) {
+    webrtc_catalog_end_recording(ctx->catalog, rec->catalog_id);
+  }
+}
+
+static void
+stop_recording(struct app_ctx *ctx, const gchar *key)
+{
+  WebrtcSession *sess = g_hash_table_lookup(ctx->sessions, key);
+
+  end_catalog_recording(NULL, g_hash_table_lookup(ctx->recordings, key), ctx);
+
+  webrtc_admission_remove_session(ctx->admission, sess);
+  webrtc_bandwidth_remove_session(ctx->bandwidth, sess);
+  webrtc_session_stop(sess);
+  g_hash_table_remove(ctx->recordings, key);
+  g_hash_table_remove(ctx->sessions, key);
+}
+
+static void on_health_changed(WebrtcSession *sess,
+                              guint health,
+                              const gchar *reason,
+                              struct app_ctx *ctx);
+
+/* A session for the next part of rec, NULL if there is nowhere to write */
+static WebrtcSession *
+start_session(struct app_ctx *ctx,
+              const gchar *key,
+              struct recording *rec,
+              gint64 kbps)
+{
+  GstElement *mux;
+  GstElement *sink;
+  WebrtcSession *sess;
+  WebrtcSettings *settings;
+  struct pending *p = rec->source;
+  gchar *location;
+  GError *lerr = NULL;
+
+  g_clear_pointer(&rec->dir, g_free);
+  location = choose_location(ctx, p, rec->part, &rec->dir);
+
+  if (location == NULL) {
+    g_warning("Not recording %s: %s is full", key, rec->dir);
+    sink = NULL;
   } else {
-    g_object_set(G_OBJECT(filesink), "location", output, NULL);
+    sink = webrtc_disk_writer_sink(ctx->disk, location, &lerr);
+    if (sink == NULL) {
+      g_warning("Not recording %s: %s", key, lerr->message);
+      g_clear_error(&lerr);
+    } else {
+      catalog_part(ctx, rec, location, sink);
+    }
+  }
+  g_free(location);
+
+  if (sink == NULL) {
+    return NULL;
+  }
+
+  /* The allocated bitrate goes into this session's initSession only */
+  settings = webrtc_settings_dup(ctx->settings);
+  if (kbps > 0) {
+    g_object_set(settings, "max_bitrate", kbps, NULL);
   }
 
+  sess = webrtc_session_new(p->c,
+                            settings,
+                            p->info->session_id,
+                            p->info->subject);
+  g_object_unref(settings);
+  g_hash_table_insert(ctx->sessions, g_strdup(key), sess);
+  g_signal_connect(sess,
+                   "health-changed",
+                   G_CALLBACK(on_health_changed),
+                   ctx);
+
+  mux = gst_element_factory_make("matroskamux", "mux");
+  g_object_set(G_OBJECT(mux), "streamable", TRUE, NULL);
+
   webrtc_session_add_element(sess, WEBRTC_SESSION_ELEM_MUX, mux);
-  webrtc_session_add_element(sess, WEBRTC_SESSION_ELEM_MUX, filesink);
+  webrtc_session_add_element(sess, WEBRTC_SESSION_ELEM_MUX, sink);
+  /* The muxer only finishes the file on EOS */
+  webrtc_session_set_drain(sess, TRUE);
 
   webrtc_session_start(sess, TRUE);
+  /* A rebuilt session takes over the slots of the failed one */
+  webrtc_admission_add_session(ctx->admission, key, sess);
+  webrtc_bandwidth_add_session(ctx->bandwidth, key, sess);
+
+  degrade_recording(sess,
+                    rec,
+                    webrtc_disk_writer_watch(ctx->disk, rec->dir));
+
+  return sess;
 }
 
+/* Takes p */
 static void
-on_remove_stream(G_GNUC_UNUSED GObject *source,
+start_recording(struct app_ctx *ctx,
+                const gchar *key,
+                struct pending *p,
+                gint64 kbps)
+{
+  struct recording *rec;
+
+  rec = g_malloc0(sizeof(*rec));
+  rec->source = p;
+  rec->priority = webrtc_settings_priority(ctx->settings,
+                                           p->info->subject,
+                                           p->info->trigger_type);
+
+  if (start_session(ctx, key, rec, kbps) == NULL) {
+    recording_free(rec);
+    webrtc_admission_cancel(ctx->admission, key);
+    webrtc_bandwidth_cancel(ctx->bandwidth, key);
+    return;
+  }
+
+  g_hash_table_insert(ctx->recordings, g_strdup(key), rec);
+}
+
+/* Same device session id, so the device only sees a new initSession, the
+ * recording continues in the next part */
+static void
+rebuild_recording(struct app_ctx *ctx, const gchar *key)
+{
+  WebrtcSession *sess = g_hash_table_lookup(ctx->sessions, key);
+  struct recording *rec = g_hash_table_lookup(ctx->recordings, key);
+  gint64 kbps = webrtc_session_get_max_bitrate(sess);
+
+  webrtc_session_stop(sess);
+
+  rec->part++;
+  rec->rebuilds++;
+  if (rec->failed_time == 0) {
+    rec->failed_time = g_get_monotonic_time();
+  }
+
+  if (start_session(ctx, key, rec, kbps) == NULL) {
+    stop_recording(ctx, key);
+  }
+}
+
+static void
+on_health_changed(WebrtcSession *sess,
+                  guint health,
+                  const gchar *reason,
+                  struct app_ctx *ctx)
+{
+  GHashTableIter iter;
+  gpointer value;
+  gpointer k;
+  const gchar *key = NULL;
+  struct recording *rec;
+  gchar *failed;
+
+  /* Stale transitions of a stopped session are not in the table */
+  g_hash_table_iter_init(&iter, ctx->sessions);
+  while (g_hash_table_iter_next(&iter, &k, &value)) {
+    if (value == sess) {
+      key = k;
+      break;
+    }
+  }
+
+  rec = key != NULL ? g_hash_table_lookup(ctx->recordings, key) : NULL;
+  if (rec == NULL) {
+    return;
+  }
+
+  switch (health) {
+  case WEBRTC_SESSION_HEALTH_STREAMING:
+    if (rec->failed_time != 0) {
+      g_message("Session %s recovered after %" G_GINT64_FORMAT
+                " ms, recording part %u",
+                key,
+                (g_get_monotonic_time() - rec->failed_time) / 1000,
+                rec->part);
+      rec->failed_time = 0;
+    }
+    rec->rebuilds = 0;
+    break;
+  case WEBRTC_SESSION_HEALTH_FAILED:
+    failed = g_strdup(key);
+    if (rec->rebuilds < MAX_REBUILDS) {
+      g_warning("Rebuilding failed session %s: %s", failed, reason);
+      rebuild_recording(ctx, failed);
+    } else {
+      g_warning("Stopping failed session %s: %s", failed, reason);
+      stop_recording(ctx, failed);
+    }
+    g_free(failed);
+    break;
+  default:
+    break;
+  }
+}
+
+static void
+request_bandwidth(struct app_ctx *ctx, const gchar *key)
+{
+  struct pending *p;
+  gint64 kbps;
+
+  p = g_hash_table_lookup(ctx->pending, key);
+  if (p == NULL) {
+    return;
+  }
+
+  if (webrtc_bandwidth_request(ctx->bandwidth,
+                               key,
+                               p->info->subject,
+                               p->info->trigger_type,
+                               TRUE,
+                               &kbps) == WEBRTC_BANDWIDTH_QUEUE) {
+    return;
+  }
+
+  start_recording(ctx, key, take_pending(ctx, key), kbps);
+}
+
+static void
+on_bandwidth_admitted(G_GNUC_UNUSED WebrtcBandwidth *source,
+                      const gchar *key,
+                      gint64 kbps,
+                      struct app_ctx *ctx)
+{
+  struct pending *p;
+
+  p = g_hash_table_lookup(ctx->pending, key);
+  if (p == NULL) {
+    webrtc_bandwidth_cancel(ctx->bandwidth, key);
+    webrtc_admission_cancel(ctx->admission, key);
+    return;
+  }
+
+  start_recording(ctx, key, take_pending(ctx, key), kbps);
+}
+
+static void
+on_admission_admitted(G_GNUC_UNUSED WebrtcAdmission *source,
+                      const gchar *key,
+                      struct app_ctx *ctx)
+{
+  if (!g_hash_table_contains(ctx->pending, key)) {
+    webrtc_admission_cancel(ctx->admission, key);
+    return;
+  }
+
+  request_bandwidth(ctx, key);
+}
+
+static void
+on_admission_rejected(G_GNUC_UNUSED WebrtcAdmission *source,
+                      const gchar *key,
+                      struct app_ctx *ctx)
+{
+  g_message("Not recording session: %s", key);
+  g_hash_table_remove(ctx->pending, key);
+}
+
+static void
+on_new_stream(WebrtcClient *source,
+              struct stream_started *info,
+              struct app_ctx *ctx)
+{
+  struct pending *p;
+  gchar *key;
+
+  g_print("New stream: %p, %p\n", info, ctx);
+
+  if (!webrtc_filter_match(ctx->filter,
+                           info->subject,
+                           info->bearer_name,
+                           info->trigger_type)) {
+    g_message("Device %s connected, not matching the filter", info->subject);
+    return;
+  }
+
+  key = session_key(source, info->session_id);
+  if (g_hash_table_contains(ctx->sessions, key) ||
+      g_hash_table_contains(ctx->pending, key)) {
+    g_warning("Session %s is already known", key);
+    g_free(key);
+    return;
+  }
+
+  p = g_malloc0(sizeof(*p));
+  p->c = g_object_ref(source);
+  p->info = stream_started_copy(info);
+  g_hash_table_insert(ctx->pending, g_strdup(key), p);
+
+  switch (webrtc_admission_request(ctx->admission,
+                                   key,
+                                   info->subject,
+                                   info->trigger_type)) {
+  case WEBRTC_ADMISSION_ADMIT:
+    request_bandwidth(ctx, key);
+    break;
+  case WEBRTC_ADMISSION_QUEUE:
+    break;
+  case WEBRTC_ADMISSION_REJECT:
+    on_admission_rejected(ctx->admission, key, ctx);
+    break;
+  }
+
+  g_free(key);
+}
+
+static void
+on_disk_state_changed(G_GNUC_UNUSED WebrtcDiskWriter *source,
+                      const gchar *dir,
+                      guint state,
+                      struct app_ctx *ctx)
+{
+  GHashTableIter iter;
+  const gchar *key;
+  struct recording *rec;
+  GPtrArray *stop = g_ptr_array_new_with_free_func(g_free);
+
+  g_hash_table_iter_init(&iter, ctx->recordings);
+  while (g_hash_table_iter_next(&iter, (gpointer *) &key, (gpointer *) &rec)) {
+    WebrtcSession *sess;
+
+    if (g_strcmp0(rec->dir, dir) != 0) {
+      continue;
+    }
+
+    sess = g_hash_table_lookup(ctx->sessions, key);
+    if (!degrade_recording(sess, rec, state)) {
+      g_ptr_array_add(stop, g_strdup(key));
+    }
+  }
+
+  for (guint i = 0; i < stop->len; i++) {
+    g_warning("Stopping session %s, %s is %s",
+              (const gchar *) stop->pdata[i],
+              dir,
+              webrtc_disk_state_name(state));
+    stop_recording(ctx, stop->pdata[i]);
+  }
+
+  g_ptr_array_unref(stop);
+}
+
+static void
+on_remove_stream(WebrtcClient *source,
                  struct stream_started *info,
                  struct app_ctx *ctx)
 {
   WebrtcSession *sess;
+  gchar *key;
+
+  key = session_key(source, info->session_id);
+
+  if (g_hash_table_remove(ctx->pending, key)) {
+    g_message("Dropping queued session: %s", key);
+    webrtc_admission_cancel(ctx->admission, key);
+    webrtc_bandwidth_cancel(ctx->bandwidth, key);
+    g_free(key);
+    return;
+  }
 
-  sess = g_hash_table_lookup(ctx->sessions, info->session_id);
+  sess = g_hash_table_lookup(ctx->sessions, key);
 
   if (sess == NULL) {
+    g_free(key);
     return;
   }
 
-  g_message("Stopping session id: %s", info->session_id);
+  g_message("Stopping session: %s", key);
+  stop_recording(ctx, key);
+  g_free(key);
+}
 
-  webrtc_session_stop(sess);
-  g_hash_table_remove(ctx->sessions, info->session_id);
+/* server is "[USER[:PASS]@]HOST", the credentials default to WEBRTC_USER and
+ * WEBRTC_PASS */
+static void
+connect_server(struct app_ctx *ctx, const gchar *server)
+{
+  WebrtcClient *c;
+  const gchar *host = server;
+  const gchar *at;
+  gchar *user = g_strdup(g_getenv("WEBRTC_USER"));
+  gchar *pass = g_strdup(g_getenv("WEBRTC_PASS"));
+
+  at = server != NULL ? strrchr(server, '@') : NULL;
+  if (at != NULL) {
+    gchar *colon;
+
+    host = at + 1;
+    g_free(user);
+    g_free(pass);
+    user = g_strndup(server, at - server);
+    colon = strchr(user, ':');
+    pass = colon != NULL ? g_strdup(colon + 1) : NULL;
+    if (colon != NULL) {
+      *colon = '\0';
+    }
+  }
+
+  g_message("Recording from %s", host);
+
+  c = webrtc_client_new(host, user, pass);
+  g_free(user);
+  g_free(pass);
+
+  g_signal_connect(c, "new-peer", G_CALLBACK(new_peer), NULL);
+  g_signal_connect(c, "new-stream", G_CALLBACK(on_new_stream), ctx);
+  g_signal_connect(c, "remove-stream", G_CALLBACK(on_remove_stream), ctx);
+
+  g_ptr_array_add(ctx->clients, c);
+  webrtc_client_connect_async(c);
 }
 
 static gboolean
@@ -100,6 +709,97 @@ handle_term_signals(struct app_ctx *ctx)
   return FALSE;
 }
 
+static void
+apply_disk_limits(struct app_ctx *ctx)
+{
+  const struct webrtc_settings_admission *limits;
+
+  limits = webrtc_settings_admission(ctx->settings);
+  webrtc_disk_writer_set_limits(ctx->disk,
+                                (guint64) limits->min_free << 20,
+                                (guint64) limits->max_write * 1000);
+}
+
+/* The trace ring keeps debug lines, whatever the levels are */
+static gboolean
+apply_log_settings(struct app_ctx *ctx, GError **error)
+{
+  webrtc_log_set_trace(webrtc_settings_get_trace(ctx->settings),
+                       WEBRTC_LOG_LEVEL_DEBUG);
+
+  return webrtc_log_set_levels(webrtc_settings_get_log(ctx->settings), error);
+}
+
+static gboolean
+handle_reload_signal(struct app_ctx *ctx)
+{
+  struct webrtc_filter *filter;
+  GPtrArray *changed;
+  GError *lerr = NULL;
+
+  changed = g_ptr_array_new();
+  if (webrtc_settings_get_config(ctx->settings) != NULL &&
+      !webrtc_settings_reload(ctx->settings, changed, &lerr)) {
+    g_warning("Reloading the settings failed, keeping them: %s",
+              lerr ? lerr->message : "No error message");
+    g_clear_error(&lerr);
+    g_ptr_array_unref(changed);
+    return G_SOURCE_CONTINUE;
+  }
+
+  /* The filter file may have changed even if its path did not */
+  filter = load_filter(ctx->settings, &lerr);
+  if (filter == NULL) {
+    g_warning("Reloading the filter failed, keeping it: %s",
+              lerr ? lerr->message : "No error message");
+    g_clear_error(&lerr);
+  } else {
+    webrtc_filter_free(ctx->filter);
+    ctx->filter = filter;
+  }
+
+  apply_disk_limits(ctx);
+
+  if (!apply_log_settings(ctx, &lerr)) {
+    g_warning("Reloading the log levels failed, keeping them: %s",
+              lerr->message);
+    g_clear_error(&lerr);
+  }
+
+  g_message("Reloaded the settings, %u changed", changed->len);
+
+  for (guint i = 0; i < changed->len; i++) {
+    const gchar *name = changed->pdata[i];
+
+    switch (webrtc_settings_scope(name)) {
+    case WEBRTC_SETTINGS_SCOPE_NOW:
+      g_message("Setting %s applied", name);
+      break;
+    case WEBRTC_SETTINGS_SCOPE_NEW_SESSION:
+      g_message("Setting %s applies to new sessions, %u running sessions "
+                "keep the old value until they restart",
+                name,
+                g_hash_table_size(ctx->sessions));
+      break;
+    case WEBRTC_SETTINGS_SCOPE_PROCESS:
+      g_warning("Setting %s needs a restart of the writer", name);
+      break;
+    }
+  }
+
+  g_ptr_array_unref(changed);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+flush_catalog(struct app_ctx *ctx)
+{
+  webrtc_catalog_flush(ctx->catalog);
+
+  return G_SOURCE_CONTINUE;
+}
+
 static void
 stop_sessions(G_GNUC_UNUSED gpointer key,
               gpointer value,
@@ -116,40 +816,186 @@ main(int argc, char **argv)
   struct app_ctx ctx = { 0 };
   gst_init(&argc, &argv);
   gint code;
+  const struct webrtc_bandwidth_metrics *metrics;
+  const struct webrtc_admission_metrics *admission;
+  struct webrtc_reaper_metrics reaper;
+  struct webrtc_threads_metrics threads;
+  const gchar *const *servers;
+  GError *lerr = NULL;
 
   ctx.settings = webrtc_settings_new();
 
+  /* Recordings favour completeness over latency unless told otherwise */
+  g_object_set(ctx.settings,
+               "latency_profile",
+               WEBRTC_SETTINGS_LATENCY_PROFILE_ARCHIVAL,
+               NULL);
+
   code = webrtc_settings_parse_opts(ctx.settings, argc, argv);
   if (code >= 0) {
     goto out;
   }
 
+  if (!apply_log_settings(&ctx, &lerr)) {
+    g_print("Invalid log levels: %s\n", lerr->message);
+    g_clear_error(&lerr);
+    code = 1;
+    goto out;
+  }
+
+  ctx.filter = load_filter(ctx.settings, &lerr);
+  if (ctx.filter == NULL) {
+    g_print("Failed to load the filter: %s\n", lerr->message);
+    g_clear_error(&lerr);
+    code = 1;
+    goto out;
+  }
+
+  ctx.disk = webrtc_disk_writer_new(DISK_THREADS, DISK_BLOCK_SIZE, &lerr);
+  if (ctx.disk == NULL) {
+    g_print("Failed to start the disk writer: %s\n", lerr->message);
+    g_clear_error(&lerr);
+    code = 1;
+    goto out;
+  }
+  g_signal_connect(ctx.disk,
+                   "state-changed",
+                   G_CALLBACK(on_disk_state_changed),
+                   &ctx);
+  apply_disk_limits(&ctx);
+
+  if (webrtc_settings_get_catalog(ctx.settings) != NULL) {
+    ctx.catalog =
+            webrtc_catalog_open(webrtc_settings_get_catalog(ctx.settings),
+                                ctx.disk,
+                                &lerr);
+    if (ctx.catalog == NULL) {
+      g_print("Failed to open the catalog: %s\n", lerr->message);
+      g_clear_error(&lerr);
+      code = 1;
+      goto out;
+    }
+    g_timeout_add_seconds(CATALOG_FLUSH_INTERVAL,
+                          G_SOURCE_FUNC(flush_catalog),
+                          &ctx);
+  }
+
+  webrtc_cpu_start(WEBRTC_CPU_SAMPLE_INTERVAL, WEBRTC_CPU_LOG_INTERVAL);
+  if (webrtc_settings_get_telemetry(ctx.settings)) {
+    webrtc_tracer_enable();
+  }
+
   ctx.sessions = g_hash_table_new_full(g_str_hash,
                                        g_str_equal,
                                        g_free,
                                        g_object_unref);
 
-  ctx.c = webrtc_client_new(g_getenv("WEBRTC_HOST"),
-                            g_getenv("WEBRTC_USER"),
-                            g_getenv("WEBRTC_PASS"));
-
-  g_signal_connect(ctx.c, "new-peer", G_CALLBACK(new_peer), NULL);
-  g_signal_connect(ctx.c, "new-stream", G_CALLBACK(on_new_stream), &ctx);
-  g_signal_connect(ctx.c, "remove-stream", G_CALLBACK(on_remove_stream), &ctx);
+  ctx.pending = g_hash_table_new_full(g_str_hash,
+                                      g_str_equal,
+                                      g_free,
+                                      (GDestroyNotify) pending_free);
+
+  ctx.admission = webrtc_admission_new(ctx.settings);
+  g_signal_connect(ctx.admission,
+                   "admitted",
+                   G_CALLBACK(on_admission_admitted),
+                   &ctx);
+  g_signal_connect(ctx.admission,
+                   "rejected",
+                   G_CALLBACK(on_admission_rejected),
+                   &ctx);
+
+  ctx.bandwidth = webrtc_bandwidth_new(ctx.settings);
+  g_signal_connect(ctx.bandwidth,
+                   "admitted",
+                   G_CALLBACK(on_bandwidth_admitted),
+                   &ctx);
+
+  ctx.recordings = g_hash_table_new_full(g_str_hash,
+                                         g_str_equal,
+                                         g_free,
+                                         (GDestroyNotify) recording_free);
+
+  /* Admission, bandwidth and the session table are shared by all servers */
+  ctx.clients = g_ptr_array_new_with_free_func(g_object_unref);
+  servers = webrtc_settings_get_servers(ctx.settings);
+  if (servers == NULL) {
+    connect_server(&ctx, g_getenv("WEBRTC_HOST"));
+  }
+  for (guint i = 0; servers != NULL && servers[i] != NULL; i++) {
+    connect_server(&ctx, servers[i]);
+  }
 
-  webrtc_client_connect_async(ctx.c);
   ctx.loop = g_main_loop_new(NULL, FALSE);
 
   g_unix_signal_add(SIGTERM, G_SOURCE_FUNC(handle_term_signals), &ctx);
   g_unix_signal_add(SIGINT, G_SOURCE_FUNC(handle_term_signals), &ctx);
+  g_unix_signal_add(SIGHUP, G_SOURCE_FUNC(handle_reload_signal), &ctx);
 
   g_main_loop_run(ctx.loop);
 
+  g_hash_table_foreach(ctx.recordings, end_catalog_recording, &ctx);
   g_hash_table_foreach(ctx.sessions, stop_sessions, NULL);
+  webrtc_reaper_wait();
+
+  metrics = webrtc_bandwidth_get_metrics(ctx.bandwidth);
+  g_message("Bandwidth: %" G_GUINT64_FORMAT " admitted, %" G_GUINT64_FORMAT
+            " degraded, %" G_GUINT64_FORMAT " queued of which %"
+            G_GUINT64_FORMAT " started and %" G_GUINT64_FORMAT " cancelled",
+            metrics->admitted_total,
+            metrics->degraded_total,
+            metrics->queued_total,
+            metrics->dequeued_total,
+            metrics->cancelled_total);
+
+  admission = webrtc_admission_get_metrics(ctx.admission);
+  g_message("Admission: %" G_GUINT64_FORMAT " admitted, %" G_GUINT64_FORMAT
+            " queued of which %" G_GUINT64_FORMAT " started, %"
+            G_GUINT64_FORMAT " rejected, %" G_GUINT64_FORMAT
+            " cancelled, %" G_GUINT64_FORMAT " start timeouts",
+            admission->admitted_total,
+            admission->queued_total,
+            admission->dequeued_total,
+            admission->rejected_total,
+            admission->cancelled_total,
+            admission->start_timeouts_total);
+
+  webrtc_reaper_get_metrics(&reaper);
+  g_message("Teardown: %" G_GUINT64_FORMAT " pipelines, %" G_GUINT64_FORMAT
+            " drained, %" G_GUINT64_FORMAT " without EOS, %" G_GUINT64_FORMAT
+            " not playing, %" G_GUINT64_FORMAT " ms average, %"
+            G_GUINT64_FORMAT " ms slowest",
+            reaper.total,
+            reaper.drained,
+            reaper.drain_timeouts,
+            reaper.not_playing,
+            reaper.total > 0 ? reaper.teardown_time / reaper.total / 1000 : 0,
+            reaper.max_teardown / 1000);
+
+  webrtc_threads_get_metrics(&threads);
+  g_message("Threads: %u, %u streaming tasks, %u decoders with %u threads, %"
+            G_GUINT64_FORMAT " voluntary and %" G_GUINT64_FORMAT
+            " involuntary context switches",
+            threads.threads,
+            threads.tasks,
+            threads.decoders,
+            threads.decoder_threads,
+            threads.voluntary_switches,
+            threads.involuntary_switches);
 
 out:
-  g_clear_object(&ctx.c);
+  g_clear_object(&ctx.admission);
+  g_clear_object(&ctx.bandwidth);
+  g_clear_pointer(&ctx.pending, g_hash_table_unref);
+  g_clear_pointer(&ctx.recordings, g_hash_table_unref);
   g_clear_pointer(&ctx.sessions, g_hash_table_unref);
+  g_clear_pointer(&ctx.clients, g_ptr_array_unref);
+  g_clear_pointer(&ctx.filter, webrtc_filter_free);
+  /* The sinks are gone, queues their last keyframes */
+  g_clear_pointer(&ctx.catalog, webrtc_catalog_close);
+  /* Stopped sessions and the catalog closed their files, waits for the last
+   * writes */
+  g_clear_object(&ctx.disk);
 
   return code;
 }
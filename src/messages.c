@@ -2,6 +2,7 @@
 #include <json-glib/json-glib.h>
 
 #include "messages.h"
+#include "webrtc_log.h"
 
 #define EVENT_TOPIC            "tns1:WebRTC/tnsaxis:Signaling/CloudEvent"
 #define TYPE_PEER_CONNECTED    "com.axis.webrtc.peer.connected"
@@ -48,25 +49,33 @@ parse_ice_candidate_msg(JsonObject *data)
   params = json_object_get_object_member(data, "params");
 
   if (params == NULL) {
-    g_warning("Parsing ice candidate: No params");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Parsing ice candidate: No params");
     return NULL;
   }
 
   if (!json_object_has_member(data, "sessionId")) {
-    g_warning("Parsing ice candidate: No session id");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Parsing ice candidate: No session id");
     return NULL;
   }
   if (!json_object_has_member(params, "candidate")) {
-    g_warning("Parsing ice candidate: No candidate");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Parsing ice candidate: No candidate");
     return NULL;
   }
 
   if (!json_object_has_member(params, "sdpMLineIndex")) {
-    g_warning("Parsing ice candidate: No sdp line index");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Parsing ice candidate: No sdp line index");
     return NULL;
   }
 
-  g_message("Parse ice candidate");
+  WEBRTC_LOG_DEBUG(WEBRTC_LOG_SIGNALING, NULL, "Parse ice candidate");
 
   res = g_malloc0(sizeof(*res));
   res->type = MSG_TYPE_ICE_CANDIDATE;
@@ -113,19 +122,23 @@ parse_sdp_msg(JsonObject *data)
   g_assert(data);
 
   if (!json_object_has_member(data, "params")) {
-    g_warning("Parse sdp offer: No params");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Parse sdp offer: No params");
     return NULL;
   }
 
   params = json_object_get_object_member(data, "params");
 
   if (!json_object_has_member(data, "sessionId")) {
-    g_warning("Parse sdp offer: No session id");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Parse sdp offer: No session id");
     return NULL;
   }
 
   if (!json_object_has_member(params, "sdp")) {
-    g_warning("Parse sdp offer: sdp");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING, NULL, "Parse sdp offer: sdp");
     return NULL;
   }
 
@@ -279,12 +292,17 @@ parse_stream_started(const gchar *msg, GError **err)
 
   root = json_parser_get_root(parser);
   if (root == NULL) {
-    g_warning("Failed to get a root node from string %s", msg);
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Failed to get a root node from string %s",
+                       msg);
     goto out;
   }
 
   if (!JSON_NODE_HOLDS_OBJECT(root)) {
-    g_warning("Bad JSON message received");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Bad JSON message received");
     goto out;
   }
 
@@ -340,12 +358,17 @@ parse_stream_stopped(const gchar *msg, GError **err)
 
   root = json_parser_get_root(parser);
   if (root == NULL) {
-    g_warning("Failed to get a root node from string %s", msg);
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Failed to get a root node from string %s",
+                       msg);
     goto out;
   }
 
   if (!JSON_NODE_HOLDS_OBJECT(root)) {
-    g_warning("Bad JSON message received");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Bad JSON message received");
     goto out;
   }
 
@@ -400,12 +423,17 @@ parse_peer_connected(const gchar *msg, GError **err)
 
   root = json_parser_get_root(parser);
   if (root == NULL) {
-    g_warning("Failed to get a root node from string %s", msg);
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Failed to get a root node from string %s",
+                       msg);
     goto out;
   }
 
   if (!JSON_NODE_HOLDS_OBJECT(root)) {
-    g_warning("Bad JSON message received");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Bad JSON message received");
     goto out;
   }
 
@@ -441,12 +469,17 @@ parse_peer_disconnected(const gchar *msg, GError **err)
 
   root = json_parser_get_root(parser);
   if (root == NULL) {
-    g_warning("Failed to get a root node from string %s", msg);
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Failed to get a root node from string %s",
+                       msg);
     goto out;
   }
 
   if (!JSON_NODE_HOLDS_OBJECT(root)) {
-    g_warning("Bad JSON message received");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Bad JSON message received");
     goto out;
   }
 
@@ -510,27 +543,29 @@ parse_auth_msg(JsonObject *obj, G_GNUC_UNUSED GError **err)
   GTimeZone *tz;
 
   g_assert(obj);
-  g_message("Parsing AUTH");
 
   token = json_object_get_string_member(obj, "token");
   expires = json_object_get_string_member(obj, "expiresAt");
   if (token == NULL || expires == NULL) {
     /* TODO: Fix error */
-    g_message("Missing variable");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Auth response without token or expiry");
     return NULL;
   }
 
   tz = g_time_zone_new_local();
   res = g_malloc0(sizeof(*res));
 
-  g_message("Setting members");
   res->type = MSG_TYPE_AUTH;
   res->data.auth.token = g_strdup(token);
   res->data.auth.expires = g_date_time_new_from_iso8601(expires, tz);
 
   if (res->data.auth.expires == NULL) {
     GDateTime *tmp;
-    g_warning("Expires could not be parsed");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Expires could not be parsed");
     tmp = g_date_time_new_now(tz);
     res->data.auth.expires = g_date_time_add_minutes(tmp, 5);
     g_date_time_unref(tmp);
@@ -538,8 +573,6 @@ parse_auth_msg(JsonObject *obj, G_GNUC_UNUSED GError **err)
 
   g_time_zone_unref(tz);
 
-  g_message("Returning from AUTH");
-
   return res;
 }
 
@@ -617,8 +650,14 @@ message_parse(GBytes *src, GError **err)
   const gchar *type;
   message_t *res = NULL;
 
-  msg = g_strndup(g_bytes_get_data(src, NULL), g_bytes_get_size(src));
-  g_message("Got message on websocket: %s", msg);
+  /* Whole frames are only copied when they are logged */
+  if (webrtc_log_enabled(WEBRTC_LOG_SIGNALING, WEBRTC_LOG_LEVEL_TRACE)) {
+    msg = g_strndup(g_bytes_get_data(src, NULL), g_bytes_get_size(src));
+    WEBRTC_LOG_TRACE(WEBRTC_LOG_SIGNALING,
+                     NULL,
+                     "Got message on websocket: %s",
+                     msg);
+  }
 
   parser = json_parser_new();
 
@@ -631,12 +670,18 @@ message_parse(GBytes *src, GError **err)
 
   root = json_parser_get_root(parser);
   if (root == NULL) {
-    g_warning("Failed to get a root node from string %s", msg);
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Failed to get a root node from a %" G_GSIZE_FORMAT
+                       " byte message",
+                       g_bytes_get_size(src));
     goto out;
   }
 
   if (!JSON_NODE_HOLDS_OBJECT(root)) {
-    g_warning("Bad JSON message received");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Bad JSON message received");
     goto out;
   }
 
@@ -782,6 +827,12 @@ message_create_init_session(const gchar *target,
     /* No audio*/
   }
 
+  /* H.264 is what devices send unless asked for something else */
+  if (webrtc_settings_video_codec(settings) ==
+      WEBRTC_SETTINGS_VIDEO_CODEC_H265) {
+    json_object_set_string_member(video, "codec", "h265");
+  }
+
   json_object_set_boolean_member(video,
                                  "adaptive",
                                  webrtc_settings_video_adaptive(settings));
@@ -930,6 +981,56 @@ message_create_ice_candidate(const gchar *target,
   return msg;
 }
 
+gchar *
+message_create_update_session(const gchar *target,
+                              const gchar *session_id,
+                              gint64 max_bitrate,
+                              const gchar *token)
+{
+  JsonObject *root;
+  JsonObject *data;
+  JsonObject *params;
+  JsonObject *video;
+  gchar *context;
+  gchar *correlation;
+  gchar *msg;
+
+  g_return_val_if_fail(target != NULL, NULL);
+  g_return_val_if_fail(session_id != NULL, NULL);
+  g_return_val_if_fail(token != NULL, NULL);
+
+  /* Same videoReceive parameters as initSession, for a running session */
+  context = g_uuid_string_random();
+  correlation = g_uuid_string_random();
+  root = json_object_new();
+  data = json_object_new();
+  params = json_object_new();
+  video = json_object_new();
+
+  json_object_set_int_member(video, "max-bitrate", max_bitrate);
+  json_object_set_object_member(params, "videoReceive", video);
+
+  json_object_set_string_member(data, "apiVersion", "1.0");
+  json_object_set_string_member(data, "type", "request");
+  json_object_set_string_member(data, "method", "updateSession");
+  json_object_set_string_member(data, "sessionId", session_id);
+  json_object_set_object_member(data, "params", params);
+  json_object_set_string_member(data, "context", context);
+
+  json_object_set_string_member(root, "type", "signaling");
+  json_object_set_string_member(root, "targetId", target);
+  json_object_set_string_member(root, "correlationId", correlation);
+  json_object_set_object_member(root, "data", data);
+  json_object_set_string_member(root, "accessToken", token);
+
+  msg = get_string_from_json_object(root);
+
+  g_free(context);
+  g_free(correlation);
+
+  return msg;
+}
+
 gchar *
 message_create_reply(message_t *msg, const gchar *token)
 {
@@ -951,13 +1052,17 @@ message_create_reply(message_t *msg, const gchar *token)
   case MSG_TYPE_PEER_DISCONNECTED:
     return NULL;
   default:
-    g_message("composing reply message");
+    WEBRTC_LOG_DEBUG(WEBRTC_LOG_SIGNALING,
+                     msg->session_id,
+                     "Composing reply message");
   }
 
   root = json_object_new();
   data = json_object_new();
   if (root == NULL || data == NULL) {
-    g_warning("Could not allocate JSON structs!");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Could not allocate JSON structs!");
     return NULL;
   }
 
@@ -989,7 +1094,10 @@ message_create_reply(message_t *msg, const gchar *token)
     break;
 
   default:
-    g_warning("Unhandled type : %u", msg->type);
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       msg->session_id,
+                       "Unhandled type : %u",
+                       msg->type);
   }
 
   json_object_set_object_member(root, "data", data);
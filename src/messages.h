@@ -103,6 +103,11 @@ gchar *message_create_ice_candidate(const gchar *target,
                                     guint line_index,
                                     const gchar *token);
 
+gchar *message_create_update_session(const gchar *target,
+                                     const gchar *session_id,
+                                     gint64 max_bitrate,
+                                     const gchar *token);
+
 gchar *message_create_reply(message_t *msg, const gchar *token);
 
 void message_free(message_t *msg);
\ No newline at end of file
@@ -0,0 +1,640 @@
+#include <glib.h>
+#include <glib-object.h>
+#include <string.h>
+
+#include "webrtc_admission.h"
+
+#define SAMPLE_INTERVAL  1   /* s */
+#define STARTING_TIMEOUT 30  /* s, a start that takes longer does not count */
+#define MAX_QUEUED       64
+
+struct entry {
+  gchar *id;
+  guint priority;
+  WebrtcSession *sess; /* NULL until the session is added */
+  gulong streaming_handler;
+  gboolean starting;
+  gint64 since; /* monotonic time it was admitted */
+};
+
+struct _WebrtcAdmission {
+  GObject parent;
+
+  WebrtcSettings *settings;
+  GPtrArray *active; /* struct entry, admitted */
+  GQueue *queue;     /* struct entry, highest priority first */
+  guint timer;
+
+  gint64 sampled_at; /* 0 if there is no previous sample */
+  guint64 cpu_idle;
+  guint64 cpu_total;
+  guint64 write_bytes;
+
+  struct webrtc_admission_metrics metrics;
+};
+
+G_DEFINE_TYPE(WebrtcAdmission, webrtc_admission, G_TYPE_OBJECT)
+
+typedef enum { PROP_SETTINGS = 1, N_PROPERTIES } WebrtcAdmissionProperty;
+
+static GParamSpec *obj_properties[N_PROPERTIES] = {
+  NULL,
+};
+
+enum admission_signals {
+  SIG_ADMITTED = 0,
+  SIG_REJECTED,
+  SIG_LAST,
+};
+static guint admission_signal_defs[SIG_LAST] = { 0 };
+
+static void
+entry_free(struct entry *e)
+{
+  if (e->sess != NULL) {
+    g_clear_signal_handler(&e->streaming_handler, e->sess);
+    g_clear_object(&e->sess);
+  }
+  g_free(e->id);
+  g_free(e);
+}
+
+/* Idle and total jiffies of all cores from the first line of /proc/stat */
+static gboolean
+read_cpu(guint64 *idle, guint64 *total)
+{
+  gchar *content = NULL;
+  gchar **fields;
+  guint n = 0;
+
+  if (!g_file_get_contents("/proc/stat", &content, NULL, NULL)) {
+    return FALSE;
+  }
+
+  content[strcspn(content, "\n")] = '\0';
+  *idle = 0;
+  *total = 0;
+
+  if (!g_str_has_prefix(content, "cpu ")) {
+    g_free(content);
+    return FALSE;
+  }
+
+  fields = g_strsplit(content, " ", -1);
+  for (guint i = 1; fields[i] != NULL; i++) {
+    guint64 val;
+
+    if (*fields[i] == '\0') {
+      continue;
+    }
+
+    val = g_ascii_strtoull(fields[i], NULL, 10);
+    /* idle and iowait */
+    if (n == 3 || n == 4) {
+      *idle += val;
+    }
+    *total += val;
+    n++;
+  }
+
+  g_strfreev(fields);
+  g_free(content);
+
+  return n > 4;
+}
+
+static gboolean
+read_write_bytes(guint64 *bytes)
+{
+  gchar *content = NULL;
+  const gchar *line;
+
+  if (!g_file_get_contents("/proc/self/io", &content, NULL, NULL)) {
+    return FALSE;
+  }
+
+  line = strstr(content, "write_bytes:");
+  if (line != NULL) {
+    *bytes = g_ascii_strtoull(line + strlen("write_bytes:"), NULL, 10);
+  }
+  g_free(content);
+
+  return line != NULL;
+}
+
+static void
+sample(WebrtcAdmission *self)
+{
+  gint64 now = g_get_monotonic_time();
+  guint64 idle = 0;
+  guint64 total = 0;
+  guint64 bytes = 0;
+  gboolean have_cpu;
+  gboolean have_disk;
+
+  have_cpu = read_cpu(&idle, &total);
+  have_disk = read_write_bytes(&bytes);
+
+  if (self->sampled_at > 0 && now > self->sampled_at) {
+    if (have_cpu && total > self->cpu_total) {
+      guint64 busy = (total - self->cpu_total) - (idle - self->cpu_idle);
+
+      self->metrics.cpu = (gint) (busy * 100 / (total - self->cpu_total));
+    }
+
+    if (have_disk && bytes >= self->write_bytes) {
+      self->metrics.disk = (gint) ((bytes - self->write_bytes) *
+                                   G_USEC_PER_SEC / (now - self->sampled_at) /
+                                   1000000);
+    }
+  }
+
+  self->sampled_at = now;
+  self->cpu_idle = idle;
+  self->cpu_total = total;
+  self->write_bytes = bytes;
+}
+
+static const gchar *
+decision_name(enum webrtc_admission_decision decision)
+{
+  switch (decision) {
+  case WEBRTC_ADMISSION_ADMIT:
+    return "admitted";
+  case WEBRTC_ADMISSION_QUEUE:
+    return "queued";
+  case WEBRTC_ADMISSION_REJECT:
+    return "rejected";
+  default:
+    return "unknown";
+  }
+}
+
+static void
+update_metrics(WebrtcAdmission *self)
+{
+  self->metrics.active = self->active->len;
+  self->metrics.starting = 0;
+  for (guint i = 0; i < self->active->len; i++) {
+    struct entry *e = self->active->pdata[i];
+
+    if (e->starting) {
+      self->metrics.starting++;
+    }
+  }
+  self->metrics.queued = g_queue_get_length(self->queue);
+}
+
+/* NULL if one more session may start, otherwise the limit it would break */
+static const gchar *
+limit_reached(WebrtcAdmission *self)
+{
+  const struct webrtc_settings_admission *limits;
+
+  limits = webrtc_settings_admission(self->settings);
+  update_metrics(self);
+
+  if (limits->max_sessions > 0 &&
+      self->metrics.active >= (guint) limits->max_sessions) {
+    return "sessions";
+  }
+
+  if (limits->max_starting > 0 &&
+      self->metrics.starting >= (guint) limits->max_starting) {
+    return "starting";
+  }
+
+  if (limits->max_cpu > 0 && self->metrics.cpu >= limits->max_cpu) {
+    return "cpu";
+  }
+
+  if (limits->max_disk > 0 && self->metrics.disk >= limits->max_disk) {
+    return "disk";
+  }
+
+  return NULL;
+}
+
+static struct entry *
+find_active(WebrtcAdmission *self, const gchar *id, WebrtcSession *sess)
+{
+  for (guint i = 0; i < self->active->len; i++) {
+    struct entry *e = self->active->pdata[i];
+
+    if ((sess != NULL && e->sess == sess) ||
+        (id != NULL && g_strcmp0(e->id, id) == 0)) {
+      return e;
+    }
+  }
+
+  return NULL;
+}
+
+static void
+admit(WebrtcAdmission *self, struct entry *e)
+{
+  e->starting = TRUE;
+  e->since = g_get_monotonic_time();
+  g_ptr_array_add(self->active, e);
+}
+
+static void
+enqueue(WebrtcAdmission *self, struct entry *e)
+{
+  /* Behind everything with the same priority */
+  for (GList *l = self->queue->head; l != NULL; l = l->next) {
+    struct entry *queued = l->data;
+
+    if (queued->priority < e->priority) {
+      g_queue_insert_before(self->queue, l, e);
+      return;
+    }
+  }
+
+  g_queue_push_tail(self->queue, e);
+}
+
+static void
+process_queue(WebrtcAdmission *self)
+{
+  while (!g_queue_is_empty(self->queue) && limit_reached(self) == NULL) {
+    struct entry *e = g_queue_pop_head(self->queue);
+    gchar *id;
+
+    admit(self, e);
+    self->metrics.dequeued_total++;
+    update_metrics(self);
+
+    g_message("Admission: %s dequeued, %u active, %u starting, %u queued",
+              e->id,
+              self->metrics.active,
+              self->metrics.starting,
+              self->metrics.queued);
+
+    /* The handler may start the session and add it right away */
+    id = g_strdup(e->id);
+    g_signal_emit(self, admission_signal_defs[SIG_ADMITTED], 0, id);
+    g_free(id);
+  }
+}
+
+static void
+expire_starting(WebrtcAdmission *self)
+{
+  gint64 now = g_get_monotonic_time();
+
+  for (guint i = 0; i < self->active->len; i++) {
+    struct entry *e = self->active->pdata[i];
+
+    if (e->starting && now - e->since > STARTING_TIMEOUT * G_USEC_PER_SEC) {
+      g_warning("Admission: %s did not start within %d s",
+                e->id,
+                STARTING_TIMEOUT);
+      e->starting = FALSE;
+      self->metrics.start_timeouts_total++;
+    }
+  }
+}
+
+static gboolean
+sample_timeout(WebrtcAdmission *self)
+{
+  sample(self);
+  expire_starting(self);
+  process_queue(self);
+  update_metrics(self);
+
+  if (self->active->len == 0 && g_queue_is_empty(self->queue)) {
+    self->timer = 0;
+    self->sampled_at = 0;
+    return G_SOURCE_REMOVE;
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+ensure_timer(WebrtcAdmission *self)
+{
+  if (self->timer == 0) {
+    sample(self);
+    self->timer = g_timeout_add_seconds(SAMPLE_INTERVAL,
+                                        G_SOURCE_FUNC(sample_timeout),
+                                        self);
+  }
+}
+
+static void
+on_streaming(WebrtcSession *sess, WebrtcAdmission *self)
+{
+  struct entry *e = find_active(self, NULL, sess);
+
+  if (e == NULL || !e->starting) {
+    return;
+  }
+
+  e->starting = FALSE;
+  g_message("Admission: %s started in %" G_GINT64_FORMAT " ms",
+            e->id,
+            (g_get_monotonic_time() - e->since) / 1000);
+
+  process_queue(self);
+  update_metrics(self);
+}
+
+static void
+webrtc_admission_dispose(GObject *obj)
+{
+  WebrtcAdmission *self = WEBRTC_ADMISSION(obj);
+
+  g_assert(self);
+
+  g_clear_handle_id(&self->timer, g_source_remove);
+  g_ptr_array_set_size(self->active, 0);
+  g_queue_clear_full(self->queue, (GDestroyNotify) entry_free);
+  g_clear_object(&self->settings);
+
+  /* Always chain up to the parent dispose function to complete object
+   * destruction. */
+  G_OBJECT_CLASS(webrtc_admission_parent_class)->dispose(obj);
+}
+
+static void
+webrtc_admission_finalize(GObject *obj)
+{
+  WebrtcAdmission *self = WEBRTC_ADMISSION(obj);
+
+  g_assert(self);
+
+  g_ptr_array_free(self->active, TRUE);
+  g_queue_free(self->queue);
+
+  /* Always chain up to the parent finalize function to complete object
+   * destruction. */
+  G_OBJECT_CLASS(webrtc_admission_parent_class)->finalize(obj);
+}
+
+static void
+get_property(GObject *object,
+             guint property_id,
+             GValue *value,
+             GParamSpec *pspec)
+{
+  WebrtcAdmission *self = WEBRTC_ADMISSION(object);
+
+  switch ((WebrtcAdmissionProperty) property_id) {
+  case PROP_SETTINGS:
+    g_value_set_object(value, self->settings);
+    break;
+
+  default:
+    /* We don't have any other property... */
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+    break;
+  }
+}
+
+static void
+set_property(GObject *object,
+             guint property_id,
+             const GValue *value,
+             GParamSpec *pspec)
+{
+  WebrtcAdmission *self = WEBRTC_ADMISSION(object);
+
+  switch ((WebrtcAdmissionProperty) property_id) {
+  case PROP_SETTINGS:
+    g_clear_object(&self->settings);
+    self->settings = g_value_dup_object(value);
+    break;
+
+  default:
+    /* We don't have any other property... */
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+    break;
+  }
+}
+
+static void
+webrtc_admission_class_init(WebrtcAdmissionClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+
+  object_class->dispose = webrtc_admission_dispose;
+  object_class->finalize = webrtc_admission_finalize;
+  object_class->set_property = set_property;
+  object_class->get_property = get_property;
+
+  GType id_types[] = { G_TYPE_STRING };
+  admission_signal_defs[SIG_ADMITTED] =
+          g_signal_newv("admitted",
+                        G_TYPE_FROM_CLASS(object_class),
+                        G_SIGNAL_RUN_LAST | G_SIGNAL_NO_RECURSE |
+                                G_SIGNAL_NO_HOOKS,
+                        NULL /* closure */,
+                        NULL /* accumulator */,
+                        NULL /* accumulator data */,
+                        NULL /* C marshaller */,
+                        G_TYPE_NONE /* return_type */,
+                        G_N_ELEMENTS(id_types) /* n_params */,
+                        id_types /* param_types, or set to NULL */
+          );
+
+  admission_signal_defs[SIG_REJECTED] =
+          g_signal_newv("rejected",
+                        G_TYPE_FROM_CLASS(object_class),
+                        G_SIGNAL_RUN_LAST | G_SIGNAL_NO_RECURSE |
+                                G_SIGNAL_NO_HOOKS,
+                        NULL /* closure */,
+                        NULL /* accumulator */,
+                        NULL /* accumulator data */,
+                        NULL /* C marshaller */,
+                        G_TYPE_NONE /* return_type */,
+                        G_N_ELEMENTS(id_types) /* n_params */,
+                        id_types /* param_types, or set to NULL */
+          );
+
+  obj_properties[PROP_SETTINGS] =
+          g_param_spec_object("settings",
+                              "Settings",
+                              "Placeholder description.",
+                              WEBRTC_TYPE_SETTINGS, /* default */
+                              G_PARAM_READWRITE);
+
+  g_object_class_install_properties(object_class, N_PROPERTIES, obj_properties);
+}
+
+static void
+webrtc_admission_init(WebrtcAdmission *self)
+{
+  self->active = g_ptr_array_new_full(0, (GDestroyNotify) entry_free);
+  self->queue = g_queue_new();
+  self->metrics.cpu = -1;
+  self->metrics.disk = -1;
+}
+
+WebrtcAdmission *
+webrtc_admission_new(WebrtcSettings *settings)
+{
+  g_return_val_if_fail(settings != NULL, NULL);
+
+  return g_object_new(WEBRTC_TYPE_ADMISSION, "settings", settings, NULL);
+}
+
+enum webrtc_admission_decision
+webrtc_admission_request(WebrtcAdmission *self,
+                         const gchar *id,
+                         const gchar *subject,
+                         const gchar *trigger_type)
+{
+  enum webrtc_admission_decision decision;
+  struct entry *e;
+  struct entry *head;
+  const gchar *limit;
+  guint priority;
+
+  g_return_val_if_fail(self != NULL, WEBRTC_ADMISSION_ADMIT);
+  g_return_val_if_fail(id != NULL, WEBRTC_ADMISSION_ADMIT);
+
+  ensure_timer(self);
+
+  priority = webrtc_settings_priority(self->settings, subject, trigger_type);
+  e = g_malloc0(sizeof(*e));
+  e->id = g_strdup(id);
+  e->priority = priority;
+
+  head = g_queue_peek_head(self->queue);
+  limit = limit_reached(self);
+  if (limit == NULL && (head == NULL || head->priority < e->priority)) {
+    decision = WEBRTC_ADMISSION_ADMIT;
+    self->metrics.admitted_total++;
+    admit(self, e);
+  } else if (g_queue_get_length(self->queue) < MAX_QUEUED) {
+    decision = WEBRTC_ADMISSION_QUEUE;
+    self->metrics.queued_total++;
+    enqueue(self, e);
+  } else {
+    struct entry *tail = g_queue_peek_tail(self->queue);
+
+    self->metrics.rejected_total++;
+    if (tail->priority < e->priority) {
+      /* Make room, the new request is more important */
+      decision = WEBRTC_ADMISSION_QUEUE;
+      self->metrics.queued_total++;
+      g_queue_pop_tail(self->queue);
+      enqueue(self, e);
+
+      g_message("Admission: %s pushed out of the queue", tail->id);
+      g_signal_emit(self, admission_signal_defs[SIG_REJECTED], 0, tail->id);
+      entry_free(tail);
+    } else {
+      decision = WEBRTC_ADMISSION_REJECT;
+      entry_free(e);
+    }
+  }
+
+  update_metrics(self);
+  g_message("Admission: %s %s, priority %u, %s, %u active, %u starting, "
+            "%u queued, cpu %d%%, disk %d MB/s",
+            id,
+            decision_name(decision),
+            priority,
+            limit != NULL ? limit : "within limits",
+            self->metrics.active,
+            self->metrics.starting,
+            self->metrics.queued,
+            self->metrics.cpu,
+            self->metrics.disk);
+
+  return decision;
+}
+
+void
+webrtc_admission_cancel(WebrtcAdmission *self, const gchar *id)
+{
+  struct entry *e;
+
+  g_return_if_fail(self != NULL);
+  g_return_if_fail(id != NULL);
+
+  for (GList *l = self->queue->head; l != NULL; l = l->next) {
+    e = l->data;
+
+    if (g_strcmp0(e->id, id) == 0) {
+      g_queue_delete_link(self->queue, l);
+      entry_free(e);
+      self->metrics.cancelled_total++;
+      update_metrics(self);
+      return;
+    }
+  }
+
+  e = find_active(self, id, NULL);
+  if (e != NULL && e->sess == NULL) {
+    g_ptr_array_remove(self->active, e);
+    self->metrics.cancelled_total++;
+    process_queue(self);
+    update_metrics(self);
+  }
+}
+
+void
+webrtc_admission_add_session(WebrtcAdmission *self,
+                             const gchar *id,
+                             WebrtcSession *sess)
+{
+  struct entry *e;
+
+  g_return_if_fail(self != NULL);
+  g_return_if_fail(id != NULL);
+  g_return_if_fail(sess != NULL);
+
+  e = find_active(self, id, NULL);
+  if (e == NULL) {
+    /* Started without asking, still counts against the limits */
+    e = g_malloc0(sizeof(*e));
+    e->id = g_strdup(id);
+    e->priority = 1;
+    admit(self, e);
+  } else if (e->sess != NULL && e->sess != sess) {
+    /* Rebuilt under the same id, it negotiates again */
+    e->starting = TRUE;
+    e->since = g_get_monotonic_time();
+  }
+
+  g_clear_signal_handler(&e->streaming_handler, e->sess);
+  g_set_object(&e->sess, sess);
+  e->streaming_handler = g_signal_connect(sess,
+                                          "streaming",
+                                          G_CALLBACK(on_streaming),
+                                          self);
+
+  ensure_timer(self);
+  update_metrics(self);
+}
+
+void
+webrtc_admission_remove_session(WebrtcAdmission *self, WebrtcSession *sess)
+{
+  struct entry *e;
+
+  g_return_if_fail(self != NULL);
+
+  e = find_active(self, NULL, sess);
+  if (e == NULL) {
+    return;
+  }
+
+  g_ptr_array_remove(self->active, e);
+
+  process_queue(self);
+  update_metrics(self);
+}
+
+const struct webrtc_admission_metrics *
+webrtc_admission_get_metrics(WebrtcAdmission *self)
+{
+  g_return_val_if_fail(self != NULL, NULL);
+
+  return &self->metrics;
+}
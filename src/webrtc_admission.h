@@ -0,0 +1,92 @@
+#pragma once
+
+#include <glib.h>
+#include <glib-object.h>
+
+#include "webrtc_session.h"
+#include "webrtc_settings.h"
+
+G_BEGIN_DECLS
+
+enum webrtc_admission_decision {
+  WEBRTC_ADMISSION_ADMIT = 0, /* start now */
+  WEBRTC_ADMISSION_QUEUE,     /* until the limits allow, see "admitted" */
+  WEBRTC_ADMISSION_REJECT,    /* the queue is full of higher priorities */
+};
+
+struct webrtc_admission_metrics {
+  guint active;   /* admitted, including the starting ones */
+  guint starting; /* admitted, no media received yet */
+  guint queued;
+  gint cpu;  /* percent of all cores, -1 until measured */
+  gint disk; /* MB/s written by the process, -1 until measured */
+  guint64 admitted_total;
+  guint64 queued_total;
+  guint64 rejected_total; /* on request or pushed out of the queue */
+  guint64 dequeued_total;
+  guint64 cancelled_total;
+  guint64 start_timeouts_total; /* no media within the start timeout */
+};
+
+/** Signal: admitted
+ * on_admitted(
+ *  WebrtcAdmission *self,
+ *  const gchar *id,
+ *  gpointer user_data
+ *);
+ *
+ * A queued request is within the limits now and may start
+ */
+
+/** Signal: rejected
+ * on_rejected(
+ *  WebrtcAdmission *self,
+ *  const gchar *id,
+ *  gpointer user_data
+ *);
+ *
+ * A queued request was pushed out by one with a higher priority
+ */
+
+/*
+ * Type declaration.
+ */
+
+#define WEBRTC_TYPE_ADMISSION webrtc_admission_get_type()
+G_DECLARE_FINAL_TYPE(WebrtcAdmission,
+                     webrtc_admission,
+                     WEBRTC,
+                     ADMISSION,
+                     GObject)
+
+/*
+ * Method definitions.
+ */
+
+/** Limits how many sessions run and start at the same time, and holds new
+ * ones back while the CPU or the disk is busy, from the admission limits of
+ * the settings. Waiting requests are served by priority. */
+WebrtcAdmission *webrtc_admission_new(WebrtcSettings *settings);
+
+enum webrtc_admission_decision
+webrtc_admission_request(WebrtcAdmission *self,
+                         const gchar *id,
+                         const gchar *subject,
+                         const gchar *trigger_type);
+
+/** Drops a request, queued or admitted but never added */
+void webrtc_admission_cancel(WebrtcAdmission *self, const gchar *id);
+
+/** The session counts as starting until it emits "streaming". id as in the
+ * request, the session id is not unique between servers */
+void webrtc_admission_add_session(WebrtcAdmission *self,
+                                  const gchar *id,
+                                  WebrtcSession *sess);
+
+void webrtc_admission_remove_session(WebrtcAdmission *self,
+                                     WebrtcSession *sess);
+
+const struct webrtc_admission_metrics *
+webrtc_admission_get_metrics(WebrtcAdmission *self);
+
+G_END_DECLS
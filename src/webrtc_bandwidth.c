@@ -0,0 +1,576 @@
+#include <glib.h>
+#include <glib-object.h>
+
+#include "webrtc_bandwidth.h"
+
+#define REBALANCE_INTERVAL 5    /* s */
+#define MIN_SESSION_KBPS   200  /* below this video is not worth watching */
+#define FULL_SESSION_KBPS  4000 /* when there is no per-session max bitrate */
+
+struct entry {
+  gchar *id;
+  WebrtcSession *sess; /* NULL until the session is added */
+  guint weight;
+  gint64 kbps; /* allocated, or reserved until the session is measured */
+};
+
+struct _WebrtcBandwidth {
+  GObject parent;
+
+  WebrtcSettings *settings;
+  GPtrArray *active; /* struct entry, admitted */
+  GQueue *queue;     /* struct entry, highest weight first */
+  guint timer;
+  struct webrtc_bandwidth_metrics metrics;
+};
+
+G_DEFINE_TYPE(WebrtcBandwidth, webrtc_bandwidth, G_TYPE_OBJECT)
+
+typedef enum { PROP_SETTINGS = 1, N_PROPERTIES } WebrtcBandwidthProperty;
+
+static GParamSpec *obj_properties[N_PROPERTIES] = {
+  NULL,
+};
+
+enum bandwidth_signals {
+  SIG_ADMITTED = 0,
+  SIG_LAST,
+};
+static guint bandwidth_signal_defs[SIG_LAST] = { 0 };
+
+struct demand {
+  struct entry *e;
+  gint64 kbps;
+};
+
+static void
+entry_free(struct entry *e)
+{
+  g_free(e->id);
+  g_clear_object(&e->sess);
+  g_free(e);
+}
+
+static const gchar *
+decision_name(enum webrtc_bandwidth_decision decision)
+{
+  switch (decision) {
+  case WEBRTC_BANDWIDTH_ADMIT:
+    return "admitted";
+  case WEBRTC_BANDWIDTH_DEGRADE:
+    return "degraded";
+  case WEBRTC_BANDWIDTH_QUEUE:
+    return "queued";
+  default:
+    return "unknown";
+  }
+}
+
+static gint64
+full_rate(WebrtcBandwidth *self)
+{
+  gint64 cap = webrtc_settings_video_max_bitrate(self->settings);
+  gint64 budget = webrtc_settings_bandwidth(self->settings);
+  gint64 full = cap > 0 ? cap : FULL_SESSION_KBPS;
+
+  return budget > 0 ? MIN(full, budget) : full;
+}
+
+static gint64
+entry_usage(struct entry *e)
+{
+  if (e->sess != NULL) {
+    struct webrtc_session_stats stats;
+
+    webrtc_session_get_stats(e->sess, &stats);
+    if (stats.bitrate > 0) {
+      return MAX((gint64) stats.bitrate, MIN_SESSION_KBPS);
+    }
+  }
+
+  return MAX(e->kbps, 0);
+}
+
+static gint64
+free_kbps(WebrtcBandwidth *self)
+{
+  gint64 budget = webrtc_settings_bandwidth(self->settings);
+
+  for (guint i = 0; i < self->active->len; i++) {
+    budget -= entry_usage(self->active->pdata[i]);
+  }
+
+  return budget;
+}
+
+static void
+update_metrics(WebrtcBandwidth *self)
+{
+  struct webrtc_bandwidth_metrics *m = &self->metrics;
+
+  m->budget = webrtc_settings_bandwidth(self->settings);
+  m->allocated = 0;
+  m->used = 0;
+  for (guint i = 0; i < self->active->len; i++) {
+    struct entry *e = self->active->pdata[i];
+
+    m->allocated += MAX(e->kbps, 0);
+    m->used += entry_usage(e);
+  }
+  m->active = self->active->len;
+  m->queued = g_queue_get_length(self->queue);
+}
+
+static struct entry *
+find_active(WebrtcBandwidth *self, const gchar *id, WebrtcSession *sess)
+{
+  for (guint i = 0; i < self->active->len; i++) {
+    struct entry *e = self->active->pdata[i];
+
+    if ((sess != NULL && e->sess == sess) ||
+        (id != NULL && g_strcmp0(e->id, id) == 0)) {
+      return e;
+    }
+  }
+
+  return NULL;
+}
+
+static void
+enqueue(WebrtcBandwidth *self, struct entry *e)
+{
+  /* Behind everything with the same weight */
+  for (GList *l = self->queue->head; l != NULL; l = l->next) {
+    struct entry *queued = l->data;
+
+    if (queued->weight < e->weight) {
+      g_queue_insert_before(self->queue, l, e);
+      return;
+    }
+  }
+
+  g_queue_push_tail(self->queue, e);
+}
+
+static gint
+cmp_demand(gconstpointer a, gconstpointer b)
+{
+  const struct demand *da = a;
+  const struct demand *db = b;
+  gint64 wa = da->kbps * db->e->weight;
+  gint64 wb = db->kbps * da->e->weight;
+
+  return (wa > wb) - (wa < wb);
+}
+
+/* Weighted max-min fairness: sessions that use less than their weighted
+ * share get what they use plus some room to grow, the rest of the budget
+ * is split between the others by weight. Admitted sessions that are not
+ * added yet keep their reservation. */
+static void
+rebalance(WebrtcBandwidth *self)
+{
+  GArray *demands;
+  gint64 budget;
+  gint64 cap;
+  gint64 full;
+  guint weights = 0;
+  gboolean unlimited;
+
+  budget = webrtc_settings_bandwidth(self->settings);
+  unlimited = budget <= 0;
+  cap = webrtc_settings_video_max_bitrate(self->settings);
+  full = full_rate(self);
+
+  demands = g_array_sized_new(FALSE,
+                              FALSE,
+                              sizeof(struct demand),
+                              self->active->len);
+
+  for (guint i = 0; i < self->active->len; i++) {
+    struct entry *e = self->active->pdata[i];
+    struct webrtc_session_stats stats;
+    struct demand d;
+
+    if (e->sess == NULL) {
+      budget -= MAX(e->kbps, 0);
+      continue;
+    }
+
+    if (unlimited) {
+      e->kbps = cap > 0 ? cap : -1;
+      webrtc_session_set_max_bitrate(e->sess, e->kbps);
+      continue;
+    }
+
+    d.e = e;
+    d.kbps = e->kbps > 0 ? e->kbps : full;
+
+    webrtc_session_get_stats(e->sess, &stats);
+    if (stats.bitrate > 0) {
+      gint64 rate = (gint64) stats.bitrate;
+
+      d.kbps = MIN(full, MAX(rate + rate / 4, MIN_SESSION_KBPS));
+    }
+
+    weights += e->weight;
+    g_array_append_val(demands, d);
+  }
+
+  g_array_sort(demands, cmp_demand);
+
+  for (guint i = 0; i < demands->len; i++) {
+    struct demand *d = &g_array_index(demands, struct demand, i);
+    gint64 share;
+
+    share = MAX(budget, 0) * d->e->weight / weights;
+    d->e->kbps = MAX(MIN(d->kbps, share), MIN_SESSION_KBPS);
+    budget -= d->e->kbps;
+    weights -= d->e->weight;
+
+    webrtc_session_set_max_bitrate(d->e->sess, d->e->kbps);
+  }
+
+  g_array_unref(demands);
+  update_metrics(self);
+}
+
+static void
+process_queue(WebrtcBandwidth *self)
+{
+  gboolean unlimited = webrtc_settings_bandwidth(self->settings) <= 0;
+
+  while (!g_queue_is_empty(self->queue)) {
+    struct entry *e;
+    gint64 available = free_kbps(self);
+    gchar *id;
+
+    if (!unlimited && available < MIN_SESSION_KBPS) {
+      break;
+    }
+
+    e = g_queue_pop_head(self->queue);
+    e->kbps = unlimited ? full_rate(self) : MIN(full_rate(self), available);
+    g_ptr_array_add(self->active, e);
+    self->metrics.dequeued_total++;
+    update_metrics(self);
+
+    g_message("Bandwidth: %s dequeued at %" G_GINT64_FORMAT " kbps",
+              e->id,
+              e->kbps);
+
+    /* The handler may start the session and add it right away */
+    id = g_strdup(e->id);
+    g_signal_emit(self, bandwidth_signal_defs[SIG_ADMITTED], 0, id, e->kbps);
+    g_free(id);
+  }
+}
+
+static gboolean
+rebalance_timeout(WebrtcBandwidth *self)
+{
+  rebalance(self);
+  process_queue(self);
+
+  if (self->active->len == 0 && g_queue_is_empty(self->queue)) {
+    self->timer = 0;
+    return G_SOURCE_REMOVE;
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+ensure_timer(WebrtcBandwidth *self)
+{
+  if (self->timer == 0) {
+    self->timer = g_timeout_add_seconds(REBALANCE_INTERVAL,
+                                        G_SOURCE_FUNC(rebalance_timeout),
+                                        self);
+  }
+}
+
+static void
+webrtc_bandwidth_dispose(GObject *obj)
+{
+  WebrtcBandwidth *self = WEBRTC_BANDWIDTH(obj);
+
+  g_assert(self);
+
+  g_clear_handle_id(&self->timer, g_source_remove);
+  g_ptr_array_set_size(self->active, 0);
+  g_queue_clear_full(self->queue, (GDestroyNotify) entry_free);
+  g_clear_object(&self->settings);
+
+  /* Always chain up to the parent dispose function to complete object
+   * destruction. */
+  G_OBJECT_CLASS(webrtc_bandwidth_parent_class)->dispose(obj);
+}
+
+static void
+webrtc_bandwidth_finalize(GObject *obj)
+{
+  WebrtcBandwidth *self = WEBRTC_BANDWIDTH(obj);
+
+  g_assert(self);
+
+  g_ptr_array_free(self->active, TRUE);
+  g_queue_free(self->queue);
+
+  /* Always chain up to the parent finalize function to complete object
+   * destruction. */
+  G_OBJECT_CLASS(webrtc_bandwidth_parent_class)->finalize(obj);
+}
+
+static void
+get_property(GObject *object,
+             guint property_id,
+             GValue *value,
+             GParamSpec *pspec)
+{
+  WebrtcBandwidth *self = WEBRTC_BANDWIDTH(object);
+
+  switch ((WebrtcBandwidthProperty) property_id) {
+  case PROP_SETTINGS:
+    g_value_set_object(value, self->settings);
+    break;
+
+  default:
+    /* We don't have any other property... */
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+    break;
+  }
+}
+
+static void
+set_property(GObject *object,
+             guint property_id,
+             const GValue *value,
+             GParamSpec *pspec)
+{
+  WebrtcBandwidth *self = WEBRTC_BANDWIDTH(object);
+
+  switch ((WebrtcBandwidthProperty) property_id) {
+  case PROP_SETTINGS:
+    g_clear_object(&self->settings);
+    self->settings = g_value_dup_object(value);
+    break;
+
+  default:
+    /* We don't have any other property... */
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+    break;
+  }
+}
+
+static void
+webrtc_bandwidth_class_init(WebrtcBandwidthClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+
+  object_class->dispose = webrtc_bandwidth_dispose;
+  object_class->finalize = webrtc_bandwidth_finalize;
+  object_class->set_property = set_property;
+  object_class->get_property = get_property;
+
+  GType admitted_types[] = { G_TYPE_STRING, G_TYPE_INT64 };
+  bandwidth_signal_defs[SIG_ADMITTED] =
+          g_signal_newv("admitted",
+                        G_TYPE_FROM_CLASS(object_class),
+                        G_SIGNAL_RUN_LAST | G_SIGNAL_NO_RECURSE |
+                                G_SIGNAL_NO_HOOKS,
+                        NULL /* closure */,
+                        NULL /* accumulator */,
+                        NULL /* accumulator data */,
+                        NULL /* C marshaller */,
+                        G_TYPE_NONE /* return_type */,
+                        G_N_ELEMENTS(admitted_types) /* n_params */,
+                        admitted_types /* param_types, or set to NULL */
+          );
+
+  obj_properties[PROP_SETTINGS] =
+          g_param_spec_object("settings",
+                              "Settings",
+                              "Placeholder description.",
+                              WEBRTC_TYPE_SETTINGS, /* default */
+                              G_PARAM_READWRITE);
+
+  g_object_class_install_properties(object_class, N_PROPERTIES, obj_properties);
+}
+
+static void
+webrtc_bandwidth_init(WebrtcBandwidth *self)
+{
+  self->active = g_ptr_array_new_full(0, (GDestroyNotify) entry_free);
+  self->queue = g_queue_new();
+}
+
+WebrtcBandwidth *
+webrtc_bandwidth_new(WebrtcSettings *settings)
+{
+  g_return_val_if_fail(settings != NULL, NULL);
+
+  return g_object_new(WEBRTC_TYPE_BANDWIDTH, "settings", settings, NULL);
+}
+
+enum webrtc_bandwidth_decision
+webrtc_bandwidth_request(WebrtcBandwidth *self,
+                         const gchar *id,
+                         const gchar *subject,
+                         const gchar *trigger_type,
+                         gboolean may_queue,
+                         gint64 *kbps)
+{
+  enum webrtc_bandwidth_decision decision;
+  struct entry *e;
+  gint64 budget;
+  gint64 available = -1;
+
+  g_return_val_if_fail(self != NULL, WEBRTC_BANDWIDTH_ADMIT);
+  g_return_val_if_fail(id != NULL, WEBRTC_BANDWIDTH_ADMIT);
+  g_return_val_if_fail(kbps != NULL, WEBRTC_BANDWIDTH_ADMIT);
+
+  e = g_malloc0(sizeof(*e));
+  e->id = g_strdup(id);
+  e->weight = webrtc_settings_priority(self->settings, subject, trigger_type);
+
+  budget = webrtc_settings_bandwidth(self->settings);
+  if (budget <= 0) {
+    gint64 cap = webrtc_settings_video_max_bitrate(self->settings);
+
+    decision = WEBRTC_BANDWIDTH_ADMIT;
+    *kbps = cap > 0 ? cap : -1;
+  } else {
+    struct entry *head = g_queue_peek_head(self->queue);
+    gboolean behind = may_queue && head != NULL && head->weight >= e->weight;
+
+    available = free_kbps(self);
+    if (!behind && available >= full_rate(self)) {
+      decision = WEBRTC_BANDWIDTH_ADMIT;
+      *kbps = full_rate(self);
+    } else if (!behind && available >= MIN_SESSION_KBPS) {
+      decision = WEBRTC_BANDWIDTH_DEGRADE;
+      *kbps = available;
+    } else if (may_queue) {
+      decision = WEBRTC_BANDWIDTH_QUEUE;
+      *kbps = 0;
+    } else {
+      decision = WEBRTC_BANDWIDTH_DEGRADE;
+      *kbps = MIN_SESSION_KBPS;
+      g_warning("Bandwidth: %s exceeds the budget of %" G_GINT64_FORMAT
+                " kbps",
+                id,
+                budget);
+    }
+  }
+
+  g_message("Bandwidth: %s %s, weight %u, %" G_GINT64_FORMAT
+            " kbps, %" G_GINT64_FORMAT " kbps free",
+            id,
+            decision_name(decision),
+            e->weight,
+            *kbps,
+            available);
+
+  e->kbps = *kbps;
+  switch (decision) {
+  case WEBRTC_BANDWIDTH_ADMIT:
+    self->metrics.admitted_total++;
+    g_ptr_array_add(self->active, e);
+    break;
+  case WEBRTC_BANDWIDTH_DEGRADE:
+    self->metrics.degraded_total++;
+    g_ptr_array_add(self->active, e);
+    break;
+  case WEBRTC_BANDWIDTH_QUEUE:
+    self->metrics.queued_total++;
+    enqueue(self, e);
+    break;
+  }
+
+  update_metrics(self);
+  ensure_timer(self);
+
+  return decision;
+}
+
+void
+webrtc_bandwidth_cancel(WebrtcBandwidth *self, const gchar *id)
+{
+  struct entry *e;
+
+  g_return_if_fail(self != NULL);
+  g_return_if_fail(id != NULL);
+
+  for (GList *l = self->queue->head; l != NULL; l = l->next) {
+    e = l->data;
+
+    if (g_strcmp0(e->id, id) == 0) {
+      g_queue_delete_link(self->queue, l);
+      entry_free(e);
+      self->metrics.cancelled_total++;
+      update_metrics(self);
+      return;
+    }
+  }
+
+  e = find_active(self, id, NULL);
+  if (e != NULL && e->sess == NULL) {
+    g_ptr_array_remove(self->active, e);
+    self->metrics.cancelled_total++;
+    process_queue(self);
+    update_metrics(self);
+  }
+}
+
+void
+webrtc_bandwidth_add_session(WebrtcBandwidth *self,
+                             const gchar *id,
+                             WebrtcSession *sess)
+{
+  struct entry *e;
+
+  g_return_if_fail(self != NULL);
+  g_return_if_fail(id != NULL);
+  g_return_if_fail(sess != NULL);
+
+  e = find_active(self, id, NULL);
+  if (e == NULL) {
+    /* Started without asking, take part in the sharing from now on */
+    e = g_malloc0(sizeof(*e));
+    e->id = g_strdup(id);
+    e->weight = 1;
+    g_ptr_array_add(self->active, e);
+  }
+
+  g_set_object(&e->sess, sess);
+
+  ensure_timer(self);
+  rebalance(self);
+}
+
+void
+webrtc_bandwidth_remove_session(WebrtcBandwidth *self, WebrtcSession *sess)
+{
+  struct entry *e;
+
+  g_return_if_fail(self != NULL);
+
+  e = find_active(self, NULL, sess);
+  if (e == NULL) {
+    return;
+  }
+
+  g_ptr_array_remove(self->active, e);
+
+  process_queue(self);
+  rebalance(self);
+}
+
+const struct webrtc_bandwidth_metrics *
+webrtc_bandwidth_get_metrics(WebrtcBandwidth *self)
+{
+  g_return_val_if_fail(self != NULL, NULL);
+
+  return &self->metrics;
+}
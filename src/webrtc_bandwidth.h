@@ -0,0 +1,87 @@
+#pragma once
+
+#include <glib.h>
+#include <glib-object.h>
+
+#include "webrtc_session.h"
+#include "webrtc_settings.h"
+
+G_BEGIN_DECLS
+
+enum webrtc_bandwidth_decision {
+  WEBRTC_BANDWIDTH_ADMIT = 0, /* at the full per-session rate */
+  WEBRTC_BANDWIDTH_DEGRADE,   /* at what is left of the budget */
+  WEBRTC_BANDWIDTH_QUEUE,     /* until the budget allows, see "admitted" */
+};
+
+struct webrtc_bandwidth_metrics {
+  gint64 budget;    /* kbps, -1 if unlimited */
+  gint64 allocated; /* kbps, handed out to active sessions */
+  gint64 used;      /* kbps, measured or reserved by active sessions */
+  guint active;
+  guint queued;
+  guint64 admitted_total;
+  guint64 degraded_total;
+  guint64 queued_total;
+  guint64 dequeued_total;
+  guint64 cancelled_total;
+};
+
+/** Signal: admitted
+ * on_admitted(
+ *  WebrtcBandwidth *self,
+ *  const gchar *id,
+ *  gint64 kbps,
+ *  gpointer user_data
+ *);
+ *
+ * A queued request fits the budget now and may start at kbps
+ */
+
+/*
+ * Type declaration.
+ */
+
+#define WEBRTC_TYPE_BANDWIDTH webrtc_bandwidth_get_type()
+G_DECLARE_FINAL_TYPE(WebrtcBandwidth,
+                     webrtc_bandwidth,
+                     WEBRTC,
+                     BANDWIDTH,
+                     GObject)
+
+/*
+ * Method definitions.
+ */
+
+/** Shares the receive budget of the settings between the sessions, weighted
+ * by the priority rules and capped by the per-session max bitrate.
+ * Rebalances when sessions come and go and periodically from the measured
+ * receive rates. */
+WebrtcBandwidth *webrtc_bandwidth_new(WebrtcSettings *settings);
+
+/** Admission of a new session before it is started. On ADMIT and DEGRADE
+ * kbps is the max bitrate to ask for in initSession, -1 for no limit.
+ * Requests that may not queue are degraded to the minimum instead. */
+enum webrtc_bandwidth_decision
+webrtc_bandwidth_request(WebrtcBandwidth *self,
+                         const gchar *id,
+                         const gchar *subject,
+                         const gchar *trigger_type,
+                         gboolean may_queue,
+                         gint64 *kbps);
+
+/** Drops a request, queued or admitted but never added */
+void webrtc_bandwidth_cancel(WebrtcBandwidth *self, const gchar *id);
+
+/** id as in the request, the session id is not unique between servers */
+void webrtc_bandwidth_add_session(WebrtcBandwidth *self,
+                                  const gchar *id,
+                                  WebrtcSession *sess);
+
+void webrtc_bandwidth_remove_session(WebrtcBandwidth *self,
+                                     WebrtcSession *sess);
+
+const struct webrtc_bandwidth_metrics *
+webrtc_bandwidth_get_metrics(WebrtcBandwidth *self);
+
+G_END_DECLS
@@ -0,0 +1,839 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "webrtc_catalog.h"
+#include "webrtc_disk.h"
+
+#define KEYFRAME_SIZE 24 /* bytes of one keyframe in an index file */
+#define RECORDING_FIELDS 12
+
+/* Element id that starts a Matroska cluster */
+static const guint8 cluster_id[] = { 0x1f, 0x43, 0xb6, 0x75 };
+
+/* The keyframes of one part, shared with the pad probe of its sink */
+struct part_index {
+  gint ref;
+  struct webrtc_disk_file *file; /* "<part>.idx", NULL if it failed */
+
+  GMutex lock;
+  GArray *pending;   /* struct webrtc_catalog_keyframe, protected by lock */
+  gboolean detached; /* the sink is gone, protected by lock */
+
+  guint64 offset; /* bytes the sink got, streaming thread only */
+};
+
+struct webrtc_catalog {
+  gchar *path;
+  WebrtcDiskWriter *disk;
+  struct webrtc_disk_file *file;
+  guint64 next_id;
+  GPtrArray *recordings; /* oldest first, owns them */
+  GHashTable *ids;       /* &id -> struct webrtc_catalog_recording */
+  GHashTable *subjects;  /* subject -> GPtrArray of recordings, oldest first */
+  GPtrArray *open;       /* recordings without an end */
+  gint64 longest;        /* us, of the ended recordings */
+  GPtrArray *indexes;    /* struct part_index with a sink or pending data */
+};
+
+G_DEFINE_QUARK(webrtc-catalog-error-quark, webrtc_catalog_error)
+
+static void
+part_free(struct webrtc_catalog_part *part)
+{
+  g_free(part->path);
+  g_free(part);
+}
+
+static void
+recording_free(struct webrtc_catalog_recording *rec)
+{
+  g_free(rec->source);
+  g_free(rec->subject);
+  g_free(rec->time);
+  g_free(rec->trigger_type);
+  g_free(rec->bearer_id);
+  g_free(rec->bearer_name);
+  g_free(rec->system_id);
+  g_free(rec->session_id);
+  g_free(rec->recording_id);
+  g_ptr_array_unref(rec->parts);
+  g_free(rec);
+}
+
+static struct webrtc_catalog_recording *
+recording_new(guint64 id, gint64 start)
+{
+  struct webrtc_catalog_recording *rec = g_malloc0(sizeof(*rec));
+
+  rec->id = id;
+  rec->start = start;
+  rec->parts = g_ptr_array_new_with_free_func((GDestroyNotify) part_free);
+
+  return rec;
+}
+
+static struct part_index *
+index_ref(struct part_index *index)
+{
+  g_atomic_int_inc(&index->ref);
+  return index;
+}
+
+static void
+index_unref(struct part_index *index)
+{
+  if (!g_atomic_int_dec_and_test(&index->ref)) {
+    return;
+  }
+
+  webrtc_disk_file_close(index->file);
+  g_array_unref(index->pending);
+  g_mutex_clear(&index->lock);
+  g_free(index);
+}
+
+static gchar *
+index_path(const gchar *path)
+{
+  return g_strconcat(path, ".idx", NULL);
+}
+
+static gboolean
+read_keyframe(gint fd, guint64 i, struct webrtc_catalog_keyframe *keyframe)
+{
+  guint64 record[3];
+
+  if (pread(fd, record, sizeof(record), i * KEYFRAME_SIZE) !=
+      (gssize) sizeof(record)) {
+    return FALSE;
+  }
+
+  keyframe->time = (gint64) GUINT64_FROM_BE(record[0]);
+  keyframe->pts = GUINT64_FROM_BE(record[1]);
+  keyframe->offset = GUINT64_FROM_BE(record[2]);
+
+  return TRUE;
+}
+
+static guint64
+count_keyframes(gint fd)
+{
+  off_t size = lseek(fd, 0, SEEK_END);
+
+  return size > 0 ? (guint64) size / KEYFRAME_SIZE : 0;
+}
+
+/* First recording of list that started at or after start */
+static guint
+lower_bound(GPtrArray *list, gint64 start)
+{
+  guint low = 0;
+  guint high = list->len;
+
+  while (low < high) {
+    guint mid = low + (high - low) / 2;
+    const struct webrtc_catalog_recording *rec = list->pdata[mid];
+
+    if (rec->start < start) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  return low;
+}
+
+/* After the recordings that started at the same time, the clock may have
+ * been set back */
+static void
+insert_sorted(GPtrArray *list, struct webrtc_catalog_recording *rec)
+{
+  guint i = rec->start < G_MAXINT64 ? lower_bound(list, rec->start + 1)
+                                    : list->len;
+
+  g_ptr_array_insert(list, i, rec);
+}
+
+static void
+add_to_index(struct webrtc_catalog *self, struct webrtc_catalog_recording *rec)
+{
+  GPtrArray *list;
+
+  insert_sorted(self->recordings, rec);
+  g_hash_table_insert(self->ids, &rec->id, rec);
+  self->next_id = MAX(self->next_id, rec->id + 1);
+
+  if (rec->subject != NULL) {
+    list = g_hash_table_lookup(self->subjects, rec->subject);
+    if (list == NULL) {
+      list = g_ptr_array_new();
+      g_hash_table_insert(self->subjects, rec->subject, list);
+    }
+    insert_sorted(list, rec);
+  }
+
+  if (rec->end == 0) {
+    g_ptr_array_add(self->open, rec);
+  } else {
+    self->longest = MAX(self->longest, rec->end - rec->start);
+  }
+}
+
+static void
+append_field(GString *line, const gchar *value)
+{
+  gchar *escaped;
+
+  g_string_append_c(line, '\t');
+  if (value == NULL) {
+    return;
+  }
+
+  escaped = g_strescape(value, NULL);
+  g_string_append(line, escaped);
+  g_free(escaped);
+}
+
+/* Empty fields are NULL */
+static gchar *
+parse_field(const gchar *field)
+{
+  return field[0] != '\0' ? g_strcompress(field) : NULL;
+}
+
+/* On an I/O thread of the disk writer, which logs a failed write */
+static void
+append_line(struct webrtc_catalog *self, GString *line)
+{
+  g_string_append_c(line, '\n');
+  webrtc_disk_file_write(self->file, line->str, line->len);
+}
+
+static void
+end_recording(struct webrtc_catalog *self,
+              struct webrtc_catalog_recording *rec,
+              gint64 end)
+{
+  rec->end = MAX(end, rec->start);
+  self->longest = MAX(self->longest, rec->end - rec->start);
+  g_ptr_array_remove_fast(self->open, rec);
+}
+
+static void
+write_end(struct webrtc_catalog *self,
+          struct webrtc_catalog_recording *rec,
+          gint64 end)
+{
+  GString *line = g_string_new(NULL);
+
+  g_string_append_printf(line,
+                         "end\t%" G_GUINT64_FORMAT "\t%" G_GINT64_FORMAT,
+                         rec->id,
+                         end);
+  append_line(self, line);
+  g_string_free(line, TRUE);
+
+  end_recording(self, rec, end);
+}
+
+/* "recording", id, start, the fields of struct stream_started */
+static gboolean
+load_recording(struct webrtc_catalog *self, gchar **fields, guint n)
+{
+  struct webrtc_catalog_recording *rec;
+  guint64 id;
+  gint64 start;
+
+  if (n < RECORDING_FIELDS ||
+      !g_ascii_string_to_unsigned(fields[1], 10, 1, G_MAXUINT64, &id, NULL) ||
+      !g_ascii_string_to_signed(fields[2],
+                                10,
+                                0,
+                                G_MAXINT64,
+                                &start,
+                                NULL) ||
+      g_hash_table_contains(self->ids, &id)) {
+    return FALSE;
+  }
+
+  rec = recording_new(id, start);
+  rec->source = parse_field(fields[3]);
+  rec->subject = parse_field(fields[4]);
+  rec->time = parse_field(fields[5]);
+  rec->trigger_type = parse_field(fields[6]);
+  rec->bearer_id = parse_field(fields[7]);
+  rec->bearer_name = parse_field(fields[8]);
+  rec->system_id = parse_field(fields[9]);
+  rec->session_id = parse_field(fields[10]);
+  rec->recording_id = parse_field(fields[11]);
+  add_to_index(self, rec);
+
+  return TRUE;
+}
+
+/* "part", id, start, path or "end", id, end */
+static gboolean
+load_event(struct webrtc_catalog *self, gchar **fields, guint n)
+{
+  struct webrtc_catalog_recording *rec;
+  struct webrtc_catalog_part *part;
+  guint64 id;
+  gint64 time;
+
+  if ((g_strcmp0(fields[0], "part") != 0 &&
+       g_strcmp0(fields[0], "end") != 0) ||
+      n < 3 ||
+      !g_ascii_string_to_unsigned(fields[1], 10, 1, G_MAXUINT64, &id, NULL) ||
+      !g_ascii_string_to_signed(fields[2], 10, 0, G_MAXINT64, &time, NULL)) {
+    return FALSE;
+  }
+
+  rec = g_hash_table_lookup(self->ids, &id);
+  if (rec == NULL) {
+    return FALSE;
+  }
+
+  if (g_strcmp0(fields[0], "end") == 0) {
+    if (rec->end == 0) {
+      end_recording(self, rec, time);
+    }
+    return TRUE;
+  }
+
+  if (n < 4 || fields[3][0] == '\0') {
+    return FALSE;
+  }
+
+  part = g_malloc0(sizeof(*part));
+  part->path = g_strcompress(fields[3]);
+  part->start = time;
+  g_ptr_array_add(rec->parts, part);
+
+  return TRUE;
+}
+
+/* Recordings of a writer that did not stop cleanly end with their last
+ * flushed keyframe */
+static void
+end_interrupted(struct webrtc_catalog *self)
+{
+  while (self->open->len > 0) {
+    struct webrtc_catalog_recording *rec = self->open->pdata[0];
+    struct webrtc_catalog_keyframe keyframe = { 0 };
+    struct webrtc_catalog_part *part;
+    gint64 end = rec->start;
+    gchar *path;
+    guint64 n;
+    gint fd;
+
+    if (rec->parts->len > 0) {
+      part = g_ptr_array_index(rec->parts, rec->parts->len - 1);
+      end = part->start;
+
+      path = index_path(part->path);
+      fd = g_open(path, O_RDONLY | O_CLOEXEC, 0);
+      g_free(path);
+      if (fd >= 0) {
+        n = count_keyframes(fd);
+        if (n > 0 && read_keyframe(fd, n - 1, &keyframe)) {
+          end = MAX(end, keyframe.time);
+        }
+        close(fd);
+      }
+    }
+
+    write_end(self, rec, end);
+  }
+}
+
+static gboolean
+load(struct webrtc_catalog *self, GError **error)
+{
+  GError *lerr = NULL;
+  gchar *contents;
+  gchar **lines;
+  gsize length;
+  guint skipped = 0;
+
+  if (!g_file_get_contents(self->path, &contents, &length, &lerr)) {
+    if (g_error_matches(lerr, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+      g_error_free(lerr);
+      return TRUE;
+    }
+    g_propagate_error(error, lerr);
+    return FALSE;
+  }
+
+  lines = g_strsplit(contents, "\n", -1);
+  for (guint i = 0; lines[i] != NULL; i++) {
+    gchar **fields;
+    guint n;
+    gboolean ok;
+
+    if (lines[i][0] == '\0') {
+      continue;
+    }
+
+    fields = g_strsplit(lines[i], "\t", -1);
+    n = g_strv_length(fields);
+    if (g_strcmp0(fields[0], "recording") == 0) {
+      ok = load_recording(self, fields, n);
+    } else {
+      ok = load_event(self, fields, n);
+    }
+    if (!ok) {
+      skipped++;
+    }
+    g_strfreev(fields);
+  }
+  g_strfreev(lines);
+
+  if (skipped > 0) {
+    g_warning("Catalog: skipped %u lines of %s", skipped, self->path);
+  }
+
+  /* A line cut short by a crash must not swallow the next one */
+  if (length > 0 && contents[length - 1] != '\n') {
+    webrtc_disk_file_write(self->file, "\n", 1);
+  }
+  g_free(contents);
+
+  return TRUE;
+}
+
+struct webrtc_catalog *
+webrtc_catalog_open(const gchar *path,
+                    WebrtcDiskWriter *disk,
+                    GError **error)
+{
+  struct webrtc_catalog *self;
+  struct webrtc_disk_file *file;
+
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(disk != NULL, NULL);
+
+  file = webrtc_disk_writer_open(disk, path, TRUE, error);
+  if (file == NULL) {
+    return NULL;
+  }
+
+  self = g_malloc0(sizeof(*self));
+  self->path = g_strdup(path);
+  self->disk = g_object_ref(disk);
+  self->file = file;
+  self->next_id = 1;
+  self->recordings =
+          g_ptr_array_new_with_free_func((GDestroyNotify) recording_free);
+  self->ids = g_hash_table_new(g_int64_hash, g_int64_equal);
+  self->subjects = g_hash_table_new_full(g_str_hash,
+                                         g_str_equal,
+                                         NULL,
+                                         (GDestroyNotify) g_ptr_array_unref);
+  self->open = g_ptr_array_new();
+  self->indexes = g_ptr_array_new_with_free_func((GDestroyNotify) index_unref);
+
+  if (!load(self, error)) {
+    webrtc_catalog_close(self);
+    return NULL;
+  }
+  end_interrupted(self);
+
+  return self;
+}
+
+void
+webrtc_catalog_close(struct webrtc_catalog *self)
+{
+  if (self == NULL) {
+    return;
+  }
+
+  webrtc_catalog_flush(self);
+
+  webrtc_disk_file_close(self->file);
+  g_ptr_array_unref(self->indexes);
+  g_ptr_array_unref(self->open);
+  g_hash_table_unref(self->subjects);
+  g_hash_table_unref(self->ids);
+  g_ptr_array_unref(self->recordings);
+  g_object_unref(self->disk);
+  g_free(self->path);
+  g_free(self);
+}
+
+guint64
+webrtc_catalog_add_recording(struct webrtc_catalog *self,
+                             const struct stream_started *info)
+{
+  struct webrtc_catalog_recording *rec;
+  GString *line;
+
+  g_return_val_if_fail(self != NULL, 0);
+  g_return_val_if_fail(info != NULL, 0);
+
+  rec = recording_new(self->next_id, g_get_real_time());
+
+  line = g_string_new(NULL);
+  g_string_append_printf(line,
+                         "recording\t%" G_GUINT64_FORMAT "\t%" G_GINT64_FORMAT,
+                         rec->id,
+                         rec->start);
+  append_field(line, info->source);
+  append_field(line, info->subject);
+  append_field(line, info->time);
+  append_field(line, info->trigger_type);
+  append_field(line, info->bearer_id);
+  append_field(line, info->bearer_name);
+  append_field(line, info->system_id);
+  append_field(line, info->session_id);
+  append_field(line, info->recording_id);
+  append_line(self, line);
+  g_string_free(line, TRUE);
+
+  /* Read back the same way as from the file */
+  rec->source = g_strdup(info->source);
+  rec->subject = g_strdup(info->subject);
+  rec->time = g_strdup(info->time);
+  rec->trigger_type = g_strdup(info->trigger_type);
+  rec->bearer_id = g_strdup(info->bearer_id);
+  rec->bearer_name = g_strdup(info->bearer_name);
+  rec->system_id = g_strdup(info->system_id);
+  rec->session_id = g_strdup(info->session_id);
+  rec->recording_id = g_strdup(info->recording_id);
+  add_to_index(self, rec);
+
+  return rec->id;
+}
+
+static void
+index_buffer(struct part_index *index, GstBuffer *buffer)
+{
+  guint8 id[sizeof(cluster_id)];
+
+  /* The muxer starts a cluster at each video keyframe, players can start
+   * reading at any cluster */
+  if (!GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT) &&
+      !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_HEADER) &&
+      gst_buffer_extract(buffer, 0, id, sizeof(id)) == sizeof(id) &&
+      memcmp(id, cluster_id, sizeof(id)) == 0) {
+    struct webrtc_catalog_keyframe keyframe = {
+      .time = g_get_real_time(),
+      .pts = GST_BUFFER_PTS(buffer),
+      .offset = index->offset,
+    };
+
+    g_mutex_lock(&index->lock);
+    g_array_append_val(index->pending, keyframe);
+    g_mutex_unlock(&index->lock);
+  }
+
+  index->offset += gst_buffer_get_size(buffer);
+}
+
+static gboolean
+index_list_item(GstBuffer **buffer, G_GNUC_UNUSED guint idx, gpointer data)
+{
+  index_buffer(data, *buffer);
+
+  return TRUE;
+}
+
+/* Streaming thread of the sink, in front of the disk writer */
+static GstPadProbeReturn
+on_muxed(G_GNUC_UNUSED GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  struct part_index *index = data;
+
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+    index_buffer(index, GST_PAD_PROBE_INFO_BUFFER(info));
+  } else if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    gst_buffer_list_foreach(GST_PAD_PROBE_INFO_BUFFER_LIST(info),
+                            index_list_item,
+                            index);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+detach_index(gpointer data)
+{
+  struct part_index *index = data;
+
+  g_mutex_lock(&index->lock);
+  index->detached = TRUE;
+  g_mutex_unlock(&index->lock);
+
+  index_unref(index);
+}
+
+void
+webrtc_catalog_add_part(struct webrtc_catalog *self,
+                        guint64 id,
+                        const gchar *path,
+                        GstElement *sink)
+{
+  struct webrtc_catalog_recording *rec;
+  struct webrtc_catalog_part *part;
+  struct part_index *index;
+  GError *lerr = NULL;
+  GString *line;
+  GstPad *pad;
+  gchar *idx;
+
+  g_return_if_fail(self != NULL);
+  g_return_if_fail(path != NULL);
+
+  rec = g_hash_table_lookup(self->ids, &id);
+  if (rec == NULL) {
+    return;
+  }
+
+  part = g_malloc0(sizeof(*part));
+  part->path = g_strdup(path);
+  part->start = g_get_real_time();
+  g_ptr_array_add(rec->parts, part);
+
+  line = g_string_new(NULL);
+  g_string_append_printf(line,
+                         "part\t%" G_GUINT64_FORMAT "\t%" G_GINT64_FORMAT,
+                         id,
+                         part->start);
+  append_field(line, path);
+  append_line(self, line);
+  g_string_free(line, TRUE);
+
+  if (sink == NULL) {
+    return;
+  }
+
+  /* Replaces the index of an earlier file of the same name */
+  idx = index_path(path);
+  index = g_malloc0(sizeof(*index));
+  index->ref = 1;
+  index->file = webrtc_disk_writer_open(self->disk, idx, FALSE, &lerr);
+  index->pending =
+          g_array_new(FALSE, FALSE, sizeof(struct webrtc_catalog_keyframe));
+  g_mutex_init(&index->lock);
+  if (index->file == NULL) {
+    g_warning("Catalog: %s", lerr->message);
+    g_clear_error(&lerr);
+  }
+  g_free(idx);
+
+  pad = gst_element_get_static_pad(sink, "sink");
+  gst_pad_add_probe(pad,
+                    GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+                    on_muxed,
+                    index_ref(index),
+                    detach_index);
+  gst_object_unref(pad);
+
+  g_ptr_array_add(self->indexes, index);
+}
+
+void
+webrtc_catalog_end_recording(struct webrtc_catalog *self, guint64 id)
+{
+  struct webrtc_catalog_recording *rec;
+
+  g_return_if_fail(self != NULL);
+
+  rec = g_hash_table_lookup(self->ids, &id);
+  if (rec == NULL || rec->end != 0) {
+    return;
+  }
+
+  write_end(self, rec, g_get_real_time());
+}
+
+void
+webrtc_catalog_flush(struct webrtc_catalog *self)
+{
+  g_return_if_fail(self != NULL);
+
+  /* Backwards, the indexes of removed sinks are dropped once written */
+  for (guint i = self->indexes->len; i > 0; i--) {
+    struct part_index *index = self->indexes->pdata[i - 1];
+    guint64 *records;
+    gboolean detached;
+    guint n;
+
+    g_mutex_lock(&index->lock);
+    n = index->pending->len;
+    records = n > 0 ? g_new(guint64, n * 3) : NULL;
+    for (guint k = 0; k < n; k++) {
+      const struct webrtc_catalog_keyframe *keyframe =
+              &g_array_index(index->pending, struct webrtc_catalog_keyframe, k);
+
+      records[k * 3] = GUINT64_TO_BE((guint64) keyframe->time);
+      records[k * 3 + 1] = GUINT64_TO_BE(keyframe->pts);
+      records[k * 3 + 2] = GUINT64_TO_BE(keyframe->offset);
+    }
+    g_array_set_size(index->pending, 0);
+    detached = index->detached;
+    g_mutex_unlock(&index->lock);
+
+    if (n > 0 && index->file != NULL) {
+      webrtc_disk_file_write(index->file, records, n * KEYFRAME_SIZE);
+    }
+    g_free(records);
+
+    if (detached) {
+      g_ptr_array_remove_index_fast(self->indexes, i - 1);
+    }
+  }
+}
+
+const struct webrtc_catalog_recording *
+webrtc_catalog_lookup(struct webrtc_catalog *self, guint64 id)
+{
+  g_return_val_if_fail(self != NULL, NULL);
+
+  return g_hash_table_lookup(self->ids, &id);
+}
+
+static gboolean
+matches(const gchar *want, const gchar *value)
+{
+  return want == NULL || g_strcmp0(want, value) == 0;
+}
+
+GPtrArray *
+webrtc_catalog_find(struct webrtc_catalog *self,
+                    const struct webrtc_catalog_query *query)
+{
+  GPtrArray *found;
+  GPtrArray *list;
+  gint64 now = g_get_real_time();
+  guint first = 0;
+  guint last;
+
+  g_return_val_if_fail(self != NULL, NULL);
+  g_return_val_if_fail(query != NULL, NULL);
+
+  found = g_ptr_array_new();
+  list = self->recordings;
+  if (query->subject != NULL) {
+    list = g_hash_table_lookup(self->subjects, query->subject);
+    if (list == NULL) {
+      return found;
+    }
+  }
+
+  /* Nothing that started at to or later overlaps, nor what started more
+   * than the longest recording before from */
+  last = query->to > 0 ? lower_bound(list, query->to) : list->len;
+  if (query->from > 0) {
+    gint64 longest = self->longest;
+
+    for (guint i = 0; i < self->open->len; i++) {
+      const struct webrtc_catalog_recording *rec = self->open->pdata[i];
+
+      longest = MAX(longest, now - rec->start);
+    }
+    first = lower_bound(list, query->from - longest);
+  }
+
+  for (guint i = first; i < last; i++) {
+    struct webrtc_catalog_recording *rec = list->pdata[i];
+    gint64 end = rec->end != 0 ? rec->end : now;
+
+    if (query->from > 0 && end <= query->from) {
+      continue;
+    }
+
+    if (matches(query->trigger_type, rec->trigger_type) &&
+        matches(query->bearer_id, rec->bearer_id) &&
+        matches(query->system_id, rec->system_id) &&
+        matches(query->recording_id, rec->recording_id)) {
+      g_ptr_array_add(found, rec);
+    }
+  }
+
+  return found;
+}
+
+gboolean
+webrtc_catalog_seek(struct webrtc_catalog *self,
+                    guint64 id,
+                    gint64 time,
+                    const gchar **path,
+                    struct webrtc_catalog_keyframe *keyframe,
+                    GError **error)
+{
+  const struct webrtc_catalog_recording *rec;
+  const struct webrtc_catalog_part *part;
+  gchar *idx;
+  guint64 low;
+  guint64 high;
+  guint64 n;
+  gint fd;
+
+  g_return_val_if_fail(self != NULL, FALSE);
+  g_return_val_if_fail(keyframe != NULL, FALSE);
+
+  rec = g_hash_table_lookup(self->ids, &id);
+  if (rec == NULL || rec->parts->len == 0) {
+    g_set_error(error,
+                WEBRTC_CATALOG_ERROR,
+                WEBRTC_CATALOG_ERROR_NOT_FOUND,
+                "No recording %" G_GUINT64_FORMAT " with files",
+                id);
+    return FALSE;
+  }
+
+  part = g_ptr_array_index(rec->parts, 0);
+  for (guint i = 1; i < rec->parts->len; i++) {
+    const struct webrtc_catalog_part *next = g_ptr_array_index(rec->parts, i);
+
+    if (next->start > time) {
+      break;
+    }
+    part = next;
+  }
+
+  if (path != NULL) {
+    *path = part->path;
+  }
+  keyframe->time = part->start;
+  keyframe->pts = 0;
+  keyframe->offset = 0;
+
+  idx = index_path(part->path);
+  fd = g_open(idx, O_RDONLY | O_CLOEXEC, 0);
+  g_free(idx);
+  if (fd < 0) {
+    return TRUE;
+  }
+
+  /* Keyframes are written in time order, the last one at or before time */
+  n = count_keyframes(fd);
+  low = 0;
+  high = n;
+  while (low < high) {
+    guint64 mid = low + (high - low) / 2;
+    struct webrtc_catalog_keyframe candidate;
+
+    if (!read_keyframe(fd, mid, &candidate)) {
+      break;
+    }
+    if (candidate.time <= time) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  if (n > 0) {
+    read_keyframe(fd, low > 0 ? low - 1 : 0, keyframe);
+  }
+  close(fd);
+
+  return TRUE;
+}
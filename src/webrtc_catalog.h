@@ -0,0 +1,110 @@
+#pragma once
+
+#include <glib.h>
+#include <gst/gst.h>
+
+#include "webrtc_client.h"
+#include "webrtc_disk.h"
+
+G_BEGIN_DECLS
+
+#define WEBRTC_CATALOG_ERROR webrtc_catalog_error_quark()
+
+enum webrtc_catalog_error {
+  WEBRTC_CATALOG_ERROR_NOT_FOUND = 0,
+};
+
+/** Index of everything the writer recorded. Recordings and the files of
+ * their parts go to an append-only text file, which is read back into
+ * memory on open. The keyframes of each part go to a binary file next to
+ * it, "<file>.idx", which seeks search in place. Both are written by the
+ * I/O threads of the disk writer, so a hung disk does not stall the
+ * caller. */
+struct webrtc_catalog;
+
+struct webrtc_catalog_part {
+  gchar *path;
+  gint64 start; /* us since the epoch */
+};
+
+struct webrtc_catalog_recording {
+  guint64 id; /* unique in the catalog, from 1 */
+  gint64 start; /* us since the epoch */
+  gint64 end;   /* 0 while recording */
+  /* struct stream_started, NULL if the server did not send it */
+  gchar *source;
+  gchar *subject;
+  gchar *time;
+  gchar *trigger_type;
+  gchar *bearer_id;
+  gchar *bearer_name;
+  gchar *system_id;
+  gchar *session_id;
+  gchar *recording_id;
+  GPtrArray *parts; /* struct webrtc_catalog_part, oldest first */
+};
+
+/** A cluster of the muxer output that starts with a keyframe */
+struct webrtc_catalog_keyframe {
+  gint64 time;    /* us since the epoch, when it was written */
+  guint64 pts;    /* ns, as set by the muxer */
+  guint64 offset; /* bytes into the file */
+};
+
+/** Recordings overlapping [from, to) whose fields equal the set ones */
+struct webrtc_catalog_query {
+  gint64 from; /* us since the epoch, 0 for no bound */
+  gint64 to;
+  const gchar *subject;
+  const gchar *trigger_type;
+  const gchar *bearer_id;
+  const gchar *system_id;
+  const gchar *recording_id;
+};
+
+GQuark webrtc_catalog_error_quark(void);
+
+/** Reads path if it exists, lines it does not understand are skipped */
+struct webrtc_catalog *webrtc_catalog_open(const gchar *path,
+                                           WebrtcDiskWriter *disk,
+                                           GError **error);
+
+/** Queues the pending keyframes, destroying the disk writer waits for the
+ * last writes */
+void webrtc_catalog_close(struct webrtc_catalog *self);
+
+/** Returns the id of the new recording, a failed write is only logged */
+guint64 webrtc_catalog_add_recording(struct webrtc_catalog *self,
+                                     const struct stream_started *info);
+
+/** Indexes the keyframes sink gets from the muxer as long as it exists,
+ * sink may be NULL for a part without an index */
+void webrtc_catalog_add_part(struct webrtc_catalog *self,
+                             guint64 id,
+                             const gchar *path,
+                             GstElement *sink);
+
+void webrtc_catalog_end_recording(struct webrtc_catalog *self, guint64 id);
+
+/** Queues the keyframes indexed since the last flush for their files */
+void webrtc_catalog_flush(struct webrtc_catalog *self);
+
+const struct webrtc_catalog_recording *
+webrtc_catalog_lookup(struct webrtc_catalog *self, guint64 id);
+
+/** The matching recordings, oldest first. The array is the caller's, the
+ * recordings stay the catalog's. */
+GPtrArray *webrtc_catalog_find(struct webrtc_catalog *self,
+                               const struct webrtc_catalog_query *query);
+
+/** The part of recording id that was written at time and its last keyframe
+ * before it, or the first one. The offset is 0 if the part has no keyframes
+ * on disk yet. */
+gboolean webrtc_catalog_seek(struct webrtc_catalog *self,
+                             guint64 id,
+                             gint64 time,
+                             const gchar **path,
+                             struct webrtc_catalog_keyframe *keyframe,
+                             GError **error);
+
+G_END_DECLS
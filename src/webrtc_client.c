@@ -5,6 +5,7 @@
 #include <gio/gio.h>
 
 #include "webrtc_client.h"
+#include "webrtc_log.h"
 #include "webrtc_settings.h"
 #include "messages.h"
 
@@ -103,9 +104,13 @@ on_text_message(SoupWebsocketConnection *ws,
 
   msg = message_parse(message, &lerr);
 
+  /* Frames the client has no use for parse to NULL without an error */
   if (msg == NULL) {
-    g_warning("Error parsing message: %s",
-              lerr ? lerr->message : "No error message");
+    WEBRTC_LOG(WEBRTC_LOG_SIGNALING,
+               lerr != NULL ? WEBRTC_LOG_LEVEL_WARNING : WEBRTC_LOG_LEVEL_DEBUG,
+               NULL,
+               "Error parsing message: %s",
+               lerr ? lerr->message : "Ignored message");
     g_clear_error(&lerr);
     return;
   }
@@ -124,7 +129,9 @@ on_text_message(SoupWebsocketConnection *ws,
                     msg->data.response.error_msg);
     }
 
-    g_message("Response received");
+    WEBRTC_LOG_DEBUG(WEBRTC_LOG_SIGNALING,
+                     msg->session_id,
+                     "Response received");
     break;
   case MSG_TYPE_HELLO: {
     gchar *msg;
@@ -134,7 +141,7 @@ on_text_message(SoupWebsocketConnection *ws,
       g_free(msg);
     }
     g_signal_emit(self, client_signal_defs[SIG_CONNECTED], 0, self->server);
-    g_message("Hello received");
+    WEBRTC_LOG_INFO(WEBRTC_LOG_SIGNALING, NULL, "Hello received");
   }
 
   break;
@@ -214,7 +221,10 @@ on_text_message(SoupWebsocketConnection *ws,
   /* use ws instead of self so that the reply goes back on the channel it came
    * in */
   if (reply != NULL) {
-    g_message("Sending reply %s", reply);
+    WEBRTC_LOG_TRACE(WEBRTC_LOG_SIGNALING,
+                     msg->session_id,
+                     "Sending reply %s",
+                     reply);
     soup_websocket_connection_send_text(ws, reply);
   }
 
@@ -233,7 +243,7 @@ send_hello(WebrtcClient *self)
 
   msg = message_create_hello(self->token);
 
-  g_message("Sending msg %s", msg);
+  WEBRTC_LOG_TRACE(WEBRTC_LOG_SIGNALING, NULL, "Sending msg %s", msg);
   soup_websocket_connection_send_text(self->client, msg);
   g_free(msg);
 }
@@ -246,7 +256,7 @@ send_data_stream_filter(WebrtcClient *self)
   g_assert(self);
 
   msg = message_create_stream_filter();
-  g_message("Sending msg %s", msg);
+  WEBRTC_LOG_TRACE(WEBRTC_LOG_SIGNALING, NULL, "Sending msg %s", msg);
   soup_websocket_connection_send_text(self->data_stream, msg);
   g_free(msg);
 }
@@ -266,7 +276,9 @@ client_connection_cb(GObject *source, GAsyncResult *res, gpointer user_data)
     g_clear_error(&err);
     return;
   }
-  g_message("Connection to client received");
+  WEBRTC_LOG_INFO(WEBRTC_LOG_SIGNALING,
+                  NULL,
+                  "Connection to client received");
 
   g_signal_connect(self->client, "message", G_CALLBACK(on_text_message), self);
   send_hello(self);
@@ -291,7 +303,9 @@ data_stream_connection_cb(GObject *source,
     g_clear_error(&err);
     return;
   }
-  g_message("Connection to data stream received");
+  WEBRTC_LOG_INFO(WEBRTC_LOG_SIGNALING,
+                  NULL,
+                  "Connection to data stream received");
 
   g_signal_connect(self->data_stream,
                    "message",
@@ -359,13 +373,15 @@ authenticate_callback(G_GNUC_UNUSED SoupMessage *msg,
   g_assert(self);
 
   if (retrying) {
-    g_message("Is retrying");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Authentication failed, not retrying");
     // Maybe don't try again if our password failed
     return FALSE;
   }
 
   soup_auth_authenticate(auth, self->user, self->pass);
-  g_message("Is NOT retrying");
+  WEBRTC_LOG_DEBUG(WEBRTC_LOG_SIGNALING, NULL, "Authenticating");
 
   // Returning TRUE means we have or *will* handle it.
   // soup_auth_authenticate() or soup_auth_cancel() can be called later
@@ -398,18 +414,24 @@ parse_target(G_GNUC_UNUSED JsonArray *array,
   id = json_object_get_string_member(obj, "id");
 
   if (id == NULL) {
-    g_warning("No id in target info");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING, NULL, "No id in target info");
     return;
   }
 
   if (!json_object_has_member(obj, "sessionId")) {
-    g_warning("No session id in target %s", id);
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "No session id in target %s",
+                       id);
     return;
   }
 
   if (json_object_has_member(obj, "stopped") ||
       json_object_has_member(obj, "disconnected")) {
-    g_warning("Target %s is either stopped or disconnectedu", id);
+    WEBRTC_LOG_DEBUG(WEBRTC_LOG_SIGNALING,
+                     NULL,
+                     "Target %s is either stopped or disconnected",
+                     id);
     return;
   }
 
@@ -419,7 +441,10 @@ parse_target(G_GNUC_UNUSED JsonArray *array,
   info.subject = json_object_get_string_member(obj, "id");
   info.time = json_object_get_string_member(obj, "started");
 
-  g_message("Emitting target %s", id);
+  WEBRTC_LOG_INFO(WEBRTC_LOG_SIGNALING,
+                  info.session_id,
+                  "Emitting target %s",
+                  id);
 
   g_signal_emit(self, client_signal_defs[SIG_NEW_STREAM], 0, &info);
 }
@@ -437,15 +462,17 @@ on_targets_callback(GObject *source, GAsyncResult *result, gpointer user_data)
 
   g_assert(self);
 
-  g_message("Receiving targets list");
+  WEBRTC_LOG_DEBUG(WEBRTC_LOG_SIGNALING, NULL, "Receiving targets list");
 
   bytes = soup_session_send_and_read_finish(SOUP_SESSION(source),
                                             result,
                                             &lerr);
 
   if (bytes == NULL) {
-    g_warning("Error retrieving targets: %s",
-              lerr ? lerr->message : "No error message");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Error retrieving targets: %s",
+                       lerr ? lerr->message : "No error message");
     g_clear_error(&lerr);
     goto out;
   }
@@ -456,13 +483,11 @@ on_targets_callback(GObject *source, GAsyncResult *result, gpointer user_data)
                                   g_bytes_get_data(bytes, NULL),
                                   g_bytes_get_size(bytes),
                                   &lerr)) {
-    gchar *msg;
-    msg = g_strndup(g_bytes_get_data(bytes, NULL), g_bytes_get_size(bytes));
-    g_warning("Could not parse incoming message %s: %s",
-              msg,
-              lerr != NULL ? lerr->message : "No error message");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Could not parse the targets list: %s",
+                       lerr != NULL ? lerr->message : "No error message");
     g_clear_error(&lerr);
-    g_free(msg);
     goto out;
   }
 
@@ -470,18 +495,16 @@ on_targets_callback(GObject *source, GAsyncResult *result, gpointer user_data)
   obj = json_node_get_object(root);
 
   if (!json_object_has_member(obj, "data")) {
-    gchar *msg;
-    msg = g_strndup(g_bytes_get_data(bytes, NULL), g_bytes_get_size(bytes));
-
-    g_warning("Message does not contain type data: %s", msg);
-    g_free(msg);
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Targets list does not contain type data");
     goto out;
   }
 
   data = json_object_get_object_member(obj, "data");
 
   if (!json_object_has_member(data, "targets")) {
-    g_warning("No target array");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING, NULL, "No target array");
     goto out;
   }
 
@@ -505,7 +528,7 @@ get_online_streams(WebrtcClient *self)
   gchar *url;
   GBytes *body;
 
-  g_message("Fetching online streams");
+  WEBRTC_LOG_DEBUG(WEBRTC_LOG_SIGNALING, NULL, "Fetching online streams");
 
   url = g_strdup_printf("https://%s/%s", self->server, URL_PATH_TARGETS);
   body = g_bytes_new(TARGETS_REQ_BODY, strlen(TARGETS_REQ_BODY));
@@ -541,7 +564,7 @@ refresh_auth(gpointer user_data)
 {
   WebrtcClient *self = user_data;
 
-  g_message("Refreshing token");
+  WEBRTC_LOG_DEBUG(WEBRTC_LOG_SIGNALING, NULL, "Refreshing token");
   get_auth(self);
 
   return FALSE;
@@ -565,8 +588,10 @@ on_auth_callback(GObject *source, GAsyncResult *result, gpointer user_data)
                                             &lerr);
 
   if (bytes == NULL) {
-    g_warning("Error retrieving token: %s",
-              lerr ? lerr->message : "No error message");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Error retrieving token: %s",
+                       lerr ? lerr->message : "No error message");
     g_clear_error(&lerr);
     goto out;
   }
@@ -574,15 +599,17 @@ on_auth_callback(GObject *source, GAsyncResult *result, gpointer user_data)
   msg = message_parse(bytes, &lerr);
 
   if (msg == NULL) {
-    g_warning("Failed to parse auth response: %s",
-              lerr != NULL ? lerr->message : "No error message");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SIGNALING,
+                       NULL,
+                       "Failed to parse auth response: %s",
+                       lerr != NULL ? lerr->message : "No error message");
     g_clear_error(&lerr);
     goto out;
   }
 
   g_object_set(self, "token", msg->data.auth.token, NULL);
 
-  g_message("Got auth token %s", self->token);
+  WEBRTC_LOG_INFO(WEBRTC_LOG_SIGNALING, NULL, "Got an auth token");
 
   now = g_date_time_new_now_utc();
 
@@ -593,7 +620,10 @@ on_auth_callback(GObject *source, GAsyncResult *result, gpointer user_data)
 
   diff = MAX(diff, MIN_TIMEOUT_REFRESH);
 
-  g_message("Refreshing auth token in %ld s", diff);
+  WEBRTC_LOG_INFO(WEBRTC_LOG_SIGNALING,
+                  NULL,
+                  "Refreshing auth token in %ld s",
+                  diff);
 
   self->refresh_timeout = g_timeout_add_seconds(diff, refresh_auth, self);
 
@@ -963,6 +993,22 @@ webrtc_client_connect_async(WebrtcClient *self)
   g_free(uri);
 }
 
+/* Takes msg, queued until the websocket is connected */
+static void
+send_message(WebrtcClient *self, const gchar *session_id, gchar *msg)
+{
+  if (self->client != NULL) {
+    WEBRTC_LOG_TRACE(WEBRTC_LOG_SIGNALING,
+                     session_id,
+                     "Sending msg %s",
+                     msg);
+    soup_websocket_connection_send_text(self->client, msg);
+    g_free(msg);
+  } else {
+    g_queue_push_tail(self->client_queue, msg);
+  }
+}
+
 gboolean
 webrtc_client_init_session(WebrtcClient *self,
                            const gchar *target,
@@ -978,13 +1024,7 @@ webrtc_client_init_session(WebrtcClient *self,
 
   msg = message_create_init_session(target, session_id, settings, self->token);
 
-  if (self->client != NULL) {
-    g_message("Sending msg %s", msg);
-    soup_websocket_connection_send_text(self->client, msg);
-    g_free(msg);
-  } else {
-    g_queue_push_tail(self->client_queue, msg);
-  }
+  send_message(self, session_id, msg);
 
   return TRUE;
 }
@@ -1005,13 +1045,7 @@ webrtc_client_send_sdp_answer(WebrtcClient *self,
 
   msg = message_create_sdp_answer(target, session_id, sdp, self->token);
 
-  if (self->client != NULL) {
-    g_message("Sending msg %s", msg);
-    soup_websocket_connection_send_text(self->client, msg);
-    g_free(msg);
-  } else {
-    g_queue_push_tail(self->client_queue, msg);
-  }
+  send_message(self, session_id, msg);
 
   return TRUE;
 }
@@ -1038,13 +1072,30 @@ webrtc_client_send_ice_candidate(WebrtcClient *self,
                                      line_index,
                                      self->token);
 
-  if (self->client != NULL) {
-    g_message("Sending msg %s", msg);
-    soup_websocket_connection_send_text(self->client, msg);
-    g_free(msg);
-  } else {
-    g_queue_push_tail(self->client_queue, msg);
-  }
+  send_message(self, session_id, msg);
+
+  return TRUE;
+}
+
+gboolean
+webrtc_client_update_session(WebrtcClient *self,
+                             const gchar *target,
+                             const gchar *session_id,
+                             gint64 max_bitrate)
+{
+  gchar *msg;
+
+  g_return_val_if_fail(self != NULL, FALSE);
+  g_return_val_if_fail(target != NULL, FALSE);
+  g_return_val_if_fail(session_id != NULL, FALSE);
+  g_return_val_if_fail(self->token != NULL, FALSE);
+
+  msg = message_create_update_session(target,
+                                      session_id,
+                                      max_bitrate,
+                                      self->token);
+
+  send_message(self, session_id, msg);
 
   return TRUE;
 }
@@ -1053,4 +1104,50 @@ const gchar *
 webrtc_client_get_name(WebrtcClient *self)
 {
   return self->server;
-}
\ No newline at end of file
+}
+
+const gchar *
+webrtc_client_get_user(WebrtcClient *self)
+{
+  return self->user;
+}
+
+struct stream_started *
+stream_started_copy(const struct stream_started *info)
+{
+  struct stream_started *copy;
+
+  g_return_val_if_fail(info != NULL, NULL);
+
+  copy = g_malloc0(sizeof(*copy));
+  copy->source = g_strdup(info->source);
+  copy->subject = g_strdup(info->subject);
+  copy->time = g_strdup(info->time);
+  copy->trigger_type = g_strdup(info->trigger_type);
+  copy->bearer_id = g_strdup(info->bearer_id);
+  copy->bearer_name = g_strdup(info->bearer_name);
+  copy->system_id = g_strdup(info->system_id);
+  copy->session_id = g_strdup(info->session_id);
+  copy->recording_id = g_strdup(info->recording_id);
+
+  return copy;
+}
+
+void
+stream_started_free(struct stream_started *info)
+{
+  if (info == NULL) {
+    return;
+  }
+
+  g_free((gchar *) info->source);
+  g_free((gchar *) info->subject);
+  g_free((gchar *) info->time);
+  g_free((gchar *) info->trigger_type);
+  g_free((gchar *) info->bearer_id);
+  g_free((gchar *) info->bearer_name);
+  g_free((gchar *) info->system_id);
+  g_free((gchar *) info->session_id);
+  g_free((gchar *) info->recording_id);
+  g_free(info);
+}
@@ -26,6 +26,11 @@ struct stream_started {
   const gchar *recording_id;
 };
 
+/** A copy of info that owns its strings */
+struct stream_started *stream_started_copy(const struct stream_started *info);
+
+void stream_started_free(struct stream_started *info);
+
 /** Signal: sdp
  * on_sdp(
  *  WebrtcClient *self,
@@ -59,7 +64,16 @@ gboolean webrtc_client_send_ice_candidate(WebrtcClient *self,
                                           const gchar *session_id,
                                           const gchar *ice,
                                           guint line_index);
+
+gboolean webrtc_client_update_session(WebrtcClient *self,
+                                      const gchar *target,
+                                      const gchar *session_id,
+                                      gint64 max_bitrate);
 const gchar *
 webrtc_client_get_name(WebrtcClient *self);
 
+/** The user logged in as, NULL without credentials */
+const gchar *
+webrtc_client_get_user(WebrtcClient *self);
+
 G_END_DECLS
@@ -0,0 +1,198 @@
+#include <glib.h>
+#include <gst/gst.h>
+#include <gst/sdp/sdp.h>
+
+#include "webrtc_codecs.h"
+
+/* Order is the order of preference when offering a codec on a transceiver */
+static const struct webrtc_codec codecs[] = {
+  { "H264",
+    WEBRTC_CODEC_MEDIA_VIDEO,
+    90000,
+    "rtph264depay",
+    "h264parse",
+    "avdec_h264" },
+  { "H265",
+    WEBRTC_CODEC_MEDIA_VIDEO,
+    90000,
+    "rtph265depay",
+    "h265parse",
+    "avdec_h265" },
+  { "VP8", WEBRTC_CODEC_MEDIA_VIDEO, 90000, "rtpvp8depay", NULL, "vp8dec" },
+  { "VP9", WEBRTC_CODEC_MEDIA_VIDEO, 90000, "rtpvp9depay", NULL, "vp9dec" },
+  { "AV1",
+    WEBRTC_CODEC_MEDIA_VIDEO,
+    90000,
+    "rtpav1depay",
+    "av1parse",
+    "dav1ddec" },
+  { "OPUS",
+    WEBRTC_CODEC_MEDIA_AUDIO,
+    48000,
+    "rtpopusdepay",
+    "opusparse",
+    "opusdec" },
+  { "MPEG4-GENERIC",
+    WEBRTC_CODEC_MEDIA_AUDIO,
+    0,
+    "rtpmp4gdepay",
+    "aacparse",
+    "avdec_aac" },
+};
+
+static gboolean
+has_factory(const gchar *name)
+{
+  GstElementFactory *factory;
+
+  if (name == NULL) {
+    return TRUE;
+  }
+
+  factory = gst_element_factory_find(name);
+  if (factory == NULL) {
+    return FALSE;
+  }
+
+  gst_object_unref(factory);
+  return TRUE;
+}
+
+const struct webrtc_codec *
+webrtc_codec_lookup(const gchar *encoding_name)
+{
+  if (encoding_name == NULL) {
+    return NULL;
+  }
+
+  for (guint i = 0; i < G_N_ELEMENTS(codecs); i++) {
+    if (g_ascii_strcasecmp(codecs[i].encoding_name, encoding_name) == 0) {
+      return &codecs[i];
+    }
+  }
+
+  return NULL;
+}
+
+const struct webrtc_codec *
+webrtc_codec_from_caps(const GstCaps *caps)
+{
+  const GstStructure *s;
+
+  if (caps == NULL || gst_caps_get_size(caps) == 0) {
+    return NULL;
+  }
+
+  s = gst_caps_get_structure(caps, 0);
+
+  return webrtc_codec_lookup(gst_structure_get_string(s, "encoding-name"));
+}
+
+gboolean
+webrtc_codec_available(const struct webrtc_codec *codec, gboolean decode)
+{
+  g_return_val_if_fail(codec != NULL, FALSE);
+
+  if (!has_factory(codec->depay) || !has_factory(codec->parse)) {
+    return FALSE;
+  }
+
+  return !decode || has_factory(codec->decode);
+}
+
+static void
+append_codec(GstCaps *caps, const struct webrtc_codec *codec, gboolean decode)
+{
+  GstStructure *s;
+
+  if (!webrtc_codec_available(codec, decode)) {
+    g_message("Not offering %s, missing elements", codec->encoding_name);
+    return;
+  }
+
+  s = gst_structure_new("application/x-rtp",
+                        "media",
+                        G_TYPE_STRING,
+                        codec->media == WEBRTC_CODEC_MEDIA_VIDEO ? "video"
+                                                                 : "audio",
+                        "encoding-name",
+                        G_TYPE_STRING,
+                        codec->encoding_name,
+                        NULL);
+
+  if (codec->clock_rate > 0) {
+    gst_structure_set(s, "clock-rate", G_TYPE_INT, codec->clock_rate, NULL);
+  }
+
+  gst_caps_append_structure(caps, s);
+}
+
+GstCaps *
+webrtc_codec_transceiver_caps(enum webrtc_codec_media media,
+                              const gchar *preferred,
+                              gboolean decode)
+{
+  const struct webrtc_codec *first;
+  GstCaps *caps;
+
+  caps = gst_caps_new_empty();
+
+  /* The preferred codec goes first, the rest in table order */
+  first = webrtc_codec_lookup(preferred);
+  if (first != NULL && first->media == media) {
+    append_codec(caps, first, decode);
+  }
+
+  for (guint i = 0; i < G_N_ELEMENTS(codecs); i++) {
+    if (&codecs[i] != first && codecs[i].media == media) {
+      append_codec(caps, &codecs[i], decode);
+    }
+  }
+
+  return caps;
+}
+
+GHashTable *
+webrtc_codec_map_from_sdp(const GstSDPMessage *sdp)
+{
+  GHashTable *map;
+
+  g_return_val_if_fail(sdp != NULL, NULL);
+
+  map = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+  for (guint i = 0; i < gst_sdp_message_medias_len(sdp); i++) {
+    const GstSDPMedia *media = gst_sdp_message_get_media(sdp, i);
+
+    for (guint j = 0; j < gst_sdp_media_attributes_len(media); j++) {
+      const GstSDPAttribute *attr = gst_sdp_media_get_attribute(media, j);
+      const struct webrtc_codec *codec;
+      gchar **parts;
+      guint64 pt;
+
+      if (g_strcmp0(attr->key, "rtpmap") != 0 || attr->value == NULL) {
+        continue;
+      }
+
+      /* a=rtpmap:<pt> <encoding>/<clock rate>[/<channels>] */
+      parts = g_strsplit_set(attr->value, " /", 3);
+      if (g_strv_length(parts) < 2 ||
+          !g_ascii_string_to_unsigned(parts[0], 10, 0, 127, &pt, NULL)) {
+        g_strfreev(parts);
+        continue;
+      }
+
+      /* rtx, red and ulpfec are handled inside webrtcbin */
+      codec = webrtc_codec_lookup(parts[1]);
+      if (codec != NULL) {
+        g_hash_table_insert(map,
+                            GUINT_TO_POINTER((guint) pt),
+                            (gpointer) codec);
+      }
+
+      g_strfreev(parts);
+    }
+  }
+
+  return map;
+}
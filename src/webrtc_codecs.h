@@ -0,0 +1,36 @@
+#pragma once
+
+#include <glib.h>
+#include <gst/gst.h>
+#include <gst/sdp/sdp.h>
+
+G_BEGIN_DECLS
+
+enum webrtc_codec_media {
+  WEBRTC_CODEC_MEDIA_VIDEO = 0,
+  WEBRTC_CODEC_MEDIA_AUDIO,
+};
+
+struct webrtc_codec {
+  const gchar *encoding_name; /* upper case, as in the RTP caps */
+  enum webrtc_codec_media media;
+  gint clock_rate; /* 0 if it varies between devices */
+  const gchar *depay;
+  const gchar *parse; /* NULL if the depayloader output needs no parser */
+  const gchar *decode;
+};
+
+const struct webrtc_codec *webrtc_codec_lookup(const gchar *encoding_name);
+
+const struct webrtc_codec *webrtc_codec_from_caps(const GstCaps *caps);
+
+gboolean webrtc_codec_available(const struct webrtc_codec *codec,
+                                gboolean decode);
+
+GstCaps *webrtc_codec_transceiver_caps(enum webrtc_codec_media media,
+                                       const gchar *preferred,
+                                       gboolean decode);
+
+GHashTable *webrtc_codec_map_from_sdp(const GstSDPMessage *sdp);
+
+G_END_DECLS
@@ -0,0 +1,465 @@
+#include <glib.h>
+#include <gst/gst.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+
+#include "webrtc_cpu.h"
+#include "webrtc_log.h"
+
+#define TAG_LENGTH 8 /* of the session key, thread names are at most 15 */
+#define TASK_DIR   "/proc/self/task"
+
+static const gchar *class_names[] = {
+  "network", "depay", "decode", "convert", "mux", "other",
+};
+
+/* In thread names */
+static const gchar *short_names[] = {
+  "net", "depay", "dec", "conv", "mux", "other",
+};
+
+/* Per session, in clock ticks */
+struct ticks {
+  guint64 classes[WEBRTC_CPU_CLASS_LAST];
+};
+
+/* The session of a tag. A session that is added again lives on until the
+ * last one is forgotten. */
+struct tagged {
+  gchar *session;
+  gint refs; /* webrtc_cpu_add_session() calls not forgotten yet */
+};
+
+/* Protects tags and usage */
+static GMutex lock;
+static GHashTable *tags;  /* tag -> struct tagged */
+static GHashTable *usage; /* session -> struct webrtc_cpu_usage */
+
+/* Protects the state between samples */
+static GMutex sample_lock;
+static GHashTable *last_ticks; /* thread id -> guint64 */
+static gint64 last_sample;     /* monotonic us */
+
+static void
+tagged_free(gpointer data)
+{
+  struct tagged *tagged = data;
+
+  g_free(tagged->session);
+  g_free(tagged);
+}
+
+static void
+ensure_tables(void)
+{
+  if (tags == NULL) {
+    tags = g_hash_table_new_full(g_str_hash,
+                                 g_str_equal,
+                                 g_free,
+                                 tagged_free);
+    usage = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  }
+}
+
+static enum webrtc_cpu_class
+classify(GstElement *element, guint depth)
+{
+  GstElementFactory *factory;
+  const gchar *klass;
+
+  if (element == NULL) {
+    return WEBRTC_CPU_OTHER;
+  }
+
+  /* A queue's thread pushes into whatever comes after it */
+  factory = gst_element_get_factory(element);
+  if (factory != NULL && g_strcmp0(GST_OBJECT_NAME(factory), "queue") == 0) {
+    enum webrtc_cpu_class cpu_class = WEBRTC_CPU_OTHER;
+    GstPad *srcpad = gst_element_get_static_pad(element, "src");
+    GstPad *peer = srcpad != NULL ? gst_pad_get_peer(srcpad) : NULL;
+    GstElement *next = peer != NULL ? gst_pad_get_parent_element(peer) : NULL;
+
+    if (next != NULL && depth == 0) {
+      cpu_class = classify(next, depth + 1);
+    }
+    g_clear_object(&next);
+    g_clear_object(&peer);
+    g_clear_object(&srcpad);
+
+    return cpu_class;
+  }
+
+  klass = gst_element_get_metadata(element, GST_ELEMENT_METADATA_KLASS);
+  if (klass == NULL) {
+    return WEBRTC_CPU_OTHER;
+  }
+
+  /* Depayloaders and DTLS decoders are network elements as well */
+  if (strstr(klass, "Depayloader") != NULL) {
+    return WEBRTC_CPU_DEPAY;
+  } else if (strstr(klass, "Muxer") != NULL) {
+    return WEBRTC_CPU_MUX;
+  } else if (strstr(klass, "Network") != NULL) {
+    return WEBRTC_CPU_NETWORK;
+  } else if (strstr(klass, "Decoder") != NULL) {
+    return WEBRTC_CPU_DECODE;
+  } else if (strstr(klass, "Converter") != NULL ||
+             strstr(klass, "Scaler") != NULL) {
+    return WEBRTC_CPU_CONVERT;
+  }
+
+  return WEBRTC_CPU_OTHER;
+}
+
+enum webrtc_cpu_class
+webrtc_cpu_classify(GstElement *element)
+{
+  return classify(element, 0);
+}
+
+const gchar *
+webrtc_cpu_class_name(enum webrtc_cpu_class cpu_class)
+{
+  g_return_val_if_fail(cpu_class < G_N_ELEMENTS(class_names), NULL);
+
+  return class_names[cpu_class];
+}
+
+/* The end of a session key, which is what sets the keys of one id apart */
+static gchar *
+session_tag(const gchar *session)
+{
+  gsize length = strlen(session);
+
+  return g_strdup(session + length - MIN(length, TAG_LENGTH));
+}
+
+void
+webrtc_cpu_name_thread(const gchar *session, GstElement *element)
+{
+  enum webrtc_cpu_class cpu_class = webrtc_cpu_classify(element);
+  gchar *tag;
+  gchar *name;
+
+  g_return_if_fail(session != NULL);
+
+  tag = session_tag(session);
+  name = g_strdup_printf("%s/%s", tag, short_names[cpu_class]);
+  prctl(PR_SET_NAME, name, 0, 0, 0);
+  g_free(name);
+
+  g_mutex_lock(&lock);
+  ensure_tables();
+  if (!g_hash_table_contains(tags, tag)) {
+    struct tagged *tagged = g_malloc0(sizeof(*tagged));
+
+    tagged->session = g_strdup(session);
+    g_hash_table_insert(tags, tag, tagged);
+    tag = NULL;
+  }
+  g_mutex_unlock(&lock);
+  g_free(tag);
+}
+
+void
+webrtc_cpu_add_session(const gchar *session)
+{
+  struct tagged *tagged;
+  gchar *tag;
+
+  g_return_if_fail(session != NULL);
+
+  tag = session_tag(session);
+  g_mutex_lock(&lock);
+  ensure_tables();
+  tagged = g_hash_table_lookup(tags, tag);
+  if (tagged == NULL) {
+    tagged = g_malloc0(sizeof(*tagged));
+    tagged->session = g_strdup(session);
+    g_hash_table_insert(tags, g_steal_pointer(&tag), tagged);
+  }
+  if (g_strcmp0(tagged->session, session) == 0) {
+    tagged->refs++;
+  }
+  g_mutex_unlock(&lock);
+  g_free(tag);
+}
+
+/* "<tag>/<class>" */
+static gboolean
+parse_name(const gchar *comm, gchar **tag, enum webrtc_cpu_class *cpu_class)
+{
+  const gchar *slash = strchr(comm, '/');
+
+  if (slash == NULL || slash - comm != TAG_LENGTH) {
+    return FALSE;
+  }
+
+  for (guint i = 0; i < G_N_ELEMENTS(short_names); i++) {
+    if (g_strcmp0(slash + 1, short_names[i]) == 0) {
+      *tag = g_strndup(comm, TAG_LENGTH);
+      *cpu_class = i;
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/* "tid (comm) state ..." with user and system time as fields 14 and 15,
+ * comm may contain anything */
+static gboolean
+read_task(const gchar *tid, gchar **comm, guint64 *ticks)
+{
+  gchar *path;
+  gchar *stat = NULL;
+  gchar **fields;
+  const gchar *open;
+  const gchar *close;
+  gboolean ret = FALSE;
+
+  path = g_build_filename(TASK_DIR, tid, "stat", NULL);
+  if (!g_file_get_contents(path, &stat, NULL, NULL)) {
+    /* Gone in the meantime */
+    g_free(path);
+    return FALSE;
+  }
+  g_free(path);
+
+  open = strchr(stat, '(');
+  close = strrchr(stat, ')');
+  if (open == NULL || close == NULL || close < open || close[1] == '\0') {
+    g_free(stat);
+    return FALSE;
+  }
+
+  fields = g_strsplit(close + 2, " ", 14);
+  if (g_strv_length(fields) >= 13) {
+    *comm = g_strndup(open + 1, close - open - 1);
+    *ticks = g_ascii_strtoull(fields[11], NULL, 10) +
+             g_ascii_strtoull(fields[12], NULL, 10);
+    ret = TRUE;
+  }
+  g_strfreev(fields);
+  g_free(stat);
+
+  return ret;
+}
+
+void
+webrtc_cpu_sample(void)
+{
+  GHashTable *sessions; /* tag -> session key, a copy */
+  GHashTable *spent;    /* session key -> struct ticks */
+  GHashTable *seen;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+  GDir *dir;
+  const gchar *tid;
+  gint64 now;
+  gdouble scale;
+
+  sessions = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  g_mutex_lock(&lock);
+  ensure_tables();
+  g_hash_table_iter_init(&iter, tags);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    struct tagged *tagged = value;
+
+    g_hash_table_insert(sessions, g_strdup(key), g_strdup(tagged->session));
+  }
+  g_mutex_unlock(&lock);
+
+  dir = g_dir_open(TASK_DIR, 0, NULL);
+  if (dir == NULL) {
+    g_hash_table_unref(sessions);
+    return;
+  }
+
+  g_mutex_lock(&sample_lock);
+  now = g_get_monotonic_time();
+  spent = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+  seen = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+  while ((tid = g_dir_read_name(dir)) != NULL) {
+    guint id = g_ascii_strtoull(tid, NULL, 10);
+    enum webrtc_cpu_class cpu_class;
+    const gchar *session;
+    struct ticks *t;
+    guint64 *total;
+    guint64 *before;
+    gchar *comm = NULL;
+    gchar *tag = NULL;
+
+    total = g_malloc(sizeof(*total));
+    if (!read_task(tid, &comm, total)) {
+      g_free(total);
+      continue;
+    }
+    g_hash_table_insert(seen, GUINT_TO_POINTER(id), total);
+
+    /* A new thread only counts from its next sample on */
+    before = last_ticks != NULL ? g_hash_table_lookup(last_ticks,
+                                                      GUINT_TO_POINTER(id))
+                                : NULL;
+    if (before != NULL && *total >= *before &&
+        parse_name(comm, &tag, &cpu_class) &&
+        (session = g_hash_table_lookup(sessions, tag)) != NULL) {
+      t = g_hash_table_lookup(spent, session);
+      if (t == NULL) {
+        t = g_malloc0(sizeof(*t));
+        g_hash_table_insert(spent, (gpointer) session, t);
+      }
+      t->classes[cpu_class] += *total - *before;
+    }
+    g_free(tag);
+    g_free(comm);
+  }
+  g_dir_close(dir);
+
+  /* percent of a core = ticks / ticks per s / interval in s * 100 */
+  scale = 0.0;
+  if (last_sample > 0 && now > last_sample) {
+    scale = 100.0 * G_USEC_PER_SEC / sysconf(_SC_CLK_TCK) /
+            (now - last_sample);
+  }
+  g_clear_pointer(&last_ticks, g_hash_table_unref);
+  last_ticks = seen;
+  last_sample = now;
+
+  g_mutex_lock(&lock);
+  g_hash_table_iter_init(&iter, sessions);
+  while (scale > 0.0 && g_hash_table_iter_next(&iter, &key, &value)) {
+    struct webrtc_cpu_usage *u;
+    struct ticks *t = g_hash_table_lookup(spent, value);
+
+    /* Forgotten while sampling */
+    if (!g_hash_table_contains(tags, key)) {
+      continue;
+    }
+
+    u = g_malloc0(sizeof(*u));
+    for (guint i = 0; t != NULL && i < WEBRTC_CPU_CLASS_LAST; i++) {
+      u->classes[i] = t->classes[i] * scale;
+      u->total += u->classes[i];
+    }
+    g_hash_table_insert(usage, g_strdup(value), u);
+  }
+  g_mutex_unlock(&lock);
+  g_mutex_unlock(&sample_lock);
+
+  g_hash_table_unref(spent);
+  g_hash_table_unref(sessions);
+}
+
+gboolean
+webrtc_cpu_get_usage(const gchar *session, struct webrtc_cpu_usage *out)
+{
+  struct webrtc_cpu_usage *u;
+
+  g_return_val_if_fail(session != NULL, FALSE);
+  g_return_val_if_fail(out != NULL, FALSE);
+
+  g_mutex_lock(&lock);
+  ensure_tables();
+  u = g_hash_table_lookup(usage, session);
+  if (u != NULL) {
+    *out = *u;
+  }
+  g_mutex_unlock(&lock);
+
+  return u != NULL;
+}
+
+void
+webrtc_cpu_forget_session(const gchar *session)
+{
+  struct tagged *tagged;
+  gchar *tag;
+
+  g_return_if_fail(session != NULL);
+
+  tag = session_tag(session);
+  g_mutex_lock(&lock);
+  ensure_tables();
+  tagged = g_hash_table_lookup(tags, tag);
+  if (tagged != NULL && g_strcmp0(tagged->session, session) == 0 &&
+      --tagged->refs <= 0) {
+    g_hash_table_remove(tags, tag);
+    g_hash_table_remove(usage, session);
+  }
+  g_mutex_unlock(&lock);
+  g_free(tag);
+}
+
+static void
+log_usage(void)
+{
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+
+  g_mutex_lock(&lock);
+  ensure_tables();
+  g_hash_table_iter_init(&iter, usage);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    struct webrtc_cpu_usage *u = value;
+
+    WEBRTC_LOG_INFO(WEBRTC_LOG_PIPELINE,
+                    key,
+                    "CPU %.1f%%: network %.1f, depay %.1f, decode %.1f, "
+                    "convert %.1f, mux %.1f, other %.1f",
+                    u->total,
+                    u->classes[WEBRTC_CPU_NETWORK],
+                    u->classes[WEBRTC_CPU_DEPAY],
+                    u->classes[WEBRTC_CPU_DECODE],
+                    u->classes[WEBRTC_CPU_CONVERT],
+                    u->classes[WEBRTC_CPU_MUX],
+                    u->classes[WEBRTC_CPU_OTHER]);
+  }
+  g_mutex_unlock(&lock);
+}
+
+struct sampler {
+  guint interval;     /* s */
+  guint log_interval; /* s */
+};
+
+static gpointer
+run_sampler(gpointer data)
+{
+  struct sampler *sampler = data;
+  guint since_log = 0;
+
+  for (;;) {
+    webrtc_cpu_sample();
+
+    since_log += sampler->interval;
+    if (sampler->log_interval > 0 && since_log >= sampler->log_interval) {
+      log_usage();
+      since_log = 0;
+    }
+
+    g_usleep(sampler->interval * G_USEC_PER_SEC);
+  }
+
+  return NULL;
+}
+
+void
+webrtc_cpu_start(guint interval, guint log_interval)
+{
+  static gsize started = 0;
+
+  g_return_if_fail(interval > 0);
+
+  if (g_once_init_enter(&started)) {
+    struct sampler *sampler = g_malloc0(sizeof(*sampler));
+
+    sampler->interval = interval;
+    sampler->log_interval = log_interval;
+    g_thread_unref(g_thread_new("webrtc-cpu", run_sampler, sampler));
+    g_once_init_leave(&started, 1);
+  }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <glib.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Seconds between CPU samples and between logging them */
+#define WEBRTC_CPU_SAMPLE_INTERVAL 5
+#define WEBRTC_CPU_LOG_INTERVAL    60
+
+/** What a streaming thread mostly does, by the element that owns it */
+enum webrtc_cpu_class {
+  WEBRTC_CPU_NETWORK = 0, /* nice, DTLS, SRTP, jitterbuffers */
+  WEBRTC_CPU_DEPAY,
+  WEBRTC_CPU_DECODE,
+  WEBRTC_CPU_CONVERT,
+  WEBRTC_CPU_MUX,
+  WEBRTC_CPU_OTHER,
+  WEBRTC_CPU_CLASS_LAST,
+};
+
+/** Percent of one core during the last sample interval */
+struct webrtc_cpu_usage {
+  gdouble total;
+  gdouble classes[WEBRTC_CPU_CLASS_LAST];
+};
+
+/** Names the calling thread "<session tag>/<class>", the tag being the
+ * last 8 characters of the session key, so that the sampler and tools like
+ * top can tell the sessions apart. element may be NULL. */
+void webrtc_cpu_name_thread(const gchar *session, GstElement *element);
+
+enum webrtc_cpu_class webrtc_cpu_classify(GstElement *element);
+
+const gchar *webrtc_cpu_class_name(enum webrtc_cpu_class cpu_class);
+
+/** Samples /proc/self/task every interval seconds on a thread of its own
+ * and logs the usage of every session every log_interval seconds */
+void webrtc_cpu_start(guint interval, guint log_interval);
+
+/** Reads the CPU time of all named threads, the usage is the time since
+ * the previous sample */
+void webrtc_cpu_sample(void);
+
+/** FALSE if nothing was sampled for session yet */
+gboolean webrtc_cpu_get_usage(const gchar *session,
+                              struct webrtc_cpu_usage *out);
+
+/** Counts the threads of session until it is forgotten as often. session
+ * is the key of one session object, an id can be in use twice. */
+void webrtc_cpu_add_session(const gchar *session);
+
+/** Drops the usage once the last webrtc_cpu_add_session() is forgotten or
+ * if it was never added */
+void webrtc_cpu_forget_session(const gchar *session);
+
+G_END_DECLS
@@ -0,0 +1,899 @@
+#include <glib.h>
+#include <glib-object.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+#include "webrtc_disk.h"
+
+#define MAX_QUEUED_BLOCKS 8  /* per file, then the recording waits */
+#define REPORT_INTERVAL   60 /* s */
+#define CHECK_INTERVAL    5  /* s */
+#define NO_SPACE_MARGIN   (64 << 20) /* free after running out, in bytes */
+#define FLUSH_POLL        (100 * G_TIME_SPAN_MILLISECOND)
+
+static const gchar *state_names[] = { "ok", "slow", "low on space", "full" };
+
+struct disk_dir {
+  gchar *path;
+  enum webrtc_disk_state state;
+  guint64 free;      /* bytes, G_MAXUINT64 if unknown */
+  guint64 max_write; /* us, since the last check */
+  gboolean no_space; /* a write failed with ENOSPC since the last check */
+  gboolean ran_out;  /* until there is NO_SPACE_MARGIN free again */
+};
+
+struct webrtc_disk_file {
+  gint ref;
+  WebrtcDiskWriter *writer;
+  gchar *path;
+  struct disk_dir *dir; /* owned by the writer */
+  gint fd;
+  gint64 write_start; /* monotonic us, 0 if idle, protected by writer lock */
+
+  GByteArray *block; /* being filled, streaming thread only */
+  GstPad *pad; /* the sink's, not owned, streaming thread only */
+
+  GMutex lock;
+  GCond drained;
+  GQueue *blocks; /* GBytes, full blocks waiting for a write */
+  gboolean scheduled;
+  gboolean closing;
+  gboolean flushing; /* between a flush start and stop */
+
+  /* protected by lock */
+  guint max_queued;
+  guint64 bytes;
+  guint64 writes;
+  guint64 write_time;
+  guint64 max_write;
+  guint64 stalls;
+  guint64 errors;
+};
+
+struct _WebrtcDiskWriter {
+  GObject parent;
+
+  GThreadPool *pool;
+  gsize block_size;
+  guint report_timer;
+  guint check_timer;
+  guint64 min_free;  /* bytes */
+  guint64 max_write; /* us */
+
+  GMutex lock;
+  GPtrArray *files; /* struct webrtc_disk_file, open, protected by lock */
+  GHashTable *dirs; /* path -> struct disk_dir, protected by lock */
+  struct webrtc_disk_metrics metrics; /* protected by lock */
+};
+
+G_DEFINE_TYPE(WebrtcDiskWriter, webrtc_disk_writer, G_TYPE_OBJECT)
+
+enum disk_signals {
+  SIG_STATE_CHANGED = 0,
+  SIG_LAST,
+};
+static guint disk_signal_defs[SIG_LAST] = { 0 };
+
+static void
+dir_free(struct disk_dir *dir)
+{
+  g_free(dir->path);
+  g_free(dir);
+}
+
+/* Called with the writer lock held */
+static struct disk_dir *
+lookup_dir(WebrtcDiskWriter *self, const gchar *path)
+{
+  struct disk_dir *dir = g_hash_table_lookup(self->dirs, path);
+
+  if (dir == NULL) {
+    dir = g_malloc0(sizeof(*dir));
+    dir->path = g_strdup(path);
+    dir->free = G_MAXUINT64;
+    g_hash_table_insert(self->dirs, dir->path, dir);
+  }
+
+  return dir;
+}
+
+static struct webrtc_disk_file *
+file_ref(struct webrtc_disk_file *file)
+{
+  g_atomic_int_inc(&file->ref);
+  return file;
+}
+
+static void
+file_unref(struct webrtc_disk_file *file)
+{
+  if (!g_atomic_int_dec_and_test(&file->ref)) {
+    return;
+  }
+
+  g_queue_free_full(file->blocks, (GDestroyNotify) g_bytes_unref);
+  if (file->block != NULL) {
+    g_byte_array_unref(file->block);
+  }
+  g_mutex_clear(&file->lock);
+  g_cond_clear(&file->drained);
+  g_free(file->path);
+  g_free(file);
+}
+
+static void
+log_file(struct webrtc_disk_file *file, const gchar *what)
+{
+  g_mutex_lock(&file->lock);
+  g_message("Disk: %s %s, %" G_GUINT64_FORMAT " kB in %" G_GUINT64_FORMAT
+            " writes, %" G_GUINT64_FORMAT " us average, %" G_GUINT64_FORMAT
+            " us max, %u queued, %u max queued, %" G_GUINT64_FORMAT
+            " stalls",
+            file->path,
+            what,
+            file->bytes / 1024,
+            file->writes,
+            file->writes > 0 ? file->write_time / file->writes : 0,
+            file->max_write,
+            g_queue_get_length(file->blocks),
+            file->max_queued,
+            file->stalls);
+  g_mutex_unlock(&file->lock);
+}
+
+/* Called with the file lock held */
+static void
+schedule(struct webrtc_disk_file *file)
+{
+  if (!file->scheduled) {
+    file->scheduled = TRUE;
+    g_thread_pool_push(file->writer->pool, file_ref(file), NULL);
+  }
+}
+
+static gboolean
+write_all(gint fd, const guint8 *data, gsize size)
+{
+  while (size > 0) {
+    gssize written = write(fd, data, size);
+
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return FALSE;
+    }
+
+    data += written;
+    size -= written;
+  }
+
+  return TRUE;
+}
+
+/* I/O thread, writes the queued blocks of one file in order. A file is in
+ * the pool at most once, so its blocks never race each other. */
+static void
+write_blocks(struct webrtc_disk_file *file, WebrtcDiskWriter *self)
+{
+  GBytes *bytes;
+  gboolean close_file = FALSE;
+
+  g_mutex_lock(&file->lock);
+  while ((bytes = g_queue_pop_head(file->blocks)) != NULL) {
+    gsize size;
+    const guint8 *data = g_bytes_get_data(bytes, &size);
+    gint64 start;
+    guint64 elapsed;
+    gboolean ok;
+    gint saved;
+
+    g_cond_broadcast(&file->drained);
+    g_mutex_unlock(&file->lock);
+
+    start = g_get_monotonic_time();
+    g_mutex_lock(&self->lock);
+    file->write_start = start;
+    g_mutex_unlock(&self->lock);
+
+    ok = write_all(file->fd, data, size);
+    saved = errno;
+    elapsed = g_get_monotonic_time() - start;
+    g_bytes_unref(bytes);
+
+    if (!ok) {
+      g_warning("Disk: writing %s failed: %s", file->path, g_strerror(saved));
+    }
+
+    g_mutex_lock(&self->lock);
+    file->write_start = 0;
+    self->metrics.queued--;
+    if (ok) {
+      self->metrics.bytes += size;
+      self->metrics.writes++;
+      self->metrics.write_time += elapsed;
+      self->metrics.max_write = MAX(self->metrics.max_write, elapsed);
+      file->dir->max_write = MAX(file->dir->max_write, elapsed);
+    } else {
+      self->metrics.errors++;
+      file->dir->no_space |= saved == ENOSPC;
+    }
+    g_mutex_unlock(&self->lock);
+
+    g_mutex_lock(&file->lock);
+    if (ok) {
+      file->bytes += size;
+      file->writes++;
+      file->write_time += elapsed;
+      file->max_write = MAX(file->max_write, elapsed);
+    } else {
+      file->errors++;
+    }
+  }
+
+  file->scheduled = FALSE;
+  close_file = file->closing && file->fd >= 0;
+  g_mutex_unlock(&file->lock);
+
+  if (close_file) {
+    log_file(file, "closed");
+    g_close(file->fd, NULL);
+    file->fd = -1;
+
+    g_mutex_lock(&self->lock);
+    g_ptr_array_remove_fast(self->files, file);
+    self->metrics.files--;
+    g_mutex_unlock(&self->lock);
+    file_unref(file);
+  }
+
+  file_unref(file);
+}
+
+/* Called with the file lock held */
+static void
+push_block(struct webrtc_disk_file *file, GBytes *bytes)
+{
+  WebrtcDiskWriter *self = file->writer;
+
+  g_queue_push_tail(file->blocks, bytes);
+  file->max_queued = MAX(file->max_queued, g_queue_get_length(file->blocks));
+  /* Counted before an I/O thread can write it and count it down */
+  g_mutex_lock(&self->lock);
+  self->metrics.queued++;
+  g_mutex_unlock(&self->lock);
+  schedule(file);
+}
+
+/* Called with the file lock held. A flushing sink stops waiting for the
+ * disk, the pad is flushing before its deactivation waits for the streaming
+ * thread, so that stopping a pipeline never waits for a hung disk. */
+static gboolean
+is_flushing(struct webrtc_disk_file *file)
+{
+  return file->flushing ||
+         (file->pad != NULL && GST_PAD_IS_FLUSHING(file->pad));
+}
+
+/* Streaming thread, blocks while the disk is MAX_QUEUED_BLOCKS behind and
+ * the sink is not flushing */
+static void
+queue_block(struct webrtc_disk_file *file)
+{
+  WebrtcDiskWriter *self = file->writer;
+  GBytes *bytes;
+
+  if (file->block == NULL || file->block->len == 0) {
+    return;
+  }
+
+  bytes = g_byte_array_free_to_bytes(file->block);
+  file->block = NULL;
+
+  g_mutex_lock(&file->lock);
+  if (g_queue_get_length(file->blocks) >= MAX_QUEUED_BLOCKS) {
+    file->stalls++;
+    g_mutex_lock(&self->lock);
+    self->metrics.stalls++;
+    g_mutex_unlock(&self->lock);
+  }
+  while (g_queue_get_length(file->blocks) >= MAX_QUEUED_BLOCKS &&
+         !is_flushing(file)) {
+    g_cond_wait_until(&file->drained,
+                      &file->lock,
+                      g_get_monotonic_time() + FLUSH_POLL);
+  }
+
+  push_block(file, bytes);
+  g_mutex_unlock(&file->lock);
+}
+
+static void
+append(struct webrtc_disk_file *file, const guint8 *data, gsize size)
+{
+  gsize block_size = file->writer->block_size;
+
+  while (size > 0) {
+    gsize n;
+
+    if (file->block == NULL) {
+      file->block = g_byte_array_sized_new(block_size);
+    }
+
+    n = MIN(size, block_size - file->block->len);
+    g_byte_array_append(file->block, data, n);
+    data += n;
+    size -= n;
+
+    if (file->block->len == block_size) {
+      queue_block(file);
+    }
+  }
+}
+
+static GstFlowReturn
+on_new_sample(GstAppSink *sink, gpointer user_data)
+{
+  struct webrtc_disk_file *file = user_data;
+  GstSample *sample;
+  GstBuffer *buffer;
+  GstMapInfo map;
+
+  sample = gst_app_sink_pull_sample(sink);
+  if (sample == NULL) {
+    return GST_FLOW_EOS;
+  }
+
+  buffer = gst_sample_get_buffer(sample);
+  if (buffer != NULL && gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+    append(file, map.data, map.size);
+    gst_buffer_unmap(buffer, &map);
+  }
+
+  gst_sample_unref(sample);
+
+  return GST_FLOW_OK;
+}
+
+static void
+on_eos(G_GNUC_UNUSED GstAppSink *sink, gpointer user_data)
+{
+  struct webrtc_disk_file *file = user_data;
+
+  queue_block(file);
+}
+
+/* Flush events arrive out of band, while the streaming thread may wait */
+static GstPadProbeReturn
+on_flush(G_GNUC_UNUSED GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  struct webrtc_disk_file *file = user_data;
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+
+  g_mutex_lock(&file->lock);
+  file->flushing = GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_START;
+  g_cond_broadcast(&file->drained);
+  g_mutex_unlock(&file->lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Lets the I/O thread close the file after the queued blocks */
+static void
+finish(struct webrtc_disk_file *file)
+{
+  g_mutex_lock(&file->lock);
+  file->closing = TRUE;
+  schedule(file);
+  g_mutex_unlock(&file->lock);
+
+  file_unref(file);
+}
+
+/* The sink is gone, write what is left */
+static void
+close_file(struct webrtc_disk_file *file)
+{
+  file->pad = NULL;
+  g_mutex_lock(&file->lock);
+  file->flushing = TRUE;
+  g_mutex_unlock(&file->lock);
+  queue_block(file);
+
+  finish(file);
+}
+
+static gboolean
+report_timeout(WebrtcDiskWriter *self)
+{
+  GPtrArray *files;
+
+  g_mutex_lock(&self->lock);
+  files = g_ptr_array_new_full(self->files->len,
+                               (GDestroyNotify) file_unref);
+  for (guint i = 0; i < self->files->len; i++) {
+    g_ptr_array_add(files, file_ref(self->files->pdata[i]));
+  }
+  g_mutex_unlock(&self->lock);
+
+  for (guint i = 0; i < files->len; i++) {
+    log_file(files->pdata[i], "open");
+  }
+  g_ptr_array_unref(files);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Called with the writer lock held, a write that is still running counts
+ * with the time it took so far */
+static void
+add_running_writes(WebrtcDiskWriter *self)
+{
+  gint64 now = g_get_monotonic_time();
+
+  for (guint i = 0; i < self->files->len; i++) {
+    struct webrtc_disk_file *file = self->files->pdata[i];
+
+    if (file->write_start > 0) {
+      file->dir->max_write = MAX(file->dir->max_write,
+                                 (guint64) (now - file->write_start));
+    }
+  }
+}
+
+/* Called with the writer lock held */
+static enum webrtc_disk_state
+dir_state(WebrtcDiskWriter *self, struct disk_dir *dir)
+{
+  guint64 min_free = self->min_free;
+
+  if (dir->no_space) {
+    dir->ran_out = TRUE;
+  }
+  if (dir->ran_out) {
+    min_free = MAX(min_free, NO_SPACE_MARGIN);
+  }
+
+  if (dir->no_space || dir->free < min_free) {
+    return WEBRTC_DISK_STATE_FULL;
+  }
+
+  dir->ran_out = FALSE;
+
+  if (dir->free < 2 * min_free) {
+    return WEBRTC_DISK_STATE_LOW;
+  }
+
+  if (self->max_write > 0 && dir->max_write > self->max_write) {
+    return WEBRTC_DISK_STATE_SLOW;
+  }
+
+  return WEBRTC_DISK_STATE_OK;
+}
+
+/* Called with the writer lock held, returns whether the state changed */
+static gboolean
+update_state(WebrtcDiskWriter *self, struct disk_dir *dir)
+{
+  enum webrtc_disk_state state = dir_state(self, dir);
+
+  if (state == dir->state) {
+    return FALSE;
+  }
+
+  if (dir->state == WEBRTC_DISK_STATE_OK) {
+    self->metrics.degraded++;
+  }
+  if (state == WEBRTC_DISK_STATE_FULL) {
+    self->metrics.full++;
+  }
+  dir->state = state;
+
+  return TRUE;
+}
+
+/* Handlers may open or close recordings, so not under the lock */
+static void
+emit_state_changed(WebrtcDiskWriter *self, const gchar *path, guint state)
+{
+  g_message("Disk: %s is %s", path, state_names[state]);
+  g_signal_emit(self, disk_signal_defs[SIG_STATE_CHANGED], 0, path, state);
+}
+
+static guint64
+free_space(const gchar *path)
+{
+  struct statvfs st;
+
+  if (statvfs(path, &st) != 0) {
+    return G_MAXUINT64;
+  }
+
+  return (guint64) st.f_bavail * st.f_frsize;
+}
+
+static gboolean
+check_timeout(WebrtcDiskWriter *self)
+{
+  GHashTableIter iter;
+  struct disk_dir *dir;
+  GPtrArray *changed = g_ptr_array_new_with_free_func(g_free);
+  GArray *states = g_array_new(FALSE, FALSE, sizeof(guint));
+  GPtrArray *paths;
+
+  g_mutex_lock(&self->lock);
+  add_running_writes(self);
+  paths = g_ptr_array_new_full(g_hash_table_size(self->dirs), g_free);
+  g_hash_table_iter_init(&iter, self->dirs);
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &dir)) {
+    g_ptr_array_add(paths, g_strdup(dir->path));
+  }
+  g_mutex_unlock(&self->lock);
+
+  for (guint i = 0; i < paths->len; i++) {
+    const gchar *path = paths->pdata[i];
+    guint64 avail = free_space(path);
+
+    g_mutex_lock(&self->lock);
+    dir = g_hash_table_lookup(self->dirs, path);
+    dir->free = avail;
+    if (update_state(self, dir)) {
+      guint state = dir->state;
+
+      g_ptr_array_add(changed, g_strdup(path));
+      g_array_append_val(states, state);
+    }
+    dir->max_write = 0;
+    dir->no_space = FALSE;
+    g_mutex_unlock(&self->lock);
+  }
+  g_ptr_array_unref(paths);
+
+  for (guint i = 0; i < changed->len; i++) {
+    emit_state_changed(self,
+                       changed->pdata[i],
+                       g_array_index(states, guint, i));
+  }
+
+  g_ptr_array_unref(changed);
+  g_array_unref(states);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+webrtc_disk_writer_dispose(GObject *obj)
+{
+  WebrtcDiskWriter *self = WEBRTC_DISK_WRITER(obj);
+
+  g_assert(self);
+
+  g_clear_handle_id(&self->report_timer, g_source_remove);
+  g_clear_handle_id(&self->check_timer, g_source_remove);
+
+  /* Always chain up to the parent dispose function to complete object
+   * destruction. */
+  G_OBJECT_CLASS(webrtc_disk_writer_parent_class)->dispose(obj);
+}
+
+static void
+webrtc_disk_writer_finalize(GObject *obj)
+{
+  WebrtcDiskWriter *self = WEBRTC_DISK_WRITER(obj);
+
+  g_assert(self);
+
+  /* Lets the closed files finish their last blocks */
+  if (self->pool != NULL) {
+    g_thread_pool_free(self->pool, FALSE, TRUE);
+  }
+  if (self->files->len > 0) {
+    g_warning("Disk: %u files still open", self->files->len);
+  }
+
+  g_message("Disk: %" G_GUINT64_FORMAT " kB in %" G_GUINT64_FORMAT
+            " writes, %" G_GUINT64_FORMAT " us average, %" G_GUINT64_FORMAT
+            " us max, %" G_GUINT64_FORMAT " stalls, %" G_GUINT64_FORMAT
+            " errors, degraded %" G_GUINT64_FORMAT " times of which %"
+            G_GUINT64_FORMAT " full",
+            self->metrics.bytes / 1024,
+            self->metrics.writes,
+            self->metrics.writes > 0 ?
+                    self->metrics.write_time / self->metrics.writes : 0,
+            self->metrics.max_write,
+            self->metrics.stalls,
+            self->metrics.errors,
+            self->metrics.degraded,
+            self->metrics.full);
+  g_ptr_array_unref(self->files);
+  g_hash_table_unref(self->dirs);
+  g_mutex_clear(&self->lock);
+
+  /* Always chain up to the parent finalize function to complete object
+   * destruction. */
+  G_OBJECT_CLASS(webrtc_disk_writer_parent_class)->finalize(obj);
+}
+
+static void
+webrtc_disk_writer_class_init(WebrtcDiskWriterClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+
+  object_class->dispose = webrtc_disk_writer_dispose;
+  object_class->finalize = webrtc_disk_writer_finalize;
+
+  GType state_types[] = { G_TYPE_STRING, G_TYPE_UINT };
+  disk_signal_defs[SIG_STATE_CHANGED] =
+          g_signal_newv("state-changed",
+                        G_TYPE_FROM_CLASS(object_class),
+                        G_SIGNAL_RUN_LAST | G_SIGNAL_NO_RECURSE |
+                                G_SIGNAL_NO_HOOKS,
+                        NULL /* closure */,
+                        NULL /* accumulator */,
+                        NULL /* accumulator data */,
+                        NULL /* C marshaller */,
+                        G_TYPE_NONE /* return_type */,
+                        G_N_ELEMENTS(state_types) /* n_params */,
+                        state_types /* param_types, or set to NULL */
+          );
+}
+
+static void
+webrtc_disk_writer_init(WebrtcDiskWriter *self)
+{
+  g_mutex_init(&self->lock);
+  self->files = g_ptr_array_new();
+  self->dirs = g_hash_table_new_full(g_str_hash,
+                                     g_str_equal,
+                                     NULL,
+                                     (GDestroyNotify) dir_free);
+}
+
+WebrtcDiskWriter *
+webrtc_disk_writer_new(guint threads, gsize block_size, GError **error)
+{
+  WebrtcDiskWriter *self;
+  GError *lerr = NULL;
+
+  g_return_val_if_fail(threads > 0, NULL);
+  g_return_val_if_fail(block_size > 0, NULL);
+
+  self = g_object_new(WEBRTC_TYPE_DISK_WRITER, NULL);
+  self->block_size = block_size;
+  self->pool = g_thread_pool_new((GFunc) write_blocks,
+                                 self,
+                                 (gint) threads,
+                                 FALSE,
+                                 &lerr);
+  if (self->pool == NULL) {
+    g_propagate_prefixed_error(error, lerr, "No I/O threads: ");
+    g_object_unref(self);
+    return NULL;
+  }
+
+  self->report_timer = g_timeout_add_seconds(REPORT_INTERVAL,
+                                             G_SOURCE_FUNC(report_timeout),
+                                             self);
+  self->check_timer = g_timeout_add_seconds(CHECK_INTERVAL,
+                                            G_SOURCE_FUNC(check_timeout),
+                                            self);
+
+  return self;
+}
+
+static struct webrtc_disk_file *
+open_file(WebrtcDiskWriter *self,
+          const gchar *path,
+          gint flags,
+          GError **error)
+{
+  struct webrtc_disk_file *file;
+  gchar *dirname;
+  gchar *canonical;
+  gint fd;
+
+  fd = g_open(path, O_WRONLY | O_CREAT | O_CLOEXEC | flags, 0644);
+  if (fd < 0) {
+    gint saved = errno;
+
+    g_set_error(error,
+                G_FILE_ERROR,
+                g_file_error_from_errno(saved),
+                "Could not open %s: %s",
+                path,
+                g_strerror(saved));
+    return NULL;
+  }
+
+  file = g_malloc0(sizeof(*file));
+  file->ref = 1;
+  file->writer = self;
+  file->path = g_strdup(path);
+  file->fd = fd;
+  file->blocks = g_queue_new();
+  g_mutex_init(&file->lock);
+  g_cond_init(&file->drained);
+
+  dirname = g_path_get_dirname(path);
+  canonical = webrtc_disk_canonical_dir(dirname);
+  g_mutex_lock(&self->lock);
+  file->dir = lookup_dir(self, canonical);
+  /* The open file list holds a reference until the I/O thread closes it */
+  g_ptr_array_add(self->files, file_ref(file));
+  self->metrics.files++;
+  g_mutex_unlock(&self->lock);
+  g_free(canonical);
+  g_free(dirname);
+
+  return file;
+}
+
+GstElement *
+webrtc_disk_writer_sink(WebrtcDiskWriter *self,
+                        const gchar *path,
+                        GError **error)
+{
+  GstAppSinkCallbacks callbacks = { 0 };
+  struct webrtc_disk_file *file;
+  GstElement *sink;
+
+  g_return_val_if_fail(self != NULL, NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+
+  file = open_file(self, path, O_TRUNC, error);
+  if (file == NULL) {
+    return NULL;
+  }
+
+  sink = gst_element_factory_make("appsink", NULL);
+  g_object_set(sink, "sync", FALSE, "async", FALSE, NULL);
+
+  file->pad = gst_element_get_static_pad(sink, "sink");
+  gst_pad_add_probe(file->pad,
+                    GST_PAD_PROBE_TYPE_EVENT_FLUSH,
+                    on_flush,
+                    file_ref(file),
+                    (GDestroyNotify) file_unref);
+  gst_object_unref(file->pad);
+
+  callbacks.eos = on_eos;
+  callbacks.new_sample = on_new_sample;
+  gst_app_sink_set_callbacks(GST_APP_SINK(sink),
+                             &callbacks,
+                             file,
+                             (GDestroyNotify) close_file);
+
+  return sink;
+}
+
+struct webrtc_disk_file *
+webrtc_disk_writer_open(WebrtcDiskWriter *self,
+                        const gchar *path,
+                        gboolean append,
+                        GError **error)
+{
+  g_return_val_if_fail(self != NULL, NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+
+  return open_file(self, path, append ? O_APPEND : O_TRUNC, error);
+}
+
+void
+webrtc_disk_file_write(struct webrtc_disk_file *file,
+                       gconstpointer data,
+                       gsize size)
+{
+  g_return_if_fail(file != NULL);
+
+  if (size == 0) {
+    return;
+  }
+
+  g_mutex_lock(&file->lock);
+  push_block(file, g_bytes_new(data, size));
+  g_mutex_unlock(&file->lock);
+}
+
+void
+webrtc_disk_file_close(struct webrtc_disk_file *file)
+{
+  if (file != NULL) {
+    finish(file);
+  }
+}
+
+void
+webrtc_disk_writer_set_limits(WebrtcDiskWriter *self,
+                              guint64 min_free,
+                              guint64 max_write)
+{
+  g_return_if_fail(self != NULL);
+
+  g_mutex_lock(&self->lock);
+  self->min_free = min_free;
+  self->max_write = max_write;
+  g_mutex_unlock(&self->lock);
+}
+
+enum webrtc_disk_state
+webrtc_disk_writer_watch(WebrtcDiskWriter *self, const gchar *dir)
+{
+  struct disk_dir *d;
+  enum webrtc_disk_state state;
+  gboolean checked;
+  gboolean changed = FALSE;
+  gchar *path;
+
+  g_return_val_if_fail(self != NULL, WEBRTC_DISK_STATE_OK);
+  g_return_val_if_fail(dir != NULL, WEBRTC_DISK_STATE_OK);
+
+  path = webrtc_disk_canonical_dir(dir);
+  g_mutex_lock(&self->lock);
+  checked = g_hash_table_contains(self->dirs, path);
+  d = lookup_dir(self, path);
+  g_mutex_unlock(&self->lock);
+
+  /* A new directory gets its state right away, later on from the timer */
+  if (!checked) {
+    guint64 avail = free_space(path);
+
+    g_mutex_lock(&self->lock);
+    d->free = avail;
+    changed = update_state(self, d);
+    g_mutex_unlock(&self->lock);
+  }
+
+  g_mutex_lock(&self->lock);
+  state = d->state;
+  g_mutex_unlock(&self->lock);
+
+  if (changed) {
+    emit_state_changed(self, path, state);
+  }
+  g_free(path);
+
+  return state;
+}
+
+gchar *
+webrtc_disk_canonical_dir(const gchar *dir)
+{
+  gchar *path;
+  gsize len;
+
+  g_return_val_if_fail(dir != NULL, NULL);
+
+  path = g_canonicalize_filename(dir, NULL);
+  len = strlen(path);
+  while (len > 1 && G_IS_DIR_SEPARATOR(path[len - 1])) {
+    path[--len] = '\0';
+  }
+
+  return path;
+}
+
+const gchar *
+webrtc_disk_state_name(enum webrtc_disk_state state)
+{
+  g_return_val_if_fail(state < G_N_ELEMENTS(state_names), NULL);
+
+  return state_names[state];
+}
+
+void
+webrtc_disk_writer_get_metrics(WebrtcDiskWriter *self,
+                               struct webrtc_disk_metrics *metrics)
+{
+  g_return_if_fail(self != NULL);
+  g_return_if_fail(metrics != NULL);
+
+  g_mutex_lock(&self->lock);
+  *metrics = self->metrics;
+  g_mutex_unlock(&self->lock);
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <glib.h>
+#include <glib-object.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+struct webrtc_disk_metrics {
+  guint files;          /* open */
+  guint queued;         /* full blocks waiting for a write, all files */
+  guint64 bytes;        /* written */
+  guint64 writes;       /* blocks written */
+  guint64 write_time;   /* us, spent in write() */
+  guint64 max_write;    /* us, slowest single write */
+  guint64 stalls;       /* times a recording waited for the disk */
+  guint64 errors;       /* failed writes, the block is dropped */
+  guint64 degraded;     /* times a directory left the ok state */
+  guint64 full;         /* times a directory became full */
+};
+
+/** A file written through the I/O threads without a sink */
+struct webrtc_disk_file;
+
+/** Health of a watched directory, worst last */
+enum webrtc_disk_state {
+  WEBRTC_DISK_STATE_OK = 0,
+  WEBRTC_DISK_STATE_SLOW, /* a write took or takes longer than max_write */
+  WEBRTC_DISK_STATE_LOW,  /* less than twice min_free left */
+  WEBRTC_DISK_STATE_FULL, /* less than min_free left or out of space */
+};
+
+/** Signal: state-changed
+ * on_state_changed(
+ *  WebrtcDiskWriter *self,
+ *  const gchar *dir,
+ *  guint state,
+ *  gpointer user_data
+ *);
+ *
+ * A watched directory changed its enum webrtc_disk_state
+ */
+
+/*
+ * Type declaration.
+ */
+
+#define WEBRTC_TYPE_DISK_WRITER webrtc_disk_writer_get_type()
+G_DECLARE_FINAL_TYPE(WebrtcDiskWriter,
+                     webrtc_disk_writer,
+                     WEBRTC,
+                     DISK_WRITER,
+                     GObject)
+
+/*
+ * Method definitions.
+ */
+
+/** Writes for all recordings go through a pool of threads I/O threads in
+ * blocks of block_size bytes, so that many concurrent files still give the
+ * disk long sequential writes. Must outlive the sinks it created. Returns
+ * NULL if the threads could not be created. */
+WebrtcDiskWriter *webrtc_disk_writer_new(guint threads,
+                                         gsize block_size,
+                                         GError **error);
+
+/** An appsink that writes what it gets to path through the writer, in place
+ * of a filesink. The file is flushed and closed on EOS or when the sink is
+ * destroyed. */
+GstElement *webrtc_disk_writer_sink(WebrtcDiskWriter *self,
+                                    const gchar *path,
+                                    GError **error);
+
+/** For small records written from the main loop, an index or a log. Writes
+ * are queued as they are and never wait for the disk, they go out in order
+ * but may not be on disk yet when the call returns. Must be closed before
+ * the writer is destroyed, which waits for the last writes. */
+struct webrtc_disk_file *webrtc_disk_writer_open(WebrtcDiskWriter *self,
+                                                 const gchar *path,
+                                                 gboolean append,
+                                                 GError **error);
+
+void webrtc_disk_file_write(struct webrtc_disk_file *file,
+                            gconstpointer data,
+                            gsize size);
+
+/** The file is closed after its queued writes */
+void webrtc_disk_file_close(struct webrtc_disk_file *file);
+
+/** min_free in bytes and max_write in us, 0 for no limit. A directory that
+ * ran out of space counts as full until some space is free again anyway. */
+void webrtc_disk_writer_set_limits(WebrtcDiskWriter *self,
+                                   guint64 min_free,
+                                   guint64 max_write);
+
+/** Checks dir from now on, the directories of the recordings are always
+ * checked. Returns the last known state. */
+enum webrtc_disk_state webrtc_disk_writer_watch(WebrtcDiskWriter *self,
+                                                const gchar *dir);
+
+/** dir as directories are known to the writer and in state-changed:
+ * absolute, without "." or ".." and without a trailing separator */
+gchar *webrtc_disk_canonical_dir(const gchar *dir);
+
+const gchar *webrtc_disk_state_name(enum webrtc_disk_state state);
+
+void webrtc_disk_writer_get_metrics(WebrtcDiskWriter *self,
+                                    struct webrtc_disk_metrics *metrics);
+
+G_END_DECLS
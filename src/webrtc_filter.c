@@ -0,0 +1,289 @@
+#include <glib.h>
+#include <string.h>
+
+#include "webrtc_filter.h"
+
+struct trie_node {
+  GHashTable *children; /* lower case byte -> struct trie_node, or NULL */
+  gboolean terminal;
+};
+
+struct field_rules {
+  GHashTable *exact;         /* lower case value */
+  struct trie_node prefixes; /* root, terminal for an empty prefix */
+  GPtrArray *globs;          /* GPatternSpec, lower case */
+};
+
+struct webrtc_filter {
+  struct field_rules fields[WEBRTC_FILTER_FIELD_LAST];
+  gboolean any;
+  guint size;
+};
+
+static const gchar *field_names[] = { "subject", "bearer", "trigger" };
+
+G_DEFINE_QUARK(webrtc-filter-error-quark, webrtc_filter_error)
+
+static void
+trie_clear(struct trie_node *node)
+{
+  g_clear_pointer(&node->children, g_hash_table_unref);
+}
+
+static void
+trie_free(struct trie_node *node)
+{
+  trie_clear(node);
+  g_free(node);
+}
+
+static void
+trie_insert(struct trie_node *root, const gchar *prefix)
+{
+  struct trie_node *node = root;
+
+  for (const gchar *c = prefix; *c != '\0'; c++) {
+    struct trie_node *next = NULL;
+    gpointer key = GUINT_TO_POINTER((guchar) *c);
+
+    if (node->children == NULL) {
+      node->children = g_hash_table_new_full(g_direct_hash,
+                                             g_direct_equal,
+                                             NULL,
+                                             (GDestroyNotify) trie_free);
+    } else {
+      next = g_hash_table_lookup(node->children, key);
+    }
+
+    if (next == NULL) {
+      next = g_malloc0(sizeof(*next));
+      g_hash_table_insert(node->children, key, next);
+    }
+    node = next;
+  }
+
+  node->terminal = TRUE;
+}
+
+/* TRUE if any inserted prefix is a prefix of value */
+static gboolean
+trie_match(const struct trie_node *root, const gchar *value)
+{
+  const struct trie_node *node = root;
+
+  for (const gchar *c = value; node != NULL; c++) {
+    if (node->terminal) {
+      return TRUE;
+    }
+
+    if (*c == '\0' || node->children == NULL) {
+      return FALSE;
+    }
+
+    node = g_hash_table_lookup(node->children,
+                               GUINT_TO_POINTER((guchar) *c));
+  }
+
+  return FALSE;
+}
+
+struct webrtc_filter *
+webrtc_filter_new(void)
+{
+  struct webrtc_filter *self = g_malloc0(sizeof(*self));
+
+  for (guint i = 0; i < WEBRTC_FILTER_FIELD_LAST; i++) {
+    self->fields[i].exact = g_hash_table_new_full(g_str_hash,
+                                                  g_str_equal,
+                                                  g_free,
+                                                  NULL);
+    self->fields[i].globs =
+            g_ptr_array_new_with_free_func((GDestroyNotify)
+                                                   g_pattern_spec_free);
+  }
+
+  return self;
+}
+
+void
+webrtc_filter_free(struct webrtc_filter *self)
+{
+  if (self == NULL) {
+    return;
+  }
+
+  for (guint i = 0; i < WEBRTC_FILTER_FIELD_LAST; i++) {
+    g_hash_table_unref(self->fields[i].exact);
+    trie_clear(&self->fields[i].prefixes);
+    g_ptr_array_unref(self->fields[i].globs);
+  }
+
+  g_free(self);
+}
+
+gboolean
+webrtc_filter_add(struct webrtc_filter *self,
+                  const gchar *rule,
+                  GError **error)
+{
+  enum webrtc_filter_field field = WEBRTC_FILTER_FIELD_SUBJECT;
+  gboolean qualified = FALSE;
+  struct field_rules *rules;
+  gchar *pattern;
+  const gchar *p;
+  gsize len;
+
+  g_return_val_if_fail(self != NULL, FALSE);
+  g_return_val_if_fail(rule != NULL, FALSE);
+
+  p = rule;
+  for (guint i = 0; i < G_N_ELEMENTS(field_names); i++) {
+    gsize n = strlen(field_names[i]);
+
+    if (g_ascii_strncasecmp(p, field_names[i], n) == 0 && p[n] == ':') {
+      field = i;
+      qualified = TRUE;
+      p += n + 1;
+      break;
+    }
+  }
+
+  pattern = g_ascii_strdown(p, -1);
+  g_strstrip(pattern);
+  len = strlen(pattern);
+
+  if (len == 0) {
+    g_set_error(error,
+                WEBRTC_FILTER_ERROR,
+                WEBRTC_FILTER_ERROR_INVALID,
+                "Empty filter rule: %s",
+                rule);
+    g_free(pattern);
+    return FALSE;
+  }
+
+  rules = &self->fields[field];
+  self->size++;
+
+  /* With a field, any value of it matches, as the empty prefix does */
+  if (g_strcmp0(pattern, "any") == 0 || g_strcmp0(pattern, "*") == 0) {
+    if (qualified) {
+      trie_insert(&rules->prefixes, "");
+    } else {
+      self->any = TRUE;
+    }
+    g_free(pattern);
+  } else if (strpbrk(pattern, "*?") == NULL) {
+    g_hash_table_add(rules->exact, pattern);
+  } else if (pattern[len - 1] == '*' &&
+             strpbrk(pattern, "*?") == pattern + len - 1) {
+    pattern[len - 1] = '\0';
+    trie_insert(&rules->prefixes, pattern);
+    g_free(pattern);
+  } else {
+    g_ptr_array_add(rules->globs, g_pattern_spec_new(pattern));
+    g_free(pattern);
+  }
+
+  return TRUE;
+}
+
+struct webrtc_filter *
+webrtc_filter_new_from_file(const gchar *path, GError **error)
+{
+  struct webrtc_filter *self;
+  gchar *content = NULL;
+  gchar **lines;
+
+  g_return_val_if_fail(path != NULL, NULL);
+
+  if (!g_file_get_contents(path, &content, NULL, error)) {
+    return NULL;
+  }
+
+  self = webrtc_filter_new();
+  lines = g_strsplit(content, "\n", -1);
+  for (guint i = 0; lines[i] != NULL; i++) {
+    gchar *line = g_strstrip(lines[i]);
+
+    if (*line == '\0' || *line == '#') {
+      continue;
+    }
+
+    if (!webrtc_filter_add(self, line, error)) {
+      g_prefix_error(error, "%s:%u: ", path, i + 1);
+      g_clear_pointer(&self, webrtc_filter_free);
+      break;
+    }
+  }
+
+  if (self != NULL && self->size == 0) {
+    g_warning("Filter: %s has no rules, every stream is accepted", path);
+  }
+
+  g_strfreev(lines);
+  g_free(content);
+
+  return self;
+}
+
+guint
+webrtc_filter_size(const struct webrtc_filter *self)
+{
+  g_return_val_if_fail(self != NULL, 0);
+
+  return self->size;
+}
+
+static gboolean
+match_field(const struct field_rules *rules, const gchar *value)
+{
+  gchar *lower;
+  gboolean ret = FALSE;
+
+  if (value == NULL) {
+    return FALSE;
+  }
+
+  lower = g_ascii_strdown(value, -1);
+
+  if (g_hash_table_contains(rules->exact, lower) ||
+      trie_match(&rules->prefixes, lower)) {
+    ret = TRUE;
+  }
+
+  for (guint i = 0; !ret && i < rules->globs->len; i++) {
+    ret = g_pattern_spec_match_string(rules->globs->pdata[i], lower);
+  }
+
+  g_free(lower);
+
+  return ret;
+}
+
+gboolean
+webrtc_filter_match(const struct webrtc_filter *self,
+                    const gchar *subject,
+                    const gchar *bearer_name,
+                    const gchar *trigger_type)
+{
+  const gchar *values[WEBRTC_FILTER_FIELD_LAST];
+
+  g_return_val_if_fail(self != NULL, FALSE);
+
+  if (self->any || self->size == 0) {
+    return TRUE;
+  }
+
+  values[WEBRTC_FILTER_FIELD_SUBJECT] = subject;
+  values[WEBRTC_FILTER_FIELD_BEARER_NAME] = bearer_name;
+  values[WEBRTC_FILTER_FIELD_TRIGGER_TYPE] = trigger_type;
+
+  for (guint i = 0; i < WEBRTC_FILTER_FIELD_LAST; i++) {
+    if (match_field(&self->fields[i], values[i])) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
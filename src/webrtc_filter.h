@@ -0,0 +1,53 @@
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define WEBRTC_FILTER_ERROR webrtc_filter_error_quark()
+
+enum webrtc_filter_error {
+  WEBRTC_FILTER_ERROR_INVALID = 0,
+};
+
+/** The event field a rule looks at */
+enum webrtc_filter_field {
+  WEBRTC_FILTER_FIELD_SUBJECT = 0,
+  WEBRTC_FILTER_FIELD_BEARER_NAME,
+  WEBRTC_FILTER_FIELD_TRIGGER_TYPE,
+  WEBRTC_FILTER_FIELD_LAST,
+};
+
+/** Compiled set of stream rules, a stream is accepted if any rule matches.
+ * Matching ignores ASCII case. Exact rules are looked up in a hash set and
+ * prefix rules in a trie, so only glob rules cost per rule. */
+struct webrtc_filter;
+
+GQuark webrtc_filter_error_quark(void);
+
+struct webrtc_filter *webrtc_filter_new(void);
+
+void webrtc_filter_free(struct webrtc_filter *self);
+
+/** A rule is "[subject|bearer|trigger:]PATTERN", subject if left out.
+ * PATTERN is exact, ends with a single * for a prefix, or is a glob with *
+ * and ? anywhere. "any" and "*" accept everything, after a field they
+ * accept every value of it. */
+gboolean webrtc_filter_add(struct webrtc_filter *self,
+                           const gchar *rule,
+                           GError **error);
+
+/** One rule per line, empty lines and lines starting with # are skipped.
+ * A file without rules is only warned about. */
+struct webrtc_filter *webrtc_filter_new_from_file(const gchar *path,
+                                                  GError **error);
+
+guint webrtc_filter_size(const struct webrtc_filter *self);
+
+/** A filter without rules accepts everything. NULL fields never match. */
+gboolean webrtc_filter_match(const struct webrtc_filter *self,
+                             const gchar *subject,
+                             const gchar *bearer_name,
+                             const gchar *trigger_type);
+
+G_END_DECLS
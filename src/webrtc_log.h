@@ -0,0 +1,99 @@
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define WEBRTC_LOG_ERROR webrtc_log_error_quark()
+
+enum webrtc_log_error {
+  WEBRTC_LOG_ERROR_INVALID = 0,
+};
+
+/** Where a line comes from, each has its own level */
+enum webrtc_log_category {
+  WEBRTC_LOG_SIGNALING = 0, /* websocket frames, auth and targets */
+  WEBRTC_LOG_SESSION,       /* negotiation, SDP and ICE of a session */
+  WEBRTC_LOG_PIPELINE,      /* elements, pads and bus messages */
+  WEBRTC_LOG_CATEGORY_LAST,
+};
+
+/** Most important first, a category logs its level and everything above */
+enum webrtc_log_level {
+  WEBRTC_LOG_LEVEL_ERROR = 0,
+  WEBRTC_LOG_LEVEL_WARNING,
+  WEBRTC_LOG_LEVEL_INFO,
+  WEBRTC_LOG_LEVEL_DEBUG,
+  WEBRTC_LOG_LEVEL_TRACE,
+  WEBRTC_LOG_LEVEL_LAST,
+};
+
+/* Per category, the least important level that is formatted at all. Read
+ * through webrtc_log_enabled(), written by webrtc_log_set_levels() and
+ * webrtc_log_set_trace(). */
+extern gint webrtc_log_thresholds[WEBRTC_LOG_CATEGORY_LAST];
+
+#define webrtc_log_enabled(category, level)                                    \
+  ((gint) (level) <= g_atomic_int_get(&webrtc_log_thresholds[(category)]))
+
+/* The arguments are only evaluated if the line is wanted, by the output or
+ * by the trace ring. Arguments that are expensive to build need their own
+ * webrtc_log_enabled() check. */
+#define WEBRTC_LOG(category, level, session, ...)                              \
+  G_STMT_START                                                                 \
+  {                                                                            \
+    if (webrtc_log_enabled((category), (level))) {                             \
+      webrtc_log_write((category), (level), (session), __VA_ARGS__);           \
+    }                                                                          \
+  }                                                                            \
+  G_STMT_END
+
+#define WEBRTC_LOG_WARNING(category, session, ...)                             \
+  WEBRTC_LOG((category), WEBRTC_LOG_LEVEL_WARNING, (session), __VA_ARGS__)
+#define WEBRTC_LOG_INFO(category, session, ...)                                \
+  WEBRTC_LOG((category), WEBRTC_LOG_LEVEL_INFO, (session), __VA_ARGS__)
+#define WEBRTC_LOG_DEBUG(category, session, ...)                               \
+  WEBRTC_LOG((category), WEBRTC_LOG_LEVEL_DEBUG, (session), __VA_ARGS__)
+#define WEBRTC_LOG_TRACE(category, session, ...)                               \
+  WEBRTC_LOG((category), WEBRTC_LOG_LEVEL_TRACE, (session), __VA_ARGS__)
+
+GQuark webrtc_log_error_quark(void);
+
+/** A comma separated list of "[CATEGORY=]LEVEL", a level without category
+ * or "*=LEVEL" applies to all categories, later entries win. NULL or an
+ * empty list restores the defaults, info everywhere. Nothing changes if the
+ * list is invalid. */
+gboolean webrtc_log_set_levels(const gchar *spec, GError **error);
+
+enum webrtc_log_level webrtc_log_get_level(enum webrtc_log_category category);
+
+/** Keeps the last size lines up to level in memory, whatever the output
+ * levels are, and writes them out with the next error. 0 disables it. */
+void webrtc_log_set_trace(guint size, enum webrtc_log_level level);
+
+/** Writes the trace ring out and empties it */
+void webrtc_log_dump_trace(void);
+
+/** Use the macros. Lines for a session are limited to a burst of
+ * WEBRTC_LOG_BURST and WEBRTC_LOG_RATE per second after that, errors are
+ * always written. Tokens, passwords and credentials are redacted. */
+void webrtc_log_write(enum webrtc_log_category category,
+                      enum webrtc_log_level level,
+                      const gchar *session,
+                      const gchar *format,
+                      ...) G_GNUC_PRINTF(4, 5);
+
+#define WEBRTC_LOG_BURST 100
+#define WEBRTC_LOG_RATE  20
+
+/** Drops the rate limit state of a session that ended. Sessions log under
+ * a key of their own, an id can be in use twice. */
+void webrtc_log_forget_session(const gchar *session);
+
+/** Copy of text with the values of secret JSON members and URL passwords
+ * replaced by "***" */
+gchar *webrtc_log_redact(const gchar *text);
+
+const gchar *webrtc_log_level_name(enum webrtc_log_level level);
+
+G_END_DECLS
@@ -0,0 +1,276 @@
+#include <glib.h>
+#include <string.h>
+
+#include "webrtc_metadata.h"
+
+enum field_type {
+  FIELD_U8 = 0,
+  FIELD_U16,
+  FIELD_U32,
+  FIELD_U64,
+  FIELD_I8,
+  FIELD_I16,
+  FIELD_I32,
+  FIELD_I64,
+  FIELD_F32,
+  FIELD_F64,
+};
+
+/* Indexed by enum field_type */
+static const struct {
+  const gchar *name;
+  gsize size;
+} types[] = {
+  { "u8", 1 },  { "u16", 2 }, { "u32", 4 }, { "u64", 8 }, { "i8", 1 },
+  { "i16", 2 }, { "i32", 4 }, { "i64", 8 }, { "f32", 4 }, { "f64", 8 },
+};
+
+struct field {
+  gchar *name;
+  enum field_type type;
+  gsize offset;
+};
+
+struct webrtc_metadata_schema {
+  GArray *fields; /* of struct field */
+  gsize size;
+};
+
+G_DEFINE_QUARK(webrtc-metadata-error-quark, webrtc_metadata_error)
+
+static void
+field_clear(gpointer data)
+{
+  struct field *field = data;
+
+  g_free(field->name);
+}
+
+static gboolean
+parse_field(const gchar *spec, struct field *field, GError **error)
+{
+  const gchar *colon = strchr(spec, ':');
+
+  if (colon == NULL || colon == spec) {
+    g_set_error(error,
+                WEBRTC_METADATA_ERROR,
+                WEBRTC_METADATA_ERROR_INVALID,
+                "Expected NAME:TYPE, got \"%s\"",
+                spec);
+    return FALSE;
+  }
+
+  for (const gchar *c = spec; c < colon; c++) {
+    if (*c == '=' || g_ascii_isspace(*c)) {
+      g_set_error(error,
+                  WEBRTC_METADATA_ERROR,
+                  WEBRTC_METADATA_ERROR_INVALID,
+                  "Invalid field name in \"%s\"",
+                  spec);
+      return FALSE;
+    }
+  }
+
+  for (guint i = 0; i < G_N_ELEMENTS(types); i++) {
+    if (g_ascii_strcasecmp(colon + 1, types[i].name) == 0) {
+      field->name = g_strndup(spec, colon - spec);
+      field->type = i;
+      return TRUE;
+    }
+  }
+
+  g_set_error(error,
+              WEBRTC_METADATA_ERROR,
+              WEBRTC_METADATA_ERROR_INVALID,
+              "Unknown type in \"%s\"",
+              spec);
+  return FALSE;
+}
+
+struct webrtc_metadata_schema *
+webrtc_metadata_schema_new(const gchar *spec, GError **error)
+{
+  struct webrtc_metadata_schema *self;
+  gchar **parts;
+
+  g_return_val_if_fail(spec != NULL, NULL);
+
+  self = g_malloc0(sizeof(*self));
+  self->fields = g_array_new(FALSE, TRUE, sizeof(struct field));
+  g_array_set_clear_func(self->fields, field_clear);
+
+  parts = g_strsplit(spec, ",", -1);
+  for (guint i = 0; parts[i] != NULL; i++) {
+    struct field field = { 0 };
+
+    g_strstrip(parts[i]);
+    if (!parse_field(parts[i], &field, error)) {
+      g_strfreev(parts);
+      webrtc_metadata_schema_free(self);
+      return NULL;
+    }
+
+    field.offset = self->size;
+    self->size += types[field.type].size;
+    g_array_append_val(self->fields, field);
+  }
+  g_strfreev(parts);
+
+  if (self->fields->len == 0) {
+    g_set_error(error,
+                WEBRTC_METADATA_ERROR,
+                WEBRTC_METADATA_ERROR_INVALID,
+                "No fields");
+    webrtc_metadata_schema_free(self);
+    return NULL;
+  }
+
+  return self;
+}
+
+void
+webrtc_metadata_schema_free(struct webrtc_metadata_schema *self)
+{
+  if (self == NULL) {
+    return;
+  }
+
+  g_array_unref(self->fields);
+  g_free(self);
+}
+
+gsize
+webrtc_metadata_schema_size(const struct webrtc_metadata_schema *self)
+{
+  g_return_val_if_fail(self != NULL, 0);
+
+  return self->size;
+}
+
+guint
+webrtc_metadata_schema_n_fields(const struct webrtc_metadata_schema *self)
+{
+  g_return_val_if_fail(self != NULL, 0);
+
+  return self->fields->len;
+}
+
+const gchar *
+webrtc_metadata_schema_field(const struct webrtc_metadata_schema *self,
+                             guint field)
+{
+  g_return_val_if_fail(self != NULL, NULL);
+  g_return_val_if_fail(field < self->fields->len, NULL);
+
+  return g_array_index(self->fields, struct field, field).name;
+}
+
+/* Records are not aligned, hence the copies */
+static gdouble
+read_field(const struct field *field, const guint8 *data)
+{
+  const guint8 *p = data + field->offset;
+  guint16 u16;
+  guint32 u32;
+  guint64 u64;
+  gfloat f32;
+  gdouble f64;
+
+  switch (field->type) {
+  case FIELD_U8:
+    return p[0];
+  case FIELD_I8:
+    return (gint8) p[0];
+  case FIELD_U16:
+  case FIELD_I16:
+    memcpy(&u16, p, sizeof(u16));
+    u16 = GUINT16_FROM_BE(u16);
+    return field->type == FIELD_U16 ? u16 : (gint16) u16;
+  case FIELD_U32:
+  case FIELD_I32:
+  case FIELD_F32:
+    memcpy(&u32, p, sizeof(u32));
+    u32 = GUINT32_FROM_BE(u32);
+    if (field->type == FIELD_F32) {
+      memcpy(&f32, &u32, sizeof(f32));
+      return f32;
+    }
+    return field->type == FIELD_U32 ? u32 : (gint32) u32;
+  case FIELD_U64:
+  case FIELD_I64:
+  case FIELD_F64:
+  default:
+    memcpy(&u64, p, sizeof(u64));
+    u64 = GUINT64_FROM_BE(u64);
+    if (field->type == FIELD_F64) {
+      memcpy(&f64, &u64, sizeof(f64));
+      return f64;
+    }
+    return field->type == FIELD_U64 ? u64 : (gint64) u64;
+  }
+}
+
+void
+webrtc_metadata_decode(const struct webrtc_metadata_schema *self,
+                       const guint8 *data,
+                       gdouble *values)
+{
+  g_return_if_fail(self != NULL);
+  g_return_if_fail(data != NULL);
+  g_return_if_fail(values != NULL);
+
+  for (guint i = 0; i < self->fields->len; i++) {
+    values[i] = read_field(&g_array_index(self->fields, struct field, i),
+                           data);
+  }
+}
+
+/* Appends as much of str as fits, keeping room for the NUL */
+static void
+append(gchar *buf, gsize size, gsize *len, const gchar *str)
+{
+  gsize n = strlen(str);
+
+  if (*len + 1 >= size) {
+    return;
+  }
+
+  n = MIN(n, size - *len - 1);
+  memcpy(buf + *len, str, n);
+  *len += n;
+  buf[*len] = '\0';
+}
+
+gsize
+webrtc_metadata_format(const struct webrtc_metadata_schema *self,
+                       const gdouble *values,
+                       gchar *buf,
+                       gsize size)
+{
+  gchar number[G_ASCII_DTOSTR_BUF_SIZE];
+  gsize len = 0;
+
+  g_return_val_if_fail(self != NULL, 0);
+  g_return_val_if_fail(values != NULL, 0);
+  g_return_val_if_fail(buf != NULL && size > 0, 0);
+
+  buf[0] = '\0';
+  for (guint i = 0; i < self->fields->len; i++) {
+    const struct field *field = &g_array_index(self->fields, struct field, i);
+
+    if (i > 0) {
+      append(buf, size, &len, " ");
+    }
+    append(buf, size, &len, field->name);
+    append(buf, size, &len, "=");
+    /* Not locale dependent, integers up to 2^53 without an exponent and
+     * floats without the digits they do not have */
+    g_ascii_formatd(number,
+                    sizeof(number),
+                    field->type == FIELD_F32 ? "%.7g" : "%.16g",
+                    values[i]);
+    append(buf, size, &len, number);
+  }
+
+  return len;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define WEBRTC_METADATA_ERROR webrtc_metadata_error_quark()
+
+enum webrtc_metadata_error {
+  WEBRTC_METADATA_ERROR_INVALID = 0,
+};
+
+/** Layout of the binary records devices send over the data channel, for
+ * example GPS positions or sensor readings. A message holds one or more
+ * records back to back. */
+struct webrtc_metadata_schema;
+
+GQuark webrtc_metadata_error_quark(void);
+
+/** spec is "NAME:TYPE,..." with TYPE one of u8, u16, u32, u64, i8, i16,
+ * i32, i64, f32 and f64, in network byte order, e.g.
+ * "time:u64,lat:f64,lon:f64,speed:f32" */
+struct webrtc_metadata_schema *webrtc_metadata_schema_new(const gchar *spec,
+                                                          GError **error);
+
+void webrtc_metadata_schema_free(struct webrtc_metadata_schema *self);
+
+/** Bytes of one record */
+gsize webrtc_metadata_schema_size(const struct webrtc_metadata_schema *self);
+
+guint
+webrtc_metadata_schema_n_fields(const struct webrtc_metadata_schema *self);
+
+const gchar *
+webrtc_metadata_schema_field(const struct webrtc_metadata_schema *self,
+                             guint field);
+
+/** Reads the record at data, which must hold at least the schema's size,
+ * into one value per field. 64 bit integers above 2^53 lose precision. */
+void webrtc_metadata_decode(const struct webrtc_metadata_schema *self,
+                            const guint8 *data,
+                            gdouble *values);
+
+/** Writes "NAME=VALUE ..." into buf, truncated to size including the
+ * terminating NUL. Returns the length without it. Neither allocates. */
+gsize webrtc_metadata_format(const struct webrtc_metadata_schema *self,
+                             const gdouble *values,
+                             gchar *buf,
+                             gsize size);
+
+G_END_DECLS
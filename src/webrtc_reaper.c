@@ -0,0 +1,219 @@
+#include <glib.h>
+#include <gst/gst.h>
+
+#include "webrtc_log.h"
+#include "webrtc_reaper.h"
+
+/* A pipeline on its way out */
+struct job {
+  GstElement *pipeline;
+  gchar *id;
+  gboolean drain;
+  GDestroyNotify done;
+  gpointer data;
+  GMainContext *context; /* done runs here */
+  gint64 queued;         /* monotonic us */
+};
+
+/* Protects metrics */
+static GMutex lock;
+static GCond idle;
+static struct webrtc_reaper_metrics metrics;
+
+static void
+job_free(gpointer data)
+{
+  struct job *job = data;
+
+  g_free(job->id);
+  g_main_context_unref(job->context);
+  g_free(job);
+}
+
+static gboolean
+finish(gpointer data)
+{
+  struct job *job = data;
+
+  job->done(job->data);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* FALSE if it did not get to EOS before the deadline of the job */
+static gboolean
+drain_pipeline(struct job *job)
+{
+  GstClockTime timeout = 0;
+  GstBus *bus;
+  GstMessage *msg;
+  gboolean drained = FALSE;
+  gint64 left;
+
+  /* The job may have waited for a thread */
+  left = job->queued + WEBRTC_REAPER_DRAIN_TIMEOUT / GST_USECOND -
+         g_get_monotonic_time();
+  if (left > 0) {
+    timeout = left * GST_USECOND;
+  }
+
+  bus = gst_element_get_bus(job->pipeline);
+  gst_element_send_event(job->pipeline, gst_event_new_eos());
+  msg = gst_bus_timed_pop_filtered(bus,
+                                   timeout,
+                                   GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  gst_object_unref(bus);
+
+  if (msg == NULL) {
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_PIPELINE,
+                       job->id,
+                       "No EOS within %" GST_TIME_FORMAT ", stopping anyway",
+                       GST_TIME_ARGS(WEBRTC_REAPER_DRAIN_TIMEOUT));
+    return FALSE;
+  }
+
+  if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+    GError *error = NULL;
+
+    gst_message_parse_error(msg, &error, NULL);
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_PIPELINE,
+                       job->id,
+                       "Error while draining: %s",
+                       error->message);
+    g_error_free(error);
+  } else {
+    drained = TRUE;
+  }
+  gst_message_unref(msg);
+
+  return drained;
+}
+
+static void
+teardown(struct job *job, G_GNUC_UNUSED gpointer user_data)
+{
+  gboolean drain = job->drain;
+  gboolean drained = FALSE;
+  gboolean playing = FALSE;
+  guint64 elapsed;
+  GSource *source;
+
+  /* Only a playing pipeline ever gets to EOS */
+  if (drain) {
+    GstState state;
+
+    gst_element_get_state(job->pipeline, &state, NULL, 0);
+    playing = state == GST_STATE_PLAYING;
+    drained = playing && drain_pipeline(job);
+  }
+
+  gst_element_set_state(job->pipeline, GST_STATE_NULL);
+  gst_object_unref(job->pipeline);
+
+  elapsed = g_get_monotonic_time() - job->queued;
+  WEBRTC_LOG_DEBUG(WEBRTC_LOG_PIPELINE,
+                   job->id,
+                   "Pipeline torn down in %" G_GUINT64_FORMAT " ms",
+                   elapsed / 1000);
+
+  /* Before pending drops, so that webrtc_reaper_wait() finds it. The job
+   * is not ours anymore after that. */
+  if (job->done != NULL) {
+    source = g_idle_source_new();
+    g_source_set_callback(source, finish, job, job_free);
+    g_source_attach(source, job->context);
+    g_source_unref(source);
+  } else {
+    job_free(job);
+  }
+
+  g_mutex_lock(&lock);
+  metrics.pending--;
+  metrics.total++;
+  if (drained) {
+    metrics.drained++;
+  } else if (drain && playing) {
+    metrics.drain_timeouts++;
+  } else if (drain) {
+    metrics.not_playing++;
+  }
+  metrics.teardown_time += elapsed;
+  metrics.max_teardown = MAX(metrics.max_teardown, elapsed);
+  metrics.last_teardown = elapsed;
+  g_cond_broadcast(&idle);
+  g_mutex_unlock(&lock);
+}
+
+/* The pool is created with the first pipeline and lives as long as the
+ * process */
+static GThreadPool *
+get_pool(void)
+{
+  static GThreadPool *pool;
+
+  if (g_once_init_enter(&pool)) {
+    GThreadPool *p = g_thread_pool_new((GFunc) teardown,
+                                       NULL,
+                                       WEBRTC_REAPER_THREADS,
+                                       FALSE,
+                                       NULL);
+
+    g_once_init_leave(&pool, p);
+  }
+
+  return pool;
+}
+
+void
+webrtc_reaper_push(GstElement *pipeline,
+                   const gchar *id,
+                   gboolean drain,
+                   GDestroyNotify done,
+                   gpointer data)
+{
+  struct job *job;
+
+  g_return_if_fail(GST_IS_ELEMENT(pipeline));
+
+  job = g_malloc0(sizeof(*job));
+  job->pipeline = pipeline;
+  job->id = g_strdup(id);
+  job->drain = drain;
+  job->done = done;
+  job->data = data;
+  job->context = g_main_context_ref_thread_default();
+  job->queued = g_get_monotonic_time();
+
+  g_mutex_lock(&lock);
+  metrics.pending++;
+  g_mutex_unlock(&lock);
+
+  g_thread_pool_push(get_pool(), job, NULL);
+}
+
+void
+webrtc_reaper_wait(void)
+{
+  GMainContext *context;
+
+  g_mutex_lock(&lock);
+  while (metrics.pending > 0) {
+    g_cond_wait(&idle, &lock);
+  }
+  g_mutex_unlock(&lock);
+
+  context = g_main_context_ref_thread_default();
+  while (g_main_context_iteration(context, FALSE)) {
+  }
+  g_main_context_unref(context);
+}
+
+void
+webrtc_reaper_get_metrics(struct webrtc_reaper_metrics *out)
+{
+  g_return_if_fail(out != NULL);
+
+  g_mutex_lock(&lock);
+  *out = metrics;
+  g_mutex_unlock(&lock);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <glib.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Waited for an EOS before a drained pipeline is stopped anyway, counted
+ * from the hand over */
+#define WEBRTC_REAPER_DRAIN_TIMEOUT (5 * GST_SECOND)
+
+/* Pipelines torn down at the same time */
+#define WEBRTC_REAPER_THREADS 4
+
+struct webrtc_reaper_metrics {
+  guint pending;           /* handed over, not torn down yet */
+  guint64 total;           /* pipelines torn down */
+  guint64 drained;         /* of which reached EOS first */
+  guint64 drain_timeouts;  /* of which were stopped without EOS */
+  guint64 not_playing;     /* of which had nothing to drain */
+  guint64 teardown_time;   /* us, from hand over to gone, all pipelines */
+  guint64 max_teardown;    /* us, slowest single teardown */
+  guint64 last_teardown;   /* us */
+};
+
+/** Takes pipeline and sets it to NULL on one of WEBRTC_REAPER_THREADS
+ * threads, so that slow teardowns of webrtcbin, nice agents, DTLS and
+ * decoders never block the main loop or each other. With drain an EOS goes
+ * through a playing pipeline first, so that muxers finish their files.
+ * The bus must not have a sync handler or watch anymore. id is for the
+ * log. done is called with data on the calling thread's main context once
+ * the pipeline is gone. */
+void webrtc_reaper_push(GstElement *pipeline,
+                        const gchar *id,
+                        gboolean drain,
+                        GDestroyNotify done,
+                        gpointer data);
+
+/** Blocks until every pipeline handed over is gone and runs the pending
+ * done callbacks of the calling thread's main context, for shutdown */
+void webrtc_reaper_wait(void);
+
+void webrtc_reaper_get_metrics(struct webrtc_reaper_metrics *out);
+
+G_END_DECLS
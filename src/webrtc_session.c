@@ -3,27 +3,84 @@
 #include <gio/gio.h>
 #include <gst/gst.h>
 #include <gst/pbutils/missing-plugins.h>
+#include <gst/rtp/rtp.h>
+#include <stdio.h>
 
 #define GST_USE_UNSTABLE_API
 #include <gst/webrtc/webrtc.h>
 
+#include "webrtc_codecs.h"
+#include "webrtc_log.h"
+#include "webrtc_metadata.h"
+#include "webrtc_reaper.h"
 #include "webrtc_session.h"
 #include "webrtc_settings.h"
-
-#define RTP_PAYLOAD_TYPE "96"
-#define STATS_INTERVAL   5
+#include "webrtc_threads.h"
+#include "webrtc_tracer.h"
+
+#define STATS_INTERVAL 5
+#define STREAMING_MESSAGE "webrtc-streaming"
+/* A degraded session is healthy again after this long without problems */
+#define DEGRADED_HOLD (10 * G_USEC_PER_SEC)
+/* A disconnected ICE transport often comes back by itself */
+#define ICE_DISCONNECTED_GRACE 3 /* s */
+#define ICE_RESTART_ATTEMPTS   4
+#define ICE_RESTART_BACKOFF    2 /* s, doubled with each attempt */
+/* A layer switch waits for the tiles to settle, and the sessions switching
+ * together ask their devices for new offers spread out over a while */
+#define LAYER_DEBOUNCE 2000 /* ms */
+#define LAYER_STAGGER  3000 /* ms */
+/* Quarters of the memory budget. Decoded video is by far the largest,
+ * the jitterbuffers hold their latency worth of the stream. */
+#define VIDEO_QUEUE_SHARE  2
+#define AUDIO_QUEUE_SHARE  1
+#define JITTER_SHARE       1
+#define MIN_JITTER_LATENCY 20 /* ms */
+/* Metadata records become subtitles from a fixed set of buffers, records
+ * arriving while all of them are queued are dropped */
+#define METADATA_TEXT_SIZE WEBRTC_SESSION_METADATA_SIZE
+#define METADATA_BUFFERS   16
+#define METADATA_DURATION  GST_SECOND
 
 struct signal {
   gulong id;
   GObject *obj;
 };
 
+struct latency_profile {
+  const gchar *name;
+  guint latency; /* ms */
+  gboolean drop_on_latency;
+  gint rtx_max_retries;
+};
+
+/* Indexed by enum webrtc_settings_latency_profile. The GUI wants frames on
+ * screen as soon as possible and rather skips a late frame, while the writer
+ * waits for retransmissions so that the recording is complete. Live still
+ * asks once for a lost packet, the answer often beats the latency. */
+static const struct latency_profile latency_profiles[] = {
+  { "live-low-latency", 50, TRUE, 0 },
+  { "balanced", 200, TRUE, 2 },
+  { "archival", 2000, FALSE, -1 },
+};
+
+/* Indexed by enum webrtc_session_health */
+static const gchar *health_names[] = {
+  "starting", "connecting", "streaming", "degraded", "failed",
+};
+
+/* Counts session keys, atomic */
+static gint key_serial;
+
 struct _WebrtcSession {
   GObject parent;
 
   WebrtcClient *protocol;
   WebrtcSettings *settings;
   gchar *id;
+  /* "<id>#<serial>", unique per object unlike the id, keys the log, CPU and
+   * tracer state of this session */
+  gchar *key;
   gchar *target;
   GPtrArray *video;
   GPtrArray *audio;
@@ -38,10 +95,53 @@ struct _WebrtcSession {
   GstElement *pipeline;
   GPtrArray *signals;
   GstPad *sinkpad;
+  GPtrArray *jitterbuffers; /* protected by lock */
+  GPtrArray *queues;        /* sized by the budget, protected by lock */
+  guint jitter_latency;     /* ms, capped by the budget, 0 if not */
+  guint64 memory_peak;      /* bytes */
+
+  struct webrtc_metadata_schema *metadata; /* NULL without one */
+  gdouble *metadata_values; /* of the last record, protected by lock */
+  GstElement *metadata_src; /* appsrc to the muxer, protected by lock */
+  GstBufferPool *metadata_pool;
+  guint64 metadata_records;  /* protected by lock */
+  guint64 metadata_invalid;
+  guint64 metadata_dropped;
+  GPtrArray *fec_decoders;  /* protected by lock */
+  const gchar *protection;
+  const struct latency_profile *profile;
+  GMutex lock;
+  GHashTable *payloads; /* pt -> const struct webrtc_codec, protected by lock */
+  enum webrtc_session_layer layer;    /* protected by lock */
+  enum webrtc_session_layer answered; /* last answered, protected by lock */
+  guint layer_timer;          /* renegotiates a layer switch */
+  gchar **rids;               /* simulcast video layers offered, best first */
+  GstElement *video_decoder;  /* protected by lock */
+  gint64 max_bitrate;         /* kbps, -1 if unlimited, protected by lock */
+  gint64 requested_bitrate;   /* kbps, last value sent to the device */
+  gboolean negotiated;        /* protected by lock */
+  GArray *remote_ssrcs;       /* protected by lock */
+  GObject *rtp_session;
+  gulong rtcp_handler;
+  gboolean streaming;
+  gint drop_audio; /* atomic */
+  gboolean drain;  /* EOS before the pipeline is stopped */
+  enum webrtc_session_health health; /* protected by lock */
+  gint64 degraded_time;              /* protected by lock, monotonic */
+  GMainContext *context;             /* health-changed is emitted here */
+  guint ice_timer;
+  guint ice_attempts;   /* restarts since the connection was lost */
+  gint64 outage_start;  /* monotonic, 0 while connected */
+  guint ice_restarts;
+  guint outages;
+  guint64 outage_time;   /* ms */
+  guint64 recovery_time; /* ms */
 
   GFileOutputStream *stats_out;
   guint stats_timer;
   gchar *stats_str;
+  struct webrtc_session_stats stats; /* protected by lock */
+  gint64 stats_time;
   GCancellable *cancel;
 };
 
@@ -59,6 +159,13 @@ static GParamSpec *obj_properties[N_PROPERTIES] = {
   NULL,
 };
 
+enum session_signals {
+  SIG_STREAMING = 0,
+  SIG_HEALTH_CHANGED,
+  SIG_LAST,
+};
+static guint session_signal_defs[SIG_LAST] = { 0 };
+
 static void
 connect(GPtrArray *signals,
         GObject *obj,
@@ -76,6 +183,240 @@ connect(GPtrArray *signals,
   g_ptr_array_add(signals, s);
 }
 
+/* Always from an idle, also on the main thread, so that no handler runs
+ * inside a caller that still uses the session */
+static void
+run_on_context(WebrtcSession *self,
+               GSourceFunc func,
+               gpointer data,
+               GDestroyNotify notify)
+{
+  GSource *source;
+
+  source = g_idle_source_new();
+  g_source_set_priority(source, G_PRIORITY_DEFAULT);
+  g_source_set_callback(source, func, data, notify);
+  g_source_attach(source, self->context);
+  g_source_unref(source);
+}
+
+struct health_change {
+  WebrtcSession *self;
+  enum webrtc_session_health health;
+  gchar *reason;
+};
+
+static void
+health_change_free(gpointer data)
+{
+  struct health_change *change = data;
+
+  g_object_unref(change->self);
+  g_free(change->reason);
+  g_free(change);
+}
+
+static gboolean
+emit_health_changed(gpointer data)
+{
+  struct health_change *change = data;
+  WebrtcSession *self = change->self;
+
+  WEBRTC_LOG_INFO(WEBRTC_LOG_SESSION,
+                  self->key,
+                  "%s: %s",
+                  health_names[change->health],
+                  change->reason);
+
+  if (change->health == WEBRTC_SESSION_HEALTH_STREAMING && !self->streaming) {
+    self->streaming = TRUE;
+    g_signal_emit(self, session_signal_defs[SIG_STREAMING], 0);
+  }
+
+  g_signal_emit(self,
+                session_signal_defs[SIG_HEALTH_CHANGED],
+                0,
+                change->health,
+                change->reason);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Any thread. Only transitions are passed on to the main context, failed
+ * is final and degradation only counts once media flows. */
+static void
+set_health(WebrtcSession *self,
+           enum webrtc_session_health health,
+           const gchar *reason)
+{
+  struct health_change *change;
+  enum webrtc_session_health old;
+
+  g_mutex_lock(&self->lock);
+  old = self->health;
+  if (health == WEBRTC_SESSION_HEALTH_DEGRADED) {
+    self->degraded_time = g_get_monotonic_time();
+  }
+  if (old == health || old == WEBRTC_SESSION_HEALTH_FAILED ||
+      (health == WEBRTC_SESSION_HEALTH_DEGRADED &&
+       old != WEBRTC_SESSION_HEALTH_STREAMING) ||
+      (health == WEBRTC_SESSION_HEALTH_CONNECTING &&
+       old != WEBRTC_SESSION_HEALTH_STARTING)) {
+    g_mutex_unlock(&self->lock);
+    return;
+  }
+  self->health = health;
+  g_mutex_unlock(&self->lock);
+
+  change = g_malloc0(sizeof(*change));
+  change->self = g_object_ref(self);
+  change->health = health;
+  change->reason = g_strdup(reason);
+  run_on_context(self, emit_health_changed, change, health_change_free);
+}
+
+/* Main loop, with the stats */
+static void
+recover_health(WebrtcSession *self)
+{
+  gboolean recovered;
+
+  g_mutex_lock(&self->lock);
+  recovered = self->health == WEBRTC_SESSION_HEALTH_DEGRADED &&
+              g_get_monotonic_time() - self->degraded_time >= DEGRADED_HOLD;
+  g_mutex_unlock(&self->lock);
+
+  if (recovered) {
+    set_health(self, WEBRTC_SESSION_HEALTH_STREAMING, "recovered");
+  }
+}
+
+/* Asks the device for a new offer, with new ICE credentials it restarts ICE
+ * through on_sdp() and on_answer_created() on the running pipeline */
+static gboolean
+restart_ice(gpointer user_data)
+{
+  WebrtcSession *self = WEBRTC_SESSION(user_data);
+  guint backoff;
+
+  self->ice_timer = 0;
+
+  if (self->outage_start == 0) {
+    return G_SOURCE_REMOVE;
+  }
+
+  if (self->ice_attempts >= ICE_RESTART_ATTEMPTS) {
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SESSION,
+                       self->key,
+                       "ICE did not recover after %u restarts",
+                       self->ice_attempts);
+    set_health(self, WEBRTC_SESSION_HEALTH_FAILED, "ICE restart failed");
+    return G_SOURCE_REMOVE;
+  }
+
+  self->ice_attempts++;
+  self->ice_restarts++;
+  WEBRTC_LOG_INFO(WEBRTC_LOG_SESSION,
+                  self->key,
+                  "ICE restart %u of %u",
+                  self->ice_attempts,
+                  ICE_RESTART_ATTEMPTS);
+  webrtc_client_init_session(self->protocol,
+                             self->target,
+                             self->settings,
+                             self->id);
+
+  backoff = ICE_RESTART_BACKOFF << (self->ice_attempts - 1);
+  self->ice_timer = g_timeout_add_seconds(backoff, restart_ice, self);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+ice_lost(WebrtcSession *self, guint delay, const gchar *reason)
+{
+  if (self->outage_start == 0) {
+    self->outage_start = g_get_monotonic_time();
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SESSION, self->key, "%s", reason);
+    set_health(self, WEBRTC_SESSION_HEALTH_DEGRADED, reason);
+  }
+
+  if (self->ice_timer == 0) {
+    self->ice_timer = g_timeout_add_seconds(delay, restart_ice, self);
+  }
+}
+
+static void
+ice_connected(WebrtcSession *self)
+{
+  guint64 outage;
+
+  if (self->outage_start == 0) {
+    return;
+  }
+
+  outage = (g_get_monotonic_time() - self->outage_start) / 1000;
+  self->outages++;
+  self->outage_time += outage;
+  self->recovery_time = outage;
+  WEBRTC_LOG_INFO(WEBRTC_LOG_SESSION,
+                  self->key,
+                  "ICE recovered after %" G_GUINT64_FORMAT " ms, %u restarts",
+                  outage,
+                  self->ice_attempts);
+
+  self->outage_start = 0;
+  self->ice_attempts = 0;
+  g_clear_handle_id(&self->ice_timer, g_source_remove);
+
+  if (self->streaming) {
+    set_health(self, WEBRTC_SESSION_HEALTH_STREAMING, "ICE recovered");
+  }
+}
+
+/* Main loop */
+static gboolean
+check_ice(gpointer user_data)
+{
+  WebrtcSession *self = WEBRTC_SESSION(user_data);
+  GstWebRTCICEConnectionState state;
+
+  if (self->pipeline == NULL) {
+    return G_SOURCE_REMOVE;
+  }
+
+  g_object_get(self->webrtc_bin, "ice-connection-state", &state, NULL);
+  WEBRTC_LOG_DEBUG(WEBRTC_LOG_SESSION, self->key, "ICE state %d", state);
+
+  switch (state) {
+  case GST_WEBRTC_ICE_CONNECTION_STATE_CONNECTED:
+  case GST_WEBRTC_ICE_CONNECTION_STATE_COMPLETED:
+    ice_connected(self);
+    break;
+  case GST_WEBRTC_ICE_CONNECTION_STATE_DISCONNECTED:
+    ice_lost(self, ICE_DISCONNECTED_GRACE, "ICE disconnected");
+    break;
+  case GST_WEBRTC_ICE_CONNECTION_STATE_FAILED:
+    ice_lost(self, 0, "ICE failed");
+    break;
+  default:
+    break;
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+/* webrtcbin thread */
+static void
+on_ice_connection_state(G_GNUC_UNUSED GstElement *webrtcbin,
+                        G_GNUC_UNUSED GParamSpec *pspec,
+                        gpointer user_data)
+{
+  WebrtcSession *self = WEBRTC_SESSION(user_data);
+
+  run_on_context(self, check_ice, g_object_ref(self), g_object_unref);
+}
+
 static void
 on_new_server_list(G_GNUC_UNUSED WebrtcClient *source,
                    const gchar *session_id,
@@ -88,10 +429,10 @@ on_new_server_list(G_GNUC_UNUSED WebrtcClient *source,
   if (g_strcmp0(self->id, session_id) != 0) {
     return;
   }
-  g_message("Session %s: Setting server lists", session_id);
+  WEBRTC_LOG_DEBUG(WEBRTC_LOG_SESSION, session_id, "Setting server lists");
 
   if (self->webrtc_bin == NULL) {
-    g_warning("Session %s: No gst bin", session_id);
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SESSION, session_id, "No gst bin");
     return;
   }
 
@@ -103,10 +444,241 @@ on_new_server_list(G_GNUC_UNUSED WebrtcClient *source,
     gboolean ret;
     g_signal_emit_by_name(self->webrtc_bin, "add-turn-server", turn[i], &ret);
     if (ret == FALSE) {
-      g_warning("Session %s: Failed to set turn server %s",
-                session_id,
-                turn[i]);
+      WEBRTC_LOG_WARNING(WEBRTC_LOG_SESSION,
+                         session_id,
+                         "Failed to set turn server %s",
+                         turn[i]);
+    }
+  }
+}
+
+static const gchar *
+find_protection(const GstSDPMessage *sdp)
+{
+  gboolean rtx = FALSE;
+  gboolean fec = FALSE;
+
+  for (guint i = 0; i < gst_sdp_message_medias_len(sdp); i++) {
+    const GstSDPMedia *media = gst_sdp_message_get_media(sdp, i);
+
+    for (guint j = 0; j < gst_sdp_media_attributes_len(media); j++) {
+      const GstSDPAttribute *attr = gst_sdp_media_get_attribute(media, j);
+      const gchar *enc;
+
+      if (g_strcmp0(attr->key, "rtpmap") != 0 || attr->value == NULL) {
+        continue;
+      }
+
+      /* a=rtpmap:<pt> <encoding>/<clock rate> */
+      enc = strchr(attr->value, ' ');
+      if (enc == NULL) {
+        continue;
+      }
+      enc++;
+
+      if (g_ascii_strncasecmp(enc, "rtx/", 4) == 0) {
+        rtx = TRUE;
+      } else if (g_ascii_strncasecmp(enc, "ulpfec/", 7) == 0) {
+        fec = TRUE;
+      }
+    }
+  }
+
+  if (rtx && fec) {
+    return "rtx+ulpfec";
+  } else if (rtx) {
+    return "rtx";
+  } else if (fec) {
+    return "ulpfec";
+  }
+
+  return "none";
+}
+
+struct layer {
+  const gchar *rid;
+  guint index;    /* position in a=simulcast */
+  gint64 pixels;  /* max-width * max-height, 0 if not restricted */
+  gint64 bitrate; /* max-br, 0 if not restricted */
+};
+
+/* a=rid:<rid> send [pt=<fmt>;]<restriction>=<value>;... (RFC 8851) */
+static void
+find_restrictions(const GstSDPMedia *media, struct layer *layer)
+{
+  gint64 width = 0;
+  gint64 height = 0;
+
+  for (guint i = 0; i < gst_sdp_media_attributes_len(media); i++) {
+    const GstSDPAttribute *attr = gst_sdp_media_get_attribute(media, i);
+    gchar **fields;
+
+    if (g_strcmp0(attr->key, "rid") != 0 || attr->value == NULL) {
+      continue;
+    }
+
+    fields = g_strsplit(attr->value, " ", 3);
+    if (g_strv_length(fields) == 3 && g_strcmp0(fields[0], layer->rid) == 0 &&
+        g_strcmp0(fields[1], "send") == 0) {
+      gchar **params = g_strsplit(fields[2], ";", -1);
+
+      for (guint j = 0; params[j] != NULL; j++) {
+        gchar **pair = g_strsplit(g_strstrip(params[j]), "=", 2);
+
+        if (g_strv_length(pair) == 2) {
+          gint64 val = g_ascii_strtoll(pair[1], NULL, 10);
+
+          if (g_strcmp0(pair[0], "max-width") == 0) {
+            width = val;
+          } else if (g_strcmp0(pair[0], "max-height") == 0) {
+            height = val;
+          } else if (g_strcmp0(pair[0], "max-br") == 0) {
+            layer->bitrate = val;
+          }
+        }
+        g_strfreev(pair);
+      }
+      g_strfreev(params);
+    }
+    g_strfreev(fields);
+  }
+
+  layer->pixels = MAX(width, 0) * MAX(height, 0);
+}
+
+static gint
+compare_layers(gconstpointer a, gconstpointer b)
+{
+  const struct layer *la = *(const struct layer **) a;
+  const struct layer *lb = *(const struct layer **) b;
+
+  if (la->pixels != lb->pixels) {
+    return la->pixels > lb->pixels ? -1 : 1;
+  }
+  if (la->bitrate != lb->bitrate) {
+    return la->bitrate > lb->bitrate ? -1 : 1;
+  }
+
+  return la->index < lb->index ? -1 : la->index > lb->index;
+}
+
+/* a=simulcast:send <rid>[,<alt>][;<rid>...], a leading ~ marks a paused
+ * stream. Only the first alternative of each stream is kept. The simulcast
+ * order is a preference, not a size, so the streams are sorted by the
+ * max-width, max-height and max-br of their a=rid lines. Streams without
+ * restrictions keep the offered order, restricted is set if any had one. */
+static gchar **
+find_simulcast(const GstSDPMessage *sdp, gboolean *restricted)
+{
+  *restricted = FALSE;
+
+  for (guint i = 0; i < gst_sdp_message_medias_len(sdp); i++) {
+    const GstSDPMedia *media = gst_sdp_message_get_media(sdp, i);
+    const gchar *simulcast;
+    GPtrArray *layers;
+    GStrvBuilder *builder;
+    gchar **streams;
+    gchar **rids;
+
+    if (g_strcmp0(gst_sdp_media_get_media(media), "video") != 0) {
+      continue;
+    }
+
+    simulcast = gst_sdp_media_get_attribute_val(media, "simulcast");
+    if (simulcast == NULL || !g_str_has_prefix(simulcast, "send ")) {
+      return NULL;
+    }
+
+    layers = g_ptr_array_new_with_free_func(g_free);
+    streams = g_strsplit(simulcast + strlen("send "), ";", -1);
+    for (guint j = 0; streams[j] != NULL; j++) {
+      gchar *alt = g_strstrip(streams[j]);
+      struct layer *layer;
+
+      alt[strcspn(alt, ",")] = '\0';
+      if (*alt == '~') {
+        alt++;
+      }
+      if (*alt == '\0') {
+        continue;
+      }
+
+      layer = g_new0(struct layer, 1);
+      layer->rid = alt;
+      layer->index = layers->len;
+      find_restrictions(media, layer);
+      *restricted |= layer->pixels > 0 || layer->bitrate > 0;
+      g_ptr_array_add(layers, layer);
+    }
+
+    g_ptr_array_sort(layers, compare_layers);
+    builder = g_strv_builder_new();
+    for (guint j = 0; j < layers->len; j++) {
+      g_strv_builder_add(builder, ((struct layer *) layers->pdata[j])->rid);
+    }
+    rids = g_strv_builder_end(builder);
+    g_ptr_array_unref(layers);
+    g_strfreev(streams);
+
+    return rids;
+  }
+
+  return NULL;
+}
+
+/* webrtcbin can not demux several simulcast streams on one transceiver,
+ * so only the selected layer is accepted and the device sends just that */
+static void
+restrict_simulcast(WebrtcSession *self, GstSDPMessage *answer)
+{
+  enum webrtc_session_layer layer;
+  const gchar *rid;
+  gchar *val;
+
+  if (self->rids == NULL || g_strv_length(self->rids) == 0) {
+    return;
+  }
+
+  g_mutex_lock(&self->lock);
+  layer = self->layer;
+  self->answered = layer;
+  g_mutex_unlock(&self->lock);
+
+  if (layer == WEBRTC_SESSION_LAYER_LOW) {
+    rid = self->rids[g_strv_length(self->rids) - 1];
+  } else {
+    rid = self->rids[0];
+  }
+
+  for (guint i = 0; i < gst_sdp_message_medias_len(answer); i++) {
+    GstSDPMedia *media = (GstSDPMedia *) gst_sdp_message_get_media(answer, i);
+
+    if (g_strcmp0(gst_sdp_media_get_media(media), "video") != 0) {
+      continue;
     }
+
+    for (guint j = gst_sdp_media_attributes_len(media); j > 0; j--) {
+      const GstSDPAttribute *attr = gst_sdp_media_get_attribute(media, j - 1);
+
+      if (g_strcmp0(attr->key, "rid") == 0 ||
+          g_strcmp0(attr->key, "simulcast") == 0) {
+        gst_sdp_media_remove_attribute(media, j - 1);
+      }
+    }
+
+    val = g_strdup_printf("%s recv", rid);
+    gst_sdp_media_add_attribute(media, "rid", val);
+    g_free(val);
+
+    val = g_strdup_printf("recv %s", rid);
+    gst_sdp_media_add_attribute(media, "simulcast", val);
+    g_free(val);
+
+    WEBRTC_LOG_INFO(WEBRTC_LOG_SESSION,
+                    self->key,
+                    "Receiving simulcast layer %s",
+                    rid);
+    return;
   }
 }
 
@@ -119,16 +691,18 @@ on_answer_created(GstPromise *promise, gpointer user_data)
   gchar *sdp_text = NULL;
   GstWebRTCSessionDescription *answer = NULL;
 
-  g_message("Answer created");
+  WEBRTC_LOG_DEBUG(WEBRTC_LOG_SESSION, self->key, "Answer created");
 
   res = gst_promise_wait(promise);
   if (res != GST_PROMISE_RESULT_REPLIED) {
     switch (res) {
     case GST_PROMISE_RESULT_INTERRUPTED:
-      g_warning("Session %s: SDP request was interrupted", self->id);
+      WEBRTC_LOG_WARNING(WEBRTC_LOG_SESSION,
+                         self->key,
+                         "SDP request was interrupted");
       break;
     case GST_PROMISE_RESULT_EXPIRED:
-      g_warning("Session %s: SDP request expired", self->id);
+      WEBRTC_LOG_WARNING(WEBRTC_LOG_SESSION, self->key, "SDP request expired");
       break;
     default:
       g_error("Session %s: Unknown error while receiving SDP answer", self->id);
@@ -140,9 +714,15 @@ on_answer_created(GstPromise *promise, gpointer user_data)
 
   reply = gst_promise_get_reply(promise);
 
-  gchar *str = gst_structure_to_string(reply);
-  g_message("Answer struct created: %s", str);
-  g_free(str);
+  if (webrtc_log_enabled(WEBRTC_LOG_SESSION, WEBRTC_LOG_LEVEL_TRACE)) {
+    gchar *str = gst_structure_to_string(reply);
+
+    WEBRTC_LOG_TRACE(WEBRTC_LOG_SESSION,
+                     self->key,
+                     "Answer struct created: %s",
+                     str);
+    g_free(str);
+  }
 
   gst_structure_get(reply,
                     "answer",
@@ -151,10 +731,14 @@ on_answer_created(GstPromise *promise, gpointer user_data)
                     NULL);
 
   if (answer == NULL) {
-    g_warning("DID NOT GET A PROPER ANSWER");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SESSION, self->key, "No answer was created");
     return;
   }
-  g_message("Setting answer as local description?");
+  WEBRTC_LOG_DEBUG(WEBRTC_LOG_SESSION,
+                   self->key,
+                   "Setting answer as local description");
+
+  restrict_simulcast(self, answer->sdp);
 
   g_signal_emit_by_name(self->webrtc_bin,
                         "set-local-description",
@@ -162,12 +746,22 @@ on_answer_created(GstPromise *promise, gpointer user_data)
                         NULL);
 
   sdp_text = gst_sdp_message_as_text(answer->sdp);
-  g_message("SDP TEXT: %s", sdp_text);
+  WEBRTC_LOG_TRACE(WEBRTC_LOG_SESSION, self->key, "SDP answer: %s", sdp_text);
+
+  self->protection = find_protection(answer->sdp);
+  WEBRTC_LOG_INFO(WEBRTC_LOG_SESSION,
+                  self->key,
+                  "Loss protection: %s",
+                  self->protection);
 
   webrtc_client_send_sdp_answer(self->protocol,
                                 self->target,
                                 self->id,
                                 sdp_text);
+  g_mutex_lock(&self->lock);
+  self->negotiated = TRUE;
+  g_mutex_unlock(&self->lock);
+  set_health(self, WEBRTC_SESSION_HEALTH_CONNECTING, "answer sent");
   g_free(sdp_text);
   gst_promise_unref(promise);
 
@@ -181,16 +775,18 @@ on_desc_set(GstPromise *promise, gpointer user_data)
   GstPromiseResult res;
   GstPromise *promise_answer;
 
-  g_message("Description set");
+  WEBRTC_LOG_DEBUG(WEBRTC_LOG_SESSION, self->key, "Description set");
 
   res = gst_promise_wait(promise);
   if (res != GST_PROMISE_RESULT_REPLIED) {
     switch (res) {
     case GST_PROMISE_RESULT_INTERRUPTED:
-      g_warning("Session %s: SDP set was interrupted", self->id);
+      WEBRTC_LOG_WARNING(WEBRTC_LOG_SESSION,
+                         self->key,
+                         "SDP set was interrupted");
       break;
     case GST_PROMISE_RESULT_EXPIRED:
-      g_warning("Session %s: SDP set expired", self->id);
+      WEBRTC_LOG_WARNING(WEBRTC_LOG_SESSION, self->key, "SDP set expired");
       break;
     default:
       g_error("Session %s: Unknown error while receiving setting description",
@@ -202,7 +798,7 @@ on_desc_set(GstPromise *promise, gpointer user_data)
   }
 
   /* Initiate returning an SDP answer */
-  g_message("Creating answer");
+  WEBRTC_LOG_DEBUG(WEBRTC_LOG_SESSION, self->key, "Creating answer");
   promise_answer =
           gst_promise_new_with_change_func(on_answer_created, self, NULL);
   g_signal_emit_by_name(self->webrtc_bin,
@@ -222,24 +818,50 @@ on_sdp(G_GNUC_UNUSED WebrtcClient *source,
   GstSDPMessage *msg;
   GstSDPResult res;
   GstPromise *promise;
+  GHashTable *payloads;
+  GHashTable *old_payloads;
+  gboolean restricted;
 
   if (g_strcmp0(self->id, session_id) != 0) {
     return;
   }
 
-  g_message("Session %s: Setting sdp", session_id);
+  WEBRTC_LOG_DEBUG(WEBRTC_LOG_SESSION, session_id, "Setting sdp");
+  WEBRTC_LOG_TRACE(WEBRTC_LOG_SESSION, session_id, "SDP offer: %s", sdp);
 
   if (self->webrtc_bin == NULL) {
-    g_warning("Session %s: No gst bin", session_id);
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SESSION, session_id, "No gst bin");
     return;
   }
 
   res = gst_sdp_message_new_from_text(sdp, &msg);
   if (res != GST_SDP_OK) {
-    g_warning("Session %s: Invalid SDP", session_id);
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SESSION, session_id, "Invalid SDP");
     return;
   }
 
+  /* Devices are free to pick their own payload numbers, a re-offer may
+   * pick new ones while the streaming threads look them up */
+  payloads = webrtc_codec_map_from_sdp(msg);
+  g_mutex_lock(&self->lock);
+  old_payloads = g_steal_pointer(&self->payloads);
+  self->payloads = payloads;
+  g_mutex_unlock(&self->lock);
+  g_clear_pointer(&old_payloads, g_hash_table_unref);
+
+  g_strfreev(self->rids);
+  self->rids = find_simulcast(msg, &restricted);
+  if (self->rids != NULL) {
+    gchar *layers = g_strjoinv(",", self->rids);
+
+    WEBRTC_LOG_INFO(WEBRTC_LOG_SESSION,
+                    session_id,
+                    "Device offers simulcast layers %s, %s",
+                    layers,
+                    restricted ? "largest first" : "in offered order");
+    g_free(layers);
+  }
+
   promise = gst_promise_new_with_change_func(on_desc_set, self, NULL);
   desc = gst_webrtc_session_description_new(GST_WEBRTC_SDP_TYPE_OFFER, msg);
   g_signal_emit_by_name(self->webrtc_bin,
@@ -263,10 +885,13 @@ on_new_candidate(G_GNUC_UNUSED WebrtcClient *source,
   if (g_strcmp0(self->id, session_id) != 0) {
     return;
   }
-  g_message("Session %s: Adding ice candidate", session_id);
+  WEBRTC_LOG_DEBUG(WEBRTC_LOG_SESSION,
+                   session_id,
+                   "Adding ice candidate %s",
+                   candidate);
 
   if (self->webrtc_bin == NULL) {
-    g_warning("Session %s: No gst bin", session_id);
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SESSION, session_id, "No gst bin");
     return;
   }
 
@@ -278,57 +903,196 @@ on_new_candidate(G_GNUC_UNUSED WebrtcClient *source,
 }
 
 static gboolean
-bus_call(G_GNUC_UNUSED GstBus *bus, GstMessage *msg, gpointer user_data)
+recalculate_latency(gpointer user_data)
+{
+  gst_bin_recalculate_latency(GST_BIN(user_data));
+
+  return G_SOURCE_REMOVE;
+}
+
+/* With a reference, NULL without an object */
+static GstObject *
+top_level(GstObject *object)
+{
+  GstObject *parent;
+
+  if (object == NULL) {
+    return NULL;
+  }
+
+  object = gst_object_ref(object);
+  while ((parent = gst_object_get_parent(object)) != NULL) {
+    gst_object_unref(object);
+    object = parent;
+  }
+
+  return object;
+}
+
+/* Whichever thread posted the message, mostly streaming threads. Messages
+ * are classified and dropped here, the main context only sees health
+ * transitions and latency recalculation. */
+static GstBusSyncReply
+bus_sync_handler(G_GNUC_UNUSED GstBus *bus, GstMessage *msg, gpointer user_data)
 {
   WebrtcSession *self = WEBRTC_SESSION(user_data);
 
   switch (GST_MESSAGE_TYPE(msg)) {
   case GST_MESSAGE_EOS:
-    g_print("End of stream\n");
+    WEBRTC_LOG_INFO(WEBRTC_LOG_PIPELINE, self->key, "End of stream");
 
     break;
 
   case GST_MESSAGE_LATENCY: {
-    g_info("Recalculating latency");
-    gst_bin_recalculate_latency(GST_BIN(self->pipeline));
+    GstObject *pipeline;
+
+    /* Queries the whole pipeline, not from a streaming thread. Stopping
+     * hands self->pipeline to the reaper, so it is found from the source,
+     * which holds its parents. */
+    WEBRTC_LOG_DEBUG(WEBRTC_LOG_PIPELINE, self->key, "Recalculating latency");
+    pipeline = top_level(GST_MESSAGE_SRC(msg));
+    if (pipeline != NULL && GST_IS_PIPELINE(pipeline)) {
+      g_main_context_invoke_full(self->context,
+                                 G_PRIORITY_DEFAULT,
+                                 recalculate_latency,
+                                 g_steal_pointer(&pipeline),
+                                 gst_object_unref);
+    }
+    g_clear_pointer(&pipeline, gst_object_unref);
 
     break;
   }
   case GST_MESSAGE_STATE_CHANGED: {
     GstState old_state, new_state;
 
+    if (!webrtc_log_enabled(WEBRTC_LOG_PIPELINE, WEBRTC_LOG_LEVEL_TRACE)) {
+      break;
+    }
+
     gst_message_parse_state_changed(msg, &old_state, &new_state, NULL);
-    g_print("Element %s changed state from %s to %s.\n",
-            GST_OBJECT_NAME(msg->src),
-            gst_element_state_get_name(old_state),
-            gst_element_state_get_name(new_state));
+    WEBRTC_LOG_TRACE(WEBRTC_LOG_PIPELINE,
+                     self->key,
+                     "Element %s changed state from %s to %s",
+                     GST_OBJECT_NAME(msg->src),
+                     gst_element_state_get_name(old_state),
+                     gst_element_state_get_name(new_state));
     break;
   }
+  case GST_MESSAGE_STREAM_STATUS: {
+    GstStreamStatusType type;
+    GstElement *owner;
+
+    /* ENTER is posted from the new thread itself */
+    webrtc_threads_stream_status(msg);
+    gst_message_parse_stream_status(msg, &type, &owner);
+    if (type == GST_STREAM_STATUS_TYPE_ENTER) {
+      webrtc_cpu_name_thread(self->key, owner);
+    }
+    break;
+  }
+  case GST_MESSAGE_APPLICATION:
+    if (gst_message_has_name(msg, STREAMING_MESSAGE)) {
+      set_health(self, WEBRTC_SESSION_HEALTH_STREAMING, "media arrived");
+    }
+    break;
+
   case GST_MESSAGE_ERROR: {
     gchar *debug_str = NULL;
     GError *error = NULL;
 
     gst_message_parse_error(msg, &error, &debug_str);
-    g_print("DEBUG: %s\n", debug_str);
+    WEBRTC_LOG_DEBUG(WEBRTC_LOG_PIPELINE, self->key, "%s", debug_str);
     g_free(debug_str);
 
-    g_warning("Error: %s", error->message);
+    WEBRTC_LOG(WEBRTC_LOG_PIPELINE,
+               WEBRTC_LOG_LEVEL_ERROR,
+               self->key,
+               "Error from %s: %s",
+               GST_OBJECT_NAME(msg->src),
+               error->message);
+    set_health(self, WEBRTC_SESSION_HEALTH_FAILED, error->message);
+    g_error_free(error);
+
+    break;
+  }
+  case GST_MESSAGE_WARNING: {
+    GError *error = NULL;
+
+    gst_message_parse_warning(msg, &error, NULL);
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_PIPELINE,
+                       self->key,
+                       "Warning from %s: %s",
+                       GST_OBJECT_NAME(msg->src),
+                       error->message);
+    set_health(self, WEBRTC_SESSION_HEALTH_DEGRADED, error->message);
     g_error_free(error);
 
     break;
   }
+  case GST_MESSAGE_QOS: {
+    guint64 processed;
+    guint64 dropped;
+
+    gst_message_parse_qos_stats(msg, NULL, &processed, &dropped);
+    WEBRTC_LOG_DEBUG(WEBRTC_LOG_PIPELINE,
+                     self->key,
+                     "QoS from %s: %" G_GUINT64_FORMAT " processed, %"
+                     G_GUINT64_FORMAT " dropped",
+                     GST_OBJECT_NAME(msg->src),
+                     processed,
+                     dropped);
+    set_health(self, WEBRTC_SESSION_HEALTH_DEGRADED, "late buffers dropped");
+
+    break;
+  }
+  case GST_MESSAGE_BUFFERING: {
+    gint percent;
+
+    gst_message_parse_buffering(msg, &percent);
+    if (percent < 100) {
+      set_health(self, WEBRTC_SESSION_HEALTH_DEGRADED, "buffering");
+    }
+
+    break;
+  }
+  case GST_MESSAGE_ELEMENT: {
+    const GstStructure *s = gst_message_get_structure(msg);
+
+    /* webrtcbin and the nice elements inside it */
+    if (s != NULL && self->webrtc_bin != NULL &&
+        gst_object_has_as_ancestor(GST_MESSAGE_SRC(msg),
+                                   GST_OBJECT(self->webrtc_bin))) {
+      WEBRTC_LOG_DEBUG(WEBRTC_LOG_SESSION,
+                       self->key,
+                       "Message %s from %s",
+                       gst_structure_get_name(s),
+                       GST_MESSAGE_SRC_NAME(msg));
+    }
+    break;
+  }
   default:
-    g_print("GOT MESSAGE %u \n", GST_MESSAGE_TYPE(msg));
+    WEBRTC_LOG_TRACE(WEBRTC_LOG_PIPELINE,
+                     self->key,
+                     "Bus message %s from %s",
+                     GST_MESSAGE_TYPE_NAME(msg),
+                     GST_MESSAGE_SRC_NAME(msg));
     break;
   }
 
   if (gst_is_missing_plugin_message(msg)) {
-    g_print("Missing plugin: %s\t%s\n",
-            gst_missing_plugin_message_get_installer_detail(msg),
-            gst_missing_plugin_message_get_description(msg));
+    gchar *detail = gst_missing_plugin_message_get_installer_detail(msg);
+    gchar *description = gst_missing_plugin_message_get_description(msg);
+
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_PIPELINE,
+                       self->key,
+                       "Missing plugin: %s\t%s",
+                       detail,
+                       description);
+    g_free(detail);
+    g_free(description);
   }
 
-  return TRUE;
+  return GST_BUS_DROP;
 }
 
 static void
@@ -346,6 +1110,14 @@ on_ice_candidate_callback(G_GNUC_UNUSED GstElement *object,
                                    mline_index);
 }
 
+static void
+discard_element(GstElement *el)
+{
+  if (el != NULL) {
+    gst_object_unref(gst_object_ref_sink(el));
+  }
+}
+
 static void
 add_all_elements(WebrtcSession *self, GPtrArray *elems)
 {
@@ -370,7 +1142,10 @@ stats_flush_done(GObject *source_object,
   if (!g_output_stream_flush_finish(G_OUTPUT_STREAM(source_object),
                                     res,
                                     &err)) {
-    g_warning("Failed to flush stats file: %s", err->message);
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SESSION,
+                       NULL,
+                       "Failed to flush stats file: %s",
+                       err->message);
     g_clear_error(&err);
   }
 }
@@ -388,11 +1163,14 @@ stats_write_done(GObject *source_object, GAsyncResult *res, gpointer data)
                                         res,
                                         NULL,
                                         &err)) {
-    g_warning("Failed to write stats file: %s", err->message);
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SESSION,
+                       self->key,
+                       "Failed to write stats file: %s",
+                       err->message);
     g_clear_error(&err);
   }
 
-  g_free(self->stats_str);
+  g_clear_pointer(&self->stats_str, g_free);
   g_object_unref(self);
 
   g_output_stream_flush_async(G_OUTPUT_STREAM(source_object),
@@ -407,9 +1185,12 @@ find_rtp_inputs(G_GNUC_UNUSED GQuark field_id,
                 const GValue *value,
                 gpointer user_data)
 {
-  guint64 *res = (guint64 *) user_data;
+  struct webrtc_session_stats *res = user_data;
   GstWebRTCStatsType type;
-  guint64 tmp;
+  guint64 tmp = 0;
+  guint64 packets = 0;
+  gint64 lost = 0;
+  gdouble jitter = 0;
   const GstStructure *gst_struct = NULL;
 
   g_assert(user_data);
@@ -433,19 +1214,133 @@ find_rtp_inputs(G_GNUC_UNUSED GQuark field_id,
   }
 
   gst_structure_get_uint64(gst_struct, "bytes-received", &tmp);
-  *res = (*res) + tmp;
+  gst_structure_get_uint64(gst_struct, "packets-received", &packets);
+  gst_structure_get_int64(gst_struct, "packets-lost", &lost);
+  gst_structure_get_double(gst_struct, "jitter", &jitter);
+
+  res->bytes_received += tmp;
+  res->packets_received += packets;
+  res->packets_lost += lost;
+  res->jitter = MAX(res->jitter, jitter);
 
   return TRUE;
 }
 
+static void
+find_recovery_stats(WebrtcSession *self, struct webrtc_session_stats *res)
+{
+  g_mutex_lock(&self->lock);
+  for (guint i = 0; i < self->jitterbuffers->len; i++) {
+    GstStructure *jb_stats = NULL;
+    guint64 late = 0;
+    guint64 rtx = 0;
+
+    g_object_get(self->jitterbuffers->pdata[i], "stats", &jb_stats, NULL);
+    if (jb_stats == NULL) {
+      continue;
+    }
+
+    gst_structure_get_uint64(jb_stats, "num-late", &late);
+    gst_structure_get_uint64(jb_stats, "rtx-success-count", &rtx);
+    res->packets_late += late;
+    res->packets_rtx_recovered += rtx;
+    gst_structure_free(jb_stats);
+  }
+
+  for (guint i = 0; i < self->fec_decoders->len; i++) {
+    guint recovered = 0;
+
+    g_object_get(self->fec_decoders->pdata[i], "recovered", &recovered, NULL);
+    res->packets_fec_recovered += recovered;
+  }
+  g_mutex_unlock(&self->lock);
+}
+
+/* The names are copied, the report is gone with the next one */
+static void
+collect_telemetry(WebrtcSession *self, struct webrtc_session_stats *res)
+{
+  GPtrArray *telemetry;
+
+  if (!webrtc_tracer_enabled()) {
+    return;
+  }
+
+  telemetry = webrtc_tracer_collect(self->key);
+  if (telemetry == NULL) {
+    return;
+  }
+
+  for (guint i = 0; i < telemetry->len; i++) {
+    struct webrtc_tracer_element *e = telemetry->pdata[i];
+
+    WEBRTC_LOG_DEBUG(WEBRTC_LOG_PIPELINE,
+                     self->key,
+                     "%s: %.1f buffers/s, %" G_GUINT64_FORMAT " us median, %"
+                     G_GUINT64_FORMAT " us 99th, %" G_GUINT64_FORMAT
+                     " us max, queue %d%% median, %d%% max",
+                     e->name,
+                     e->rate,
+                     e->time_p50,
+                     e->time_p99,
+                     e->time_max,
+                     e->fill_p50,
+                     e->fill_max);
+
+    /* Slowest first */
+    if (i == 0) {
+      g_strlcpy(res->slowest_element,
+                e->name,
+                sizeof(res->slowest_element));
+      res->slowest_time = e->time_p99;
+    }
+    if (e->fill_max > res->queue_fill) {
+      g_strlcpy(res->fullest_queue, e->name, sizeof(res->fullest_queue));
+      res->queue_fill = e->fill_max;
+    }
+  }
+
+  g_ptr_array_unref(telemetry);
+}
+
+static guint64
+memory_budget(WebrtcSession *self)
+{
+  return (guint64) webrtc_settings_memory(self->settings) * 1024 * 1024;
+}
+
+/* Streaming thread */
+static void
+find_memory_stats(WebrtcSession *self, struct webrtc_session_stats *res)
+{
+  guint64 memory = 0;
+
+  g_mutex_lock(&self->lock);
+  for (guint i = 0; i < self->queues->len; i++) {
+    guint bytes = 0;
+
+    g_object_get(self->queues->pdata[i], "current-level-bytes", &bytes, NULL);
+    memory += bytes;
+  }
+
+  /* The jitterbuffers do not tell. Under a budget they drop beyond their
+   * latency, so this bounds them; kbps are bytes per 8 ms. */
+  memory += res->bitrate * res->latency / 8;
+  self->memory_peak = MAX(self->memory_peak, memory);
+  res->memory_peak = self->memory_peak;
+  g_mutex_unlock(&self->lock);
+
+  res->memory = memory;
+  res->memory_budget = memory_budget(self);
+}
+
 static void
 on_stats_cb(GstPromise *promise, gpointer user_data)
 {
   WebrtcSession *self = WEBRTC_SESSION(user_data);
   GstPromiseResult res;
   const GstStructure *reply;
-
-  guint64 bytes_received = 0;
+  struct webrtc_session_stats stats = { 0 };
   gint64 ts;
 
   g_assert(promise);
@@ -455,10 +1350,14 @@ on_stats_cb(GstPromise *promise, gpointer user_data)
   if (res != GST_PROMISE_RESULT_REPLIED) {
     switch (res) {
     case GST_PROMISE_RESULT_INTERRUPTED:
-      g_warning("Session %s: Stats request was interrupted", self->id);
+      WEBRTC_LOG_WARNING(WEBRTC_LOG_SESSION,
+                         self->key,
+                         "Stats request was interrupted");
       break;
     case GST_PROMISE_RESULT_EXPIRED:
-      g_warning("Session %s: Stats request expired", self->id);
+      WEBRTC_LOG_WARNING(WEBRTC_LOG_SESSION,
+                         self->key,
+                         "Stats request expired");
       break;
     default:
       g_error("Session %s: Unknown error while receiving stats answer",
@@ -475,22 +1374,104 @@ on_stats_cb(GstPromise *promise, gpointer user_data)
     return;
   }
 
-  g_message("GETTING STATS");
+  WEBRTC_LOG_TRACE(WEBRTC_LOG_SESSION, self->key, "Got stats");
 
-  gst_structure_foreach(reply, find_rtp_inputs, &bytes_received);
+  gst_structure_foreach(reply, find_rtp_inputs, &stats);
 
   gst_promise_unref(promise);
 
-  if (bytes_received == 0) {
+  if (stats.bytes_received == 0) {
     return;
   }
 
   ts = g_get_real_time();
 
-  self->stats_str =
-          g_strdup_printf("%" G_GINT64_FORMAT "\t%" G_GUINT64_FORMAT "\n",
-                          ts,
-                          bytes_received);
+  stats.latency_profile = self->profile->name;
+  stats.latency = self->jitter_latency > 0 ? self->jitter_latency
+                                           : self->profile->latency;
+  stats.protection = self->protection;
+  if (self->stats_time > 0 && ts > self->stats_time &&
+      stats.bytes_received >= self->stats.bytes_received) {
+    stats.bitrate = (stats.bytes_received - self->stats.bytes_received) * 8 *
+                    1000 / (ts - self->stats_time);
+  }
+  find_recovery_stats(self, &stats);
+  find_memory_stats(self, &stats);
+  stats.ice_restarts = self->ice_restarts;
+  stats.outages = self->outages;
+  stats.outage_time = self->outage_time;
+  stats.recovery_time = self->recovery_time;
+  webrtc_cpu_get_usage(self->key, &stats.cpu);
+  collect_telemetry(self, &stats);
+  g_mutex_lock(&self->lock);
+  stats.metadata_records = self->metadata_records;
+  stats.metadata_invalid = self->metadata_invalid;
+  stats.metadata_dropped = self->metadata_dropped;
+  if (self->metadata_records > 0) {
+    webrtc_metadata_format(self->metadata,
+                           self->metadata_values,
+                           stats.metadata_last,
+                           sizeof(stats.metadata_last));
+  }
+  self->stats = stats;
+  g_mutex_unlock(&self->lock);
+  self->stats_time = ts;
+
+  if (self->stats_out == NULL || self->stats_str != NULL) {
+    /* No stats file, or the previous line is still being written */
+    return;
+  }
+
+  self->stats_str = g_strdup_printf("%" G_GINT64_FORMAT "\t%" G_GUINT64_FORMAT
+                                    "\t%s\t%u\t%" G_GUINT64_FORMAT
+                                    "\t%" G_GINT64_FORMAT "\t%" G_GUINT64_FORMAT
+                                    "\t%.6f\t%s\t%" G_GUINT64_FORMAT
+                                    "\t%" G_GUINT64_FORMAT "\t%u\t%u"
+                                    "\t%" G_GUINT64_FORMAT "\t%.1f\t%.1f"
+                                    "\t%.1f\t%.1f\t%.1f\t%.1f\t%.1f"
+                                    "\t%s\t%" G_GUINT64_FORMAT "\t%s\t%d"
+                                    "\t%" G_GUINT64_FORMAT
+                                    "\t%" G_GUINT64_FORMAT
+                                    "\t%" G_GUINT64_FORMAT
+                                    "\t%" G_GUINT64_FORMAT
+                                    "\t%" G_GUINT64_FORMAT "\t%s\n",
+                                    ts,
+                                    stats.bytes_received,
+                                    stats.latency_profile,
+                                    stats.latency,
+                                    stats.packets_received,
+                                    stats.packets_lost,
+                                    stats.packets_late,
+                                    stats.jitter,
+                                    stats.protection,
+                                    stats.packets_rtx_recovered,
+                                    stats.packets_fec_recovered,
+                                    stats.ice_restarts,
+                                    stats.outages,
+                                    stats.outage_time,
+                                    stats.cpu.total,
+                                    stats.cpu.classes[WEBRTC_CPU_NETWORK],
+                                    stats.cpu.classes[WEBRTC_CPU_DEPAY],
+                                    stats.cpu.classes[WEBRTC_CPU_DECODE],
+                                    stats.cpu.classes[WEBRTC_CPU_CONVERT],
+                                    stats.cpu.classes[WEBRTC_CPU_MUX],
+                                    stats.cpu.classes[WEBRTC_CPU_OTHER],
+                                    stats.slowest_element[0] != '\0'
+                                            ? stats.slowest_element
+                                            : "-",
+                                    stats.slowest_time,
+                                    stats.fullest_queue[0] != '\0'
+                                            ? stats.fullest_queue
+                                            : "-",
+                                    stats.queue_fill,
+                                    stats.memory,
+                                    stats.memory_peak,
+                                    stats.metadata_records,
+                                    stats.metadata_invalid,
+                                    stats.metadata_dropped,
+                                    stats.metadata_last[0] != '\0'
+                                            ? stats.metadata_last
+                                            : "-");
 
   g_output_stream_write_all_async(G_OUTPUT_STREAM(self->stats_out),
                                   self->stats_str,
@@ -508,119 +1489,600 @@ request_stats(WebrtcSession *self)
 
   g_assert(self);
 
-  if (self->stats_out == NULL) {
+  if (self->pipeline == NULL) {
     return FALSE;
   }
 
+  recover_health(self);
+
   promise = gst_promise_new_with_change_func(on_stats_cb,
                                              g_object_ref(G_OBJECT(self)),
                                              g_object_unref);
   g_signal_emit_by_name(self->webrtc_bin, "get-stats", NULL, promise);
 
-  return TRUE;
+  return TRUE;
+}
+
+static void
+stats_file_created_cb(GObject *source_object, GAsyncResult *res, gpointer data)
+{
+  WebrtcSession *self = WEBRTC_SESSION(data);
+  GError *err = NULL;
+
+  self->stats_out = g_file_create_finish(G_FILE(source_object), res, &err);
+
+  if (self->stats_out == NULL) {
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_SESSION,
+                       self->key,
+                       "Failed to create stats file: %s",
+                       err->message);
+    g_clear_error(&err);
+  }
+
+  g_object_unref(self);
+}
+
+static void
+print_caps(WebrtcSession *self, const GstCaps *caps)
+{
+  GstStructure *s;
+  gchar *caps_str;
+  const gchar *name;
+
+  if (!webrtc_log_enabled(WEBRTC_LOG_PIPELINE, WEBRTC_LOG_LEVEL_DEBUG)) {
+    return;
+  }
+
+  for (guint i = 0; i < gst_caps_get_size(caps); i++) {
+    s = gst_caps_get_structure(caps, i);
+    caps_str = gst_structure_to_string(s);
+    name = gst_structure_get_name(s);
+
+    WEBRTC_LOG_DEBUG(WEBRTC_LOG_PIPELINE,
+                     self->key,
+                     "Caps %s: %s",
+                     name,
+                     caps_str);
+    g_free(caps_str);
+  }
+}
+
+static void
+data_channel_on_error(G_GNUC_UNUSED GObject *dc,
+                      G_GNUC_UNUSED gpointer user_data)
+{
+  WEBRTC_LOG_WARNING(WEBRTC_LOG_SESSION, NULL, "Data channel error");
+}
+
+static void
+data_channel_on_open(G_GNUC_UNUSED GObject *dc,
+                     G_GNUC_UNUSED gpointer user_data)
+{
+  WEBRTC_LOG_INFO(WEBRTC_LOG_SESSION, NULL, "Data channel opened");
+}
+
+static void
+data_channel_on_close(G_GNUC_UNUSED GObject *dc,
+                      G_GNUC_UNUSED gpointer user_data)
+{
+  WEBRTC_LOG_INFO(WEBRTC_LOG_SESSION, NULL, "Data channel closed");
+}
+
+static void
+data_channel_on_message_string(G_GNUC_UNUSED GObject *dc,
+                               gchar *str,
+                               G_GNUC_UNUSED gpointer user_data)
+{
+  WEBRTC_LOG_DEBUG(WEBRTC_LOG_SESSION,
+                   NULL,
+                   "Received data channel message: %s",
+                   str);
+}
+
+/* Called with the lock held. The text goes straight into a buffer of the
+ * pool, which returns to it once the muxer is done. */
+static void
+push_metadata(WebrtcSession *self)
+{
+  GstBufferPoolAcquireParams params = {
+    .flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT,
+  };
+  GstBuffer *buffer = NULL;
+  GstFlowReturn ret;
+  GstMapInfo map;
+  gsize len;
+
+  if (self->metadata_src == NULL) {
+    return;
+  }
+
+  if (gst_buffer_pool_acquire_buffer(self->metadata_pool,
+                                     &buffer,
+                                     &params) != GST_FLOW_OK) {
+    self->metadata_dropped++;
+    return;
+  }
+
+  gst_buffer_map(buffer, &map, GST_MAP_WRITE);
+  len = webrtc_metadata_format(self->metadata,
+                               self->metadata_values,
+                               (gchar *) map.data,
+                               map.size);
+  gst_buffer_unmap(buffer, &map);
+  gst_buffer_set_size(buffer, len);
+  /* appsrc sets the running time, which aligns it with the media */
+  GST_BUFFER_DURATION(buffer) = METADATA_DURATION;
+
+  g_signal_emit_by_name(self->metadata_src, "push-buffer", buffer, &ret);
+  gst_buffer_unref(buffer);
+}
+
+/* SCTP thread. data is only read in place. */
+static void
+data_channel_on_message_data(G_GNUC_UNUSED GObject *dc,
+                             GBytes *data,
+                             WebrtcSession *self)
+{
+  const guint8 *bytes;
+  gsize record;
+  gsize size;
+
+  if (self->metadata == NULL || data == NULL) {
+    return;
+  }
+
+  bytes = g_bytes_get_data(data, &size);
+  record = webrtc_metadata_schema_size(self->metadata);
+
+  g_mutex_lock(&self->lock);
+  if (size < record || size % record != 0) {
+    self->metadata_invalid++;
+  }
+  for (gsize offset = 0; offset + record <= size; offset += record) {
+    webrtc_metadata_decode(self->metadata,
+                           bytes + offset,
+                           self->metadata_values);
+    self->metadata_records++;
+    push_metadata(self);
+  }
+  g_mutex_unlock(&self->lock);
+}
+
+/* Before the first media reaches the muxer, it takes no new pads after */
+static void
+add_metadata_track(WebrtcSession *self, GstElement *mux)
+{
+  GstStructure *config;
+  GstElement *src;
+  GstPad *srcpad;
+  GstPad *sinkpad;
+  GstCaps *caps;
+
+  if (self->metadata == NULL) {
+    return;
+  }
+
+  sinkpad = gst_element_request_pad_simple(mux, "subtitle_%u");
+  if (sinkpad == NULL) {
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_PIPELINE,
+                       self->key,
+                       "%s has no subtitle track for the metadata",
+                       GST_OBJECT_NAME(mux));
+    return;
+  }
+
+  src = gst_element_factory_make("appsrc", "metadata");
+  if (src == NULL) {
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_PIPELINE, self->key, "No appsrc");
+    gst_element_release_request_pad(mux, sinkpad);
+    gst_object_unref(sinkpad);
+    return;
+  }
+
+  caps = gst_caps_new_simple("text/x-raw",
+                             "format",
+                             G_TYPE_STRING,
+                             "utf8",
+                             NULL);
+  g_object_set(src,
+               "caps",
+               caps,
+               "format",
+               GST_FORMAT_TIME,
+               "is-live",
+               TRUE,
+               "do-timestamp",
+               TRUE,
+               NULL);
+
+  self->metadata_pool = gst_buffer_pool_new();
+  config = gst_buffer_pool_get_config(self->metadata_pool);
+  gst_buffer_pool_config_set_params(config,
+                                    caps,
+                                    METADATA_TEXT_SIZE,
+                                    METADATA_BUFFERS,
+                                    METADATA_BUFFERS);
+  gst_buffer_pool_set_config(self->metadata_pool, config);
+  gst_buffer_pool_set_active(self->metadata_pool, TRUE);
+  gst_caps_unref(caps);
+
+  gst_bin_add(GST_BIN(self->pipeline), src);
+  srcpad = gst_element_get_static_pad(src, "src");
+  if (gst_pad_link(srcpad, sinkpad) != GST_PAD_LINK_OK) {
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_PIPELINE,
+                       self->key,
+                       "Could not link the metadata track");
+  }
+  gst_object_unref(srcpad);
+  gst_object_unref(sinkpad);
+  gst_element_sync_state_with_parent(src);
+
+  g_mutex_lock(&self->lock);
+  self->metadata_src = gst_object_ref(src);
+  g_mutex_unlock(&self->lock);
+}
+
+static void
+on_data_channel(G_GNUC_UNUSED GstElement *webrtc,
+                GObject *data_channel,
+                WebrtcSession *self)
+{
+  connect(self->signals,
+          G_OBJECT(data_channel),
+          "on-error",
+          G_CALLBACK(data_channel_on_error),
+          NULL);
+  connect(self->signals,
+          G_OBJECT(data_channel),
+          "on-open",
+          G_CALLBACK(data_channel_on_open),
+          NULL);
+  connect(self->signals,
+          G_OBJECT(data_channel),
+          "on-close",
+          G_CALLBACK(data_channel_on_close),
+          NULL);
+  connect(self->signals,
+          G_OBJECT(data_channel),
+          "on-message-string",
+          G_CALLBACK(data_channel_on_message_string),
+          NULL);
+  connect(self->signals,
+          G_OBJECT(data_channel),
+          "on-message-data",
+          G_CALLBACK(data_channel_on_message_data),
+          self);
+}
+
+/* The latency whose worth of the stream fits the jitterbuffers' share, 0
+ * if the profile's latency does or the bitrate is not known */
+static guint
+jitter_latency(WebrtcSession *self)
+{
+  guint64 share = memory_budget(self) * JITTER_SHARE / 4;
+  gint64 kbps;
+  guint64 latency;
+
+  g_mutex_lock(&self->lock);
+  kbps = self->max_bitrate;
+  g_mutex_unlock(&self->lock);
+  if (kbps <= 0) {
+    kbps = webrtc_settings_video_max_bitrate(self->settings);
+  }
+  if (share == 0 || kbps <= 0) {
+    return 0;
+  }
+
+  /* kbps are bits per ms */
+  latency = share * 8 / kbps;
+  if (latency >= self->profile->latency) {
+    return 0;
+  }
+
+  return MAX(latency, MIN_JITTER_LATENCY);
+}
+
+/* The budget only ever lowers what a queue holds, its time and buffer
+ * limits stay. A queue in front of the screen drops the oldest frames when
+ * the sink stalls, one in front of the muxer blocks, and the jitterbuffers
+ * behind it then drop their oldest packets. */
+static void
+budget_queue(WebrtcSession *self,
+             GstElement *queue,
+             enum webrtc_codec_media media,
+             gboolean leaky)
+{
+  guint64 bytes;
+  guint max_bytes = 0;
+
+  bytes = memory_budget(self) *
+          (media == WEBRTC_CODEC_MEDIA_VIDEO ? VIDEO_QUEUE_SHARE
+                                             : AUDIO_QUEUE_SHARE) /
+          4;
+  if (bytes == 0) {
+    return;
+  }
+
+  g_object_get(queue, "max-size-bytes", &max_bytes, NULL);
+  if (max_bytes > 0) {
+    bytes = MIN(bytes, max_bytes);
+  }
+  g_object_set(queue, "max-size-bytes", (guint) MIN(bytes, G_MAXUINT), NULL);
+  if (leaky) {
+    gst_util_set_object_arg(G_OBJECT(queue), "leaky", "downstream");
+  }
+
+  WEBRTC_LOG_DEBUG(WEBRTC_LOG_PIPELINE,
+                   self->key,
+                   "%s holds up to %" G_GUINT64_FORMAT " KB%s",
+                   GST_OBJECT_NAME(queue),
+                   bytes / 1024,
+                   leaky ? ", dropping old buffers" : "");
+
+  g_mutex_lock(&self->lock);
+  g_ptr_array_add(self->queues, gst_object_ref(queue));
+  g_mutex_unlock(&self->lock);
+}
+
+/* Receiver estimated maximum bitrate, draft-alvestrand-rmcat-remb: an
+ * application layer feedback message with "REMB", the number of SSRCs, a
+ * 6 bit exponent and an 18 bit mantissa followed by the SSRCs */
+static gboolean
+add_remb(GstBuffer *buffer, guint32 sender, guint64 bitrate, GArray *ssrcs)
+{
+  GstRTCPBuffer rtcp = GST_RTCP_BUFFER_INIT;
+  GstRTCPPacket packet;
+  guint8 *fci;
+  guint exp = 0;
+  gboolean res = FALSE;
+
+  if (ssrcs->len == 0 || ssrcs->len > 255) {
+    return FALSE;
+  }
+
+  while (bitrate > 0x3ffff) {
+    bitrate >>= 1;
+    exp++;
+  }
+
+  if (!gst_rtcp_buffer_map(buffer, GST_MAP_READWRITE, &rtcp)) {
+    return FALSE;
+  }
+
+  if (!gst_rtcp_buffer_add_packet(&rtcp, GST_RTCP_TYPE_PSFB, &packet)) {
+    goto out;
+  }
+
+  gst_rtcp_packet_fb_set_type(&packet, GST_RTCP_PSFB_TYPE_AFB);
+  gst_rtcp_packet_fb_set_sender_ssrc(&packet, sender);
+  gst_rtcp_packet_fb_set_media_ssrc(&packet, 0);
+  if (!gst_rtcp_packet_fb_set_fci_length(&packet, 2 + ssrcs->len)) {
+    gst_rtcp_packet_remove(&packet);
+    goto out;
+  }
+
+  fci = gst_rtcp_packet_fb_get_fci(&packet);
+  memcpy(fci, "REMB", 4);
+  fci[4] = ssrcs->len;
+  fci[5] = (exp << 2) | ((bitrate >> 16) & 0x3);
+  fci[6] = (bitrate >> 8) & 0xff;
+  fci[7] = bitrate & 0xff;
+  for (guint i = 0; i < ssrcs->len; i++) {
+    GST_WRITE_UINT32_BE(fci + 8 + i * 4, g_array_index(ssrcs, guint32, i));
+  }
+  res = TRUE;
+
+out:
+  gst_rtcp_buffer_unmap(&rtcp);
+  return res;
+}
+
+static gboolean
+on_sending_rtcp(GObject *session,
+                GstBuffer *buffer,
+                G_GNUC_UNUSED gboolean early,
+                WebrtcSession *self)
+{
+  guint sender = 0;
+  gboolean res = FALSE;
+
+  g_object_get(session, "internal-ssrc", &sender, NULL);
+
+  g_mutex_lock(&self->lock);
+  if (self->max_bitrate > 0) {
+    res = add_remb(buffer,
+                   sender,
+                   (guint64) self->max_bitrate * 1000,
+                   self->remote_ssrcs);
+  }
+  g_mutex_unlock(&self->lock);
+
+  /* Keep an otherwise empty early packet if it carries the estimate */
+  return res;
+}
+
+static void
+on_new_ssrc(GstElement *rtpbin,
+            guint session,
+            G_GNUC_UNUSED guint ssrc,
+            WebrtcSession *self)
+{
+  GObject *rtp_session = NULL;
+
+  g_signal_emit_by_name(rtpbin, "get-internal-session", session, &rtp_session);
+  if (rtp_session == NULL) {
+    return;
+  }
+
+  g_mutex_lock(&self->lock);
+  /* webrtcbin bundles everything into one session */
+  if (self->rtp_session == NULL) {
+    self->rtp_session = g_object_ref(rtp_session);
+    self->rtcp_handler = g_signal_connect(rtp_session,
+                                          "on-sending-rtcp",
+                                          G_CALLBACK(on_sending_rtcp),
+                                          self);
+  }
+  g_mutex_unlock(&self->lock);
+
+  g_object_unref(rtp_session);
 }
 
-static void
-stats_file_created_cb(GObject *source_object, GAsyncResult *res, gpointer data)
+/* rtpbin only adds a source pad for a media stream, never for its RTX
+ * stream, REMB lists the video streams once each */
+/* Streaming threads, the map is swapped by a re-offer on the main thread */
+static const struct webrtc_codec *
+lookup_pt(WebrtcSession *self, guint pt)
 {
-  WebrtcSession *self = WEBRTC_SESSION(data);
-  GError *err = NULL;
-
-  self->stats_out = g_file_create_finish(G_FILE(source_object), res, &err);
+  const struct webrtc_codec *codec = NULL;
+  GHashTable *payloads = NULL;
 
-  if (self->stats_out == NULL) {
-    g_warning("Failed to create stats file: %s", err->message);
-    g_clear_error(&err);
+  g_mutex_lock(&self->lock);
+  if (self->payloads != NULL) {
+    payloads = g_hash_table_ref(self->payloads);
   }
+  g_mutex_unlock(&self->lock);
 
-  self->stats_timer = g_timeout_add_seconds(STATS_INTERVAL,
-                                            G_SOURCE_FUNC(request_stats),
-                                            data);
+  if (payloads != NULL) {
+    codec = g_hash_table_lookup(payloads, GUINT_TO_POINTER(pt));
+    g_hash_table_unref(payloads);
+  }
 
-  g_object_unref(self);
+  return codec;
 }
 
 static void
-print_caps(const GstCaps *caps)
+on_rtpbin_pad_added(G_GNUC_UNUSED GstElement *rtpbin,
+                    GstPad *pad,
+                    WebrtcSession *self)
 {
-  GstStructure *s;
-  gchar *caps_str;
-  const gchar *name;
+  const struct webrtc_codec *codec = NULL;
+  guint session;
+  guint ssrc;
+  guint pt;
+
+  if (sscanf(GST_PAD_NAME(pad),
+             "recv_rtp_src_%u_%u_%u",
+             &session,
+             &ssrc,
+             &pt) != 3) {
+    return;
+  }
 
-  for (guint i = 0; i < gst_caps_get_size(caps); i++) {
-    s = gst_caps_get_structure(caps, i);
-    caps_str = gst_structure_to_string(s);
-    name = gst_structure_get_name(s);
+  codec = lookup_pt(self, pt);
+  if (codec != NULL && codec->media == WEBRTC_CODEC_MEDIA_AUDIO) {
+    return;
+  }
 
-    g_message("Caps %s: %s", name, caps_str);
-    g_free(caps_str);
+  g_mutex_lock(&self->lock);
+  for (guint i = 0; i < self->remote_ssrcs->len; i++) {
+    if (g_array_index(self->remote_ssrcs, guint32, i) == ssrc) {
+      g_mutex_unlock(&self->lock);
+      return;
+    }
   }
+  g_array_append_val(self->remote_ssrcs, ssrc);
+  g_mutex_unlock(&self->lock);
 }
 
 static void
-data_channel_on_error(G_GNUC_UNUSED GObject *dc,
-                      G_GNUC_UNUSED gpointer user_data)
+on_deep_element_added(G_GNUC_UNUSED GstBin *bin,
+                      G_GNUC_UNUSED GstBin *sub_bin,
+                      GstElement *element,
+                      WebrtcSession *self)
 {
-  g_warning("Data channel error");
-}
+  GstElementFactory *factory;
 
-static void
-data_channel_on_open(G_GNUC_UNUSED GObject *dc,
-                     G_GNUC_UNUSED gpointer user_data)
-{
-  GBytes *bytes = g_bytes_new("data", strlen("data"));
-  g_message("data channel opened\n");
-  /*
-  g_signal_emit_by_name(dc, "send-string", "Hi! from GStreamer");
-  g_signal_emit_by_name(dc, "send-data", bytes);
-  */
-  g_bytes_unref(bytes);
-}
+  factory = gst_element_get_factory(element);
+  if (factory == NULL) {
+    return;
+  }
 
-static void
-data_channel_on_close(G_GNUC_UNUSED GObject *dc,
-                      G_GNUC_UNUSED gpointer user_data)
-{
-  g_message("Data channel closed");
-}
+  if (g_strcmp0(GST_OBJECT_NAME(factory), "rtpbin") == 0) {
+    connect(self->signals,
+            G_OBJECT(element),
+            "on-new-ssrc",
+            G_CALLBACK(on_new_ssrc),
+            self);
+    connect(self->signals,
+            G_OBJECT(element),
+            "pad-added",
+            G_CALLBACK(on_rtpbin_pad_added),
+            self);
+    return;
+  }
 
-static void
-data_channel_on_message_string(G_GNUC_UNUSED GObject *dc,
-                               gchar *str,
-                               G_GNUC_UNUSED gpointer user_data)
-{
-  gst_print("Received data channel message: %s\n", str);
+  if (g_strcmp0(GST_OBJECT_NAME(factory), "rtpulpfecdec") == 0) {
+    g_mutex_lock(&self->lock);
+    g_ptr_array_add(self->fec_decoders, gst_object_ref(element));
+    g_mutex_unlock(&self->lock);
+    return;
+  }
+
+  if (g_strcmp0(GST_OBJECT_NAME(factory), "rtpjitterbuffer") != 0) {
+    return;
+  }
+
+  WEBRTC_LOG_DEBUG(WEBRTC_LOG_PIPELINE,
+                   self->key,
+                   "Applying latency profile %s to %s",
+                   self->profile->name,
+                   GST_OBJECT_NAME(element));
+
+  /* latency is handed down by webrtcbin from its latency property. It sets
+   * do-retransmission from the do-nack of the transceivers before rtpbin
+   * adds the jitterbuffer, every profile asks for lost packets and only
+   * the retries differ. */
+  /* With a budget the jitterbuffer never holds more than its latency,
+   * also when a blocked muxer queue stops it from pushing */
+  g_object_set(element,
+               "do-retransmission",
+               TRUE,
+               "drop-on-latency",
+               self->profile->drop_on_latency || memory_budget(self) > 0,
+               "rtx-max-retries",
+               self->profile->rtx_max_retries,
+               NULL);
+
+  self->jitter_latency = jitter_latency(self);
+  if (self->jitter_latency > 0) {
+    WEBRTC_LOG_INFO(WEBRTC_LOG_PIPELINE,
+                    self->key,
+                    "Latency of %s capped at %u ms by the memory budget",
+                    GST_OBJECT_NAME(element),
+                    self->jitter_latency);
+    g_object_set(element, "latency", self->jitter_latency, NULL);
+  }
+
+  g_mutex_lock(&self->lock);
+  g_ptr_array_add(self->jitterbuffers, gst_object_ref(element));
+  g_mutex_unlock(&self->lock);
 }
 
-static void
-on_data_channel(G_GNUC_UNUSED GstElement *webrtc,
-                GObject *data_channel,
-                WebrtcSession *self)
+/* Streaming thread, the gap tells the muxer not to wait for the audio */
+static GstPadProbeReturn
+drop_audio_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
 {
-  connect(self->signals,
-          G_OBJECT(data_channel),
-          "on-error",
-          G_CALLBACK(data_channel_on_error),
-          NULL);
-  connect(self->signals,
-          G_OBJECT(data_channel),
-          "on-open",
-          G_CALLBACK(data_channel_on_open),
-          NULL);
-  connect(self->signals,
-          G_OBJECT(data_channel),
-          "on-close",
-          G_CALLBACK(data_channel_on_close),
-          NULL);
-  connect(self->signals,
-          G_OBJECT(data_channel),
-          "on-message-string",
-          G_CALLBACK(data_channel_on_message_string),
-          NULL);
+  WebrtcSession *self = WEBRTC_SESSION(user_data);
+  GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+
+  if (!g_atomic_int_get(&self->drop_audio)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (GST_BUFFER_PTS_IS_VALID(buf)) {
+    gst_pad_push_event(pad,
+                       gst_event_new_gap(GST_BUFFER_PTS(buf),
+                                         GST_BUFFER_DURATION(buf)));
+  }
+
+  return GST_PAD_PROBE_DROP;
 }
 
 static void
-setup_muxed_pipeline(guint pt, GstPad *pad, WebrtcSession *self)
+setup_muxed_pipeline(const struct webrtc_codec *codec,
+                     GstPad *pad,
+                     WebrtcSession *self)
 {
   GstPad *sinkpad;
   GstPadLinkReturn ret;
@@ -638,34 +2100,47 @@ setup_muxed_pipeline(guint pt, GstPad *pad, WebrtcSession *self)
 
   elems = self->mux;
   if (!self->mux_added) {
-    g_message("Adding all MUX elements");
+    WEBRTC_LOG_DEBUG(WEBRTC_LOG_PIPELINE, self->key, "Adding all MUX elements");
     add_all_elements(self, elems);
+    add_metadata_track(self, GST_ELEMENT(elems->pdata[0]));
     self->mux_added = TRUE;
   }
 
   caps = gst_pad_get_current_caps(pad);
-  print_caps(caps);
+  print_caps(self, caps);
+
+  WEBRTC_LOG_DEBUG(WEBRTC_LOG_PIPELINE,
+                   self->key,
+                   "Adding %s pad link",
+                   codec->encoding_name);
 
-  if (pt == 96) {
-    g_message("Adding video pad link");
-    rtpdepay = gst_element_factory_make("rtph264depay", NULL);
-    queue = gst_element_factory_make("queue", NULL);
-    parse = gst_element_factory_make("h264parse", NULL);
+  if (codec->media == WEBRTC_CODEC_MEDIA_VIDEO) {
     sink_name = video;
     other_sink_name = audio;
-  } else if (pt == 97) {
-    g_message("Adding audio pad link");
-
-    rtpdepay = gst_element_factory_make("rtpopusdepay", NULL);
-    queue = gst_element_factory_make("queue", NULL);
-    parse = gst_element_factory_make("opusparse", NULL);
+  } else {
     sink_name = audio;
     other_sink_name = video;
-  } else {
-    g_warning("Unknown content id: %d", pt);
+  }
+
+  rtpdepay = gst_element_factory_make(codec->depay, NULL);
+  queue = gst_element_factory_make("queue", NULL);
+  parse = gst_element_factory_make(codec->parse != NULL ? codec->parse
+                                                        : "identity",
+                                   NULL);
+
+  if (rtpdepay == NULL || parse == NULL) {
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_PIPELINE,
+                       self->key,
+                       "Missing elements for %s",
+                       codec->encoding_name);
+    discard_element(rtpdepay);
+    discard_element(parse);
+    discard_element(queue);
     goto out;
   }
 
+  budget_queue(self, queue, codec->media, FALSE);
+
   gst_bin_add(GST_BIN(self->pipeline), rtpdepay);
   gst_bin_add(GST_BIN(self->pipeline), queue);
   gst_bin_add(GST_BIN(self->pipeline), parse);
@@ -682,12 +2157,12 @@ setup_muxed_pipeline(guint pt, GstPad *pad, WebrtcSession *self)
 
   /* from rtpdepay to parse */
   if (!gst_element_link(rtpdepay, parse)) {
-    g_warning("Could not link parser");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_PIPELINE, self->key, "Could not link parser");
   }
 
   /* from parse to queue */
   if (!gst_element_link(parse, queue)) {
-    g_warning("Could not link queue");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_PIPELINE, self->key, "Could not link queue");
   }
 
   /* from queue to muxer */
@@ -702,6 +2177,14 @@ setup_muxed_pipeline(guint pt, GstPad *pad, WebrtcSession *self)
     sinkpad = self->sinkpad;
   }
 
+  if (codec->media == WEBRTC_CODEC_MEDIA_AUDIO) {
+    gst_pad_add_probe(srcpad,
+                      GST_PAD_PROBE_TYPE_BUFFER,
+                      drop_audio_probe,
+                      self,
+                      NULL);
+  }
+
   ret = gst_pad_link(srcpad, sinkpad);
   g_assert_cmphex(ret, ==, GST_PAD_LINK_OK);
   gst_object_unref(srcpad);
@@ -712,8 +2195,29 @@ out:
   g_clear_pointer(&caps, gst_caps_unref);
 }
 
+/* skip-frame 1 makes the libav decoders skip B-frames, the only frames they
+ * can drop without breaking the prediction of later ones. Real-time encoders
+ * rarely send any, so for most streams this saves little and the simulcast
+ * layer does the work. Decoders without the property decode everything. */
+static void
+apply_layer(WebrtcSession *self)
+{
+  g_mutex_lock(&self->lock);
+  if (self->video_decoder != NULL &&
+      g_object_class_find_property(G_OBJECT_GET_CLASS(self->video_decoder),
+                                   "skip-frame") != NULL) {
+    gst_util_set_object_arg(G_OBJECT(self->video_decoder),
+                            "skip-frame",
+                            self->layer == WEBRTC_SESSION_LAYER_LOW ? "1"
+                                                                    : "0");
+  }
+  g_mutex_unlock(&self->lock);
+}
+
 static void
-setup_pipeline(guint pt, GstPad *pad, WebrtcSession *self)
+setup_pipeline(const struct webrtc_codec *codec,
+               GstPad *pad,
+               WebrtcSession *self)
 {
   GstPad *sinkpad;
   GstPadLinkReturn ret;
@@ -722,50 +2226,44 @@ setup_pipeline(guint pt, GstPad *pad, WebrtcSession *self)
   GstElement *decode;
   GstElement *parse;
 
-  switch (pt) {
-  case 96: /* h264 */
-    g_message("Adding video pad link");
-
+  if (codec->media == WEBRTC_CODEC_MEDIA_VIDEO) {
     if (!self->use_video) {
       goto out;
     }
-    rtpdepay = gst_element_factory_make("rtph264depay", NULL);
-    parse = gst_element_factory_make("h264parse", NULL);
-    decode = gst_element_factory_make("avdec_h264", NULL);
     elems = self->video;
-    break;
-
-  case 97: /* opus */
-    g_message("Adding audio (opus) pad link");
-
-    if (!self->use_audio) {
-      goto out;
-    }
-
-    rtpdepay = gst_element_factory_make("rtpopusdepay", NULL);
-    parse = gst_element_factory_make("opusparse", NULL);
-    decode = gst_element_factory_make("opusdec", NULL);
-    elems = self->audio;
-    break;
-
-  case 127:
-    g_message("Adding audio (aac) pad link");
-
+  } else {
     if (!self->use_audio) {
       goto out;
     }
-
-    rtpdepay = gst_element_factory_make("rtpmp4gdepay", NULL);
-    parse = gst_element_factory_make("aacparse", NULL);
-    decode = gst_element_factory_make("avdec_aac", NULL);
     elems = self->audio;
-    break;
+  }
 
-  default:
-    g_warning("Unknown content id: %d", pt);
+  WEBRTC_LOG_DEBUG(WEBRTC_LOG_PIPELINE,
+                   self->key,
+                   "Adding %s pad link",
+                   codec->encoding_name);
+
+  rtpdepay = gst_element_factory_make(codec->depay, NULL);
+  parse = gst_element_factory_make(codec->parse != NULL ? codec->parse
+                                                        : "identity",
+                                   NULL);
+  decode = gst_element_factory_make(codec->decode, NULL);
+
+  if (rtpdepay == NULL || parse == NULL || decode == NULL) {
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_PIPELINE,
+                       self->key,
+                       "Missing elements to decode %s",
+                       codec->encoding_name);
+    discard_element(rtpdepay);
+    discard_element(parse);
+    discard_element(decode);
     goto out;
   }
 
+  webrtc_threads_budget_decoder(decode);
+  /* The queue the session starts its elements with */
+  budget_queue(self, GST_ELEMENT(elems->pdata[0]), codec->media, TRUE);
+
   gst_bin_add(GST_BIN(self->pipeline), rtpdepay);
   gst_bin_add(GST_BIN(self->pipeline), parse);
   gst_bin_add(GST_BIN(self->pipeline), decode);
@@ -776,6 +2274,14 @@ setup_pipeline(guint pt, GstPad *pad, WebrtcSession *self)
 
   add_all_elements(self, elems);
 
+  if (codec->media == WEBRTC_CODEC_MEDIA_VIDEO) {
+    g_mutex_lock(&self->lock);
+    gst_object_replace((GstObject **) &self->video_decoder,
+                       GST_OBJECT(decode));
+    g_mutex_unlock(&self->lock);
+    apply_layer(self);
+  }
+
   /* From rtpidentifier to rtpdepay */
   sinkpad = gst_element_get_static_pad(rtpdepay, "sink");
   ret = gst_pad_link(pad, sinkpad);
@@ -788,13 +2294,32 @@ setup_pipeline(guint pt, GstPad *pad, WebrtcSession *self)
                              decode,
                              GST_ELEMENT(elems->pdata[0]),
                              NULL)) {
-    g_warning("Could not link parser");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_PIPELINE, self->key, "Could not link parser");
   }
 
   /* Fall through */
 out:
 }
 
+static const struct webrtc_codec *
+find_codec(WebrtcSession *self, guint pt, GstPad *pad)
+{
+  const struct webrtc_codec *codec = NULL;
+  GstCaps *caps;
+
+  caps = gst_pad_get_current_caps(pad);
+  if (caps != NULL) {
+    codec = webrtc_codec_from_caps(caps);
+    gst_caps_unref(caps);
+  }
+
+  if (codec == NULL) {
+    codec = lookup_pt(self, pt);
+  }
+
+  return codec;
+}
+
 static void
 new_payload_type_callback(G_GNUC_UNUSED GstElement *demux,
                           guint pt,
@@ -802,14 +2327,44 @@ new_payload_type_callback(G_GNUC_UNUSED GstElement *demux,
                           gpointer user_data)
 {
   WebrtcSession *self = WEBRTC_SESSION(user_data);
+  const struct webrtc_codec *codec;
 
-  g_message("New payload type: %u", pt);
+  WEBRTC_LOG_DEBUG(WEBRTC_LOG_PIPELINE, self->key, "New payload type: %u", pt);
+
+  codec = find_codec(self, pt, pad);
+  if (codec == NULL) {
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_PIPELINE,
+                       self->key,
+                       "Unknown payload type: %u",
+                       pt);
+    return;
+  }
 
   if (self->use_mux) {
-    setup_muxed_pipeline(pt, pad, self);
+    setup_muxed_pipeline(codec, pad, self);
+  }
+
+  setup_pipeline(codec, pad, self);
+}
+
+/* Streaming thread, tell the main loop through the bus */
+static GstPadProbeReturn
+first_buffer_probe(GstPad *pad,
+                   G_GNUC_UNUSED GstPadProbeInfo *info,
+                   G_GNUC_UNUSED gpointer user_data)
+{
+  GstElement *parent = gst_pad_get_parent_element(pad);
+  GstStructure *s;
+
+  if (parent != NULL) {
+    s = gst_structure_new_empty(STREAMING_MESSAGE);
+    gst_element_post_message(parent,
+                             gst_message_new_application(GST_OBJECT(parent),
+                                                         s));
+    gst_object_unref(parent);
   }
 
-  setup_pipeline(pt, pad, self);
+  return GST_PAD_PROBE_REMOVE;
 }
 
 static void
@@ -820,10 +2375,12 @@ on_pad_added(G_GNUC_UNUSED GstElement *element, GstPad *pad, gpointer user_data)
   WebrtcSession *self = WEBRTC_SESSION(user_data);
 
   if (GST_PAD_DIRECTION(pad) != GST_PAD_SRC) {
-    g_message("Pad not a source pad, returning");
+    WEBRTC_LOG_DEBUG(WEBRTC_LOG_PIPELINE,
+                     self->key,
+                     "Pad not a source pad, returning");
   }
 
-  g_message("Linking rtpptdemux bin");
+  WEBRTC_LOG_DEBUG(WEBRTC_LOG_PIPELINE, self->key, "Linking rtpptdemux bin");
   decodebin = gst_element_factory_make("rtpptdemux", NULL);
 
   connect(self->signals,
@@ -838,6 +2395,12 @@ on_pad_added(G_GNUC_UNUSED GstElement *element, GstPad *pad, gpointer user_data)
   sinkpad = gst_element_get_static_pad(decodebin, "sink");
   gst_pad_link(pad, sinkpad);
   gst_object_unref(sinkpad);
+
+  gst_pad_add_probe(pad,
+                    GST_PAD_PROBE_TYPE_BUFFER,
+                    first_buffer_probe,
+                    NULL,
+                    NULL);
 }
 
 static void
@@ -848,6 +2411,16 @@ webrtc_session_dispose(GObject *obj)
   g_assert(self);
 
   g_clear_handle_id(&self->stats_timer, g_source_remove);
+  g_clear_handle_id(&self->ice_timer, g_source_remove);
+  g_clear_handle_id(&self->layer_timer, g_source_remove);
+  if (self->stats.memory_peak > 0) {
+    WEBRTC_LOG_INFO(WEBRTC_LOG_PIPELINE,
+                    self->key,
+                    "Peak memory %" G_GUINT64_FORMAT " KB, budget %"
+                    G_GUINT64_FORMAT " KB",
+                    self->stats.memory_peak / 1024,
+                    self->stats.memory_budget / 1024);
+  }
   g_clear_object(&self->stats_out);
 
   /* Do unrefs of objects and such. The object might be used after dispose,
@@ -870,8 +2443,27 @@ webrtc_session_finalize(GObject *obj)
 
   g_clear_object(&self->protocol);
 
+  if (self->key != NULL) {
+    webrtc_log_forget_session(self->key);
+    webrtc_cpu_forget_session(self->key);
+  }
+  g_free(self->key);
   g_free(self->id);
   g_ptr_array_free(self->signals, TRUE);
+  g_ptr_array_free(self->jitterbuffers, TRUE);
+  g_ptr_array_free(self->queues, TRUE);
+  g_ptr_array_free(self->fec_decoders, TRUE);
+  g_clear_pointer(&self->metadata, webrtc_metadata_schema_free);
+  g_free(self->metadata_values);
+  if (self->metadata_pool != NULL) {
+    gst_buffer_pool_set_active(self->metadata_pool, FALSE);
+    gst_object_unref(self->metadata_pool);
+  }
+  g_clear_pointer(&self->payloads, g_hash_table_unref);
+  g_strfreev(self->rids);
+  g_array_unref(self->remote_ssrcs);
+  g_mutex_clear(&self->lock);
+  g_main_context_unref(self->context);
 
   /* Always chain up to the parent finalize function to complete object
    * destruction. */
@@ -948,8 +2540,20 @@ set_property(GObject *object,
     break;
 
   case PROP_ID:
+    if (self->key != NULL) {
+      webrtc_log_forget_session(self->key);
+      webrtc_cpu_forget_session(self->key);
+    }
     g_free(self->id);
+    g_free(self->key);
     self->id = g_value_dup_string(value);
+    self->key = NULL;
+    if (self->id != NULL) {
+      self->key = g_strdup_printf("%s#%u",
+                                  self->id,
+                                  (guint) g_atomic_int_add(&key_serial, 1));
+      webrtc_cpu_add_session(self->key);
+    }
     break;
 
   case PROP_TARGET:
@@ -974,6 +2578,35 @@ webrtc_session_class_init(WebrtcSessionClass *klass)
   object_class->set_property = set_property;
   object_class->get_property = get_property;
 
+  session_signal_defs[SIG_STREAMING] =
+          g_signal_newv("streaming",
+                        G_TYPE_FROM_CLASS(object_class),
+                        G_SIGNAL_RUN_LAST | G_SIGNAL_NO_RECURSE |
+                                G_SIGNAL_NO_HOOKS,
+                        NULL /* closure */,
+                        NULL /* accumulator */,
+                        NULL /* accumulator data */,
+                        NULL /* C marshaller */,
+                        G_TYPE_NONE /* return_type */,
+                        0 /* n_params */,
+                        NULL /* param_types, or set to NULL */
+          );
+
+  GType health_types[] = { G_TYPE_UINT, G_TYPE_STRING };
+  session_signal_defs[SIG_HEALTH_CHANGED] =
+          g_signal_newv("health-changed",
+                        G_TYPE_FROM_CLASS(object_class),
+                        G_SIGNAL_RUN_LAST | G_SIGNAL_NO_RECURSE |
+                                G_SIGNAL_NO_HOOKS,
+                        NULL /* closure */,
+                        NULL /* accumulator */,
+                        NULL /* accumulator data */,
+                        NULL /* C marshaller */,
+                        G_TYPE_NONE /* return_type */,
+                        G_N_ELEMENTS(health_types) /* n_params */,
+                        health_types /* param_types, or set to NULL */
+          );
+
   obj_properties[PROP_PROTOCOL] =
           g_param_spec_object("protocol",
                               "Protocol",
@@ -1014,6 +2647,16 @@ webrtc_session_init(WebrtcSession *self)
   self->audio = g_ptr_array_new_full(0, g_object_unref);
   self->video = g_ptr_array_new_full(0, g_object_unref);
   self->mux = g_ptr_array_new_full(0, g_object_unref);
+  self->jitterbuffers = g_ptr_array_new_full(0, gst_object_unref);
+  self->queues = g_ptr_array_new_full(0, gst_object_unref);
+  self->fec_decoders = g_ptr_array_new_full(0, gst_object_unref);
+  self->protection = "none";
+  self->max_bitrate = -1;
+  self->requested_bitrate = -1;
+  self->remote_ssrcs = g_array_new(FALSE, FALSE, sizeof(guint32));
+  g_mutex_init(&self->lock);
+  self->health = WEBRTC_SESSION_HEALTH_STARTING;
+  self->context = g_main_context_ref_thread_default();
 
   g_ptr_array_add(self->video, gst_element_factory_make("queue", NULL));
   g_ptr_array_add(self->video, gst_element_factory_make("videoconvert", NULL));
@@ -1064,7 +2707,35 @@ webrtc_session_add_element(WebrtcSession *self,
     self->use_mux = TRUE;
     break;
   default:
-    g_warning("Invalid element type!");
+    WEBRTC_LOG_WARNING(WEBRTC_LOG_PIPELINE,
+                       self->key,
+                       "Invalid element type!");
+  }
+}
+
+static const gchar *
+preferred_video_codec(WebrtcSession *self)
+{
+  switch (webrtc_settings_video_codec(self->settings)) {
+  case WEBRTC_SETTINGS_VIDEO_CODEC_H265:
+    return "H265";
+  case WEBRTC_SETTINGS_VIDEO_CODEC_H264:
+    /* fall through */
+  default:
+    return "H264";
+  }
+}
+
+static const gchar *
+preferred_audio_codec(WebrtcSession *self)
+{
+  switch (webrtc_settings_audio_codec(self->settings)) {
+  case WEBRTC_SETTINGS_AUDIO_CODEC_AAC:
+    return "MPEG4-GENERIC";
+  case WEBRTC_SETTINGS_AUDIO_CODEC_OPUS:
+    /* fall through */
+  default:
+    return "OPUS";
   }
 }
 
@@ -1074,24 +2745,35 @@ set_transceiver(WebrtcSession *self)
   GstCaps *video_caps;
   GstCaps *audio_caps;
   GstWebRTCRTPTransceiver *trans = NULL;
+  gboolean decode;
 
   g_assert(self);
 
-  video_caps = gst_caps_from_string(
-          "application/x-rtp,media=video,encoding-name=H264,payload=" RTP_PAYLOAD_TYPE);
+  /* Only offer what the consumers of this session can handle */
+  decode = self->use_video || self->use_audio;
+
+  video_caps = webrtc_codec_transceiver_caps(WEBRTC_CODEC_MEDIA_VIDEO,
+                                             preferred_video_codec(self),
+                                             decode);
   g_signal_emit_by_name(self->webrtc_bin,
                         "add-transceiver",
                         GST_WEBRTC_RTP_TRANSCEIVER_DIRECTION_RECVONLY,
                         video_caps,
                         &trans);
   gst_caps_unref(video_caps);
+  /* do-nack makes webrtcbin accept the rtx payload offered for the media,
+   * whether NACKs are sent is up to the latency profile. ULPFEC is only
+   * worth its overhead on video. */
   g_object_set(trans, "do-nack", TRUE, NULL);
+  if (webrtc_settings_fec(self->settings)) {
+    g_object_set(trans, "fec-type", GST_WEBRTC_FEC_TYPE_ULP_RED, NULL);
+  }
 
   gst_object_unref(trans);
 
-  audio_caps = gst_caps_from_string(
-          "x-rtp,media=audio,encoding-name=OPUS,"
-          "clock-rate=48000,payload=97,encoding-params=(string)2");
+  audio_caps = webrtc_codec_transceiver_caps(WEBRTC_CODEC_MEDIA_AUDIO,
+                                             preferred_audio_codec(self),
+                                             decode);
   g_signal_emit_by_name(self->webrtc_bin,
                         "add-transceiver",
                         GST_WEBRTC_RTP_TRANSCEIVER_DIRECTION_RECVONLY,
@@ -1131,14 +2813,36 @@ webrtc_session_start(WebrtcSession *self, gboolean stat_file)
     g_clear_object(&stats_file);
   }
 
+  self->profile =
+          &latency_profiles[webrtc_settings_latency_profile(self->settings)];
+
+  if (webrtc_settings_get_metadata(self->settings) != NULL) {
+    GError *lerr = NULL;
+
+    self->metadata = webrtc_metadata_schema_new(
+            webrtc_settings_get_metadata(self->settings),
+            &lerr);
+    if (self->metadata == NULL) {
+      WEBRTC_LOG_WARNING(WEBRTC_LOG_SESSION,
+                         self->key,
+                         "Ignoring the data channel: %s",
+                         lerr->message);
+      g_clear_error(&lerr);
+    } else {
+      self->metadata_values =
+              g_new0(gdouble, webrtc_metadata_schema_n_fields(self->metadata));
+    }
+  }
+
   /* Create gstreamer elements */
   pipeline = gst_pipeline_new("video-player");
   self->pipeline = pipeline;
+  webrtc_tracer_tag_pipeline(pipeline, self->key);
   self->webrtc_bin = gst_element_factory_make("webrtcbin", "video-source");
 
   if (webrtc_settings_ice_force_turn(self->settings)) {
     transport_policy = GST_WEBRTC_ICE_TRANSPORT_POLICY_RELAY;
-    g_message("Enforcing TURN relay");
+    WEBRTC_LOG_INFO(WEBRTC_LOG_SESSION, self->key, "Enforcing TURN relay");
   }
 
   g_object_set(self->webrtc_bin,
@@ -1146,6 +2850,8 @@ webrtc_session_start(WebrtcSession *self, gboolean stat_file)
                GST_WEBRTC_BUNDLE_POLICY_MAX_BUNDLE,
                "ice-transport-policy",
                transport_policy,
+               "latency",
+               self->profile->latency,
                NULL);
 
   // conv = gst_element_factory_make("videoconvert", "converter");
@@ -1169,7 +2875,10 @@ webrtc_session_start(WebrtcSession *self, gboolean stat_file)
 */
 
   if (!pipeline || !self->webrtc_bin) {
-    g_printerr("One element could not be created. Exiting.\n");
+    WEBRTC_LOG(WEBRTC_LOG_PIPELINE,
+               WEBRTC_LOG_LEVEL_ERROR,
+               self->key,
+               "One element could not be created");
 
     return;
   }
@@ -1180,8 +2889,20 @@ webrtc_session_start(WebrtcSession *self, gboolean stat_file)
           G_CALLBACK(on_ice_candidate_callback),
           self);
 
+  connect(self->signals,
+          G_OBJECT(self->webrtc_bin),
+          "notify::ice-connection-state",
+          G_CALLBACK(on_ice_connection_state),
+          self);
+
+  connect(self->signals,
+          G_OBJECT(pipeline),
+          "deep-element-added",
+          G_CALLBACK(on_deep_element_added),
+          self);
+
   bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
-  gst_bus_add_watch(bus, bus_call, self);
+  gst_bus_set_sync_handler(bus, bus_sync_handler, self, NULL);
   gst_object_unref(bus);
 
   set_transceiver(self);
@@ -1206,6 +2927,10 @@ webrtc_session_start(WebrtcSession *self, gboolean stat_file)
                              self->settings,
                              self->id);
   gst_element_set_state(self->pipeline, GST_STATE_PLAYING);
+
+  self->stats_timer = g_timeout_add_seconds(STATS_INTERVAL,
+                                            G_SOURCE_FUNC(request_stats),
+                                            self);
 }
 
 gboolean
@@ -1220,10 +2945,13 @@ webrtc_session_check_plugins(void)
 
   registry = gst_registry_get();
   for (guint i = 0; i < g_strv_length((gchar **) needed); i++) {
-    g_message("Checking %s", needed[i]);
+    WEBRTC_LOG_DEBUG(WEBRTC_LOG_PIPELINE, NULL, "Checking %s", needed[i]);
     plugin = gst_registry_find_plugin(registry, needed[i]);
     if (!plugin) {
-      gst_print("Required gstreamer plugin '%s' not found\n", needed[i]);
+      WEBRTC_LOG_WARNING(WEBRTC_LOG_PIPELINE,
+                         NULL,
+                         "Required gstreamer plugin '%s' not found",
+                         needed[i]);
       ret = FALSE;
       continue;
     }
@@ -1247,10 +2975,38 @@ webrtc_session_stop(WebrtcSession *self)
     }
   }
 
+  g_clear_handle_id(&self->stats_timer, g_source_remove);
+  g_clear_handle_id(&self->ice_timer, g_source_remove);
+  g_clear_handle_id(&self->layer_timer, g_source_remove);
+
+  /* Stopping takes long, the reaper does it. Streaming threads can still
+   * call into the session until then, so it holds a reference. */
   if (self->pipeline != NULL) {
-    gst_element_set_state(self->pipeline, GST_STATE_NULL);
-    g_clear_object(&self->pipeline);
+    GstBus *bus;
+
+    bus = gst_pipeline_get_bus(GST_PIPELINE(self->pipeline));
+    gst_bus_set_sync_handler(bus, NULL, NULL, NULL);
+    gst_object_unref(bus);
+    /* Nothing is accounted to the session during the teardown */
+    webrtc_tracer_untag_pipeline(self->pipeline);
+    webrtc_reaper_push(g_steal_pointer(&self->pipeline),
+                       self->key,
+                       self->drain,
+                       g_object_unref,
+                       g_object_ref(self));
+  }
+  g_mutex_lock(&self->lock);
+  g_ptr_array_set_size(self->jitterbuffers, 0);
+  g_ptr_array_set_size(self->queues, 0);
+  g_ptr_array_set_size(self->fec_decoders, 0);
+  gst_clear_object(&self->metadata_src);
+  gst_clear_object(&self->video_decoder);
+  if (self->rtp_session != NULL) {
+    g_clear_signal_handler(&self->rtcp_handler, self->rtp_session);
+    g_clear_object(&self->rtp_session);
   }
+  g_array_set_size(self->remote_ssrcs, 0);
+  g_mutex_unlock(&self->lock);
   g_cancellable_cancel(self->cancel);
 }
 
@@ -1260,4 +3016,170 @@ webrtc_session_get_id(WebrtcSession *self)
   g_return_val_if_fail(self != NULL, NULL);
 
   return self->id;
-}
\ No newline at end of file
+}
+
+void
+webrtc_session_get_stats(WebrtcSession *self,
+                         struct webrtc_session_stats *stats)
+{
+  g_return_if_fail(self != NULL);
+  g_return_if_fail(stats != NULL);
+
+  g_mutex_lock(&self->lock);
+  *stats = self->stats;
+  g_mutex_unlock(&self->lock);
+}
+
+void
+webrtc_session_set_drain(WebrtcSession *self, gboolean drain)
+{
+  g_return_if_fail(self != NULL);
+
+  self->drain = drain;
+}
+
+enum webrtc_session_health
+webrtc_session_get_health(WebrtcSession *self)
+{
+  enum webrtc_session_health health;
+
+  g_return_val_if_fail(self != NULL, WEBRTC_SESSION_HEALTH_FAILED);
+
+  g_mutex_lock(&self->lock);
+  health = self->health;
+  g_mutex_unlock(&self->lock);
+
+  return health;
+}
+
+const gchar *
+webrtc_session_health_name(enum webrtc_session_health health)
+{
+  g_return_val_if_fail(health < G_N_ELEMENTS(health_names), NULL);
+
+  return health_names[health];
+}
+
+static gboolean
+renegotiate_layer(gpointer user_data)
+{
+  WebrtcSession *self = WEBRTC_SESSION(user_data);
+  gboolean changed;
+
+  self->layer_timer = 0;
+
+  g_mutex_lock(&self->lock);
+  changed = self->negotiated && self->layer != self->answered;
+  g_mutex_unlock(&self->lock);
+
+  if (!changed) {
+    return G_SOURCE_REMOVE;
+  }
+
+  WEBRTC_LOG_INFO(WEBRTC_LOG_SESSION,
+                  self->key,
+                  "Renegotiating for the simulcast layer");
+  webrtc_client_init_session(self->protocol,
+                             self->target,
+                             self->settings,
+                             self->id);
+
+  return G_SOURCE_REMOVE;
+}
+
+void
+webrtc_session_select_layer(WebrtcSession *self,
+                            enum webrtc_session_layer layer)
+{
+  g_return_if_fail(self != NULL);
+
+  g_mutex_lock(&self->lock);
+  if (self->layer == layer) {
+    g_mutex_unlock(&self->lock);
+    return;
+  }
+  self->layer = layer;
+  g_mutex_unlock(&self->lock);
+
+  WEBRTC_LOG_INFO(WEBRTC_LOG_SESSION,
+                  self->key,
+                  "Selecting %s layer",
+                  layer == WEBRTC_SESSION_LAYER_LOW ? "low" : "high");
+
+  apply_layer(self);
+
+  /* The simulcast layer is part of the answer already sent, the device is
+   * asked for a new offer the same way an ICE restart does. Switching back
+   * before the timer fires needs none. */
+  if (self->rids != NULL) {
+    g_clear_handle_id(&self->layer_timer, g_source_remove);
+    self->layer_timer =
+            g_timeout_add(LAYER_DEBOUNCE + g_random_int_range(0, LAYER_STAGGER),
+                          renegotiate_layer,
+                          self);
+  }
+}
+
+void
+webrtc_session_drop_audio(WebrtcSession *self, gboolean drop)
+{
+  g_return_if_fail(self != NULL);
+
+  drop = !!drop;
+  if (g_atomic_int_get(&self->drop_audio) == drop) {
+    return;
+  }
+
+  g_atomic_int_set(&self->drop_audio, drop);
+  WEBRTC_LOG_INFO(WEBRTC_LOG_SESSION,
+                  self->key,
+                  "%s audio",
+                  drop ? "Dropping" : "Recording");
+}
+
+void
+webrtc_session_set_max_bitrate(WebrtcSession *self, gint64 kbps)
+{
+  gint64 requested;
+  gboolean negotiated;
+
+  g_return_if_fail(self != NULL);
+
+  g_mutex_lock(&self->lock);
+  self->max_bitrate = kbps;
+  negotiated = self->negotiated;
+  g_mutex_unlock(&self->lock);
+
+  /* Until the answer is sent the device uses the initSession limits */
+  if (kbps <= 0 || !negotiated) {
+    return;
+  }
+
+  /* The REMB in every RTCP report follows the limit closely, the device is
+   * only asked to reconfigure its encoder on changes of more than 10% */
+  requested = self->requested_bitrate;
+  if (requested > 0 && ABS(kbps - requested) * 10 <= requested) {
+    return;
+  }
+
+  WEBRTC_LOG_INFO(WEBRTC_LOG_SESSION,
+                  self->key,
+                  "Limiting video to %" G_GINT64_FORMAT " kbps",
+                  kbps);
+  self->requested_bitrate = kbps;
+  webrtc_client_update_session(self->protocol, self->target, self->id, kbps);
+}
+
+gint64
+webrtc_session_get_max_bitrate(WebrtcSession *self)
+{
+  gint64 kbps;
+
+  g_return_val_if_fail(self != NULL, -1);
+
+  g_mutex_lock(&self->lock);
+  kbps = self->max_bitrate;
+  g_mutex_unlock(&self->lock);
+
+  return kbps;
+}
@@ -5,16 +5,89 @@
 #include <gst/gst.h>
 
 #include "webrtc_client.h"
+#include "webrtc_cpu.h"
 #include "webrtc_settings.h"
 
 G_BEGIN_DECLS
 
+#define WEBRTC_SESSION_NAME_SIZE     64  /* element names in the stats */
+#define WEBRTC_SESSION_METADATA_SIZE 512 /* a metadata record as text */
+
 enum webrtc_session_elem_type {
   WEBRTC_SESSION_ELEM_VIDEO = 0,
   WEBRTC_SESSION_ELEM_AUDIO,
   WEBRTC_SESSION_ELEM_MUX
 };
 
+/** Which layer of a simulcast or scalable stream to consume */
+enum webrtc_session_layer {
+  WEBRTC_SESSION_LAYER_HIGH = 0,
+  WEBRTC_SESSION_LAYER_LOW,
+};
+
+/** Health of a session, driven by its pipeline bus. Failed is final, the
+ * session has to be stopped. */
+enum webrtc_session_health {
+  WEBRTC_SESSION_HEALTH_STARTING = 0,
+  WEBRTC_SESSION_HEALTH_CONNECTING, /* answer sent, waiting for media */
+  WEBRTC_SESSION_HEALTH_STREAMING,
+  WEBRTC_SESSION_HEALTH_DEGRADED, /* warnings, QoS drops or buffering */
+  WEBRTC_SESSION_HEALTH_FAILED,
+};
+
+/** Signal: streaming
+ * on_streaming(
+ *  WebrtcSession *self,
+ *  gpointer user_data
+ *);
+ *
+ * Media arrived for the first time after the session was started
+ */
+
+/** Signal: health-changed
+ * on_health_changed(
+ *  WebrtcSession *self,
+ *  guint health,
+ *  const gchar *reason,
+ *  gpointer user_data
+ *);
+ *
+ * Emitted on the main context for transitions only, reason is a short text
+ * for the log
+ */
+
+struct webrtc_session_stats {
+  const gchar *latency_profile;
+  guint latency;           /* ms */
+  guint64 bytes_received;
+  guint64 packets_received;
+  gint64 packets_lost;     /* as reported by the sender side RTCP */
+  guint64 packets_late;    /* dropped by the jitterbuffer, arrived too late */
+  gdouble jitter;          /* s */
+  const gchar *protection; /* negotiated loss protection, e.g. "rtx" */
+  guint64 packets_rtx_recovered;
+  guint64 packets_fec_recovered;
+  guint64 bitrate; /* kbps, received during the last interval */
+  guint ice_restarts;     /* asked the device for a new offer */
+  guint outages;          /* ICE lost and recovered in place */
+  guint64 outage_time;    /* ms, total of the recovered outages */
+  guint64 recovery_time;  /* ms, of the last recovered outage */
+  struct webrtc_cpu_usage cpu; /* of the streaming threads */
+  guint64 memory;        /* bytes in queues and jitterbuffers, estimated */
+  guint64 memory_peak;
+  guint64 memory_budget;  /* 0 if unlimited */
+  /* With the tracer, empty without buffers */
+  gchar slowest_element[WEBRTC_SESSION_NAME_SIZE]; /* highest 99th pct */
+  guint64 slowest_time; /* us, its 99th percentile */
+  gchar fullest_queue[WEBRTC_SESSION_NAME_SIZE];
+  gint queue_fill; /* percent, its highest level */
+  guint64 metadata_records;     /* decoded from the data channel */
+  guint64 metadata_invalid;     /* messages not made of whole records */
+  guint64 metadata_dropped;     /* records the muxer did not keep up with */
+  /* "NAME=VALUE ..." of the last record, empty before the first */
+  gchar metadata_last[WEBRTC_SESSION_METADATA_SIZE];
+};
+
 /*
  * Type declaration.
  */
@@ -37,7 +110,35 @@ void webrtc_session_add_element(WebrtcSession *self,
                                 GstElement *el);
 
 void webrtc_session_start(WebrtcSession *self, gboolean stat_file);
+
+/** Disconnects the session and returns, the pipeline is stopped on the
+ * reaper thread, see webrtc_reaper_push() */
 void webrtc_session_stop(WebrtcSession *self);
 
+/** Sends an EOS through the pipeline on stop, so that the output is
+ * finished */
+void webrtc_session_set_drain(WebrtcSession *self, gboolean drain);
+
 const gchar *webrtc_session_get_id(WebrtcSession *self);
+
+/** Picks the simulcast stream with the largest or smallest restrictions.
+ * After the answer was sent the device is asked for a new offer a few
+ * seconds later, at a random point so that sessions switching together do
+ * not renegotiate at once, and not at all if the layer is back by then. */
+void webrtc_session_select_layer(WebrtcSession *self,
+                                 enum webrtc_session_layer layer);
+
+void webrtc_session_set_max_bitrate(WebrtcSession *self, gint64 kbps);
+gint64 webrtc_session_get_max_bitrate(WebrtcSession *self);
+
+/** Records gaps instead of the audio while drop is set, the muxer keeps
+ * going without it */
+void webrtc_session_drop_audio(WebrtcSession *self, gboolean drop);
+
+/** Copies the stats of the last interval, all 0 before the first */
+void webrtc_session_get_stats(WebrtcSession *self,
+                              struct webrtc_session_stats *stats);
+
+enum webrtc_session_health webrtc_session_get_health(WebrtcSession *self);
+const gchar *webrtc_session_health_name(enum webrtc_session_health health);
 G_END_DECLS
@@ -14,7 +14,25 @@ struct _WebrtcSettings {
   GSettings *settings;
   gchar *target;
   gchar *output;
+  gchar *fallback_output;
   gboolean force_turn;
+  enum webrtc_settings_latency_profile latency_profile;
+  gboolean fec;
+  enum webrtc_settings_video_codec video_codec;
+  gint64 bandwidth;
+  GStrv priorities;
+  gint memory;
+  struct webrtc_settings_admission admission;
+  GStrv servers;
+  gchar *config;
+  gchar *filter;
+  gchar *log;
+  gint trace;
+  gboolean telemetry;
+  gchar *metadata;
+  gchar *catalog;
+  GKeyFile *overrides; /* the command line, as in the --config file */
+  WebrtcSettings *defaults; /* as the program set them before parse_opts */
 };
 
 G_DEFINE_TYPE(WebrtcSettings, webrtc_settings, G_TYPE_OBJECT)
@@ -26,12 +44,34 @@ typedef enum {
   PROP_MAX_BITRATE,
   PROP_ADAPTIVE,
   PROP_FORCE_TURN,
+  PROP_LATENCY_PROFILE,
+  PROP_FEC,
+  PROP_VIDEO_CODEC,
+  PROP_BANDWIDTH,
+  PROP_PRIORITIES,
+  PROP_MEMORY,
   N_PROPERTIES
 } WebrtcSettingsProperty;
 static GParamSpec *obj_properties[N_PROPERTIES] = {
   NULL,
 };
 
+/* Of the properties in the key file and in the changed settings */
+static const gchar *key_names[N_PROPERTIES] = {
+  [PROP_GOP] = "gop",
+  [PROP_AUDIO_CODEC] = "audio-codec",
+  [PROP_COMPRESSION] = "compression",
+  [PROP_MAX_BITRATE] = "max-bitrate",
+  [PROP_ADAPTIVE] = "adaptive",
+  [PROP_FORCE_TURN] = "force-turn",
+  [PROP_LATENCY_PROFILE] = "latency-profile",
+  [PROP_FEC] = "fec",
+  [PROP_VIDEO_CODEC] = "video-codec",
+  [PROP_BANDWIDTH] = "bandwidth",
+  [PROP_PRIORITIES] = "priorities",
+  [PROP_MEMORY] = "memory",
+};
+
 static void
 webrtc_settings_dispose(GObject *obj)
 {
@@ -57,6 +97,16 @@ webrtc_settings_finalize(GObject *obj)
 
   g_free(self->target);
   g_free(self->output);
+  g_free(self->fallback_output);
+  g_strfreev(self->priorities);
+  g_strfreev(self->servers);
+  g_free(self->config);
+  g_free(self->filter);
+  g_free(self->log);
+  g_free(self->metadata);
+  g_free(self->catalog);
+  g_clear_pointer(&self->overrides, g_key_file_free);
+  g_clear_object(&self->defaults);
 
   /* Always chain up to the parent finalize function to complete object
    * destruction. */
@@ -96,6 +146,30 @@ get_property(GObject *object,
     g_value_set_boolean(value, self->force_turn);
     break;
 
+  case PROP_LATENCY_PROFILE:
+    g_value_set_int(value, self->latency_profile);
+    break;
+
+  case PROP_FEC:
+    g_value_set_boolean(value, self->fec);
+    break;
+
+  case PROP_VIDEO_CODEC:
+    g_value_set_int(value, self->video_codec);
+    break;
+
+  case PROP_BANDWIDTH:
+    g_value_set_int64(value, self->bandwidth);
+    break;
+
+  case PROP_PRIORITIES:
+    g_value_set_boxed(value, self->priorities);
+    break;
+
+  case PROP_MEMORY:
+    g_value_set_int(value, self->memory);
+    break;
+
   default:
     /* We don't have any other property... */
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
@@ -129,6 +203,25 @@ set_property(GObject *object,
   case PROP_FORCE_TURN:
     self->force_turn = g_value_get_boolean(value);
     break;
+  case PROP_LATENCY_PROFILE:
+    self->latency_profile = g_value_get_int(value);
+    break;
+  case PROP_FEC:
+    self->fec = g_value_get_boolean(value);
+    break;
+  case PROP_VIDEO_CODEC:
+    self->video_codec = g_value_get_int(value);
+    break;
+  case PROP_BANDWIDTH:
+    self->bandwidth = g_value_get_int64(value);
+    break;
+  case PROP_PRIORITIES:
+    g_strfreev(self->priorities);
+    self->priorities = g_value_dup_boxed(value);
+    break;
+  case PROP_MEMORY:
+    self->memory = g_value_get_int(value);
+    break;
   default:
     /* We don't have any other property... */
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
@@ -195,14 +288,67 @@ webrtc_settings_class_init(WebrtcSettingsClass *klass)
                                FALSE, /* default */
                                G_PARAM_READWRITE);
 
+  obj_properties[PROP_LATENCY_PROFILE] =
+          g_param_spec_int("latency_profile",
+                           "Latency_profile",
+                           "Jitterbuffer latency versus loss trade-off.",
+                           0,
+                           WEBRTC_SETTINGS_LATENCY_PROFILE_LAST - 1,
+                           WEBRTC_SETTINGS_LATENCY_PROFILE_BALANCED,
+                           G_PARAM_READWRITE);
+
+  obj_properties[PROP_FEC] =
+          g_param_spec_boolean("fec",
+                               "Fec",
+                               "Negotiate RED/ULPFEC on the video transceiver.",
+                               FALSE, /* default */
+                               G_PARAM_READWRITE);
+
+  obj_properties[PROP_VIDEO_CODEC] =
+          g_param_spec_int("video_codec",
+                           "Video_codec",
+                           "Video codec preferred when negotiating.",
+                           0,
+                           WEBRTC_SETTINGS_VIDEO_CODEC_LAST - 1,
+                           WEBRTC_SETTINGS_VIDEO_CODEC_H264, /* default */
+                           G_PARAM_READWRITE);
+
+  obj_properties[PROP_BANDWIDTH] =
+          g_param_spec_int64("bandwidth",
+                             "Bandwidth",
+                             "Receive budget for all sessions in kbps.",
+                             -1,
+                             G_MAXINT32,
+                             -1, /* default */
+                             G_PARAM_READWRITE);
+
+  obj_properties[PROP_PRIORITIES] =
+          g_param_spec_boxed("priorities",
+                             "Priorities",
+                             "Bandwidth weights by trigger type or subject.",
+                             G_TYPE_STRV,
+                             G_PARAM_READWRITE);
+
+  obj_properties[PROP_MEMORY] =
+          g_param_spec_int("memory",
+                           "Memory",
+                           "Budget per session in MB, 0 for the defaults.",
+                           0,
+                           G_MAXINT16,
+                           WEBRTC_SETTINGS_DEFAULT_MEMORY,
+                           G_PARAM_READWRITE);
+
   g_object_class_install_properties(object_class, N_PROPERTIES, obj_properties);
 }
 
 static void
-webrtc_settings_init(G_GNUC_UNUSED WebrtcSettings *self)
+webrtc_settings_init(WebrtcSettings *self)
 {
   /* initialize all public and private members to reasonable default values.
    * They are all automatically initialized to 0 to begin with. */
+  self->latency_profile = WEBRTC_SETTINGS_LATENCY_PROFILE_BALANCED;
+  self->bandwidth = -1;
+  self->memory = WEBRTC_SETTINGS_DEFAULT_MEMORY;
 }
 
 WebrtcSettings *
@@ -211,6 +357,40 @@ webrtc_settings_new(void)
   return g_object_new(WEBRTC_TYPE_SETTINGS, NULL);
 }
 
+WebrtcSettings *
+webrtc_settings_dup(WebrtcSettings *self)
+{
+  WebrtcSettings *copy;
+
+  g_return_val_if_fail(self != NULL, NULL);
+
+  copy = webrtc_settings_new();
+
+  for (guint i = 1; i < N_PROPERTIES; i++) {
+    GValue value = G_VALUE_INIT;
+
+    g_value_init(&value, obj_properties[i]->value_type);
+    g_object_get_property(G_OBJECT(self), obj_properties[i]->name, &value);
+    g_object_set_property(G_OBJECT(copy), obj_properties[i]->name, &value);
+    g_value_unset(&value);
+  }
+
+  copy->target = g_strdup(self->target);
+  copy->output = g_strdup(self->output);
+  copy->fallback_output = g_strdup(self->fallback_output);
+  copy->admission = self->admission;
+  copy->servers = g_strdupv(self->servers);
+  copy->config = g_strdup(self->config);
+  copy->filter = g_strdup(self->filter);
+  copy->log = g_strdup(self->log);
+  copy->trace = self->trace;
+  copy->telemetry = self->telemetry;
+  copy->metadata = g_strdup(self->metadata);
+  copy->catalog = g_strdup(self->catalog);
+
+  return copy;
+}
+
 enum webrtc_settings_audio_codec
 webrtc_settings_audio_codec(WebrtcSettings *self)
 {
@@ -237,6 +417,11 @@ webrtc_settings_video_gop(WebrtcSettings *self)
 {
   return self->gop;
 }
+enum webrtc_settings_video_codec
+webrtc_settings_video_codec(WebrtcSettings *self)
+{
+  return self->video_codec;
+}
 
 void
 webrtc_settings_set_string(WebrtcSettings *self,
@@ -245,6 +430,8 @@ webrtc_settings_set_string(WebrtcSettings *self,
 {
   const gchar *audio_codec_list[] = AUDIO_CODEC_LIST;
   const gchar *boolean_options_list[] = BOOLEAN_LIST;
+  const gchar *latency_profile_list[] = LATENCY_PROFILE_LIST;
+  const gchar *video_codec_list[] = VIDEO_CODEC_LIST;
 
   if (setting == WEBRTC_SETTINGS_AUDIO_CODEC) {
     for (guint i = 0; i < G_N_ELEMENTS(audio_codec_list); i++) {
@@ -278,6 +465,39 @@ webrtc_settings_set_string(WebrtcSettings *self,
     }
     return;
   }
+
+  if (setting == WEBRTC_SETTINGS_FEC) {
+    if (g_strcmp0(boolean_options_list[0], val) == 0) {
+      g_object_set(self, "fec", FALSE, NULL);
+      g_settings_set_boolean(self->settings, "fec", FALSE);
+    } else {
+      g_object_set(self, "fec", TRUE, NULL);
+      g_settings_set_boolean(self->settings, "fec", TRUE);
+    }
+    return;
+  }
+
+  if (setting == WEBRTC_SETTINGS_LATENCY_PROFILE) {
+    for (guint i = 0; i < G_N_ELEMENTS(latency_profile_list); i++) {
+      if (g_strcmp0(latency_profile_list[i], val) == 0) {
+        g_object_set(self, "latency_profile", i, NULL);
+        g_settings_set_enum(self->settings, "latency-profile", i);
+        break;
+      }
+    }
+    return;
+  }
+
+  if (setting == WEBRTC_SETTINGS_VIDEO_CODEC) {
+    for (guint i = 0; i < G_N_ELEMENTS(video_codec_list); i++) {
+      if (g_strcmp0(video_codec_list[i], val) == 0) {
+        g_object_set(self, "video_codec", i, NULL);
+        g_settings_set_enum(self->settings, "video-codec", i);
+        break;
+      }
+    }
+    return;
+  }
 }
 
 void
@@ -292,6 +512,9 @@ webrtc_settings_set_number(WebrtcSettings *self, GQuark setting, gint64 val)
   } else if (setting == WEBRTC_SETTINGS_VIDEO_GOP) {
     g_object_set(self, "gop", val, NULL);
     g_settings_set_int(self->settings, "gop", (gint) val);
+  } else if (setting == WEBRTC_SETTINGS_BANDWIDTH) {
+    g_object_set(self, "bandwidth", val, NULL);
+    g_settings_set_int64(self->settings, "bandwidth", val);
   }
 }
 
@@ -321,6 +544,22 @@ webrtc_settings_bind(WebrtcSettings *self)
                g_settings_get_int(self->settings, "compression"),
                NULL);
   g_object_set(self, "gop", g_settings_get_int(self->settings, "gop"), NULL);
+  g_object_set(self,
+               "latency_profile",
+               g_settings_get_enum(self->settings, "latency-profile"),
+               NULL);
+  g_object_set(self,
+               "fec",
+               g_settings_get_boolean(self->settings, "fec"),
+               NULL);
+  g_object_set(self,
+               "video_codec",
+               g_settings_get_enum(self->settings, "video-codec"),
+               NULL);
+  g_object_set(self,
+               "bandwidth",
+               g_settings_get_int64(self->settings, "bandwidth"),
+               NULL);
 }
 
 guint
@@ -346,68 +585,244 @@ webrtc_settings_selected(WebrtcSettings *self, GQuark setting)
     }
   }
 
+  if (setting == WEBRTC_SETTINGS_LATENCY_PROFILE) {
+    return self->latency_profile;
+  }
+
+  if (setting == WEBRTC_SETTINGS_FEC) {
+    if (self->fec == FALSE) {
+      return 0;
+    } else {
+      return 1;
+    }
+  }
+
+  if (setting == WEBRTC_SETTINGS_VIDEO_CODEC) {
+    return self->video_codec;
+  }
+
   return 0;
 }
 
+static gboolean load_settings(WebrtcSettings *self, GError **error);
+
+/* Only --config, so that the other options can override the file */
+static gchar *
+find_config(int argc, char **argv)
+{
+  GOptionContext *context;
+  gchar **args;
+  gchar *config = NULL;
+
+  /* clang-format off */
+  GOptionEntry entries[] = {
+    { "config", 'C', 0, G_OPTION_ARG_FILENAME, &config, NULL, NULL },
+    G_OPTION_ENTRY_NULL
+  };
+
+  /* clang-format on */
+
+  args = g_new0(gchar *, argc + 1);
+  for (gint i = 0; i < argc; i++) {
+    args[i] = g_strdup(argv[i]);
+  }
+
+  context = g_option_context_new(NULL);
+  g_option_context_set_ignore_unknown_options(context, TRUE);
+  g_option_context_set_help_enabled(context, FALSE);
+  g_option_context_add_main_entries(context, entries, NULL);
+  g_option_context_parse_strv(context, &args, NULL);
+  g_option_context_free(context);
+  g_strfreev(args);
+
+  return config;
+}
+
+static void
+override_string(GKeyFile *kf,
+                const gchar *group,
+                const gchar *key,
+                const gchar *val)
+{
+  if (val != NULL) {
+    g_key_file_set_string(kf, group, key, val);
+  }
+}
+
+/* Negative for not given */
+static void
+override_number(GKeyFile *kf,
+                const gchar *group,
+                const gchar *key,
+                gint64 val)
+{
+  if (val >= 0) {
+    g_key_file_set_int64(kf, group, key, val);
+  }
+}
+
+static void
+override_list(GKeyFile *kf, const gchar *key, GStrv list)
+{
+  if (list != NULL) {
+    g_key_file_set_string_list(kf,
+                               "writer",
+                               key,
+                               (const gchar *const *) list,
+                               g_strv_length(list));
+  }
+}
+
+static void
+override_flag(GKeyFile *kf,
+              const gchar *group,
+              const gchar *key,
+              gboolean flag)
+{
+  if (flag) {
+    g_key_file_set_boolean(kf, group, key, TRUE);
+  }
+}
+
+/* The options in the groups and keys of the --config file, so that a
+ * reload applies them on top of the file again. The choices are checked
+ * when they are loaded. */
+static GKeyFile *
+save_overrides(WebrtcSettings *cli,
+               const gchar *audio,
+               const gchar *latency,
+               const gchar *video,
+               gint memory)
+{
+  struct webrtc_settings_admission *limits = &cli->admission;
+  GKeyFile *kf = g_key_file_new();
+
+  override_string(kf, "session", "audio-codec", audio);
+  override_string(kf, "session", "latency-profile", latency);
+  override_string(kf, "session", "video-codec", video);
+  override_number(kf, "session", "memory", MIN(memory, G_MAXINT16));
+  override_flag(kf, "session", "force-turn", cli->force_turn);
+  override_flag(kf, "session", "fec", cli->fec);
+
+  override_string(kf, "writer", "output", cli->output);
+  override_string(kf, "writer", "fallback-output", cli->fallback_output);
+  override_string(kf, "writer", "target", cli->target);
+  override_string(kf, "writer", "catalog", cli->catalog);
+  override_string(kf, "writer", "filter", cli->filter);
+  override_string(kf, "writer", "log", cli->log);
+  override_string(kf, "writer", "metadata", cli->metadata);
+  override_list(kf, "servers", cli->servers);
+  override_list(kf, "priorities", cli->priorities);
+  override_number(kf,
+                  "writer",
+                  "bandwidth",
+                  cli->bandwidth > 0 ? cli->bandwidth : -1);
+  override_number(kf, "writer", "max-sessions", limits->max_sessions);
+  override_number(kf, "writer", "max-starting", limits->max_starting);
+  override_number(kf, "writer", "max-cpu", limits->max_cpu);
+  override_number(kf, "writer", "max-disk", limits->max_disk);
+  override_number(kf, "writer", "min-free", limits->min_free);
+  override_number(kf, "writer", "max-write", limits->max_write);
+  override_number(kf, "writer", "trace", cli->trace);
+  override_flag(kf, "writer", "telemetry", cli->telemetry);
+
+  return kf;
+}
+
 gint
 webrtc_settings_parse_opts(WebrtcSettings *self, int argc, char **argv)
 {
   GError *error = NULL;
   GOptionContext *context;
-  gchar *audio;
-  gboolean turn;
+  WebrtcSettings *cli;
+  gchar *audio = NULL;
+  gchar *latency = NULL;
+  gchar *video = NULL;
+  gchar *config = NULL;
+  gint memory = -1;
+  gint ret = -1;
+
+  /* Only what was given, the rest comes from the file or the defaults */
+  cli = webrtc_settings_new();
+  cli->bandwidth = 0;
+  cli->admission = (struct webrtc_settings_admission) { -1, -1, -1,
+                                                        -1, -1, -1 };
+  cli->trace = -1;
 
   /* clang-format off */
   GOptionEntry entries[] = {
-    { "output", 'o', 0, G_OPTION_ARG_STRING, &self->output, "Output file", "FILE" },
-    { "target", 't', 0, G_OPTION_ARG_STRING, &self->target, "Target device", "TARGET" },
+    { "config", 'C', 0, G_OPTION_ARG_FILENAME, &config, "Key file with the settings, reloaded on SIGHUP", "FILE" },
+    { "output", 'o', 0, G_OPTION_ARG_STRING, &cli->output, "Output file", "FILE" },
+    { "fallback-output", 'O', 0, G_OPTION_ARG_FILENAME, &cli->fallback_output, "Directory for new recordings while the output volume is full", "DIR" },
+    { "target", 't', 0, G_OPTION_ARG_STRING, &cli->target, "Target device", "TARGET" },
+    { "catalog", 'K', 0, G_OPTION_ARG_FILENAME, &cli->catalog, "Index of the recordings and their keyframes, appended to", "FILE" },
+    { "filter", 'F', 0, G_OPTION_ARG_FILENAME, &cli->filter, "File with stream filter rules, one per line", "FILE" },
+    { "server", 'S', 0, G_OPTION_ARG_STRING_ARRAY, &cli->servers, "Server to connect to instead of WEBRTC_HOST, may be repeated", "[USER[:PASS]@]HOST" },
     { "audio", 'a', 0, G_OPTION_ARG_STRING, &audio, "Which audio codec to use (AAC | OPUS | NONE)", "AUDIO" },
-    { "force-turn", 'u', 0, G_OPTION_ARG_NONE, &turn, "Forces TURN relay", "TURN" },
+    { "video", 'v', 0, G_OPTION_ARG_STRING, &video, "Preferred video codec (H264 | H265)", "VIDEO" },
+    { "force-turn", 'u', 0, G_OPTION_ARG_NONE, &cli->force_turn, "Forces TURN relay", "TURN" },
+    { "fec", 'f', 0, G_OPTION_ARG_NONE, &cli->fec, "Negotiate RED/ULPFEC for video", NULL },
+    { "bandwidth", 'b', 0, G_OPTION_ARG_INT64, &cli->bandwidth, "Receive budget for all sessions in kbps", "KBPS" },
+    { "priority", 'p', 0, G_OPTION_ARG_STRING_ARRAY, &cli->priorities, "Bandwidth weight of a trigger type or subject, may be repeated", "TYPE=WEIGHT" },
+    { "latency", 'l', 0, G_OPTION_ARG_STRING, &latency, "Latency profile (LIVE-LOW-LATENCY | BALANCED | ARCHIVAL)", "PROFILE" },
+    { "memory", 'y', 0, G_OPTION_ARG_INT, &memory, "Memory budget per session for queues and jitterbuffers, 0 for the GStreamer defaults", "MB" },
+    { "max-sessions", 'm', 0, G_OPTION_ARG_INT, &cli->admission.max_sessions, "Sessions recorded at the same time", "N" },
+    { "max-starting", 's', 0, G_OPTION_ARG_INT, &cli->admission.max_starting, "Sessions negotiating at the same time", "N" },
+    { "max-cpu", 'c', 0, G_OPTION_ARG_INT, &cli->admission.max_cpu, "CPU usage in percent above which new sessions wait", "PERCENT" },
+    { "max-disk", 'd', 0, G_OPTION_ARG_INT, &cli->admission.max_disk, "Disk writes in MB/s above which new sessions wait", "MBPS" },
+    { "min-free", 'n', 0, G_OPTION_ARG_INT, &cli->admission.min_free, "Free space in MB below which an output volume counts as full", "MB" },
+    { "max-write", 'w', 0, G_OPTION_ARG_INT, &cli->admission.max_write, "Duration in ms of one disk write above which the disk counts as slow", "MS" },
+    { "log", 'L', 0, G_OPTION_ARG_STRING, &cli->log, "Log levels per category, e.g. signaling=debug,pipeline=warning", "LEVELS" },
+    { "trace", 'T', 0, G_OPTION_ARG_INT, &cli->trace, "Debug lines kept in memory and written out with the next error", "LINES" },
+    { "metadata", 'D', 0, G_OPTION_ARG_STRING, &cli->metadata, "Layout of the binary data channel records to record, e.g. time:u64,lat:f64,lon:f64", "NAME:TYPE,..." },
+    { "telemetry", 'M', 0, G_OPTION_ARG_NONE, &cli->telemetry, "Measure the time buffers spend in each element and the queue levels", NULL },
     G_OPTION_ENTRY_NULL
   };
 
   /* clang-format on */
 
+  /* What reload starts from, the program may have changed the defaults */
+  g_clear_object(&self->defaults);
+  self->defaults = webrtc_settings_dup(self);
+  self->config = find_config(argc, argv);
+
   context = g_option_context_new("-run the WebRTC client");
   g_option_context_add_main_entries(context, entries, NULL);
   /** g_option_context_add_group(context, gtk_get_option_group(TRUE));*/
   if (!g_option_context_parse(context, &argc, &argv, &error)) {
     g_print("option parsing failed: %s\n", error->message);
-    return 1;
+    g_clear_error(&error);
+    ret = 1;
+    goto out;
   }
 
-  if (self->target == NULL) {
-    self->target = g_strdup(g_getenv("WEBRTC_TARGET"));
+  self->overrides = save_overrides(cli, audio, latency, video, memory);
+  if (!load_settings(self, &error)) {
+    g_print("Failed to load the settings: %s\n", error->message);
+    g_clear_error(&error);
+    ret = 1;
+    goto out;
   }
 
-  if (self->output == NULL) {
-    self->output = g_strdup(g_getenv("WEBRTC_OUTPUT"));
+  if (self->target == NULL && self->filter == NULL) {
+    g_print("Target or filter must be set\n");
+    ret = 1;
+    goto out;
   }
 
-  if (self->target == NULL) {
-    g_print("Target must be set\n");
-    return 1;
-  }
-
-  if (g_ascii_strncasecmp("any", self->target, 3) == 0) {
-    g_clear_pointer(&self->target, g_free);
+  if (webrtc_settings_get_target(self) == NULL && self->filter == NULL) {
     g_message("Waiting for any device to connect");
   }
 
-  if (audio == NULL) {
-    self->audio_codec = WEBRTC_SETTINGS_AUDIO_CODEC_OPUS;
-  } else if (g_ascii_strcasecmp(audio, "aac") == 0) {
-    self->audio_codec = WEBRTC_SETTINGS_AUDIO_CODEC_AAC;
-  } else if (g_ascii_strcasecmp(audio, "opus") == 0) {
-    self->audio_codec = WEBRTC_SETTINGS_AUDIO_CODEC_OPUS;
-  } else if (g_ascii_strcasecmp(audio, "none") == 0) {
-    self->audio_codec = WEBRTC_SETTINGS_AUDIO_CODEC_NONE;
-  } else {
-    self->audio_codec = WEBRTC_SETTINGS_AUDIO_CODEC_OPUS;
-  }
-  self->force_turn = turn;
+out:
+  g_option_context_free(context);
+  g_object_unref(cli);
+  g_free(config);
+  g_free(audio);
+  g_free(latency);
+  g_free(video);
 
-  return -1;
+  return ret;
 }
 
 const gchar *
@@ -415,6 +830,11 @@ webrtc_settings_get_target(WebrtcSettings *self)
 {
   g_return_val_if_fail(self != NULL, NULL);
 
+  if (self->target != NULL &&
+      g_ascii_strncasecmp("any", self->target, 3) == 0) {
+    return NULL;
+  }
+
   return self->target;
 }
 
@@ -426,10 +846,667 @@ webrtc_settings_get_output(WebrtcSettings *self)
   return self->output;
 }
 
+const gchar *
+webrtc_settings_get_fallback_output(WebrtcSettings *self)
+{
+  g_return_val_if_fail(self != NULL, NULL);
+
+  return self->fallback_output;
+}
+
+const gchar *
+webrtc_settings_get_config(WebrtcSettings *self)
+{
+  g_return_val_if_fail(self != NULL, NULL);
+
+  return self->config;
+}
+
+const gchar *
+webrtc_settings_get_filter(WebrtcSettings *self)
+{
+  g_return_val_if_fail(self != NULL, NULL);
+
+  return self->filter;
+}
+
+const gchar *
+webrtc_settings_get_log(WebrtcSettings *self)
+{
+  g_return_val_if_fail(self != NULL, NULL);
+
+  return self->log;
+}
+
+guint
+webrtc_settings_get_trace(WebrtcSettings *self)
+{
+  g_return_val_if_fail(self != NULL, 0);
+
+  return self->trace;
+}
+
+const gchar *
+webrtc_settings_get_catalog(WebrtcSettings *self)
+{
+  g_return_val_if_fail(self != NULL, NULL);
+
+  return self->catalog;
+}
+
+const gchar *
+webrtc_settings_get_metadata(WebrtcSettings *self)
+{
+  g_return_val_if_fail(self != NULL, NULL);
+
+  return self->metadata;
+}
+
+gboolean
+webrtc_settings_get_telemetry(WebrtcSettings *self)
+{
+  g_return_val_if_fail(self != NULL, FALSE);
+
+  return self->telemetry;
+}
+
+const gchar *const *
+webrtc_settings_get_servers(WebrtcSettings *self)
+{
+  g_return_val_if_fail(self != NULL, NULL);
+
+  return (const gchar *const *) self->servers;
+}
+
 gboolean
 webrtc_settings_ice_force_turn(WebrtcSettings *self)
 {
   g_return_val_if_fail(self != NULL, FALSE);
 
   return self->force_turn;
-}
\ No newline at end of file
+}
+
+enum webrtc_settings_latency_profile
+webrtc_settings_latency_profile(WebrtcSettings *self)
+{
+  g_return_val_if_fail(self != NULL, WEBRTC_SETTINGS_LATENCY_PROFILE_BALANCED);
+
+  return self->latency_profile;
+}
+
+gboolean
+webrtc_settings_fec(WebrtcSettings *self)
+{
+  g_return_val_if_fail(self != NULL, FALSE);
+
+  return self->fec;
+}
+
+gint64
+webrtc_settings_bandwidth(WebrtcSettings *self)
+{
+  g_return_val_if_fail(self != NULL, -1);
+
+  return self->bandwidth;
+}
+
+guint
+webrtc_settings_memory(WebrtcSettings *self)
+{
+  g_return_val_if_fail(self != NULL, 0);
+
+  return self->memory;
+}
+
+const gchar *const *
+webrtc_settings_priorities(WebrtcSettings *self)
+{
+  g_return_val_if_fail(self != NULL, NULL);
+
+  return (const gchar *const *) self->priorities;
+}
+
+guint
+webrtc_settings_priority(WebrtcSettings *self,
+                         const gchar *subject,
+                         const gchar *trigger_type)
+{
+  guint weight = 1;
+
+  g_return_val_if_fail(self != NULL, 1);
+
+  for (guint i = 0; self->priorities != NULL && self->priorities[i] != NULL;
+       i++) {
+    gchar **rule = g_strsplit(self->priorities[i], "=", 2);
+    guint64 w;
+
+    if (g_strv_length(rule) == 2 &&
+        g_ascii_string_to_unsigned(rule[1], 10, 1, 1000, &w, NULL) &&
+        ((trigger_type != NULL &&
+          g_ascii_strcasecmp(rule[0], trigger_type) == 0) ||
+         (subject != NULL && g_str_has_prefix(subject, rule[0])))) {
+      weight = MAX(weight, (guint) w);
+    }
+    g_strfreev(rule);
+  }
+
+  return weight;
+}
+
+const struct webrtc_settings_admission *
+webrtc_settings_admission(WebrtcSettings *self)
+{
+  g_return_val_if_fail(self != NULL, NULL);
+
+  return &self->admission;
+}
+
+static gboolean
+set_checked(WebrtcSettings *self,
+            WebrtcSettingsProperty prop,
+            GValue *value,
+            const gchar *key,
+            GError **error)
+{
+  if (g_param_value_validate(obj_properties[prop], value)) {
+    g_set_error(error,
+                G_KEY_FILE_ERROR,
+                G_KEY_FILE_ERROR_INVALID_VALUE,
+                "%s is out of range",
+                key);
+    return FALSE;
+  }
+
+  g_object_set_property(G_OBJECT(self), obj_properties[prop]->name, value);
+  return TRUE;
+}
+
+static gboolean
+load_number(WebrtcSettings *self,
+            GKeyFile *kf,
+            const gchar *group,
+            const gchar *key,
+            WebrtcSettingsProperty prop,
+            GError **error)
+{
+  GValue value = G_VALUE_INIT;
+  GError *lerr = NULL;
+  gint64 val;
+  gboolean ret;
+
+  if (!g_key_file_has_key(kf, group, key, NULL)) {
+    return TRUE;
+  }
+
+  val = g_key_file_get_int64(kf, group, key, &lerr);
+  if (lerr != NULL) {
+    g_propagate_error(error, lerr);
+    return FALSE;
+  }
+
+  g_value_init(&value, obj_properties[prop]->value_type);
+  if (G_VALUE_HOLDS_INT(&value)) {
+    g_value_set_int(&value, (gint) CLAMP(val, G_MININT, G_MAXINT));
+  } else {
+    g_value_set_int64(&value, val);
+  }
+
+  ret = set_checked(self, prop, &value, key, error);
+  g_value_unset(&value);
+
+  return ret;
+}
+
+static gboolean
+load_boolean(WebrtcSettings *self,
+             GKeyFile *kf,
+             const gchar *key,
+             WebrtcSettingsProperty prop,
+             GError **error)
+{
+  GValue value = G_VALUE_INIT;
+  GError *lerr = NULL;
+  gboolean val;
+
+  if (!g_key_file_has_key(kf, "session", key, NULL)) {
+    return TRUE;
+  }
+
+  val = g_key_file_get_boolean(kf, "session", key, &lerr);
+  if (lerr != NULL) {
+    g_propagate_error(error, lerr);
+    return FALSE;
+  }
+
+  g_value_init(&value, G_TYPE_BOOLEAN);
+  g_value_set_boolean(&value, val);
+  g_object_set_property(G_OBJECT(self), obj_properties[prop]->name, &value);
+  g_value_unset(&value);
+
+  return TRUE;
+}
+
+static gboolean
+load_choice(WebrtcSettings *self,
+            GKeyFile *kf,
+            const gchar *key,
+            const gchar *const *choices,
+            WebrtcSettingsProperty prop,
+            GError **error)
+{
+  gchar *val;
+
+  if (!g_key_file_has_key(kf, "session", key, NULL)) {
+    return TRUE;
+  }
+
+  val = g_key_file_get_string(kf, "session", key, error);
+  if (val == NULL) {
+    return FALSE;
+  }
+
+  for (guint i = 0; choices[i] != NULL; i++) {
+    if (g_ascii_strcasecmp(choices[i], val) == 0) {
+      g_object_set(self, obj_properties[prop]->name, (gint) i, NULL);
+      g_free(val);
+      return TRUE;
+    }
+  }
+
+  g_set_error(error,
+              G_KEY_FILE_ERROR,
+              G_KEY_FILE_ERROR_INVALID_VALUE,
+              "%s is not a valid %s",
+              val,
+              key);
+  g_free(val);
+
+  return FALSE;
+}
+
+static gboolean
+load_limit(GKeyFile *kf, const gchar *key, gint *limit, GError **error)
+{
+  GError *lerr = NULL;
+  gint val;
+
+  if (!g_key_file_has_key(kf, "writer", key, NULL)) {
+    return TRUE;
+  }
+
+  val = g_key_file_get_integer(kf, "writer", key, &lerr);
+  if (lerr != NULL) {
+    g_propagate_error(error, lerr);
+    return FALSE;
+  }
+
+  if (val < 0) {
+    g_set_error(error,
+                G_KEY_FILE_ERROR,
+                G_KEY_FILE_ERROR_INVALID_VALUE,
+                "%s is out of range",
+                key);
+    return FALSE;
+  }
+
+  *limit = val;
+  return TRUE;
+}
+
+static gboolean
+load_flag(GKeyFile *kf, const gchar *key, gboolean *flag, GError **error)
+{
+  GError *lerr = NULL;
+  gboolean val;
+
+  if (!g_key_file_has_key(kf, "writer", key, NULL)) {
+    return TRUE;
+  }
+
+  val = g_key_file_get_boolean(kf, "writer", key, &lerr);
+  if (lerr != NULL) {
+    g_propagate_error(error, lerr);
+    return FALSE;
+  }
+
+  *flag = val;
+  return TRUE;
+}
+
+static void
+load_string(GKeyFile *kf, const gchar *key, gchar **str)
+{
+  if (g_key_file_has_key(kf, "writer", key, NULL)) {
+    g_free(*str);
+    *str = g_key_file_get_string(kf, "writer", key, NULL);
+  }
+}
+
+static void
+load_list(GKeyFile *kf, const gchar *key, GStrv *list)
+{
+  if (g_key_file_has_key(kf, "writer", key, NULL)) {
+    g_strfreev(*list);
+    *list = g_key_file_get_string_list(kf, "writer", key, NULL, NULL);
+  }
+}
+
+static gboolean
+load_key_file(WebrtcSettings *self, GKeyFile *kf, GError **error)
+{
+  const gchar *audio_codec_list[] = { "none", "opus", "aac", NULL };
+  const gchar *video_codec_list[] = VIDEO_CODEC_LIST;
+  const gchar *latency_profile_list[] = LATENCY_PROFILE_LIST;
+  struct webrtc_settings_admission *limits = &self->admission;
+
+  if (!load_choice(self,
+                   kf,
+                   "audio-codec",
+                   audio_codec_list,
+                   PROP_AUDIO_CODEC,
+                   error) ||
+      !load_choice(self,
+                   kf,
+                   "video-codec",
+                   video_codec_list,
+                   PROP_VIDEO_CODEC,
+                   error) ||
+      !load_choice(self,
+                   kf,
+                   "latency-profile",
+                   latency_profile_list,
+                   PROP_LATENCY_PROFILE,
+                   error) ||
+      !load_number(self,
+                   kf,
+                   "session",
+                   "max-bitrate",
+                   PROP_MAX_BITRATE,
+                   error) ||
+      !load_number(self,
+                   kf,
+                   "session",
+                   "compression",
+                   PROP_COMPRESSION,
+                   error) ||
+      !load_number(self, kf, "session", "gop", PROP_GOP, error) ||
+      !load_number(self, kf, "session", "memory", PROP_MEMORY, error) ||
+      !load_number(self, kf, "writer", "bandwidth", PROP_BANDWIDTH, error) ||
+      !load_boolean(self, kf, "adaptive", PROP_ADAPTIVE, error) ||
+      !load_boolean(self, kf, "fec", PROP_FEC, error) ||
+      !load_boolean(self, kf, "force-turn", PROP_FORCE_TURN, error) ||
+      !load_limit(kf, "max-sessions", &limits->max_sessions, error) ||
+      !load_limit(kf, "max-starting", &limits->max_starting, error) ||
+      !load_limit(kf, "max-cpu", &limits->max_cpu, error) ||
+      !load_limit(kf, "max-disk", &limits->max_disk, error) ||
+      !load_limit(kf, "min-free", &limits->min_free, error) ||
+      !load_limit(kf, "max-write", &limits->max_write, error) ||
+      !load_limit(kf, "trace", &self->trace, error) ||
+      !load_flag(kf, "telemetry", &self->telemetry, error)) {
+    return FALSE;
+  }
+
+  load_string(kf, "target", &self->target);
+  load_string(kf, "output", &self->output);
+  load_string(kf, "fallback-output", &self->fallback_output);
+  load_string(kf, "filter", &self->filter);
+  load_string(kf, "catalog", &self->catalog);
+  load_string(kf, "log", &self->log);
+  load_string(kf, "metadata", &self->metadata);
+  load_list(kf, "servers", &self->servers);
+  load_list(kf, "priorities", &self->priorities);
+
+  return TRUE;
+}
+
+static gboolean
+strv_equal(const gchar *const *a, const gchar *const *b)
+{
+  if (a == NULL || b == NULL) {
+    return a == b;
+  }
+
+  return g_strv_equal(a, b);
+}
+
+static void
+merge_string(gchar **to,
+             gchar **from,
+             const gchar *name,
+             GPtrArray *changed)
+{
+  if (g_strcmp0(*to, *from) != 0) {
+    g_free(*to);
+    *to = g_steal_pointer(from);
+    if (changed != NULL) {
+      g_ptr_array_add(changed, (gpointer) name);
+    }
+  }
+}
+
+static void
+merge_limit(gint *to, gint from, const gchar *name, GPtrArray *changed)
+{
+  if (*to != from) {
+    *to = from;
+    if (changed != NULL) {
+      g_ptr_array_add(changed, (gpointer) name);
+    }
+  }
+}
+
+/* Takes over the settings of from that differ, changed gets their key file
+ * names */
+static void
+merge(WebrtcSettings *self, WebrtcSettings *from, GPtrArray *changed)
+{
+  for (guint i = 1; i < N_PROPERTIES; i++) {
+    GParamSpec *pspec = obj_properties[i];
+    GValue old = G_VALUE_INIT;
+    GValue val = G_VALUE_INIT;
+    gboolean same;
+
+    g_value_init(&old, pspec->value_type);
+    g_value_init(&val, pspec->value_type);
+    g_object_get_property(G_OBJECT(self), pspec->name, &old);
+    g_object_get_property(G_OBJECT(from), pspec->name, &val);
+
+    if (pspec->value_type == G_TYPE_STRV) {
+      same = strv_equal(g_value_get_boxed(&old), g_value_get_boxed(&val));
+    } else {
+      same = g_param_values_cmp(pspec, &old, &val) == 0;
+    }
+
+    if (!same) {
+      g_object_set_property(G_OBJECT(self), pspec->name, &val);
+      if (changed != NULL) {
+        g_ptr_array_add(changed, (gpointer) key_names[i]);
+      }
+    }
+
+    g_value_unset(&old);
+    g_value_unset(&val);
+  }
+
+  merge_string(&self->target, &from->target, "target", changed);
+  merge_string(&self->output, &from->output, "output", changed);
+  merge_string(&self->fallback_output,
+               &from->fallback_output,
+               "fallback-output",
+               changed);
+  merge_string(&self->filter, &from->filter, "filter", changed);
+  merge_string(&self->catalog, &from->catalog, "catalog", changed);
+  merge_string(&self->log, &from->log, "log", changed);
+  merge_string(&self->metadata, &from->metadata, "metadata", changed);
+
+  if (!strv_equal((const gchar *const *) self->servers,
+                  (const gchar *const *) from->servers)) {
+    g_strfreev(self->servers);
+    self->servers = g_steal_pointer(&from->servers);
+    if (changed != NULL) {
+      g_ptr_array_add(changed, "servers");
+    }
+  }
+
+  merge_limit(&self->admission.max_sessions,
+              from->admission.max_sessions,
+              "max-sessions",
+              changed);
+  merge_limit(&self->admission.max_starting,
+              from->admission.max_starting,
+              "max-starting",
+              changed);
+  merge_limit(&self->admission.max_cpu,
+              from->admission.max_cpu,
+              "max-cpu",
+              changed);
+  merge_limit(&self->admission.max_disk,
+              from->admission.max_disk,
+              "max-disk",
+              changed);
+  merge_limit(&self->admission.min_free,
+              from->admission.min_free,
+              "min-free",
+              changed);
+  merge_limit(&self->admission.max_write,
+              from->admission.max_write,
+              "max-write",
+              changed);
+  merge_limit(&self->trace, from->trace, "trace", changed);
+  merge_limit(&self->telemetry, from->telemetry, "telemetry", changed);
+}
+
+gboolean
+webrtc_settings_load_file(WebrtcSettings *self,
+                          const gchar *path,
+                          GPtrArray *changed,
+                          GError **error)
+{
+  WebrtcSettings *copy;
+  GKeyFile *kf;
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail(self != NULL, FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+
+  kf = g_key_file_new();
+  copy = webrtc_settings_dup(self);
+
+  /* Into a copy first, so that a bad file changes nothing */
+  if (g_key_file_load_from_file(kf, path, G_KEY_FILE_NONE, error) &&
+      load_key_file(copy, kf, error)) {
+    merge(self, copy, changed);
+    ret = TRUE;
+  }
+
+  g_object_unref(copy);
+  g_key_file_free(kf);
+
+  return ret;
+}
+
+/* The defaults, then the --config file, the command line and the
+ * environment on top */
+static gboolean
+load_settings(WebrtcSettings *self, GError **error)
+{
+  GKeyFile *kf;
+
+  self->audio_codec = WEBRTC_SETTINGS_AUDIO_CODEC_OPUS;
+
+  if (self->config != NULL) {
+    gboolean ok;
+
+    kf = g_key_file_new();
+    ok = g_key_file_load_from_file(kf, self->config, G_KEY_FILE_NONE, error) &&
+         load_key_file(self, kf, error);
+    g_key_file_free(kf);
+    if (!ok) {
+      g_prefix_error(error, "%s: ", self->config);
+      return FALSE;
+    }
+  }
+
+  if (self->overrides != NULL && !load_key_file(self, self->overrides, error)) {
+    g_prefix_error(error, "command line: ");
+    return FALSE;
+  }
+
+  if (self->target == NULL) {
+    self->target = g_strdup(g_getenv("WEBRTC_TARGET"));
+  }
+  if (self->output == NULL) {
+    self->output = g_strdup(g_getenv("WEBRTC_OUTPUT"));
+  }
+  if (self->log == NULL) {
+    self->log = g_strdup(g_getenv("WEBRTC_LOG"));
+  }
+
+  return TRUE;
+}
+
+gboolean
+webrtc_settings_reload(WebrtcSettings *self,
+                       GPtrArray *changed,
+                       GError **error)
+{
+  WebrtcSettings *fresh;
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail(self != NULL, FALSE);
+
+  if (self->config == NULL) {
+    g_set_error(error,
+                G_FILE_ERROR,
+                G_FILE_ERROR_NOENT,
+                "No config file given");
+    return FALSE;
+  }
+
+  /* From the defaults, so that a key removed from the file is back to its
+   * default or the command line again */
+  if (self->defaults != NULL) {
+    fresh = webrtc_settings_dup(self->defaults);
+  } else {
+    fresh = webrtc_settings_new();
+  }
+  g_free(fresh->config);
+  fresh->config = g_strdup(self->config);
+  if (self->overrides != NULL) {
+    fresh->overrides = g_key_file_ref(self->overrides);
+  }
+
+  if (load_settings(fresh, error)) {
+    merge(self, fresh, changed);
+    ret = TRUE;
+  }
+
+  g_object_unref(fresh);
+
+  return ret;
+}
+
+enum webrtc_settings_scope
+webrtc_settings_scope(const gchar *name)
+{
+  g_return_val_if_fail(name != NULL, WEBRTC_SETTINGS_SCOPE_PROCESS);
+
+  /* The clients, the tracer and the catalog are only created at startup */
+  if (g_strcmp0(name, "servers") == 0 || g_strcmp0(name, "telemetry") == 0 ||
+      g_strcmp0(name, "catalog") == 0) {
+    return WEBRTC_SETTINGS_SCOPE_PROCESS;
+  }
+
+  /* The allocators, the stream filter, the disk watch and the log read
+   * these for every decision */
+  if (g_strcmp0(name, "bandwidth") == 0 ||
+      g_strcmp0(name, "priorities") == 0 || g_strcmp0(name, "target") == 0 ||
+      g_strcmp0(name, "filter") == 0 || g_strcmp0(name, "min-free") == 0 ||
+      g_strcmp0(name, "log") == 0 || g_strcmp0(name, "trace") == 0 ||
+      g_str_has_prefix(name, "max-")) {
+    return WEBRTC_SETTINGS_SCOPE_NOW;
+  }
+
+  /* Everything else goes into initSession or the pipeline of a session */
+  return WEBRTC_SETTINGS_SCOPE_NEW_SESSION;
+}
@@ -12,9 +12,20 @@ G_BEGIN_DECLS
   g_quark_from_static_string("compression")
 #define WEBRTC_SETTINGS_VIDEO_GOP  g_quark_from_static_string("keyframeInterval")
 #define WEBRTC_SETTINGS_FORCE_TURN g_quark_from_static_string("force_turn")
+#define WEBRTC_SETTINGS_LATENCY_PROFILE                                        \
+  g_quark_from_static_string("latency_profile")
+#define WEBRTC_SETTINGS_FEC         g_quark_from_static_string("fec")
+#define WEBRTC_SETTINGS_VIDEO_CODEC g_quark_from_static_string("video_codec")
+#define WEBRTC_SETTINGS_BANDWIDTH   g_quark_from_static_string("bandwidth")
 
 #define AUDIO_CODEC_LIST { "No audio", "opus", "aac", NULL }
 #define BOOLEAN_LIST     { "disabled", "enabled", NULL }
+#define LATENCY_PROFILE_LIST                                                   \
+  { "live-low-latency", "balanced", "archival", NULL }
+#define VIDEO_CODEC_LIST { "h264", "h265", NULL }
+
+/* MB per session, see webrtc_settings_memory() */
+#define WEBRTC_SETTINGS_DEFAULT_MEMORY 64
 
 /** matching the settings */
 enum webrtc_settings_audio_codec {
@@ -24,11 +35,47 @@ enum webrtc_settings_audio_codec {
   WEBRTC_SETTINGS_AUDIO_CODEC_LAST,
 };
 
+/** matching the settings, order as in VIDEO_CODEC_LIST. The selected codec
+ * is preferred, the other one is still offered as a fallback */
+enum webrtc_settings_video_codec {
+  WEBRTC_SETTINGS_VIDEO_CODEC_H264 = 0,
+  WEBRTC_SETTINGS_VIDEO_CODEC_H265,
+  WEBRTC_SETTINGS_VIDEO_CODEC_LAST,
+};
+
+/** Writer admission limits, 0 for no limit */
+struct webrtc_settings_admission {
+  gint max_sessions; /* recording at the same time */
+  gint max_starting; /* negotiating, not receiving media yet */
+  gint max_cpu;      /* percent of all cores */
+  gint max_disk;     /* MB/s written by the process */
+  gint min_free;     /* MB free on an output volume before it counts as full */
+  gint max_write;    /* ms for one disk write before the disk counts as slow */
+};
+
+/** When a changed setting takes effect */
+enum webrtc_settings_scope {
+  WEBRTC_SETTINGS_SCOPE_NOW = 0,     /* right away, also for running sessions */
+  WEBRTC_SETTINGS_SCOPE_NEW_SESSION, /* running sessions need a restart */
+  WEBRTC_SETTINGS_SCOPE_PROCESS,     /* the process needs a restart */
+};
+
+/** matching the settings, order as in LATENCY_PROFILE_LIST */
+enum webrtc_settings_latency_profile {
+  WEBRTC_SETTINGS_LATENCY_PROFILE_LOW_LATENCY = 0,
+  WEBRTC_SETTINGS_LATENCY_PROFILE_BALANCED,
+  WEBRTC_SETTINGS_LATENCY_PROFILE_ARCHIVAL,
+  WEBRTC_SETTINGS_LATENCY_PROFILE_LAST,
+};
+
 #define WEBRTC_TYPE_SETTINGS webrtc_settings_get_type()
 G_DECLARE_FINAL_TYPE(WebrtcSettings, webrtc_settings, WEBRTC, SETTINGS, GObject)
 
 WebrtcSettings *webrtc_settings_new(void);
 
+/** Unbound copy of all properties, target and output, for a single session */
+WebrtcSettings *webrtc_settings_dup(WebrtcSettings *self);
+
 enum webrtc_settings_audio_codec
 webrtc_settings_audio_codec(WebrtcSettings *self);
 
@@ -36,9 +83,35 @@ gboolean webrtc_settings_video_adaptive(WebrtcSettings *self);
 gint webrtc_settings_video_compression(WebrtcSettings *self);
 gint64 webrtc_settings_video_max_bitrate(WebrtcSettings *self);
 gint webrtc_settings_video_gop(WebrtcSettings *self);
+enum webrtc_settings_video_codec
+webrtc_settings_video_codec(WebrtcSettings *self);
 
 gboolean webrtc_settings_ice_force_turn(WebrtcSettings *self);
 
+enum webrtc_settings_latency_profile
+webrtc_settings_latency_profile(WebrtcSettings *self);
+
+gboolean webrtc_settings_fec(WebrtcSettings *self);
+
+/** Receive budget for all sessions in kbps, -1 if unlimited */
+gint64 webrtc_settings_bandwidth(WebrtcSettings *self);
+
+/** Memory in MB a session may hold in its queues and jitterbuffers, 0 to
+ * leave them at the GStreamer defaults */
+guint webrtc_settings_memory(WebrtcSettings *self);
+
+/** NULL terminated "<trigger type or subject>=<weight>" rules */
+const gchar *const *webrtc_settings_priorities(WebrtcSettings *self);
+
+/** The highest weight of the priority rules matching the trigger type or a
+ * prefix of the subject, 1 if none does */
+guint webrtc_settings_priority(WebrtcSettings *self,
+                               const gchar *subject,
+                               const gchar *trigger_type);
+
+const struct webrtc_settings_admission *
+webrtc_settings_admission(WebrtcSettings *self);
+
 void webrtc_settings_set_string(WebrtcSettings *self,
                                 GQuark setting,
                                 const gchar *val);
@@ -50,8 +123,79 @@ guint webrtc_settings_selected(WebrtcSettings *self, GQuark setting);
 
 void webrtc_settings_bind(WebrtcSettings *self);
 
+/** Loads --config before the other options, which win over the file */
 gint webrtc_settings_parse_opts(WebrtcSettings *self, int argc, char **argv);
 
+/** Applies the keys present in a key file, all or nothing:
+ *
+ * [session]
+ * audio-codec=opus|aac|none
+ * video-codec=h264|h265
+ * max-bitrate=<kbps>
+ * adaptive, fec, force-turn=true|false
+ * compression=<percent>
+ * gop=<frames>
+ * latency-profile=live-low-latency|balanced|archival
+ * memory=<MB per session>
+ *
+ * [writer]
+ * servers=[USER[:PASS]@]HOST;...
+ * target=<subject prefix>|any
+ * filter=<file with one rule per line, see webrtc_filter.h>
+ * output=<file or directory>
+ * fallback-output=<directory used while the output volume is full>
+ * catalog=<index file of the recordings, see webrtc_catalog.h>
+ * bandwidth=<kbps>
+ * priorities=<trigger type or subject>=<weight>;...
+ * max-sessions, max-starting, max-cpu, max-disk, min-free, max-write=<limit>
+ * log=[<category>=]<level>,... see webrtc_log.h
+ * trace=<lines kept in memory for the next error>
+ * metadata=<data channel record layout, see webrtc_metadata.h>
+ * telemetry=true|false
+ *
+ * The names of the settings that changed are added to changed, if set. */
+gboolean webrtc_settings_load_file(WebrtcSettings *self,
+                                   const gchar *path,
+                                   GPtrArray *changed,
+                                   GError **error);
+
+/** Builds the settings again from the defaults, as they were before
+ * webrtc_settings_parse_opts(), the --config file and the command line, so
+ * that keys removed from the file are reset. FALSE without a file, changed
+ * gets the key file names. */
+gboolean webrtc_settings_reload(WebrtcSettings *self,
+                                GPtrArray *changed,
+                                GError **error);
+
+enum webrtc_settings_scope webrtc_settings_scope(const gchar *name);
+
 const gchar *webrtc_settings_get_target(WebrtcSettings *self);
 const gchar *webrtc_settings_get_output(WebrtcSettings *self);
+
+/** Directory for new recordings while the output volume is full, or NULL */
+const gchar *webrtc_settings_get_fallback_output(WebrtcSettings *self);
+
+/** The --config file, or NULL */
+const gchar *webrtc_settings_get_config(WebrtcSettings *self);
+
+/** File with stream filter rules, or NULL */
+const gchar *webrtc_settings_get_filter(WebrtcSettings *self);
+
+/** Index of the recordings, or NULL to keep none */
+const gchar *webrtc_settings_get_catalog(WebrtcSettings *self);
+
+/** Log levels for webrtc_log_set_levels(), or NULL for the defaults */
+const gchar *webrtc_settings_get_log(WebrtcSettings *self);
+
+/** Size of the trace ring, 0 without one */
+guint webrtc_settings_get_trace(WebrtcSettings *self);
+
+/** Layout of the binary data channel records, or NULL to ignore them */
+const gchar *webrtc_settings_get_metadata(WebrtcSettings *self);
+
+/** Whether the per element tracer is installed, see webrtc_tracer.h */
+gboolean webrtc_settings_get_telemetry(WebrtcSettings *self);
+
+/** NULL terminated "[USER[:PASS]@]HOST" from the command line, or NULL */
+const gchar *const *webrtc_settings_get_servers(WebrtcSettings *self);
 G_END_DECLS
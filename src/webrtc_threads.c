@@ -0,0 +1,117 @@
+#include <glib.h>
+#include <gst/gst.h>
+#include <string.h>
+
+#include "webrtc_log.h"
+#include "webrtc_threads.h"
+
+/* Properties decoders use for their thread count, 0 means one per core */
+static const gchar *thread_properties[] = { "max-threads", "threads" };
+
+static gint tasks;           /* atomic */
+static gint decoders;        /* atomic */
+static gint decoder_threads; /* atomic */
+
+void
+webrtc_threads_stream_status(GstMessage *msg)
+{
+  GstStreamStatusType type;
+  GstElement *owner;
+
+  g_return_if_fail(GST_MESSAGE_TYPE(msg) == GST_MESSAGE_STREAM_STATUS);
+
+  /* Both are posted from the task's own thread */
+  gst_message_parse_stream_status(msg, &type, &owner);
+  if (type == GST_STREAM_STATUS_TYPE_ENTER) {
+    g_atomic_int_inc(&tasks);
+  } else if (type == GST_STREAM_STATUS_TYPE_LEAVE) {
+    g_atomic_int_add(&tasks, -1);
+  }
+}
+
+static const gchar *
+thread_property(GstElement *decoder)
+{
+  GObjectClass *klass = G_OBJECT_GET_CLASS(decoder);
+
+  for (guint i = 0; i < G_N_ELEMENTS(thread_properties); i++) {
+    if (g_object_class_find_property(klass, thread_properties[i]) != NULL) {
+      return thread_properties[i];
+    }
+  }
+
+  return NULL;
+}
+
+static void
+decoder_gone(G_GNUC_UNUSED gpointer data,
+             G_GNUC_UNUSED GObject *where_the_object_was)
+{
+  g_atomic_int_add(&decoders, -1);
+}
+
+/* The decoders read their thread count when the codec opens, so the share
+ * is only set once, before the decoder starts */
+void
+webrtc_threads_budget_decoder(GstElement *decoder)
+{
+  const gchar *property;
+  guint active;
+  guint threads;
+
+  g_return_if_fail(GST_IS_ELEMENT(decoder));
+
+  property = thread_property(decoder);
+  if (property == NULL) {
+    return;
+  }
+
+  active = g_atomic_int_add(&decoders, 1) + 1;
+  threads = MAX(1, g_get_num_processors() / active);
+  g_atomic_int_set(&decoder_threads, threads);
+  g_object_weak_ref(G_OBJECT(decoder), decoder_gone, NULL);
+
+  WEBRTC_LOG_DEBUG(WEBRTC_LOG_PIPELINE,
+                   NULL,
+                   "%s gets %u threads, %u decoders",
+                   GST_OBJECT_NAME(decoder),
+                   threads,
+                   active);
+  g_object_set(decoder, property, threads, NULL);
+}
+
+/* "Name:\tvalue" lines of /proc/self/status */
+static guint64
+status_value(const gchar *status, const gchar *name)
+{
+  const gchar *line = strstr(status, name);
+
+  if (line == NULL) {
+    return 0;
+  }
+
+  return g_ascii_strtoull(line + strlen(name), NULL, 10);
+}
+
+void
+webrtc_threads_get_metrics(struct webrtc_threads_metrics *out)
+{
+  gchar *status = NULL;
+
+  g_return_if_fail(out != NULL);
+
+  memset(out, 0, sizeof(*out));
+  out->tasks = g_atomic_int_get(&tasks);
+  out->decoders = g_atomic_int_get(&decoders);
+  out->decoder_threads = g_atomic_int_get(&decoder_threads);
+
+  if (!g_file_get_contents("/proc/self/status", &status, NULL, NULL)) {
+    return;
+  }
+
+  out->threads = status_value(status, "\nThreads:");
+  out->voluntary_switches = status_value(status, "\nvoluntary_ctxt_switches:");
+  out->involuntary_switches = status_value(status,
+                                           "\nnonvoluntary_ctxt_switches:");
+  g_free(status);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <glib.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+struct webrtc_threads_metrics {
+  guint threads;                /* of the process */
+  guint tasks;                  /* streaming tasks running */
+  guint decoders;               /* alive, with a thread budget */
+  guint decoder_threads;        /* given to each decoder */
+  guint64 voluntary_switches;   /* context switches of the process */
+  guint64 involuntary_switches;
+};
+
+/** Counts the streaming tasks from a stream-status message, called from
+ * the sync handler of a pipeline bus. The tasks stay on GStreamer's
+ * default pool, which already reuses idle threads across pipelines. A
+ * bounded pool does not fit, a streaming task holds its thread until the
+ * pipeline stops, so that a full pool would stall the next session. */
+void webrtc_threads_stream_status(GstMessage *msg);
+
+/** Gives decoder, before it starts, an equal share of the cores with
+ * everything decoding at the same time in mind, at least one thread.
+ * Decoders read it when they open, so the shares of running decoders stay
+ * as they were. Decoders without a threads property are left alone. */
+void webrtc_threads_budget_decoder(GstElement *decoder);
+
+void webrtc_threads_get_metrics(struct webrtc_threads_metrics *out);
+
+G_END_DECLS
@@ -0,0 +1,543 @@
+#include <glib.h>
+#include <gst/gst.h>
+
+#include "webrtc_tracer.h"
+
+#define FILL_BUCKETS 11 /* tenths of a queue's limit, the last one is full */
+#define FILL_EVERY   16 /* buffers between queue level samples */
+
+/* Per element, shared by the element and its session. Counters are only
+ * touched atomically, the streaming threads never take a lock. */
+struct element_stats {
+  gchar *name;
+  gboolean queue;
+  gint buffers;
+  gint times[WEBRTC_TRACER_BUCKETS];
+  gint time_max; /* us */
+  gint fills[FILL_BUCKETS];
+  gint fill_max; /* percent */
+};
+
+/* A push in progress on the calling thread */
+struct frame {
+  struct element_stats *stats; /* NULL for bins and untagged pipelines */
+  GstClockTime start;
+  GstClockTime nested; /* spent in pushes further downstream */
+};
+
+struct session {
+  GPtrArray *elements; /* of struct element_stats */
+  gint64 collected;    /* monotonic us */
+};
+
+/* Elements are looked up once, elements that are not accounted point
+ * here */
+static gint untracked;
+
+static GQuark element_quark;
+static GQuark session_quark;
+static gint enabled; /* atomic */
+
+/* Protects sessions */
+static GMutex lock;
+static GHashTable *sessions; /* session key -> struct session */
+
+static GPrivate frames = G_PRIVATE_INIT((GDestroyNotify) g_array_unref);
+
+typedef struct {
+  GstTracer parent;
+} WebrtcTracer;
+
+typedef struct {
+  GstTracerClass parent_class;
+} WebrtcTracerClass;
+
+GType webrtc_tracer_get_type(void);
+G_DEFINE_TYPE(WebrtcTracer, webrtc_tracer, GST_TYPE_TRACER);
+
+static void
+element_stats_clear(gpointer data)
+{
+  struct element_stats *stats = data;
+
+  g_free(stats->name);
+}
+
+static void
+element_stats_release(gpointer data)
+{
+  g_atomic_rc_box_release_full(data, element_stats_clear);
+}
+
+static void
+session_free(gpointer data)
+{
+  struct session *session = data;
+
+  g_ptr_array_unref(session->elements);
+  g_free(session);
+}
+
+static void
+atomic_max(gint *max, gint val)
+{
+  gint old = g_atomic_int_get(max);
+
+  while (val > old && !g_atomic_int_compare_and_exchange(max, old, val)) {
+    old = g_atomic_int_get(max);
+  }
+}
+
+/* The session of the top level bin, NULL if it is not tagged */
+static gchar *
+find_session(GstElement *element, gboolean *in_pipeline)
+{
+  GstObject *top = gst_object_ref(GST_OBJECT(element));
+  GstObject *parent;
+  gchar *session;
+
+  while ((parent = gst_object_get_parent(top)) != NULL) {
+    gst_object_unref(top);
+    top = parent;
+  }
+
+  session = g_strdup(g_object_get_qdata(G_OBJECT(top), session_quark));
+  *in_pipeline = GST_IS_PIPELINE(top);
+  gst_object_unref(top);
+
+  return session;
+}
+
+static struct element_stats *
+resolve(GstElement *element)
+{
+  struct element_stats *stats;
+  GstElementFactory *factory;
+  struct session *entry;
+  gboolean in_pipeline = FALSE;
+  gchar *session;
+  gchar *tagged;
+
+  /* Bins only pass buffers on to their children */
+  session = GST_IS_BIN(element) ? NULL
+                                : find_session(element, &in_pipeline);
+  if (session == NULL) {
+    /* Not in a pipeline yet, asks again with the next buffer */
+    if (GST_IS_BIN(element) || in_pipeline) {
+      g_object_set_qdata(G_OBJECT(element), element_quark, &untracked);
+    }
+    return NULL;
+  }
+
+  stats = g_atomic_rc_box_new0(struct element_stats);
+  stats->name = gst_object_get_name(GST_OBJECT(element));
+  factory = gst_element_get_factory(element);
+  stats->queue = factory != NULL &&
+                 g_strcmp0(GST_OBJECT_NAME(factory), "queue") == 0;
+
+  /* Two threads can push into the same element for the first time */
+  if (!g_object_replace_qdata(G_OBJECT(element),
+                              element_quark,
+                              NULL,
+                              stats,
+                              element_stats_release,
+                              NULL)) {
+    element_stats_release(stats);
+    g_free(session);
+    stats = g_object_get_qdata(G_OBJECT(element), element_quark);
+    return stats != (gpointer) &untracked ? stats : NULL;
+  }
+
+  /* Not if the pipeline was untagged meanwhile, a new pipeline of the
+   * session may already use its entry */
+  g_mutex_lock(&lock);
+  tagged = find_session(element, &in_pipeline);
+  if (g_strcmp0(tagged, session) == 0) {
+    entry = g_hash_table_lookup(sessions, session);
+    if (entry == NULL) {
+      entry = g_malloc0(sizeof(*entry));
+      entry->elements =
+              g_ptr_array_new_with_free_func(element_stats_release);
+      g_hash_table_insert(sessions, g_strdup(session), entry);
+    }
+    g_ptr_array_add(entry->elements, g_atomic_rc_box_acquire(stats));
+  }
+  g_mutex_unlock(&lock);
+  g_free(tagged);
+  g_free(session);
+
+  return stats;
+}
+
+static struct element_stats *
+lookup(GstPad *pad)
+{
+  GstPad *peer = GST_PAD_PEER(pad);
+  GstObject *parent = peer != NULL ? GST_OBJECT_PARENT(peer) : NULL;
+  gpointer stats;
+
+  /* The internal pads of ghost pads have pads as parents */
+  if (parent == NULL || !GST_IS_ELEMENT(parent)) {
+    return NULL;
+  }
+
+  stats = g_object_get_qdata(G_OBJECT(parent), element_quark);
+  if (stats == NULL) {
+    return resolve(GST_ELEMENT(parent));
+  }
+
+  return stats != (gpointer) &untracked ? stats : NULL;
+}
+
+/* max-size-* of 0 are unlimited */
+static void
+sample_fill(struct element_stats *stats, GstElement *queue)
+{
+  guint buffers, max_buffers, bytes, max_bytes;
+  guint64 time, max_time;
+  guint fill = 0;
+
+  g_object_get(queue,
+               "current-level-buffers",
+               &buffers,
+               "max-size-buffers",
+               &max_buffers,
+               "current-level-bytes",
+               &bytes,
+               "max-size-bytes",
+               &max_bytes,
+               "current-level-time",
+               &time,
+               "max-size-time",
+               &max_time,
+               NULL);
+
+  if (max_buffers > 0) {
+    fill = MAX(fill, (guint64) buffers * 100 / max_buffers);
+  }
+  if (max_bytes > 0) {
+    fill = MAX(fill, (guint64) bytes * 100 / max_bytes);
+  }
+  if (max_time > 0) {
+    fill = MAX(fill, time * 100 / max_time);
+  }
+  fill = MIN(fill, 100);
+
+  g_atomic_int_inc(&stats->fills[fill / 10]);
+  atomic_max(&stats->fill_max, fill);
+}
+
+static void
+push_pre(GstPad *pad, GstClockTime ts, gint buffers)
+{
+  GArray *stack = g_private_get(&frames);
+  struct frame frame = { 0 };
+  gint before;
+
+  if (stack == NULL) {
+    stack = g_array_sized_new(FALSE, FALSE, sizeof(struct frame), 8);
+    g_private_set(&frames, stack);
+  }
+
+  frame.stats = lookup(pad);
+  frame.start = ts;
+  if (frame.stats != NULL) {
+    before = g_atomic_int_add(&frame.stats->buffers, buffers);
+    /* Crossed a multiple of FILL_EVERY */
+    if (frame.stats->queue &&
+        before / FILL_EVERY != (before + buffers) / FILL_EVERY) {
+      sample_fill(frame.stats, GST_PAD_PARENT(GST_PAD_PEER(pad)));
+    }
+  }
+
+  g_array_append_val(stack, frame);
+}
+
+/* Only what the element did itself, not the pushes it made downstream */
+static void
+push_post(GstClockTime ts)
+{
+  GArray *stack = g_private_get(&frames);
+  struct frame *frame;
+  GstClockTime spent;
+  guint bucket;
+  gint us;
+
+  if (stack == NULL || stack->len == 0) {
+    return;
+  }
+
+  frame = &g_array_index(stack, struct frame, stack->len - 1);
+  spent = ts > frame->start ? ts - frame->start : 0;
+  /* A full queue blocks upstream, that shows in its level instead */
+  if (frame->stats != NULL && !frame->stats->queue) {
+    us = MIN((spent - MIN(spent, frame->nested)) / GST_USECOND, G_MAXINT);
+    bucket = MIN(g_bit_storage(us), WEBRTC_TRACER_BUCKETS - 1);
+    g_atomic_int_inc(&frame->stats->times[bucket]);
+    atomic_max(&frame->stats->time_max, us);
+  }
+  g_array_set_size(stack, stack->len - 1);
+
+  if (stack->len > 0) {
+    g_array_index(stack, struct frame, stack->len - 1).nested += spent;
+  }
+}
+
+static void
+on_push_pre(G_GNUC_UNUSED GObject *tracer,
+            GstClockTime ts,
+            GstPad *pad,
+            G_GNUC_UNUSED GstBuffer *buffer)
+{
+  push_pre(pad, ts, 1);
+}
+
+static void
+on_push_list_pre(G_GNUC_UNUSED GObject *tracer,
+                 GstClockTime ts,
+                 GstPad *pad,
+                 GstBufferList *list)
+{
+  push_pre(pad, ts, gst_buffer_list_length(list));
+}
+
+static void
+on_push_post(G_GNUC_UNUSED GObject *tracer,
+             GstClockTime ts,
+             G_GNUC_UNUSED GstPad *pad,
+             G_GNUC_UNUSED GstFlowReturn res)
+{
+  push_post(ts);
+}
+
+static void
+webrtc_tracer_class_init(G_GNUC_UNUSED WebrtcTracerClass *klass)
+{
+}
+
+static void
+webrtc_tracer_init(WebrtcTracer *self)
+{
+  GstTracer *tracer = GST_TRACER(self);
+
+  gst_tracing_register_hook(tracer, "pad-push-pre", G_CALLBACK(on_push_pre));
+  gst_tracing_register_hook(tracer,
+                            "pad-push-list-pre",
+                            G_CALLBACK(on_push_list_pre));
+  gst_tracing_register_hook(tracer,
+                            "pad-push-post",
+                            G_CALLBACK(on_push_post));
+  gst_tracing_register_hook(tracer,
+                            "pad-push-list-post",
+                            G_CALLBACK(on_push_post));
+}
+
+static void
+init_quarks(void)
+{
+  static gsize initialized = 0;
+
+  if (g_once_init_enter(&initialized)) {
+    element_quark = g_quark_from_static_string("webrtc-tracer-element");
+    session_quark = g_quark_from_static_string("webrtc-tracer-session");
+    g_mutex_lock(&lock);
+    sessions = g_hash_table_new_full(g_str_hash,
+                                     g_str_equal,
+                                     g_free,
+                                     session_free);
+    g_mutex_unlock(&lock);
+    g_once_init_leave(&initialized, 1);
+  }
+}
+
+void
+webrtc_tracer_enable(void)
+{
+  static GstTracer *tracer;
+
+  init_quarks();
+
+  if (g_once_init_enter(&tracer)) {
+    GstTracer *t = g_object_new(webrtc_tracer_get_type(), NULL);
+
+    gst_object_ref_sink(t);
+    g_atomic_int_set(&enabled, TRUE);
+    g_once_init_leave(&tracer, t);
+  }
+}
+
+gboolean
+webrtc_tracer_enabled(void)
+{
+  return g_atomic_int_get(&enabled);
+}
+
+void
+webrtc_tracer_tag_pipeline(GstElement *pipeline, const gchar *session)
+{
+  g_return_if_fail(GST_IS_ELEMENT(pipeline));
+  g_return_if_fail(session != NULL);
+
+  init_quarks();
+  g_object_set_qdata_full(G_OBJECT(pipeline),
+                          session_quark,
+                          g_strdup(session),
+                          g_free);
+}
+
+/* Reads a counter and sets it to 0 */
+static guint
+take(gint *counter)
+{
+  return g_atomic_int_and((guint *) counter, 0);
+}
+
+/* Copies and clears the buckets, returns their sum */
+static guint
+take_buckets(gint *buckets, guint *out, guint n)
+{
+  guint total = 0;
+
+  for (guint i = 0; i < n; i++) {
+    out[i] = take(&buckets[i]);
+    total += out[i];
+  }
+
+  return total;
+}
+
+static guint
+percentile(const guint *buckets, guint n, guint total, gdouble q)
+{
+  guint64 seen = 0;
+
+  for (guint i = 0; i < n; i++) {
+    seen += buckets[i];
+    if (seen > 0 && seen >= total * q) {
+      return i;
+    }
+  }
+
+  return n - 1;
+}
+
+static void
+element_free(gpointer data)
+{
+  struct webrtc_tracer_element *e = data;
+
+  g_free(e->name);
+  g_free(e);
+}
+
+static gint
+slowest_first(gconstpointer a, gconstpointer b)
+{
+  const struct webrtc_tracer_element *ea =
+          *(const struct webrtc_tracer_element **) a;
+  const struct webrtc_tracer_element *eb =
+          *(const struct webrtc_tracer_element **) b;
+
+  if (ea->time_p99 != eb->time_p99) {
+    return ea->time_p99 < eb->time_p99 ? 1 : -1;
+  }
+  if (ea->time_max != eb->time_max) {
+    return ea->time_max < eb->time_max ? 1 : -1;
+  }
+
+  return 0;
+}
+
+GPtrArray *
+webrtc_tracer_collect(const gchar *session)
+{
+  struct session *entry;
+  GPtrArray *report;
+  gint64 now = g_get_monotonic_time();
+  gdouble interval = 0.0;
+
+  g_return_val_if_fail(session != NULL, NULL);
+
+  init_quarks();
+
+  g_mutex_lock(&lock);
+  entry = g_hash_table_lookup(sessions, session);
+  if (entry == NULL) {
+    g_mutex_unlock(&lock);
+    return NULL;
+  }
+
+  if (entry->collected > 0 && now > entry->collected) {
+    interval = (gdouble) (now - entry->collected) / G_USEC_PER_SEC;
+  }
+  entry->collected = now;
+
+  report = g_ptr_array_new_with_free_func(element_free);
+  for (guint i = 0; i < entry->elements->len; i++) {
+    struct element_stats *stats = g_ptr_array_index(entry->elements, i);
+    guint times[WEBRTC_TRACER_BUCKETS];
+    guint fills[FILL_BUCKETS];
+    struct webrtc_tracer_element *e;
+    guint total;
+
+    e = g_malloc0(sizeof(*e));
+    e->buffers = take(&stats->buffers);
+    total = take_buckets(stats->times, times, WEBRTC_TRACER_BUCKETS);
+    e->time_max = take(&stats->time_max);
+    if (e->buffers == 0) {
+      g_free(e);
+      continue;
+    }
+
+    e->name = g_strdup(stats->name);
+    e->rate = interval > 0.0 ? e->buffers / interval : 0.0;
+    /* Upper bounds of the buckets */
+    if (total > 0) {
+      e->time_p50 = G_GUINT64_CONSTANT(1)
+                    << percentile(times, WEBRTC_TRACER_BUCKETS, total, 0.5);
+      e->time_p99 = G_GUINT64_CONSTANT(1)
+                    << percentile(times, WEBRTC_TRACER_BUCKETS, total, 0.99);
+    }
+
+    e->fill_p50 = -1;
+    e->fill_max = -1;
+    if (stats->queue) {
+      total = take_buckets(stats->fills, fills, FILL_BUCKETS);
+      e->fill_max = take(&stats->fill_max);
+      e->fill_p50 = 0;
+      if (total > 0) {
+        e->fill_p50 = percentile(fills, FILL_BUCKETS, total, 0.5) * 10;
+      }
+    }
+
+    g_ptr_array_add(report, e);
+  }
+  g_mutex_unlock(&lock);
+
+  if (report->len == 0) {
+    g_ptr_array_unref(report);
+    return NULL;
+  }
+
+  g_ptr_array_sort(report, slowest_first);
+
+  return report;
+}
+
+void
+webrtc_tracer_untag_pipeline(GstElement *pipeline)
+{
+  gchar *session;
+
+  g_return_if_fail(GST_IS_ELEMENT(pipeline));
+
+  init_quarks();
+
+  g_mutex_lock(&lock);
+  session = g_object_steal_qdata(G_OBJECT(pipeline), session_quark);
+  if (session != NULL) {
+    g_hash_table_remove(sessions, session);
+  }
+  g_mutex_unlock(&lock);
+  g_free(session);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <glib.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Histogram buckets, bucket i counts processing times below 2^i us */
+#define WEBRTC_TRACER_BUCKETS 16
+
+/** One element of a session pipeline, since the previous collection */
+struct webrtc_tracer_element {
+  gchar *name;
+  guint64 buffers;
+  gdouble rate;      /* buffers per s */
+  guint64 time_p50;  /* us spent in the element itself, 0 for queues */
+  guint64 time_p99;
+  guint64 time_max;
+  gint fill_p50;     /* percent of the queue's limit, -1 if not a queue */
+  gint fill_max;
+};
+
+/** Installs the tracer, from then on every buffer pushed in a tagged
+ * pipeline is accounted to the element it enters. Stays installed. */
+void webrtc_tracer_enable(void);
+
+gboolean webrtc_tracer_enabled(void);
+
+/** Accounts the elements of pipeline to session, cheap without the tracer */
+void webrtc_tracer_tag_pipeline(GstElement *pipeline, const gchar *session);
+
+/** The elements of session that saw buffers since the last call, slowest
+ * first, or NULL without any. Resets the histograms. */
+GPtrArray *webrtc_tracer_collect(const gchar *session);
+
+/** Drops what was accounted to the session of pipeline and stops
+ * accounting it, before a stopped pipeline is handed over for teardown. A
+ * new pipeline of the same session starts over. */
+void webrtc_tracer_untag_pipeline(GstElement *pipeline);
+
+G_END_DECLS
@@ -0,0 +1,205 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+
+#include "webrtc_admission.h"
+
+static WebrtcSettings *
+settings_from(const gchar *keys)
+{
+  WebrtcSettings *settings = webrtc_settings_new();
+  GError *lerr = NULL;
+  gchar *path;
+  gint fd;
+
+  fd = g_file_open_tmp("admission-XXXXXX.conf", &path, &lerr);
+  g_assert_no_error(lerr);
+  g_close(fd, NULL);
+  g_assert_true(g_file_set_contents(path, keys, -1, NULL));
+  g_assert_true(webrtc_settings_load_file(settings, path, NULL, &lerr));
+  g_assert_no_error(lerr);
+
+  g_remove(path);
+  g_free(path);
+
+  return settings;
+}
+
+static void
+collect_id(G_GNUC_UNUSED WebrtcAdmission *admission,
+           const gchar *id,
+           GPtrArray *ids)
+{
+  g_ptr_array_add(ids, g_strdup(id));
+}
+
+void
+test_queue(void)
+{
+  const struct webrtc_admission_metrics *metrics;
+  WebrtcAdmission *admission;
+  WebrtcSettings *settings;
+  GPtrArray *admitted = g_ptr_array_new_with_free_func(g_free);
+
+  settings = settings_from("[writer]\n"
+                           "max-sessions=2\n"
+                           "priorities=Emergency=10\n");
+  admission = webrtc_admission_new(settings);
+  g_signal_connect(admission, "admitted", G_CALLBACK(collect_id), admitted);
+
+  g_assert_cmpint(WEBRTC_ADMISSION_ADMIT,
+                  ==,
+                  webrtc_admission_request(admission, "a", "Cam", "Manual"));
+  g_assert_cmpint(WEBRTC_ADMISSION_ADMIT,
+                  ==,
+                  webrtc_admission_request(admission, "b", "Cam", "Manual"));
+  g_assert_cmpint(WEBRTC_ADMISSION_QUEUE,
+                  ==,
+                  webrtc_admission_request(admission, "c", "Cam", "Manual"));
+  g_assert_cmpint(WEBRTC_ADMISSION_QUEUE,
+                  ==,
+                  webrtc_admission_request(admission,
+                                           "d",
+                                           "Cam",
+                                           "Emergency"));
+
+  metrics = webrtc_admission_get_metrics(admission);
+  g_assert_cmpuint(2, ==, metrics->active);
+  g_assert_cmpuint(2, ==, metrics->starting);
+  g_assert_cmpuint(2, ==, metrics->queued);
+
+  /* An admitted request that never started makes room for the highest
+   * priority in the queue, not the oldest */
+  webrtc_admission_cancel(admission, "a");
+  g_assert_cmpuint(1, ==, admitted->len);
+  g_assert_cmpstr("d", ==, admitted->pdata[0]);
+  g_assert_cmpuint(2, ==, metrics->active);
+  g_assert_cmpuint(1, ==, metrics->queued);
+
+  webrtc_admission_cancel(admission, "c");
+  webrtc_admission_cancel(admission, "unknown");
+  g_assert_cmpuint(1, ==, admitted->len);
+  g_assert_cmpuint(2, ==, metrics->active);
+  g_assert_cmpuint(0, ==, metrics->queued);
+
+  g_assert_cmpuint(2, ==, metrics->admitted_total);
+  g_assert_cmpuint(2, ==, metrics->queued_total);
+  g_assert_cmpuint(1, ==, metrics->dequeued_total);
+  g_assert_cmpuint(2, ==, metrics->cancelled_total);
+  g_assert_cmpuint(0, ==, metrics->rejected_total);
+
+  g_object_unref(admission);
+  g_object_unref(settings);
+  g_ptr_array_unref(admitted);
+}
+
+void
+test_reject(void)
+{
+  const struct webrtc_admission_metrics *metrics;
+  WebrtcAdmission *admission;
+  WebrtcSettings *settings;
+  GPtrArray *rejected = g_ptr_array_new_with_free_func(g_free);
+  enum webrtc_admission_decision decision = WEBRTC_ADMISSION_QUEUE;
+  gchar *newest;
+
+  settings = settings_from("[writer]\n"
+                           "max-sessions=1\n"
+                           "priorities=Emergency=10\n");
+  admission = webrtc_admission_new(settings);
+  g_signal_connect(admission, "rejected", G_CALLBACK(collect_id), rejected);
+
+  g_assert_cmpint(WEBRTC_ADMISSION_ADMIT,
+                  ==,
+                  webrtc_admission_request(admission, "a", "Cam", NULL));
+
+  /* Queued until the queue is full, then rejected */
+  for (guint i = 0; decision == WEBRTC_ADMISSION_QUEUE; i++) {
+    gchar *id = g_strdup_printf("q%u", i);
+
+    decision = webrtc_admission_request(admission, id, "Cam", NULL);
+    g_free(id);
+  }
+  metrics = webrtc_admission_get_metrics(admission);
+  g_assert_cmpint(WEBRTC_ADMISSION_REJECT, ==, decision);
+  g_assert_cmpuint(1, ==, metrics->rejected_total);
+  g_assert_cmpuint(metrics->queued, ==, metrics->queued_total);
+  g_assert_cmpuint(0, ==, rejected->len);
+
+  /* A higher priority pushes out the newest of the lowest */
+  newest = g_strdup_printf("q%u", metrics->queued - 1);
+  g_assert_cmpint(WEBRTC_ADMISSION_QUEUE,
+                  ==,
+                  webrtc_admission_request(admission,
+                                           "urgent",
+                                           "Cam",
+                                           "Emergency"));
+  g_assert_cmpuint(1, ==, rejected->len);
+  g_assert_cmpstr(newest, ==, rejected->pdata[0]);
+  g_assert_cmpuint(2, ==, metrics->rejected_total);
+
+  g_free(newest);
+  g_object_unref(admission);
+  g_object_unref(settings);
+  g_ptr_array_unref(rejected);
+}
+
+void
+test_takeover(void)
+{
+  const struct webrtc_admission_metrics *metrics;
+  WebrtcAdmission *admission;
+  WebrtcSettings *settings;
+  WebrtcClient *client;
+  WebrtcSession *old;
+  WebrtcSession *rebuilt;
+
+  settings = settings_from("[writer]\nmax-sessions=2\n");
+  admission = webrtc_admission_new(settings);
+  metrics = webrtc_admission_get_metrics(admission);
+  client = webrtc_client_new("localhost", NULL, NULL);
+  old = webrtc_session_new(client, settings, "a", "Cam");
+  rebuilt = webrtc_session_new(client, settings, "a", "Cam");
+
+  g_assert_cmpint(WEBRTC_ADMISSION_ADMIT,
+                  ==,
+                  webrtc_admission_request(admission, "a", "Cam", NULL));
+  webrtc_admission_add_session(admission, "a", old);
+  g_signal_emit_by_name(old, "streaming");
+  g_assert_cmpuint(0, ==, metrics->starting);
+
+  /* The rebuilt session starts over, the old one is no longer listened to */
+  webrtc_admission_add_session(admission, "a", rebuilt);
+  g_assert_cmpuint(1, ==, metrics->active);
+  g_assert_cmpuint(1, ==, metrics->starting);
+  g_assert_false(g_signal_has_handler_pending(
+          old,
+          g_signal_lookup("streaming", WEBRTC_TYPE_SESSION),
+          0,
+          FALSE));
+
+  g_signal_emit_by_name(rebuilt, "streaming");
+  g_assert_cmpuint(0, ==, metrics->starting);
+
+  webrtc_admission_remove_session(admission, rebuilt);
+  g_assert_cmpuint(0, ==, metrics->active);
+
+  g_object_unref(rebuilt);
+  g_object_unref(old);
+  g_object_unref(client);
+  g_object_unref(admission);
+  g_object_unref(settings);
+}
+
+int
+main(int argc, char *argv[])
+{
+  gst_init(&argc, &argv);
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/admission/queue", test_queue);
+  g_test_add_func("/admission/reject", test_reject);
+  g_test_add_func("/admission/takeover", test_takeover);
+
+  return g_test_run();
+}
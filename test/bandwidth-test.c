@@ -0,0 +1,169 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "webrtc_bandwidth.h"
+
+struct admitted {
+  gchar *id;
+  gint64 kbps;
+};
+
+static WebrtcSettings *
+settings_from(const gchar *keys)
+{
+  WebrtcSettings *settings = webrtc_settings_new();
+  GError *lerr = NULL;
+  gchar *path;
+  gint fd;
+
+  fd = g_file_open_tmp("bandwidth-XXXXXX.conf", &path, &lerr);
+  g_assert_no_error(lerr);
+  g_close(fd, NULL);
+  g_assert_true(g_file_set_contents(path, keys, -1, NULL));
+  g_assert_true(webrtc_settings_load_file(settings, path, NULL, &lerr));
+  g_assert_no_error(lerr);
+
+  g_remove(path);
+  g_free(path);
+
+  return settings;
+}
+
+static void
+on_admitted(G_GNUC_UNUSED WebrtcBandwidth *bandwidth,
+            const gchar *id,
+            gint64 kbps,
+            struct admitted *admitted)
+{
+  g_free(admitted->id);
+  admitted->id = g_strdup(id);
+  admitted->kbps = kbps;
+}
+
+void
+test_queue(void)
+{
+  const struct webrtc_bandwidth_metrics *metrics;
+  struct admitted admitted = { 0 };
+  WebrtcBandwidth *bandwidth;
+  WebrtcSettings *settings;
+  gint64 kbps;
+
+  /* Room for two sessions at the full 1000 kbps and half of a third */
+  settings = settings_from("[session]\n"
+                           "max-bitrate=1000\n"
+                           "[writer]\n"
+                           "bandwidth=2500\n"
+                           "priorities=Emergency=10\n");
+  bandwidth = webrtc_bandwidth_new(settings);
+  g_signal_connect(bandwidth,
+                   "admitted",
+                   G_CALLBACK(on_admitted),
+                   &admitted);
+
+  g_assert_cmpint(
+          WEBRTC_BANDWIDTH_ADMIT,
+          ==,
+          webrtc_bandwidth_request(bandwidth, "a", "Cam", NULL, TRUE, &kbps));
+  g_assert_cmpint(1000, ==, kbps);
+  g_assert_cmpint(
+          WEBRTC_BANDWIDTH_ADMIT,
+          ==,
+          webrtc_bandwidth_request(bandwidth, "b", "Cam", NULL, TRUE, &kbps));
+  g_assert_cmpint(
+          WEBRTC_BANDWIDTH_DEGRADE,
+          ==,
+          webrtc_bandwidth_request(bandwidth, "c", "Cam", NULL, TRUE, &kbps));
+  g_assert_cmpint(500, ==, kbps);
+
+  /* Nothing left, the higher weight queues ahead */
+  g_assert_cmpint(
+          WEBRTC_BANDWIDTH_QUEUE,
+          ==,
+          webrtc_bandwidth_request(bandwidth, "d", "Cam", NULL, TRUE, &kbps));
+  g_assert_cmpint(WEBRTC_BANDWIDTH_QUEUE,
+                  ==,
+                  webrtc_bandwidth_request(bandwidth,
+                                           "e",
+                                           "Cam",
+                                           "Emergency",
+                                           TRUE,
+                                           &kbps));
+
+  /* One that may not wait gets the minimum over the budget */
+  g_test_expect_message(NULL,
+                        G_LOG_LEVEL_WARNING,
+                        "Bandwidth: f exceeds the budget*");
+  g_assert_cmpint(
+          WEBRTC_BANDWIDTH_DEGRADE,
+          ==,
+          webrtc_bandwidth_request(bandwidth, "f", "Cam", NULL, FALSE, &kbps));
+  g_test_assert_expected_messages();
+  g_assert_cmpint(200, ==, kbps);
+
+  metrics = webrtc_bandwidth_get_metrics(bandwidth);
+  g_assert_cmpuint(4, ==, metrics->active);
+  g_assert_cmpuint(2, ==, metrics->queued);
+  g_assert_cmpint(2700, ==, metrics->allocated);
+  g_assert_null(admitted.id);
+
+  /* What a cancelled reservation frees goes to the highest weight */
+  webrtc_bandwidth_cancel(bandwidth, "a");
+  g_assert_cmpstr("e", ==, admitted.id);
+  g_assert_cmpint(800, ==, admitted.kbps);
+  g_assert_cmpuint(4, ==, metrics->active);
+  g_assert_cmpuint(1, ==, metrics->queued);
+  g_assert_cmpint(2500, ==, metrics->allocated);
+
+  webrtc_bandwidth_cancel(bandwidth, "d");
+  webrtc_bandwidth_cancel(bandwidth, "unknown");
+  g_assert_cmpuint(4, ==, metrics->active);
+  g_assert_cmpuint(0, ==, metrics->queued);
+
+  g_assert_cmpuint(2, ==, metrics->admitted_total);
+  g_assert_cmpuint(2, ==, metrics->degraded_total);
+  g_assert_cmpuint(2, ==, metrics->queued_total);
+  g_assert_cmpuint(1, ==, metrics->dequeued_total);
+  g_assert_cmpuint(2, ==, metrics->cancelled_total);
+
+  g_object_unref(bandwidth);
+  g_object_unref(settings);
+  g_free(admitted.id);
+}
+
+void
+test_unlimited(void)
+{
+  WebrtcBandwidth *bandwidth;
+  WebrtcSettings *settings;
+  gint64 kbps;
+
+  settings = settings_from("[session]\nmax-bitrate=1500\n");
+  bandwidth = webrtc_bandwidth_new(settings);
+
+  for (guint i = 0; i < 10; i++) {
+    gchar *id = g_strdup_printf("s%u", i);
+
+    g_assert_cmpint(
+            WEBRTC_BANDWIDTH_ADMIT,
+            ==,
+            webrtc_bandwidth_request(bandwidth, id, NULL, NULL, TRUE, &kbps));
+    g_assert_cmpint(1500, ==, kbps);
+    g_free(id);
+  }
+  g_assert_cmpuint(0, ==, webrtc_bandwidth_get_metrics(bandwidth)->queued);
+
+  g_object_unref(bandwidth);
+  g_object_unref(settings);
+}
+
+int
+main(int argc, char *argv[])
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/bandwidth/queue", test_queue);
+  g_test_add_func("/bandwidth/unlimited", test_unlimited);
+
+  return g_test_run();
+}
@@ -0,0 +1,289 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+#include <string.h>
+
+#include "webrtc_catalog.h"
+#include "webrtc_disk.h"
+
+static const guint8 cluster[] = { 0x1f, 0x43, 0xb6, 0x75, 0x01, 0x02 };
+static const guint8 block[] = { 0xa3, 0x81, 0x00, 0x00 };
+
+static GstBuffer *
+muxed(const guint8 *data, gsize size, GstBufferFlags flags, guint64 pts)
+{
+  GstBuffer *buffer = gst_buffer_new_memdup(data, size);
+
+  GST_BUFFER_FLAG_SET(buffer, flags);
+  GST_BUFFER_PTS(buffer) = pts;
+
+  return buffer;
+}
+
+/* The writer is gone once the catalog released it, which waits for the
+ * queued lines and keyframes */
+static struct webrtc_catalog *
+reopen(struct webrtc_catalog *catalog, const gchar *path)
+{
+  WebrtcDiskWriter *disk;
+
+  if (catalog != NULL) {
+    webrtc_catalog_close(catalog);
+  }
+
+  disk = webrtc_disk_writer_new(1, 4096, NULL);
+  catalog = webrtc_catalog_open(path, disk, NULL);
+  g_object_unref(disk);
+
+  return catalog;
+}
+
+static void
+remove_tree(const gchar *dir)
+{
+  const gchar *name;
+  GDir *d = g_dir_open(dir, 0, NULL);
+
+  while (d != NULL && (name = g_dir_read_name(d)) != NULL) {
+    gchar *path = g_build_filename(dir, name, NULL);
+
+    g_remove(path);
+    g_free(path);
+  }
+  if (d != NULL) {
+    g_dir_close(d);
+  }
+  g_rmdir(dir);
+}
+
+void
+test_recordings(void)
+{
+  struct stream_started first = {
+    .subject = "Camera-1",
+    .trigger_type = "Emergency",
+    .bearer_id = "4711",
+    .system_id = "sys\tone",
+    .session_id = "s1",
+    .recording_id = "r1",
+  };
+  struct stream_started second = {
+    .subject = "Camera-2",
+    .trigger_type = "Manual",
+    .session_id = "s2",
+  };
+  struct webrtc_catalog_query query = { 0 };
+  const struct webrtc_catalog_recording *rec;
+  struct webrtc_catalog *catalog;
+  GPtrArray *found;
+  gchar *dir;
+  gchar *path;
+  guint64 id1;
+  guint64 id2;
+
+  dir = g_dir_make_tmp("catalog-XXXXXX", NULL);
+  g_assert_nonnull(dir);
+  path = g_build_filename(dir, "catalog.tab", NULL);
+
+  catalog = reopen(NULL, path);
+  g_assert_nonnull(catalog);
+  id1 = webrtc_catalog_add_recording(catalog, &first);
+  webrtc_catalog_add_part(catalog, id1, "/rec/Camera-1-s1.mkv", NULL);
+  webrtc_catalog_add_part(catalog, id1, "/rec/Camera-1-s1-1.mkv", NULL);
+  webrtc_catalog_end_recording(catalog, id1);
+  id2 = webrtc_catalog_add_recording(catalog, &second);
+  g_assert_cmpuint(1, ==, id1);
+  g_assert_cmpuint(2, ==, id2);
+
+  query.subject = "Camera-1";
+  found = webrtc_catalog_find(catalog, &query);
+  g_assert_cmpuint(1, ==, found->len);
+  g_ptr_array_unref(found);
+
+  query.subject = NULL;
+  query.trigger_type = "Manual";
+  found = webrtc_catalog_find(catalog, &query);
+  g_assert_cmpuint(1, ==, found->len);
+  rec = found->pdata[0];
+  g_assert_cmpuint(id2, ==, rec->id);
+  g_ptr_array_unref(found);
+
+  /* Read back, the recording that was not ended ends with its start */
+  catalog = reopen(catalog, path);
+  g_assert_nonnull(catalog);
+  rec = webrtc_catalog_lookup(catalog, id1);
+  g_assert_nonnull(rec);
+  g_assert_cmpstr("sys\tone", ==, rec->system_id);
+  g_assert_cmpstr("4711", ==, rec->bearer_id);
+  g_assert_null(rec->bearer_name);
+  g_assert_cmpint(rec->end, >=, rec->start);
+  g_assert_cmpuint(2, ==, rec->parts->len);
+  g_assert_cmpstr("/rec/Camera-1-s1-1.mkv",
+                  ==,
+                  ((struct webrtc_catalog_part *) rec->parts->pdata[1])->path);
+  rec = webrtc_catalog_lookup(catalog, id2);
+  g_assert_nonnull(rec);
+  g_assert_cmpint(rec->end, ==, rec->start);
+
+  memset(&query, 0, sizeof(query));
+  found = webrtc_catalog_find(catalog, &query);
+  g_assert_cmpuint(2, ==, found->len);
+  g_ptr_array_unref(found);
+
+  query.to = rec->start + 1;
+  query.from = 1;
+  query.system_id = "sys\tone";
+  found = webrtc_catalog_find(catalog, &query);
+  g_assert_cmpuint(1, ==, found->len);
+  g_ptr_array_unref(found);
+
+  query.from = g_get_real_time() + G_USEC_PER_SEC;
+  query.to = 0;
+  found = webrtc_catalog_find(catalog, &query);
+  g_assert_cmpuint(0, ==, found->len);
+  g_ptr_array_unref(found);
+
+  g_assert_cmpuint(3, ==, webrtc_catalog_add_recording(catalog, &second));
+  webrtc_catalog_close(catalog);
+
+  remove_tree(dir);
+  g_free(path);
+  g_free(dir);
+}
+
+void
+test_damaged(void)
+{
+  struct webrtc_catalog *catalog;
+  struct stream_started info = { .subject = "Camera-3" };
+  gchar *dir;
+  gchar *path;
+
+  dir = g_dir_make_tmp("catalog-XXXXXX", NULL);
+  path = g_build_filename(dir, "catalog.tab", NULL);
+  g_assert_true(g_file_set_contents(path,
+                                    "recording\t7\t1000\t\tCamera-1\t\t\t\t"
+                                    "\t\t\t\n"
+                                    "garbage\n"
+                                    "end\t7\t5000\n"
+                                    "recording\t8\t20",
+                                    -1,
+                                    NULL));
+
+  g_test_expect_message(NULL, G_LOG_LEVEL_WARNING, "Catalog: skipped 2 *");
+  catalog = reopen(NULL, path);
+  g_test_assert_expected_messages();
+  g_assert_nonnull(catalog);
+  g_assert_cmpint(5000, ==, webrtc_catalog_lookup(catalog, 7)->end);
+  g_assert_null(webrtc_catalog_lookup(catalog, 8));
+  g_assert_cmpuint(8, ==, webrtc_catalog_add_recording(catalog, &info));
+
+  /* The torn line did not swallow the new one */
+  g_test_expect_message(NULL, G_LOG_LEVEL_WARNING, "Catalog: skipped 2 *");
+  catalog = reopen(catalog, path);
+  g_test_assert_expected_messages();
+  g_assert_cmpstr("Camera-3", ==, webrtc_catalog_lookup(catalog, 8)->subject);
+  webrtc_catalog_close(catalog);
+
+  remove_tree(dir);
+  g_free(path);
+  g_free(dir);
+}
+
+void
+test_seek(void)
+{
+  struct stream_started info = { .subject = "Camera-1" };
+  struct webrtc_catalog_keyframe keyframe;
+  struct webrtc_catalog *catalog;
+  GstSegment segment;
+  GstElement *sink;
+  GstPad *src;
+  GstPad *pad;
+  const gchar *file;
+  gchar *dir;
+  gchar *path;
+  gchar *part;
+  guint64 id;
+
+  dir = g_dir_make_tmp("catalog-XXXXXX", NULL);
+  path = g_build_filename(dir, "catalog.tab", NULL);
+  part = g_build_filename(dir, "Camera-1-s1.mkv", NULL);
+
+  catalog = reopen(NULL, path);
+  id = webrtc_catalog_add_recording(catalog, &info);
+
+  sink = gst_element_factory_make("fakesink", NULL);
+  g_assert_nonnull(sink);
+  g_object_set(sink, "sync", FALSE, "async", FALSE, NULL);
+  webrtc_catalog_add_part(catalog, id, part, sink);
+  gst_element_set_state(sink, GST_STATE_PLAYING);
+
+  src = gst_pad_new("src", GST_PAD_SRC);
+  pad = gst_element_get_static_pad(sink, "sink");
+  g_assert_cmpint(GST_PAD_LINK_OK, ==, gst_pad_link(src, pad));
+  gst_object_unref(pad);
+  gst_pad_set_active(src, TRUE);
+  gst_segment_init(&segment, GST_FORMAT_TIME);
+  gst_pad_push_event(src, gst_event_new_stream_start("catalog"));
+  gst_pad_push_event(src,
+                     gst_event_new_caps(
+                             gst_caps_new_empty_simple("video/x-matroska")));
+  gst_pad_push_event(src, gst_event_new_segment(&segment));
+
+  /* Header, two keyframe clusters with a delta block in between and a
+   * cluster of delta frames */
+  gst_pad_push(src, muxed(block, sizeof(block), GST_BUFFER_FLAG_HEADER, 0));
+  gst_pad_push(src, muxed(cluster, sizeof(cluster), 0, GST_SECOND));
+  gst_pad_push(src,
+               muxed(block, sizeof(block), GST_BUFFER_FLAG_DELTA_UNIT, 0));
+  gst_pad_push(src, muxed(cluster, sizeof(cluster), 0, 2 * GST_SECOND));
+  gst_pad_push(src,
+               muxed(cluster,
+                     sizeof(cluster),
+                     GST_BUFFER_FLAG_DELTA_UNIT,
+                     3 * GST_SECOND));
+
+  gst_pad_set_active(src, FALSE);
+  gst_object_unref(src);
+  gst_element_set_state(sink, GST_STATE_NULL);
+  gst_object_unref(sink);
+  catalog = reopen(catalog, path);
+
+  g_assert_true(webrtc_catalog_seek(catalog,
+                                    id,
+                                    G_MAXINT64,
+                                    &file,
+                                    &keyframe,
+                                    NULL));
+  g_assert_cmpstr(part, ==, file);
+  g_assert_cmpuint(2 * GST_SECOND, ==, keyframe.pts);
+  g_assert_cmpuint(sizeof(block) * 2 + sizeof(cluster), ==, keyframe.offset);
+
+  g_assert_true(
+          webrtc_catalog_seek(catalog, id, 0, &file, &keyframe, NULL));
+  g_assert_cmpuint(GST_SECOND, ==, keyframe.pts);
+  g_assert_cmpuint(sizeof(block), ==, keyframe.offset);
+
+  g_assert_false(
+          webrtc_catalog_seek(catalog, id + 1, 0, NULL, &keyframe, NULL));
+  webrtc_catalog_close(catalog);
+
+  remove_tree(dir);
+  g_free(part);
+  g_free(path);
+  g_free(dir);
+}
+
+int
+main(int argc, char *argv[])
+{
+  gst_init(&argc, &argv);
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/catalog/recordings", test_recordings);
+  g_test_add_func("/catalog/damaged", test_damaged);
+  g_test_add_func("/catalog/seek", test_seek);
+
+  return g_test_run();
+}
@@ -0,0 +1,120 @@
+#include <glib.h>
+#include <gst/gst.h>
+#include <gst/sdp/sdp.h>
+
+#include "webrtc_codecs.h"
+
+static GstSDPMessage *
+load_sdp_file(const gchar *name)
+{
+  gchar *path;
+  gchar *content = NULL;
+  gsize size;
+  GstSDPMessage *sdp = NULL;
+  GError *lerr = NULL;
+
+  path = g_strdup_printf("%s/sdp/%s.sdp", g_getenv("G_TEST_SRCDIR"), name);
+
+  if (!g_file_get_contents(path, &content, &size, &lerr)) {
+    g_warning("Failed to load sdp file at %s: %s",
+              path,
+              lerr ? lerr->message : "No error message");
+    g_clear_error(&lerr);
+    g_free(path);
+    return NULL;
+  }
+
+  gst_sdp_message_new(&sdp);
+  if (gst_sdp_message_parse_buffer((guint8 *) content, size, sdp) !=
+      GST_SDP_OK) {
+    gst_sdp_message_free(sdp);
+    sdp = NULL;
+  }
+
+  g_free(content);
+  g_free(path);
+  return sdp;
+}
+
+void
+test_lookup(void)
+{
+  const struct webrtc_codec *codec;
+
+  codec = webrtc_codec_lookup("h265");
+  g_assert_true(codec != NULL);
+  g_assert_cmpstr("H265", ==, codec->encoding_name);
+  g_assert_cmpint(WEBRTC_CODEC_MEDIA_VIDEO, ==, codec->media);
+  g_assert_cmpstr("rtph265depay", ==, codec->depay);
+
+  codec = webrtc_codec_lookup("opus");
+  g_assert_true(codec != NULL);
+  g_assert_cmpint(WEBRTC_CODEC_MEDIA_AUDIO, ==, codec->media);
+
+  g_assert_null(webrtc_codec_lookup("rtx"));
+  g_assert_null(webrtc_codec_lookup(NULL));
+}
+
+void
+test_from_caps(void)
+{
+  const struct webrtc_codec *codec;
+  GstCaps *caps;
+
+  caps = gst_caps_from_string("application/x-rtp, media=video, "
+                              "encoding-name=VP9, payload=98");
+  codec = webrtc_codec_from_caps(caps);
+  g_assert_true(codec != NULL);
+  g_assert_cmpstr("VP9", ==, codec->encoding_name);
+  gst_caps_unref(caps);
+
+  caps = gst_caps_from_string("application/x-rtp, media=video, payload=98");
+  g_assert_null(webrtc_codec_from_caps(caps));
+  gst_caps_unref(caps);
+}
+
+void
+test_map_from_sdp(void)
+{
+  const struct webrtc_codec *codec;
+  GstSDPMessage *sdp;
+  GHashTable *map;
+
+  sdp = load_sdp_file("renumbered_offer");
+  g_assert_true(sdp != NULL);
+
+  map = webrtc_codec_map_from_sdp(sdp);
+  g_assert_true(map != NULL);
+
+  codec = g_hash_table_lookup(map, GUINT_TO_POINTER(102));
+  g_assert_true(codec != NULL);
+  g_assert_cmpstr("H265", ==, codec->encoding_name);
+
+  codec = g_hash_table_lookup(map, GUINT_TO_POINTER(108));
+  g_assert_true(codec != NULL);
+  g_assert_cmpstr("VP8", ==, codec->encoding_name);
+
+  codec = g_hash_table_lookup(map, GUINT_TO_POINTER(111));
+  g_assert_true(codec != NULL);
+  g_assert_cmpstr("OPUS", ==, codec->encoding_name);
+
+  /* Retransmissions are not a codec of their own */
+  g_assert_false(g_hash_table_contains(map, GUINT_TO_POINTER(103)));
+  g_assert_cmpuint(3, ==, g_hash_table_size(map));
+
+  g_hash_table_unref(map);
+  gst_sdp_message_free(sdp);
+}
+
+int
+main(int argc, char *argv[])
+{
+  gst_init(&argc, &argv);
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/codecs/lookup", test_lookup);
+  g_test_add_func("/codecs/from_caps", test_from_caps);
+  g_test_add_func("/codecs/map_from_sdp", test_map_from_sdp);
+
+  return g_test_run();
+}
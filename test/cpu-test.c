@@ -0,0 +1,87 @@
+#include <glib.h>
+#include <gst/gst.h>
+
+#include "webrtc_cpu.h"
+
+#define SESSION "0123abcd-4567-89ef-0123-456789abcdef#1"
+/* The same id again, another session object */
+#define REBUILT "0123abcd-4567-89ef-0123-456789abcdef#2"
+
+static gint stop; /* atomic */
+
+static gpointer
+spin(G_GNUC_UNUSED gpointer data)
+{
+  volatile guint64 n = 0;
+
+  webrtc_cpu_name_thread(SESSION, NULL);
+  while (!g_atomic_int_get(&stop)) {
+    n++;
+  }
+
+  return NULL;
+}
+
+void
+test_classify(void)
+{
+  GstElement *pipeline;
+  GstElement *queue;
+
+  g_assert_cmpint(WEBRTC_CPU_OTHER, ==, webrtc_cpu_classify(NULL));
+  g_assert_cmpstr("decode", ==, webrtc_cpu_class_name(WEBRTC_CPU_DECODE));
+
+  /* A queue is what comes after it, a sink is nothing in particular */
+  pipeline = gst_parse_launch("fakesrc ! queue name=q ! fakesink", NULL);
+  g_assert_nonnull(pipeline);
+  queue = gst_bin_get_by_name(GST_BIN(pipeline), "q");
+  g_assert_cmpint(WEBRTC_CPU_OTHER, ==, webrtc_cpu_classify(queue));
+  gst_object_unref(queue);
+  gst_object_unref(pipeline);
+}
+
+void
+test_usage(void)
+{
+  struct webrtc_cpu_usage usage;
+  GThread *thread;
+
+  g_assert_false(webrtc_cpu_get_usage(SESSION, &usage));
+
+  thread = g_thread_new("spin", spin, NULL);
+  /* The thread needs its name before the first sample sees it */
+  g_usleep(50000);
+  webrtc_cpu_sample();
+  g_usleep(300000);
+  webrtc_cpu_sample();
+
+  g_assert_true(webrtc_cpu_get_usage(SESSION, &usage));
+  g_assert_cmpfloat(usage.total, >, 10.0);
+  g_assert_cmpfloat(usage.classes[WEBRTC_CPU_OTHER], >, 10.0);
+  g_assert_cmpfloat(usage.classes[WEBRTC_CPU_DECODE], <, 0.1);
+  g_assert_false(webrtc_cpu_get_usage(REBUILT, &usage));
+
+  g_atomic_int_set(&stop, 1);
+  g_thread_join(thread);
+
+  /* Added twice, counted until forgotten twice */
+  webrtc_cpu_add_session(SESSION);
+  webrtc_cpu_add_session(SESSION);
+  webrtc_cpu_forget_session(SESSION);
+  g_assert_true(webrtc_cpu_get_usage(SESSION, &usage));
+
+  webrtc_cpu_forget_session(SESSION);
+  g_assert_false(webrtc_cpu_get_usage(SESSION, &usage));
+}
+
+int
+main(int argc, char *argv[])
+{
+  gst_init(&argc, &argv);
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/cpu/classify", test_classify);
+  g_test_add_func("/cpu/usage", test_usage);
+
+  return g_test_run();
+}
@@ -0,0 +1,370 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "webrtc_disk.h"
+
+#define BLOCK 4096
+#define PUSHES 64
+
+struct pusher {
+  GstPad *src;
+  guint pushed;
+};
+
+static GstPad *
+start_sink(GstElement *sink)
+{
+  GstSegment segment;
+  GstPad *src;
+  GstPad *pad;
+
+  gst_element_set_state(sink, GST_STATE_PLAYING);
+  src = gst_pad_new("src", GST_PAD_SRC);
+  pad = gst_element_get_static_pad(sink, "sink");
+  g_assert_cmpint(GST_PAD_LINK_OK, ==, gst_pad_link(src, pad));
+  gst_object_unref(pad);
+  gst_pad_set_active(src, TRUE);
+  gst_segment_init(&segment, GST_FORMAT_BYTES);
+  gst_pad_push_event(src, gst_event_new_stream_start("disk"));
+  gst_pad_push_event(src,
+                     gst_event_new_caps(gst_caps_new_empty_simple(
+                             "application/octet-stream")));
+  gst_pad_push_event(src, gst_event_new_segment(&segment));
+
+  return src;
+}
+
+static void
+stop_sink(GstElement *sink, GstPad *src)
+{
+  gst_pad_set_active(src, FALSE);
+  gst_object_unref(src);
+  gst_element_set_state(sink, GST_STATE_NULL);
+  gst_object_unref(sink);
+}
+
+/* Every byte is its offset in the file modulo 251, so any reordering or
+ * lost block shows */
+static GstFlowReturn
+push_bytes(GstPad *src, gsize offset, gsize size)
+{
+  guint8 *data = g_malloc(size);
+
+  for (gsize i = 0; i < size; i++) {
+    data[i] = (offset + i) % 251;
+  }
+
+  return gst_pad_push(src, gst_buffer_new_wrapped(data, size));
+}
+
+static void
+check_bytes(const guint8 *data, gsize size)
+{
+  for (gsize i = 0; i < size; i++) {
+    g_assert_cmpuint(i % 251, ==, data[i]);
+  }
+}
+
+static void
+wait_closed(WebrtcDiskWriter *writer, struct webrtc_disk_metrics *metrics)
+{
+  gint64 deadline = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+
+  do {
+    g_usleep(10 * G_TIME_SPAN_MILLISECOND);
+    webrtc_disk_writer_get_metrics(writer, metrics);
+  } while (metrics->files > 0 && g_get_monotonic_time() < deadline);
+
+  g_assert_cmpuint(0, ==, metrics->files);
+}
+
+void
+test_order(void)
+{
+  struct webrtc_disk_metrics metrics;
+  WebrtcDiskWriter *writer;
+  GstElement *sink;
+  GstPad *src;
+  GError *error = NULL;
+  gchar *contents;
+  gchar *dir;
+  gchar *path;
+  gsize offset = 0;
+  gsize len;
+
+  dir = g_dir_make_tmp("disk-XXXXXX", NULL);
+  path = g_build_filename(dir, "order.mkv", NULL);
+
+  writer = webrtc_disk_writer_new(2, 16, &error);
+  g_assert_no_error(error);
+  sink = webrtc_disk_writer_sink(writer, path, &error);
+  g_assert_no_error(error);
+  src = start_sink(sink);
+
+  /* Buffers smaller, equal and larger than a block, the last one partial */
+  for (gsize size = 1; size < 40; size++) {
+    g_assert_cmpint(GST_FLOW_OK, ==, push_bytes(src, offset, size));
+    offset += size;
+  }
+  gst_pad_push_event(src, gst_event_new_eos());
+  stop_sink(sink, src);
+
+  wait_closed(writer, &metrics);
+  g_assert_cmpuint(0, ==, metrics.queued);
+  g_assert_cmpuint(0, ==, metrics.errors);
+  g_assert_cmpuint(offset, ==, metrics.bytes);
+  g_assert_cmpuint((offset + 15) / 16, ==, metrics.writes);
+  g_object_unref(writer);
+
+  g_assert_true(g_file_get_contents(path, &contents, &len, NULL));
+  g_assert_cmpuint(offset, ==, len);
+  check_bytes((const guint8 *) contents, len);
+  g_free(contents);
+
+  g_remove(path);
+  g_rmdir(dir);
+  g_free(path);
+  g_free(dir);
+}
+
+void
+test_queue(void)
+{
+  struct webrtc_disk_metrics metrics;
+  WebrtcDiskWriter *writer;
+  GstElement *sinks[4];
+  GstPad *srcs[4];
+  gchar *paths[4];
+  gchar *dir;
+
+  dir = g_dir_make_tmp("disk-XXXXXX", NULL);
+  writer = webrtc_disk_writer_new(2, 64, NULL);
+  g_assert_nonnull(writer);
+
+  for (guint i = 0; i < G_N_ELEMENTS(sinks); i++) {
+    gchar *name = g_strdup_printf("queue-%u.mkv", i);
+
+    paths[i] = g_build_filename(dir, name, NULL);
+    sinks[i] = webrtc_disk_writer_sink(writer, paths[i], NULL);
+    g_assert_nonnull(sinks[i]);
+    srcs[i] = start_sink(sinks[i]);
+    g_free(name);
+  }
+
+  /* Interleaved, so the I/O threads write for several files at once */
+  for (guint j = 0; j < PUSHES; j++) {
+    for (guint i = 0; i < G_N_ELEMENTS(sinks); i++) {
+      g_assert_cmpint(GST_FLOW_OK, ==, push_bytes(srcs[i], j * 64, 64));
+    }
+  }
+
+  webrtc_disk_writer_get_metrics(writer, &metrics);
+  g_assert_cmpuint(G_N_ELEMENTS(sinks), ==, metrics.files);
+  g_assert_cmpuint(G_N_ELEMENTS(sinks) * PUSHES, >=, metrics.queued);
+
+  for (guint i = 0; i < G_N_ELEMENTS(sinks); i++) {
+    stop_sink(sinks[i], srcs[i]);
+  }
+
+  /* Every queued block was counted before it was written */
+  wait_closed(writer, &metrics);
+  g_assert_cmpuint(0, ==, metrics.queued);
+  g_assert_cmpuint(G_N_ELEMENTS(sinks) * PUSHES, ==, metrics.writes);
+  g_assert_cmpuint(G_N_ELEMENTS(sinks) * PUSHES * 64, ==, metrics.bytes);
+  g_object_unref(writer);
+
+  for (guint i = 0; i < G_N_ELEMENTS(sinks); i++) {
+    gchar *contents;
+    gsize len;
+
+    g_assert_true(g_file_get_contents(paths[i], &contents, &len, NULL));
+    g_assert_cmpuint(PUSHES * 64, ==, len);
+    check_bytes((const guint8 *) contents, len);
+    g_free(contents);
+    g_remove(paths[i]);
+    g_free(paths[i]);
+  }
+
+  g_rmdir(dir);
+  g_free(dir);
+}
+
+static gpointer
+push_blocks(gpointer data)
+{
+  struct pusher *pusher = data;
+
+  while (pusher->pushed < PUSHES &&
+         push_bytes(pusher->src, pusher->pushed * BLOCK, BLOCK) ==
+                 GST_FLOW_OK) {
+    pusher->pushed++;
+  }
+
+  return NULL;
+}
+
+void
+test_block(void)
+{
+  struct webrtc_disk_metrics metrics;
+  struct pusher pusher = { 0 };
+  WebrtcDiskWriter *writer;
+  GstElement *sink;
+  GThread *thread;
+  GByteArray *read_back;
+  gint64 deadline;
+  gchar *dir;
+  gchar *path;
+  guint8 buf[BLOCK];
+  gssize n;
+  gint fd;
+
+  /* Nobody reads the fifo, so the I/O thread hangs once it is full */
+  dir = g_dir_make_tmp("disk-XXXXXX", NULL);
+  path = g_build_filename(dir, "block.mkv", NULL);
+  g_assert_cmpint(0, ==, mkfifo(path, 0600));
+  fd = g_open(path, O_RDONLY | O_NONBLOCK, 0);
+  g_assert_cmpint(fd, >=, 0);
+
+  writer = webrtc_disk_writer_new(1, BLOCK, NULL);
+  sink = webrtc_disk_writer_sink(writer, path, NULL);
+  g_assert_nonnull(sink);
+  pusher.src = start_sink(sink);
+  thread = g_thread_new("push", push_blocks, &pusher);
+
+  /* One block hangs in write(), eight more wait behind it */
+  deadline = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+  do {
+    g_usleep(10 * G_TIME_SPAN_MILLISECOND);
+    webrtc_disk_writer_get_metrics(writer, &metrics);
+  } while ((metrics.queued < 9 || metrics.stalls == 0) &&
+           g_get_monotonic_time() < deadline);
+  g_assert_cmpuint(9, ==, metrics.queued);
+  g_assert_cmpuint(metrics.stalls, >=, 1);
+
+  /* The recording waits for the disk, until its pipeline is flushed */
+  gst_pad_push_event(pusher.src, gst_event_new_flush_start());
+  g_thread_join(thread);
+  g_assert_cmpuint(pusher.pushed, <, PUSHES);
+  stop_sink(sink, pusher.src);
+
+  /* What was queued is still written, in order */
+  read_back = g_byte_array_new();
+  deadline = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+  while ((n = read(fd, buf, sizeof(buf))) != 0 &&
+         g_get_monotonic_time() < deadline) {
+    if (n > 0) {
+      g_byte_array_append(read_back, buf, n);
+    } else if (errno == EAGAIN) {
+      g_usleep(G_TIME_SPAN_MILLISECOND);
+    }
+  }
+  g_assert_cmpint(0, ==, n);
+  g_assert_cmpuint(pusher.pushed * BLOCK, ==, read_back->len);
+  check_bytes(read_back->data, read_back->len);
+  g_byte_array_unref(read_back);
+  g_close(fd, NULL);
+
+  wait_closed(writer, &metrics);
+  g_assert_cmpuint(0, ==, metrics.queued);
+  g_object_unref(writer);
+
+  g_remove(path);
+  g_rmdir(dir);
+  g_free(path);
+  g_free(dir);
+}
+
+static void
+on_state_changed(G_GNUC_UNUSED WebrtcDiskWriter *writer,
+                 const gchar *dir,
+                 guint state,
+                 GPtrArray *changes)
+{
+  g_ptr_array_add(changes, g_strdup_printf("%s %u", dir, state));
+}
+
+void
+test_watch(void)
+{
+  WebrtcDiskWriter *writer;
+  struct webrtc_disk_file *file;
+  GPtrArray *changes;
+  gchar *dir;
+  gchar *canonical;
+  gchar *slashed;
+  gchar *dotted;
+  gchar *path;
+  gchar *expected;
+
+  dir = g_dir_make_tmp("disk-XXXXXX", NULL);
+  slashed = g_strconcat(dir, G_DIR_SEPARATOR_S, NULL);
+  dotted = g_build_filename(dir, ".", NULL);
+  path = g_build_filename(slashed, "watch.tab", NULL);
+
+  canonical = webrtc_disk_canonical_dir(dir);
+  for (guint i = 0; i < 2; i++) {
+    gchar *other = webrtc_disk_canonical_dir(i == 0 ? slashed : dotted);
+
+    g_assert_cmpstr(canonical, ==, other);
+    g_free(other);
+  }
+
+  /* No volume has that much space, so the first check finds it full */
+  writer = webrtc_disk_writer_new(1, BLOCK, NULL);
+  webrtc_disk_writer_set_limits(writer, G_MAXUINT64 / 2, 0);
+  changes = g_ptr_array_new_with_free_func(g_free);
+  g_signal_connect(writer,
+                   "state-changed",
+                   G_CALLBACK(on_state_changed),
+                   changes);
+
+  g_assert_cmpint(WEBRTC_DISK_STATE_FULL,
+                  ==,
+                  webrtc_disk_writer_watch(writer, slashed));
+
+  /* The same directory however it is spelled, also for the files in it */
+  g_assert_cmpint(WEBRTC_DISK_STATE_FULL,
+                  ==,
+                  webrtc_disk_writer_watch(writer, dir));
+  g_assert_cmpint(WEBRTC_DISK_STATE_FULL,
+                  ==,
+                  webrtc_disk_writer_watch(writer, dotted));
+  file = webrtc_disk_writer_open(writer, path, FALSE, NULL);
+  g_assert_nonnull(file);
+  webrtc_disk_file_close(file);
+
+  expected = g_strdup_printf("%s %u", canonical, WEBRTC_DISK_STATE_FULL);
+  g_assert_cmpuint(1, ==, changes->len);
+  g_assert_cmpstr(expected, ==, changes->pdata[0]);
+  g_free(expected);
+
+  g_object_unref(writer);
+  g_ptr_array_unref(changes);
+  g_remove(path);
+  g_rmdir(dir);
+  g_free(path);
+  g_free(dotted);
+  g_free(slashed);
+  g_free(canonical);
+  g_free(dir);
+}
+
+int
+main(int argc, char *argv[])
+{
+  gst_init(&argc, &argv);
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/disk/order", test_order);
+  g_test_add_func("/disk/queue", test_queue);
+  g_test_add_func("/disk/block", test_block);
+  g_test_add_func("/disk/watch", test_watch);
+
+  return g_test_run();
+}
@@ -0,0 +1,128 @@
+#include <glib.h>
+
+#include "webrtc_filter.h"
+
+static gchar *
+filter_path(const gchar *name)
+{
+  return g_strdup_printf("%s/config/%s.txt", g_getenv("G_TEST_SRCDIR"), name);
+}
+
+void
+test_exact_and_prefix(void)
+{
+  struct webrtc_filter *filter;
+
+  filter = webrtc_filter_new();
+  g_assert_true(webrtc_filter_add(filter, "B8A44F000001", NULL));
+  g_assert_true(webrtc_filter_add(filter, "subject:Camera-*", NULL));
+  g_assert_true(webrtc_filter_add(filter, "Cam*", NULL));
+  g_assert_cmpuint(3, ==, webrtc_filter_size(filter));
+
+  g_assert_true(webrtc_filter_match(filter, "b8a44f000001", NULL, NULL));
+  g_assert_false(webrtc_filter_match(filter, "B8A44F0000011", NULL, NULL));
+  g_assert_false(webrtc_filter_match(filter, "B8A44F00000", NULL, NULL));
+
+  g_assert_true(webrtc_filter_match(filter, "CAMERA-7", NULL, NULL));
+  g_assert_true(webrtc_filter_match(filter, "Cam", NULL, NULL));
+  g_assert_false(webrtc_filter_match(filter, "Ca", NULL, NULL));
+  g_assert_false(webrtc_filter_match(filter, NULL, "Camera", "Camera"));
+
+  webrtc_filter_free(filter);
+}
+
+void
+test_globs(void)
+{
+  struct webrtc_filter *filter;
+
+  filter = webrtc_filter_new();
+  g_assert_true(webrtc_filter_add(filter, "bearer:Officer ?. Smith", NULL));
+  g_assert_true(webrtc_filter_add(filter, "trigger:*emergency*", NULL));
+
+  g_assert_true(webrtc_filter_match(filter, "X", "officer J. Smith", NULL));
+  g_assert_false(webrtc_filter_match(filter, "X", "Officer Smith", NULL));
+  g_assert_true(webrtc_filter_match(filter, "X", NULL, "PanicEmergencyBtn"));
+  g_assert_false(webrtc_filter_match(filter, "emergency", NULL, "Manual"));
+
+  webrtc_filter_free(filter);
+}
+
+void
+test_any(void)
+{
+  struct webrtc_filter *filter;
+
+  /* No rules at all is the same as "any" */
+  filter = webrtc_filter_new();
+  g_assert_true(webrtc_filter_match(filter, "Whatever", NULL, NULL));
+
+  g_assert_true(webrtc_filter_add(filter, "Camera", NULL));
+  g_assert_false(webrtc_filter_match(filter, "Whatever", NULL, NULL));
+
+  /* Only streams that have a trigger */
+  g_assert_true(webrtc_filter_add(filter, "trigger:any", NULL));
+  g_assert_false(webrtc_filter_match(filter, "Whatever", NULL, NULL));
+  g_assert_true(webrtc_filter_match(filter, "Whatever", NULL, "Manual"));
+  g_assert_true(webrtc_filter_add(filter, "BEARER:*", NULL));
+  g_assert_false(webrtc_filter_match(filter, "Whatever", NULL, NULL));
+  g_assert_true(webrtc_filter_match(filter, NULL, "Officer", NULL));
+
+  g_assert_true(webrtc_filter_add(filter, "any", NULL));
+  g_assert_true(webrtc_filter_match(filter, "Whatever", NULL, NULL));
+
+  webrtc_filter_free(filter);
+}
+
+void
+test_from_file(void)
+{
+  struct webrtc_filter *filter;
+  GError *lerr = NULL;
+  gchar *path;
+
+  path = filter_path("filter");
+  filter = webrtc_filter_new_from_file(path, &lerr);
+  g_assert_no_error(lerr);
+  g_assert_true(filter != NULL);
+  g_assert_cmpuint(5, ==, webrtc_filter_size(filter));
+
+  g_assert_true(webrtc_filter_match(filter, "B8A44F000002", NULL, NULL));
+  g_assert_true(webrtc_filter_match(filter, "B8A44F1234", NULL, NULL));
+  g_assert_true(webrtc_filter_match(filter, "X", "Officer K. Smith", NULL));
+  g_assert_true(webrtc_filter_match(filter, "X", NULL, "emergency"));
+  g_assert_false(webrtc_filter_match(filter, "B8A44F2234", "K", "Manual"));
+
+  webrtc_filter_free(filter);
+  g_free(path);
+
+  /* Accepts everything, which is likely not what was meant */
+  path = filter_path("filter_empty");
+  g_test_expect_message(NULL, G_LOG_LEVEL_WARNING, "Filter: * has no rules*");
+  filter = webrtc_filter_new_from_file(path, &lerr);
+  g_test_assert_expected_messages();
+  g_assert_no_error(lerr);
+  g_assert_cmpuint(0, ==, webrtc_filter_size(filter));
+  webrtc_filter_free(filter);
+  g_free(path);
+
+  path = filter_path("filter_invalid");
+  filter = webrtc_filter_new_from_file(path, &lerr);
+  g_assert_null(filter);
+  g_assert_error(lerr, WEBRTC_FILTER_ERROR, WEBRTC_FILTER_ERROR_INVALID);
+  g_clear_error(&lerr);
+  g_free(path);
+}
+
+int
+main(int argc, char *argv[])
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/filter/exact_and_prefix", test_exact_and_prefix);
+  g_test_add_func("/filter/globs", test_globs);
+  g_test_add_func("/filter/any", test_any);
+  g_test_add_func("/filter/from_file", test_from_file);
+
+  return g_test_run();
+}
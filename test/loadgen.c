@@ -0,0 +1,1541 @@
+#include <glib.h>
+#include <glib-object.h>
+#include <glib-unix.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/sdp/sdp.h>
+#include <gst/webrtc/webrtc.h>
+#include <json-glib/json-glib.h>
+#include <libsoup/soup.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Emulates a body worn system on the local machine: the signaling server
+ * the writer logs in to, and cameras that start streams, answer its
+ * sessions and send synthetic H.264 and Opus through webrtcbin. */
+
+#define URL_PATH_AUTH    "/local/BodyWornLiveStandalone/auth.cgi"
+#define URL_PATH_WSS     "/local/BodyWornLiveStandalone/client"
+#define URL_PATH_TARGETS "/local/BodyWornLiveStandalone/status.cgi"
+#define URL_PATH_STREAM  "/vapix/ws-data-stream"
+
+#define EVENT_TOPIC      "tns1:WebRTC/tnsaxis:Signaling/CloudEvent"
+#define EVENT_STARTED    "com.axis.bodyworn.stream.started"
+#define EVENT_STOPPED    "com.axis.bodyworn.stream.stopped"
+#define TOKEN_LIFETIME   3600 /* s */
+#define REPORT_INTERVAL  5    /* s */
+#define RESTART_DELAY    1    /* s, before a stopped camera streams again */
+#define VIDEO_PT         96
+#define AUDIO_PT         97
+#define MAX_QUEUED_BYTES (2 << 20) /* per camera and media */
+
+struct options {
+  gint port;
+  gint cameras;
+  gdouble rate;     /* cameras started per second */
+  gint duration;    /* s per stream, 0 to stream until the end */
+  gint run_time;    /* s, 0 to run until interrupted */
+  gint width;
+  gint height;
+  gint fps;
+  gint bitrate;     /* kbps */
+  gint pid;         /* writer to sample, 0 for none */
+  gchar *cert;
+};
+
+struct loadgen;
+
+/* Shared with get-stats replies that may come after the camera is gone */
+struct rtp_counts {
+  GMutex *lock; /* the loadgen lock */
+  guint64 packets_sent;
+  guint64 packets_lost;
+};
+
+struct camera {
+  struct loadgen *ctx;
+  guint index;
+  gchar *id; /* target id, the subject of the stream events */
+  gchar *session_id;
+  gchar *bearer_id;
+  gchar *started; /* ISO 8601 */
+  GstElement *pipeline;
+  GstElement *webrtc;
+  GstElement *video_src;
+  GstElement *audio_src;
+  SoupWebsocketConnection *peer; /* the client that asked for the session */
+  gint64 announced;    /* monotonic us */
+  gint64 init_at;      /* initSession received */
+  gint64 connected_at; /* ICE connected */
+  guint stop_timer;
+  gboolean stopped;
+  struct rtp_counts *counts;
+};
+
+struct proc_sample {
+  gint64 at; /* monotonic us */
+  guint64 ticks;
+};
+
+struct loadgen {
+  struct options opts;
+  GMainLoop *loop;
+  SoupServer *server;
+  GPtrArray *data_streams; /* SoupWebsocketConnection, stream events */
+  GPtrArray *clients;      /* SoupWebsocketConnection, signaling */
+  GHashTable *cameras;     /* session id -> struct camera */
+  GstElement *media;       /* encoders shared by all cameras */
+  gchar *system_id;
+  guint next_index;
+  guint ramp_timer;
+  guint report_timer;
+  guint tokens;
+
+  GMutex lock;
+  GPtrArray *video_srcs; /* GstElement appsrc, protected by lock */
+  GPtrArray *audio_srcs; /* GstElement appsrc, protected by lock */
+
+  /* totals */
+  guint64 streams_started;
+  guint64 streams_stopped;
+  guint64 sessions;  /* initSession received */
+  guint64 connected;
+  guint64 failed;
+  guint64 unknown_sessions;
+  GArray *setup_times; /* gdouble, ms from stream start to ICE connected */
+  GArray *init_times;  /* gdouble, ms from stream start to initSession */
+
+  struct proc_sample self_cpu;
+  struct proc_sample writer_cpu;
+};
+
+/* Work from the webrtcbin threads, done on the main loop */
+enum camera_event_type {
+  CAMERA_EVENT_OFFER = 0,
+  CAMERA_EVENT_CANDIDATE,
+  CAMERA_EVENT_ICE_STATE,
+};
+
+struct camera_event {
+  struct loadgen *ctx;
+  enum camera_event_type type;
+  gchar *session_id;
+  gchar *text;
+  guint mline;
+  GstWebRTCICEConnectionState state;
+};
+
+static gchar *
+now_iso8601(void)
+{
+  GDateTime *now = g_date_time_new_now_utc();
+  gchar *res = g_date_time_format_iso8601(now);
+
+  g_date_time_unref(now);
+
+  return res;
+}
+
+static gchar *
+builder_to_string(JsonBuilder *builder)
+{
+  JsonGenerator *generator = json_generator_new();
+  JsonNode *root = json_builder_get_root(builder);
+  gchar *text;
+
+  json_generator_set_root(generator, root);
+  text = json_generator_to_data(generator, NULL);
+
+  json_node_unref(root);
+  g_object_unref(generator);
+  g_object_unref(builder);
+
+  return text;
+}
+
+static void
+send_text(SoupWebsocketConnection *ws, gchar *text)
+{
+  if (soup_websocket_connection_get_state(ws) == SOUP_WEBSOCKET_STATE_OPEN) {
+    soup_websocket_connection_send_text(ws, text);
+  }
+  g_free(text);
+}
+
+/*
+ * Stream events, on the data stream
+ */
+
+static gchar *
+create_stream_event(struct camera *cam, const gchar *type)
+{
+  JsonBuilder *builder = json_builder_new();
+  gchar *uuid = g_uuid_string_random();
+  gchar *recording_id;
+  gchar *time = now_iso8601();
+  gchar *event;
+
+  recording_id = g_strdup_printf("loadgen_%s_%s", cam->id, cam->session_id);
+
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "id");
+  json_builder_add_string_value(builder, uuid);
+  json_builder_set_member_name(builder, "source");
+  json_builder_add_string_value(builder, "target");
+  json_builder_set_member_name(builder, "specversion");
+  json_builder_add_string_value(builder, "1.0");
+  json_builder_set_member_name(builder, "type");
+  json_builder_add_string_value(builder, type);
+  json_builder_set_member_name(builder, "datacontenttype");
+  json_builder_add_string_value(builder, "application/json");
+  json_builder_set_member_name(builder, "dataschema");
+  json_builder_add_string_value(builder, "com/axis/bodyworn/stream@v1.0.0");
+  json_builder_set_member_name(builder, "subject");
+  json_builder_add_string_value(builder, cam->id);
+  json_builder_set_member_name(builder, "time");
+  json_builder_add_string_value(builder, time);
+  json_builder_set_member_name(builder, "data");
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "triggerType");
+  json_builder_add_string_value(builder, "loadgen");
+  json_builder_set_member_name(builder, "bearerId");
+  json_builder_add_string_value(builder, cam->bearer_id);
+  json_builder_set_member_name(builder, "bearerName");
+  json_builder_add_string_value(builder, cam->id);
+  json_builder_set_member_name(builder, "gpsTimestamp");
+  json_builder_add_int_value(builder, 0);
+  json_builder_set_member_name(builder, "eph");
+  json_builder_add_double_value(builder, 0.0);
+  json_builder_set_member_name(builder, "lat");
+  json_builder_add_double_value(builder, 0.0);
+  json_builder_set_member_name(builder, "lon");
+  json_builder_add_double_value(builder, 0.0);
+  json_builder_set_member_name(builder, "systemId");
+  json_builder_add_string_value(builder, cam->ctx->system_id);
+  json_builder_set_member_name(builder, "sessionId");
+  json_builder_add_string_value(builder, cam->session_id);
+  json_builder_set_member_name(builder, "recordingId");
+  json_builder_add_string_value(builder, recording_id);
+  json_builder_end_object(builder);
+  json_builder_end_object(builder);
+  event = builder_to_string(builder);
+
+  builder = json_builder_new();
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "apiVersion");
+  json_builder_add_string_value(builder, "1.0");
+  json_builder_set_member_name(builder, "method");
+  json_builder_add_string_value(builder, "events:notify");
+  json_builder_set_member_name(builder, "params");
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "notification");
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "topic");
+  json_builder_add_string_value(builder, EVENT_TOPIC);
+  json_builder_set_member_name(builder, "timestamp");
+  json_builder_add_int_value(builder, g_get_real_time() / 1000);
+  json_builder_set_member_name(builder, "message");
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "source");
+  json_builder_begin_object(builder);
+  json_builder_end_object(builder);
+  json_builder_set_member_name(builder, "key");
+  json_builder_begin_object(builder);
+  json_builder_end_object(builder);
+  json_builder_set_member_name(builder, "data");
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "event");
+  json_builder_add_string_value(builder, event);
+  json_builder_set_member_name(builder, "eventType");
+  json_builder_add_string_value(builder, type);
+  json_builder_end_object(builder);
+  json_builder_end_object(builder);
+  json_builder_end_object(builder);
+  json_builder_end_object(builder);
+  json_builder_end_object(builder);
+
+  g_free(event);
+  g_free(time);
+  g_free(recording_id);
+  g_free(uuid);
+
+  return builder_to_string(builder);
+}
+
+static void
+broadcast_stream_event(struct camera *cam, const gchar *type)
+{
+  struct loadgen *ctx = cam->ctx;
+
+  for (guint i = 0; i < ctx->data_streams->len; i++) {
+    send_text(ctx->data_streams->pdata[i], create_stream_event(cam, type));
+  }
+}
+
+/*
+ * Signaling, on the client socket
+ */
+
+static void
+begin_signaling(JsonBuilder *builder,
+                struct camera *cam,
+                const gchar *correlation_id,
+                const gchar *type,
+                const gchar *method)
+{
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "type");
+  json_builder_add_string_value(builder, "signaling");
+  json_builder_set_member_name(builder, "targetId");
+  json_builder_add_string_value(builder, cam->id);
+  json_builder_set_member_name(builder, "orgId");
+  json_builder_add_null_value(builder);
+  json_builder_set_member_name(builder, "correlationId");
+  json_builder_add_string_value(builder, correlation_id);
+  json_builder_set_member_name(builder, "data");
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "apiVersion");
+  json_builder_add_string_value(builder, "1.0");
+  json_builder_set_member_name(builder, "sessionId");
+  json_builder_add_string_value(builder, cam->session_id);
+  json_builder_set_member_name(builder, "type");
+  json_builder_add_string_value(builder, type);
+  json_builder_set_member_name(builder, "method");
+  json_builder_add_string_value(builder, method);
+}
+
+static void
+end_signaling(JsonBuilder *builder)
+{
+  json_builder_end_object(builder);
+  json_builder_end_object(builder);
+}
+
+static void
+send_offer(struct camera *cam, const gchar *sdp)
+{
+  JsonBuilder *builder = json_builder_new();
+
+  begin_signaling(builder, cam, "", "request", "setSdpOffer");
+  json_builder_set_member_name(builder, "params");
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "type");
+  json_builder_add_string_value(builder, "offer");
+  json_builder_set_member_name(builder, "sdp");
+  json_builder_add_string_value(builder, sdp);
+  json_builder_end_object(builder);
+  end_signaling(builder);
+
+  send_text(cam->peer, builder_to_string(builder));
+}
+
+static void
+send_candidate(struct camera *cam, const gchar *candidate, guint mline)
+{
+  JsonBuilder *builder = json_builder_new();
+  gchar *context = g_strdup_printf("%u", g_random_int());
+
+  begin_signaling(builder, cam, "", "request", "addIceCandidate");
+  json_builder_set_member_name(builder, "params");
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "candidate");
+  json_builder_add_string_value(builder, candidate);
+  json_builder_set_member_name(builder, "sdpMLineIndex");
+  json_builder_add_int_value(builder, mline);
+  json_builder_end_object(builder);
+  json_builder_set_member_name(builder, "context");
+  json_builder_add_string_value(builder, context);
+  end_signaling(builder);
+  g_free(context);
+
+  send_text(cam->peer, builder_to_string(builder));
+}
+
+/* What a device answers to requests from the client */
+static void
+send_response(SoupWebsocketConnection *ws,
+              struct camera *cam,
+              const gchar *method,
+              const gchar *correlation_id)
+{
+  JsonBuilder *builder = json_builder_new();
+
+  begin_signaling(builder, cam, correlation_id, "response", method);
+  json_builder_set_member_name(builder, "data");
+  json_builder_begin_object(builder);
+  json_builder_end_object(builder);
+  end_signaling(builder);
+
+  send_text(ws, builder_to_string(builder));
+}
+
+/* No STUN or TURN servers, everything is on the loopback interface */
+static void
+send_init_session(SoupWebsocketConnection *ws,
+                  struct camera *cam,
+                  const gchar *correlation_id)
+{
+  JsonBuilder *builder = json_builder_new();
+
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "type");
+  json_builder_add_string_value(builder, "initSession");
+  json_builder_set_member_name(builder, "targetId");
+  json_builder_add_string_value(builder, cam->id);
+  json_builder_set_member_name(builder, "correlationId");
+  json_builder_add_string_value(builder, correlation_id);
+  json_builder_set_member_name(builder, "turnServers");
+  json_builder_begin_array(builder);
+  json_builder_end_array(builder);
+  json_builder_set_member_name(builder, "stunServers");
+  json_builder_begin_array(builder);
+  json_builder_end_array(builder);
+  json_builder_set_member_name(builder, "data");
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "apiVersion");
+  json_builder_add_string_value(builder, "1.0");
+  json_builder_set_member_name(builder, "type");
+  json_builder_add_string_value(builder, "response");
+  json_builder_set_member_name(builder, "method");
+  json_builder_add_string_value(builder, "initSession");
+  json_builder_set_member_name(builder, "sessionId");
+  json_builder_add_string_value(builder, cam->session_id);
+  json_builder_end_object(builder);
+  json_builder_end_object(builder);
+
+  send_text(ws, builder_to_string(builder));
+}
+
+/*
+ * Cameras
+ */
+
+static void
+camera_event_free(struct camera_event *ev)
+{
+  g_free(ev->session_id);
+  g_free(ev->text);
+  g_free(ev);
+}
+
+static gboolean
+handle_camera_event(struct camera_event *ev)
+{
+  struct loadgen *ctx = ev->ctx;
+  struct camera *cam;
+
+  /* The camera may have stopped in the meantime */
+  cam = g_hash_table_lookup(ctx->cameras, ev->session_id);
+  if (cam == NULL || cam->peer == NULL) {
+    return G_SOURCE_REMOVE;
+  }
+
+  switch (ev->type) {
+  case CAMERA_EVENT_OFFER:
+    send_offer(cam, ev->text);
+    break;
+  case CAMERA_EVENT_CANDIDATE:
+    send_candidate(cam, ev->text, ev->mline);
+    break;
+  case CAMERA_EVENT_ICE_STATE:
+    if ((ev->state == GST_WEBRTC_ICE_CONNECTION_STATE_CONNECTED ||
+         ev->state == GST_WEBRTC_ICE_CONNECTION_STATE_COMPLETED) &&
+        cam->connected_at == 0) {
+      gdouble ms;
+
+      cam->connected_at = g_get_monotonic_time();
+      ms = (cam->connected_at - cam->announced) / 1000.0;
+      g_array_append_val(ctx->setup_times, ms);
+      ctx->connected++;
+    } else if (ev->state == GST_WEBRTC_ICE_CONNECTION_STATE_FAILED) {
+      g_warning("Camera %s: ICE failed", cam->id);
+      ctx->failed++;
+    }
+    break;
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Any thread */
+static void
+post_camera_event(struct camera *cam,
+                  enum camera_event_type type,
+                  const gchar *text,
+                  guint mline,
+                  GstWebRTCICEConnectionState state)
+{
+  struct camera_event *ev = g_malloc0(sizeof(*ev));
+
+  ev->ctx = cam->ctx;
+  ev->type = type;
+  ev->session_id = g_strdup(cam->session_id);
+  ev->text = g_strdup(text);
+  ev->mline = mline;
+  ev->state = state;
+
+  g_idle_add_full(G_PRIORITY_DEFAULT,
+                  G_SOURCE_FUNC(handle_camera_event),
+                  ev,
+                  (GDestroyNotify) camera_event_free);
+}
+
+static void
+on_offer_created(GstPromise *promise, gpointer user_data)
+{
+  struct camera *cam = user_data;
+  GstWebRTCSessionDescription *offer = NULL;
+  const GstStructure *reply;
+  gchar *sdp;
+
+  reply = gst_promise_get_reply(promise);
+  if (reply != NULL) {
+    gst_structure_get(reply,
+                      "offer",
+                      GST_TYPE_WEBRTC_SESSION_DESCRIPTION,
+                      &offer,
+                      NULL);
+  }
+  gst_promise_unref(promise);
+
+  if (offer == NULL) {
+    g_warning("Camera %s: no offer", cam->id);
+    return;
+  }
+
+  g_signal_emit_by_name(cam->webrtc, "set-local-description", offer, NULL);
+
+  sdp = gst_sdp_message_as_text(offer->sdp);
+  post_camera_event(cam, CAMERA_EVENT_OFFER, sdp, 0, 0);
+  g_free(sdp);
+  gst_webrtc_session_description_free(offer);
+}
+
+static void
+on_negotiation_needed(GstElement *webrtc, struct camera *cam)
+{
+  GstPromise *promise;
+
+  promise = gst_promise_new_with_change_func(on_offer_created, cam, NULL);
+  g_signal_emit_by_name(webrtc, "create-offer", NULL, promise);
+}
+
+static void
+on_ice_candidate(G_GNUC_UNUSED GstElement *webrtc,
+                 guint mline,
+                 gchar *candidate,
+                 struct camera *cam)
+{
+  post_camera_event(cam, CAMERA_EVENT_CANDIDATE, candidate, mline, 0);
+}
+
+static void
+on_ice_state(GstElement *webrtc,
+             G_GNUC_UNUSED GParamSpec *pspec,
+             struct camera *cam)
+{
+  GstWebRTCICEConnectionState state;
+
+  g_object_get(webrtc, "ice-connection-state", &state, NULL);
+  post_camera_event(cam, CAMERA_EVENT_ICE_STATE, NULL, 0, state);
+}
+
+static GstElement *
+add_branch(struct camera *cam,
+           const gchar *pay_name,
+           const gchar *rtp_caps,
+           GPtrArray *srcs)
+{
+  struct loadgen *ctx = cam->ctx;
+  GstElement *src = gst_element_factory_make("appsrc", NULL);
+  GstElement *pay = gst_element_factory_make(pay_name, NULL);
+  GstElement *filter = gst_element_factory_make("capsfilter", NULL);
+  GstCaps *caps = gst_caps_from_string(rtp_caps);
+
+  g_object_set(src,
+               "is-live",
+               TRUE,
+               "format",
+               GST_FORMAT_TIME,
+               "do-timestamp",
+               TRUE,
+               "max-bytes",
+               (guint64) MAX_QUEUED_BYTES,
+               NULL);
+  if (g_object_class_find_property(G_OBJECT_GET_CLASS(src), "leaky-type")) {
+    gst_util_set_object_arg(G_OBJECT(src), "leaky-type", "downstream");
+  }
+  g_object_set(filter, "caps", caps, NULL);
+  gst_caps_unref(caps);
+
+  gst_bin_add_many(GST_BIN(cam->pipeline), src, pay, filter, NULL);
+  if (!gst_element_link_many(src, pay, filter, cam->webrtc, NULL)) {
+    g_error("Camera %s: could not link %s", cam->id, pay_name);
+  }
+
+  g_mutex_lock(&ctx->lock);
+  g_ptr_array_add(srcs, gst_object_ref(src));
+  g_mutex_unlock(&ctx->lock);
+
+  return src;
+}
+
+/* The client asked for the session, the camera offers its media */
+static void
+camera_start_session(struct camera *cam, SoupWebsocketConnection *ws)
+{
+  struct loadgen *ctx = cam->ctx;
+
+  cam->peer = g_object_ref(ws);
+  cam->init_at = g_get_monotonic_time();
+
+  cam->pipeline = gst_pipeline_new(cam->id);
+  cam->webrtc = gst_element_factory_make("webrtcbin", NULL);
+  g_object_set(cam->webrtc,
+               "bundle-policy",
+               GST_WEBRTC_BUNDLE_POLICY_MAX_BUNDLE,
+               NULL);
+  gst_bin_add(GST_BIN(cam->pipeline), cam->webrtc);
+
+  cam->video_src = add_branch(cam,
+                              "rtph264pay",
+                              "application/x-rtp,media=video,"
+                              "encoding-name=H264,clock-rate=90000,"
+                              "payload=" G_STRINGIFY(VIDEO_PT),
+                              ctx->video_srcs);
+  cam->audio_src = add_branch(cam,
+                              "rtpopuspay",
+                              "application/x-rtp,media=audio,"
+                              "encoding-name=OPUS,clock-rate=48000,"
+                              "payload=" G_STRINGIFY(AUDIO_PT),
+                              ctx->audio_srcs);
+
+  g_signal_connect(cam->webrtc,
+                   "on-negotiation-needed",
+                   G_CALLBACK(on_negotiation_needed),
+                   cam);
+  g_signal_connect(cam->webrtc,
+                   "on-ice-candidate",
+                   G_CALLBACK(on_ice_candidate),
+                   cam);
+  g_signal_connect(cam->webrtc,
+                   "notify::ice-connection-state",
+                   G_CALLBACK(on_ice_state),
+                   cam);
+
+  gst_element_set_state(cam->pipeline, GST_STATE_PLAYING);
+}
+
+static void
+on_answer(struct camera *cam, const gchar *sdp)
+{
+  GstWebRTCSessionDescription *answer;
+  GstSDPMessage *msg;
+
+  if (cam->webrtc == NULL ||
+      gst_sdp_message_new_from_text(sdp, &msg) != GST_SDP_OK) {
+    g_warning("Camera %s: unusable answer", cam->id);
+    return;
+  }
+
+  answer = gst_webrtc_session_description_new(GST_WEBRTC_SDP_TYPE_ANSWER, msg);
+  g_signal_emit_by_name(cam->webrtc, "set-remote-description", answer, NULL);
+  gst_webrtc_session_description_free(answer);
+}
+
+static void start_camera(struct loadgen *ctx, guint index);
+
+static gboolean
+restart_camera(gpointer user_data)
+{
+  struct camera *cam = user_data;
+  struct loadgen *ctx = cam->ctx;
+  guint index = cam->index;
+
+  cam->stop_timer = 0;
+  g_hash_table_remove(ctx->cameras, cam->session_id);
+  start_camera(ctx, index);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+camera_free(struct camera *cam)
+{
+  struct loadgen *ctx = cam->ctx;
+
+  g_mutex_lock(&ctx->lock);
+  if (cam->video_src != NULL) {
+    g_ptr_array_remove_fast(ctx->video_srcs, cam->video_src);
+  }
+  if (cam->audio_src != NULL) {
+    g_ptr_array_remove_fast(ctx->audio_srcs, cam->audio_src);
+  }
+  g_mutex_unlock(&ctx->lock);
+
+  if (cam->pipeline != NULL) {
+    gst_element_set_state(cam->pipeline, GST_STATE_NULL);
+    gst_object_unref(cam->pipeline);
+  }
+
+  g_clear_handle_id(&cam->stop_timer, g_source_remove);
+  g_clear_object(&cam->peer);
+  g_atomic_rc_box_release(cam->counts);
+  g_free(cam->id);
+  g_free(cam->session_id);
+  g_free(cam->bearer_id);
+  g_free(cam->started);
+  g_free(cam);
+}
+
+static gboolean
+stop_camera(gpointer user_data)
+{
+  struct camera *cam = user_data;
+
+  broadcast_stream_event(cam, EVENT_STOPPED);
+  cam->stopped = TRUE;
+  cam->ctx->streams_stopped++;
+
+  /* Keep the number of streams, a new session from the same camera */
+  cam->stop_timer = g_timeout_add_seconds(RESTART_DELAY, restart_camera, cam);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+start_camera(struct loadgen *ctx, guint index)
+{
+  struct camera *cam = g_malloc0(sizeof(*cam));
+
+  cam->ctx = ctx;
+  cam->index = index;
+  cam->id = g_strdup_printf("LOADGEN%06u", index);
+  cam->session_id = g_uuid_string_random();
+  cam->bearer_id = g_uuid_string_random();
+  cam->started = now_iso8601();
+  cam->announced = g_get_monotonic_time();
+  cam->counts = g_atomic_rc_box_new0(struct rtp_counts);
+  cam->counts->lock = &ctx->lock;
+  g_hash_table_insert(ctx->cameras, cam->session_id, cam);
+
+  broadcast_stream_event(cam, EVENT_STARTED);
+  ctx->streams_started++;
+
+  if (ctx->opts.duration > 0) {
+    cam->stop_timer = g_timeout_add_seconds(ctx->opts.duration,
+                                            stop_camera,
+                                            cam);
+  }
+}
+
+static gboolean
+ramp_up(struct loadgen *ctx)
+{
+  start_camera(ctx, ctx->next_index++);
+
+  if (ctx->next_index < (guint) ctx->opts.cameras) {
+    return G_SOURCE_CONTINUE;
+  }
+
+  ctx->ramp_timer = 0;
+  g_print("All %d cameras started\n", ctx->opts.cameras);
+
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * Shared media
+ */
+
+/* Streaming thread of the encoders, every camera gets the same data with
+ * its own timestamps */
+static GstFlowReturn
+on_media_sample(GstAppSink *sink, gpointer user_data)
+{
+  struct loadgen *ctx = user_data;
+  GstSample *sample = gst_app_sink_pull_sample(sink);
+  GPtrArray *srcs;
+  GstBuffer *buf;
+
+  if (sample == NULL) {
+    return GST_FLOW_EOS;
+  }
+
+  srcs = g_strcmp0(GST_OBJECT_NAME(sink), "video") == 0 ? ctx->video_srcs
+                                                         : ctx->audio_srcs;
+  buf = gst_buffer_copy(gst_sample_get_buffer(sample));
+  GST_BUFFER_PTS(buf) = GST_CLOCK_TIME_NONE;
+  GST_BUFFER_DTS(buf) = GST_CLOCK_TIME_NONE;
+
+  g_mutex_lock(&ctx->lock);
+  for (guint i = 0; i < srcs->len; i++) {
+    GstSample *copy = gst_sample_new(buf,
+                                     gst_sample_get_caps(sample),
+                                     NULL,
+                                     NULL);
+
+    gst_app_src_push_sample(GST_APP_SRC(srcs->pdata[i]), copy);
+    gst_sample_unref(copy);
+  }
+  g_mutex_unlock(&ctx->lock);
+
+  gst_buffer_unref(buf);
+  gst_sample_unref(sample);
+
+  return GST_FLOW_OK;
+}
+
+static GstElement *
+create_media(struct loadgen *ctx, GError **error)
+{
+  GstAppSinkCallbacks callbacks = { 0 };
+  GstElement *media;
+  gchar *desc;
+
+  desc = g_strdup_printf(
+          "videotestsrc is-live=true pattern=ball ! "
+          "video/x-raw,width=%d,height=%d,framerate=%d/1 ! "
+          "x264enc tune=zerolatency speed-preset=ultrafast bitrate=%d "
+          "key-int-max=%d ! "
+          "h264parse config-interval=-1 ! "
+          "video/x-h264,stream-format=byte-stream,alignment=au,"
+          "profile=constrained-baseline ! "
+          "appsink name=video sync=false "
+          "audiotestsrc is-live=true wave=ticks ! "
+          "audioconvert ! audioresample ! opusenc ! "
+          "appsink name=audio sync=false",
+          ctx->opts.width,
+          ctx->opts.height,
+          ctx->opts.fps,
+          ctx->opts.bitrate,
+          ctx->opts.fps * 2);
+  media = gst_parse_launch(desc, error);
+  g_free(desc);
+
+  if (media == NULL) {
+    return NULL;
+  }
+
+  callbacks.new_sample = on_media_sample;
+  for (guint i = 0; i < 2; i++) {
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(media),
+                                           i == 0 ? "video" : "audio");
+
+    gst_app_sink_set_callbacks(GST_APP_SINK(sink), &callbacks, ctx, NULL);
+    gst_object_unref(sink);
+  }
+
+  return media;
+}
+
+/*
+ * HTTP and websocket endpoints
+ */
+
+static void
+reply_json(SoupServerMessage *msg, gchar *body)
+{
+  soup_server_message_set_status(msg, SOUP_STATUS_OK, NULL);
+  soup_server_message_set_response(msg,
+                                   "application/json",
+                                   SOUP_MEMORY_TAKE,
+                                   body,
+                                   strlen(body));
+}
+
+/* Any credentials are good */
+static void
+on_auth(G_GNUC_UNUSED SoupServer *server,
+        SoupServerMessage *msg,
+        G_GNUC_UNUSED const char *path,
+        G_GNUC_UNUSED GHashTable *query,
+        gpointer user_data)
+{
+  struct loadgen *ctx = user_data;
+  JsonBuilder *builder = json_builder_new();
+  GDateTime *now = g_date_time_new_now_utc();
+  GDateTime *expires = g_date_time_add_seconds(now, TOKEN_LIFETIME);
+  gchar *expires_at = g_date_time_format_iso8601(expires);
+  gchar *token;
+
+  g_date_time_unref(expires);
+  g_date_time_unref(now);
+  token = g_strdup_printf("loadgen-token-%u", ++ctx->tokens);
+
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "apiVersion");
+  json_builder_add_string_value(builder, "1.0");
+  json_builder_set_member_name(builder, "method");
+  json_builder_add_string_value(builder, "getSignalingClientToken");
+  json_builder_set_member_name(builder, "data");
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "token");
+  json_builder_add_string_value(builder, token);
+  json_builder_set_member_name(builder, "expiresAt");
+  json_builder_add_string_value(builder, expires_at);
+  json_builder_end_object(builder);
+  json_builder_end_object(builder);
+
+  reply_json(msg, builder_to_string(builder));
+  g_free(token);
+  g_free(expires_at);
+}
+
+/* The streams that are running, for a client that connects late */
+static void
+on_status(G_GNUC_UNUSED SoupServer *server,
+          SoupServerMessage *msg,
+          G_GNUC_UNUSED const char *path,
+          G_GNUC_UNUSED GHashTable *query,
+          gpointer user_data)
+{
+  struct loadgen *ctx = user_data;
+  JsonBuilder *builder = json_builder_new();
+  GHashTableIter iter;
+  struct camera *cam;
+
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "apiVersion");
+  json_builder_add_string_value(builder, "1.0");
+  json_builder_set_member_name(builder, "method");
+  json_builder_add_string_value(builder, "getTargets");
+  json_builder_set_member_name(builder, "data");
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "targets");
+  json_builder_begin_array(builder);
+
+  g_hash_table_iter_init(&iter, ctx->cameras);
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &cam)) {
+    if (cam->stopped) {
+      continue;
+    }
+
+    json_builder_begin_object(builder);
+    json_builder_set_member_name(builder, "id");
+    json_builder_add_string_value(builder, cam->id);
+    json_builder_set_member_name(builder, "sessionId");
+    json_builder_add_string_value(builder, cam->session_id);
+    json_builder_set_member_name(builder, "bearerId");
+    json_builder_add_string_value(builder, cam->bearer_id);
+    json_builder_set_member_name(builder, "bearerName");
+    json_builder_add_string_value(builder, cam->id);
+    json_builder_set_member_name(builder, "started");
+    json_builder_add_string_value(builder, cam->started);
+    json_builder_end_object(builder);
+  }
+
+  json_builder_end_array(builder);
+  json_builder_end_object(builder);
+  json_builder_end_object(builder);
+
+  reply_json(msg, builder_to_string(builder));
+}
+
+static void
+on_signaling(struct loadgen *ctx,
+             SoupWebsocketConnection *ws,
+             JsonObject *obj,
+             const gchar *correlation_id)
+{
+  JsonObject *data;
+  JsonObject *params = NULL;
+  const gchar *type;
+  const gchar *method;
+  struct camera *cam;
+
+  data = json_object_get_object_member(obj, "data");
+  if (data == NULL) {
+    return;
+  }
+
+  cam = g_hash_table_lookup(ctx->cameras,
+                            json_object_get_string_member_with_default(
+                                    data,
+                                    "sessionId",
+                                    ""));
+  if (cam == NULL) {
+    ctx->unknown_sessions++;
+    return;
+  }
+
+  type = json_object_get_string_member_with_default(data, "type", "");
+  method = json_object_get_string_member_with_default(data, "method", "");
+  if (json_object_has_member(data, "params")) {
+    params = json_object_get_object_member(data, "params");
+  }
+
+  /* Replies to the offer and to the candidates of the camera */
+  if (g_strcmp0(type, "request") != 0) {
+    return;
+  }
+
+  if (g_strcmp0(method, "setSdpAnswer") == 0 && params != NULL) {
+    on_answer(cam,
+              json_object_get_string_member_with_default(params, "sdp", ""));
+  } else if (g_strcmp0(method, "addIceCandidate") == 0 && params != NULL &&
+             cam->webrtc != NULL) {
+    g_signal_emit_by_name(
+            cam->webrtc,
+            "add-ice-candidate",
+            (guint) json_object_get_int_member_with_default(params,
+                                                            "sdpMLineIndex",
+                                                            0),
+            json_object_get_string_member_with_default(params,
+                                                       "candidate",
+                                                       ""));
+  }
+
+  send_response(ws, cam, method, correlation_id);
+}
+
+static void
+on_client_message(SoupWebsocketConnection *ws,
+                  G_GNUC_UNUSED gint type,
+                  GBytes *message,
+                  struct loadgen *ctx)
+{
+  JsonParser *parser = json_parser_new();
+  JsonObject *obj;
+  const gchar *msg_type;
+  const gchar *correlation_id;
+  gsize size;
+  const gchar *text = g_bytes_get_data(message, &size);
+
+  if (!json_parser_load_from_data(parser, text, size, NULL) ||
+      !JSON_NODE_HOLDS_OBJECT(json_parser_get_root(parser))) {
+    g_warning("Unparsable message from a client");
+    g_object_unref(parser);
+    return;
+  }
+
+  obj = json_node_get_object(json_parser_get_root(parser));
+  msg_type = json_object_get_string_member_with_default(obj, "type", "");
+  correlation_id = json_object_get_string_member_with_default(obj,
+                                                              "correlationId",
+                                                              "");
+
+  if (g_strcmp0(msg_type, "hello") == 0) {
+    JsonBuilder *builder = json_builder_new();
+    gchar *id = g_strdup_printf("loadgen-client-%u::auto_assigned",
+                                ctx->clients->len);
+
+    json_builder_begin_object(builder);
+    json_builder_set_member_name(builder, "type");
+    json_builder_add_string_value(builder, "hello");
+    json_builder_set_member_name(builder, "id");
+    json_builder_add_string_value(builder, id);
+    json_builder_set_member_name(builder, "correlationId");
+    json_builder_add_string_value(builder, correlation_id);
+    json_builder_end_object(builder);
+    send_text(ws, builder_to_string(builder));
+    g_free(id);
+  } else if (g_strcmp0(msg_type, "initSession") == 0) {
+    JsonObject *data = json_object_get_object_member(obj, "data");
+    struct camera *cam = NULL;
+
+    if (data != NULL) {
+      cam = g_hash_table_lookup(ctx->cameras,
+                                json_object_get_string_member_with_default(
+                                        data,
+                                        "sessionId",
+                                        ""));
+    }
+
+    if (cam == NULL || cam->peer != NULL) {
+      ctx->unknown_sessions++;
+    } else {
+      gdouble ms;
+
+      ctx->sessions++;
+      send_init_session(ws, cam, correlation_id);
+      camera_start_session(cam, ws);
+      ms = (cam->init_at - cam->announced) / 1000.0;
+      g_array_append_val(ctx->init_times, ms);
+    }
+  } else if (g_strcmp0(msg_type, "signaling") == 0) {
+    on_signaling(ctx, ws, obj, correlation_id);
+  }
+
+  g_object_unref(parser);
+}
+
+static void
+on_ws_closed(SoupWebsocketConnection *ws, struct loadgen *ctx)
+{
+  g_ptr_array_remove(ctx->clients, ws);
+  g_ptr_array_remove(ctx->data_streams, ws);
+}
+
+static void
+on_client_socket(G_GNUC_UNUSED SoupServer *server,
+                 G_GNUC_UNUSED SoupServerMessage *msg,
+                 G_GNUC_UNUSED const char *path,
+                 SoupWebsocketConnection *ws,
+                 gpointer user_data)
+{
+  struct loadgen *ctx = user_data;
+
+  g_print("Client connected\n");
+  g_ptr_array_add(ctx->clients, g_object_ref(ws));
+  g_signal_connect(ws, "message", G_CALLBACK(on_client_message), ctx);
+  g_signal_connect(ws, "closed", G_CALLBACK(on_ws_closed), ctx);
+}
+
+/* Only the events:configure filter comes in on the data stream */
+static void
+on_data_stream(G_GNUC_UNUSED SoupServer *server,
+               G_GNUC_UNUSED SoupServerMessage *msg,
+               G_GNUC_UNUSED const char *path,
+               SoupWebsocketConnection *ws,
+               gpointer user_data)
+{
+  struct loadgen *ctx = user_data;
+
+  g_print("Data stream connected\n");
+  g_ptr_array_add(ctx->data_streams, g_object_ref(ws));
+  g_signal_connect(ws, "closed", G_CALLBACK(on_ws_closed), ctx);
+}
+
+/*
+ * Reporting
+ */
+
+static gboolean
+read_proc_ticks(gint pid, guint64 *ticks, glong *rss)
+{
+  gchar *path;
+  gchar *content = NULL;
+  gchar **fields;
+  const gchar *end;
+  gboolean ok;
+
+  path = pid > 0 ? g_strdup_printf("/proc/%d/stat", pid)
+                 : g_strdup("/proc/self/stat");
+  ok = g_file_get_contents(path, &content, NULL, NULL);
+  g_free(path);
+  if (!ok) {
+    return FALSE;
+  }
+
+  /* The command may contain spaces, the fields start after its ")" */
+  end = strrchr(content, ')');
+  fields = g_strsplit(end != NULL ? end + 2 : content, " ", -1);
+  ok = g_strv_length(fields) > 21;
+  if (ok) {
+    /* utime and stime, then rss in pages */
+    *ticks = g_ascii_strtoull(fields[11], NULL, 10) +
+             g_ascii_strtoull(fields[12], NULL, 10);
+    *rss = g_ascii_strtoll(fields[21], NULL, 10) * (sysconf(_SC_PAGESIZE) /
+                                                    1024);
+  }
+
+  g_strfreev(fields);
+  g_free(content);
+
+  return ok;
+}
+
+/* Percent of one core since the previous sample, -1 for the first */
+static gdouble
+sample_cpu(gint pid, struct proc_sample *prev, glong *rss)
+{
+  gint64 now = g_get_monotonic_time();
+  guint64 ticks;
+  gdouble cpu = -1;
+
+  if (!read_proc_ticks(pid, &ticks, rss)) {
+    *rss = -1;
+    return -1;
+  }
+
+  if (prev->at > 0 && now > prev->at) {
+    cpu = (ticks - prev->ticks) * 100.0 / sysconf(_SC_CLK_TCK) /
+          ((now - prev->at) / (gdouble) G_USEC_PER_SEC);
+  }
+  prev->at = now;
+  prev->ticks = ticks;
+
+  return cpu;
+}
+
+static gint
+compare_doubles(gconstpointer a, gconstpointer b)
+{
+  gdouble x = *(const gdouble *) a;
+  gdouble y = *(const gdouble *) b;
+
+  return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static gdouble
+percentile(GArray *values, guint p)
+{
+  if (values->len == 0) {
+    return 0;
+  }
+
+  g_array_sort(values, compare_doubles);
+
+  return g_array_index(values, gdouble, (values->len - 1) * p / 100);
+}
+
+static void
+on_stats(GstPromise *promise, gpointer user_data)
+{
+  struct rtp_counts *counts = user_data;
+  const GstStructure *reply = gst_promise_get_reply(promise);
+  guint64 sent = 0;
+  guint64 lost = 0;
+
+  for (gint i = 0; reply != NULL && i < gst_structure_n_fields(reply); i++) {
+    const GValue *val = gst_structure_get_value(reply,
+                                                gst_structure_nth_field_name(
+                                                        reply,
+                                                        i));
+    const GstStructure *s;
+    GstWebRTCStatsType type;
+    guint64 u64;
+    gint lost_i;
+
+    if (!GST_VALUE_HOLDS_STRUCTURE(val)) {
+      continue;
+    }
+
+    s = gst_value_get_structure(val);
+    if (!gst_structure_get(s,
+                           "type",
+                           GST_TYPE_WEBRTC_STATS_TYPE,
+                           &type,
+                           NULL)) {
+      continue;
+    }
+
+    if (type == GST_WEBRTC_STATS_OUTBOUND_RTP &&
+        gst_structure_get_uint64(s, "packets-sent", &u64)) {
+      sent += u64;
+    } else if (type == GST_WEBRTC_STATS_REMOTE_INBOUND_RTP &&
+               gst_structure_get_int(s, "packets-lost", &lost_i) &&
+               lost_i > 0) {
+      lost += lost_i;
+    }
+  }
+  gst_promise_unref(promise);
+
+  g_mutex_lock(counts->lock);
+  counts->packets_sent = sent;
+  counts->packets_lost = lost;
+  g_mutex_unlock(counts->lock);
+}
+
+static gboolean
+report(struct loadgen *ctx)
+{
+  GHashTableIter iter;
+  struct camera *cam;
+  guint active = 0;
+  guint64 sent = 0;
+  guint64 lost = 0;
+  gdouble cpu;
+  gdouble writer_cpu = -1;
+  glong rss;
+  glong writer_rss = -1;
+
+  g_mutex_lock(&ctx->lock);
+  g_hash_table_iter_init(&iter, ctx->cameras);
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &cam)) {
+    sent += cam->counts->packets_sent;
+    lost += cam->counts->packets_lost;
+  }
+  g_mutex_unlock(&ctx->lock);
+
+  /* For the next report */
+  g_hash_table_iter_init(&iter, ctx->cameras);
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &cam)) {
+    if (cam->webrtc != NULL) {
+      active++;
+      g_signal_emit_by_name(cam->webrtc,
+                            "get-stats",
+                            NULL,
+                            gst_promise_new_with_change_func(
+                                    on_stats,
+                                    g_atomic_rc_box_acquire(cam->counts),
+                                    g_atomic_rc_box_release));
+    }
+  }
+
+  cpu = sample_cpu(0, &ctx->self_cpu, &rss);
+  if (ctx->opts.pid > 0) {
+    writer_cpu = sample_cpu(ctx->opts.pid, &ctx->writer_cpu, &writer_rss);
+  }
+
+  g_print("streams %" G_GUINT64_FORMAT " started, %" G_GUINT64_FORMAT
+          " stopped | sessions %u active, %" G_GUINT64_FORMAT
+          " connected, %" G_GUINT64_FORMAT " failed | setup p50 %.0f ms, "
+          "p95 %.0f ms, max %.0f ms | loss %.2f%% | loadgen %.0f%% CPU, "
+          "%ld kB",
+          ctx->streams_started,
+          ctx->streams_stopped,
+          active,
+          ctx->connected,
+          ctx->failed,
+          percentile(ctx->setup_times, 50),
+          percentile(ctx->setup_times, 95),
+          percentile(ctx->setup_times, 100),
+          sent > 0 ? lost * 100.0 / (sent + lost) : 0.0,
+          cpu,
+          rss);
+  if (ctx->opts.pid > 0) {
+    g_print(" | writer %.0f%% CPU, %ld kB", writer_cpu, writer_rss);
+  }
+  g_print("\n");
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+print_summary(struct loadgen *ctx)
+{
+  g_print("\nSummary\n");
+  g_print("  streams started:      %" G_GUINT64_FORMAT "\n",
+          ctx->streams_started);
+  g_print("  sessions requested:   %" G_GUINT64_FORMAT "\n", ctx->sessions);
+  g_print("  sessions connected:   %" G_GUINT64_FORMAT "\n", ctx->connected);
+  g_print("  sessions failed:      %" G_GUINT64_FORMAT "\n", ctx->failed);
+  g_print("  unknown sessions:     %" G_GUINT64_FORMAT "\n",
+          ctx->unknown_sessions);
+  g_print("  stream to initSession p50/p95/max: %.0f/%.0f/%.0f ms\n",
+          percentile(ctx->init_times, 50),
+          percentile(ctx->init_times, 95),
+          percentile(ctx->init_times, 100));
+  g_print("  stream to connected   p50/p95/max: %.0f/%.0f/%.0f ms\n",
+          percentile(ctx->setup_times, 50),
+          percentile(ctx->setup_times, 95),
+          percentile(ctx->setup_times, 100));
+}
+
+static gboolean
+handle_term_signals(struct loadgen *ctx)
+{
+  g_main_loop_quit(ctx->loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* A self-signed certificate for this run only, the writer accepts any */
+static GTlsCertificate *
+create_certificate(GError **error)
+{
+  GTlsCertificate *cert = NULL;
+  gchar *dir;
+  gchar *key;
+  gchar *crt;
+  gint status;
+
+  dir = g_dir_make_tmp("loadgen-XXXXXX", error);
+  if (dir == NULL) {
+    return NULL;
+  }
+  key = g_build_filename(dir, "key.pem", NULL);
+  crt = g_build_filename(dir, "cert.pem", NULL);
+
+  const gchar *args[] = {
+    "openssl", "req",           "-x509",   "-newkey", "rsa:2048", "-nodes",
+    "-days",   "1",             "-subj",   "/CN=localhost",       "-keyout",
+    key,       "-out",          crt,       NULL
+  };
+
+  if (g_spawn_sync(NULL,
+                   (gchar **) args,
+                   NULL,
+                   G_SPAWN_SEARCH_PATH | G_SPAWN_STDOUT_TO_DEV_NULL |
+                           G_SPAWN_STDERR_TO_DEV_NULL,
+                   NULL,
+                   NULL,
+                   NULL,
+                   NULL,
+                   &status,
+                   error) &&
+      g_spawn_check_wait_status(status, error)) {
+    cert = g_tls_certificate_new_from_files(crt, key, error);
+  }
+
+  g_remove(key);
+  g_remove(crt);
+  g_rmdir(dir);
+  g_free(key);
+  g_free(crt);
+  g_free(dir);
+
+  return cert;
+}
+
+int
+main(int argc, char **argv)
+{
+  struct loadgen ctx = { 0 };
+  GOptionContext *context;
+  GTlsCertificate *cert;
+  GError *lerr = NULL;
+  gint code = 0;
+
+  ctx.opts.port = 8443;
+  ctx.opts.cameras = 10;
+  ctx.opts.rate = 5;
+  ctx.opts.width = 640;
+  ctx.opts.height = 360;
+  ctx.opts.fps = 15;
+  ctx.opts.bitrate = 800;
+
+  /* clang-format off */
+  GOptionEntry entries[] = {
+    { "port", 'P', 0, G_OPTION_ARG_INT, &ctx.opts.port, "HTTPS port of the emulated server, 8443 by default", "PORT" },
+    { "cameras", 'n', 0, G_OPTION_ARG_INT, &ctx.opts.cameras, "Cameras streaming at the same time, 10 by default", "N" },
+    { "rate", 'r', 0, G_OPTION_ARG_DOUBLE, &ctx.opts.rate, "Cameras started per second, 5 by default", "RATE" },
+    { "duration", 'd', 0, G_OPTION_ARG_INT, &ctx.opts.duration, "Seconds per stream before the camera starts a new one, 0 to never stop", "S" },
+    { "run-time", 't', 0, G_OPTION_ARG_INT, &ctx.opts.run_time, "Seconds to run, 0 until interrupted", "S" },
+    { "width", 'W', 0, G_OPTION_ARG_INT, &ctx.opts.width, "Video width", "PIXELS" },
+    { "height", 'H', 0, G_OPTION_ARG_INT, &ctx.opts.height, "Video height", "PIXELS" },
+    { "fps", 'f', 0, G_OPTION_ARG_INT, &ctx.opts.fps, "Video frame rate", "FPS" },
+    { "bitrate", 'b', 0, G_OPTION_ARG_INT, &ctx.opts.bitrate, "Video bitrate in kbps", "KBPS" },
+    { "pid", 'p', 0, G_OPTION_ARG_INT, &ctx.opts.pid, "Process id of the writer, to report its CPU and memory", "PID" },
+    { "cert", 'c', 0, G_OPTION_ARG_FILENAME, &ctx.opts.cert, "PEM file with the server certificate and key, a self-signed one is created by default", "FILE" },
+    G_OPTION_ENTRY_NULL
+  };
+  /* clang-format on */
+
+  gst_init(&argc, &argv);
+
+  context = g_option_context_new("- emulate a body worn system and cameras");
+  g_option_context_add_main_entries(context, entries, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &lerr)) {
+    g_print("option parsing failed: %s\n", lerr->message);
+    return 1;
+  }
+  g_option_context_free(context);
+
+  if (ctx.opts.cameras <= 0 || ctx.opts.rate <= 0 || ctx.opts.fps <= 0) {
+    g_print("Cameras, rate and fps must be positive\n");
+    return 1;
+  }
+
+  if (ctx.opts.cert == NULL) {
+    cert = create_certificate(&lerr);
+    if (cert == NULL) {
+      g_print("Failed to create a certificate: %s\n", lerr->message);
+      return 1;
+    }
+  } else {
+    cert = g_tls_certificate_new_from_file(ctx.opts.cert, &lerr);
+    if (cert == NULL) {
+      g_print("Failed to load %s: %s\n", ctx.opts.cert, lerr->message);
+      return 1;
+    }
+  }
+
+  g_mutex_init(&ctx.lock);
+  ctx.system_id = g_uuid_string_random();
+  ctx.data_streams = g_ptr_array_new_with_free_func(g_object_unref);
+  ctx.clients = g_ptr_array_new_with_free_func(g_object_unref);
+  ctx.cameras = g_hash_table_new_full(g_str_hash,
+                                      g_str_equal,
+                                      NULL,
+                                      (GDestroyNotify) camera_free);
+  ctx.video_srcs = g_ptr_array_new_with_free_func(gst_object_unref);
+  ctx.audio_srcs = g_ptr_array_new_with_free_func(gst_object_unref);
+  ctx.setup_times = g_array_new(FALSE, FALSE, sizeof(gdouble));
+  ctx.init_times = g_array_new(FALSE, FALSE, sizeof(gdouble));
+
+  ctx.media = create_media(&ctx, &lerr);
+  if (ctx.media == NULL) {
+    g_print("Failed to create the encoders: %s\n", lerr->message);
+    code = 1;
+    goto out;
+  }
+
+  ctx.server = soup_server_new("tls-certificate", cert, NULL);
+  soup_server_add_handler(ctx.server, URL_PATH_AUTH, on_auth, &ctx, NULL);
+  soup_server_add_handler(ctx.server,
+                          URL_PATH_TARGETS,
+                          on_status,
+                          &ctx,
+                          NULL);
+  soup_server_add_websocket_handler(ctx.server,
+                                    URL_PATH_WSS,
+                                    NULL,
+                                    NULL,
+                                    on_client_socket,
+                                    &ctx,
+                                    NULL);
+  soup_server_add_websocket_handler(ctx.server,
+                                    URL_PATH_STREAM,
+                                    NULL,
+                                    NULL,
+                                    on_data_stream,
+                                    &ctx,
+                                    NULL);
+
+  if (!soup_server_listen_local(ctx.server,
+                                ctx.opts.port,
+                                SOUP_SERVER_LISTEN_HTTPS,
+                                &lerr)) {
+    g_print("Failed to listen on port %d: %s\n",
+            ctx.opts.port,
+            lerr->message);
+    code = 1;
+    goto out;
+  }
+
+  g_print("Listening on 127.0.0.1:%d, run the writer with "
+          "-S user:pass@127.0.0.1:%d -t LOADGEN\n",
+          ctx.opts.port,
+          ctx.opts.port);
+
+  gst_element_set_state(ctx.media, GST_STATE_PLAYING);
+
+  ctx.loop = g_main_loop_new(NULL, FALSE);
+  ctx.ramp_timer = g_timeout_add((guint) MAX(1000 / ctx.opts.rate, 1),
+                                 G_SOURCE_FUNC(ramp_up),
+                                 &ctx);
+  ctx.report_timer = g_timeout_add_seconds(REPORT_INTERVAL,
+                                           G_SOURCE_FUNC(report),
+                                           &ctx);
+  if (ctx.opts.run_time > 0) {
+    g_timeout_add_seconds(ctx.opts.run_time,
+                          G_SOURCE_FUNC(handle_term_signals),
+                          &ctx);
+  }
+  g_unix_signal_add(SIGTERM, G_SOURCE_FUNC(handle_term_signals), &ctx);
+  g_unix_signal_add(SIGINT, G_SOURCE_FUNC(handle_term_signals), &ctx);
+
+  g_main_loop_run(ctx.loop);
+
+  print_summary(&ctx);
+
+out:
+  g_clear_error(&lerr);
+  g_clear_handle_id(&ctx.ramp_timer, g_source_remove);
+  g_clear_handle_id(&ctx.report_timer, g_source_remove);
+  g_clear_pointer(&ctx.cameras, g_hash_table_unref);
+  if (ctx.media != NULL) {
+    gst_element_set_state(ctx.media, GST_STATE_NULL);
+    gst_object_unref(ctx.media);
+  }
+  g_clear_object(&ctx.server);
+  g_clear_pointer(&ctx.clients, g_ptr_array_unref);
+  g_clear_pointer(&ctx.data_streams, g_ptr_array_unref);
+  g_clear_pointer(&ctx.video_srcs, g_ptr_array_unref);
+  g_clear_pointer(&ctx.audio_srcs, g_ptr_array_unref);
+  g_clear_pointer(&ctx.setup_times, g_array_unref);
+  g_clear_pointer(&ctx.init_times, g_array_unref);
+  g_clear_pointer(&ctx.loop, g_main_loop_unref);
+  g_object_unref(cert);
+  g_free(ctx.system_id);
+  g_free(ctx.opts.cert);
+  g_mutex_clear(&ctx.lock);
+
+  return code;
+}
@@ -0,0 +1,471 @@
+#include <glib.h>
+#include <json-glib/json-glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "messages.h"
+#include "webrtc_settings.h"
+
+#define DEFAULT_ITERATIONS 1000000
+#define WARMUP_DIVISOR     100 /* warm up with 1% of the iterations */
+
+/* Every allocation in the process goes through these on glibc, also the
+ * ones made by GLib and json-glib */
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static guint64 allocs;
+
+void *
+malloc(size_t size)
+{
+  __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+  return __libc_malloc(size);
+}
+
+void *
+calloc(size_t n, size_t size)
+{
+  __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+  return __libc_calloc(n, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+  __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+  return __libc_realloc(ptr, size);
+}
+
+void
+free(void *ptr)
+{
+  __libc_free(ptr);
+}
+
+static guint64
+alloc_count(void)
+{
+  return __atomic_load_n(&allocs, __ATOMIC_RELAXED);
+}
+#else
+static guint64
+alloc_count(void)
+{
+  return 0;
+}
+#endif
+
+/* Arguments for the message_create_* calls, taken from test/send */
+struct create_args {
+  gchar *target;
+  gchar *session_id;
+  gchar *token;
+  gchar *sdp;
+  gchar *candidate;
+  WebrtcSettings *settings;
+};
+
+struct bench {
+  gchar *name;
+  void (*op)(gconstpointer data);
+  gconstpointer data;
+};
+
+struct result {
+  guint64 iterations;
+  guint64 elapsed; /* us */
+  guint64 allocs;
+  glong peak_rss; /* kB */
+};
+
+static struct create_args args;
+
+static gchar *
+fixture_path(const gchar *dir, const gchar *name)
+{
+  const gchar *srcdir = g_getenv("G_TEST_SRCDIR");
+
+  return g_build_filename(srcdir != NULL ? srcdir : ".", dir, name, NULL);
+}
+
+/* A string member of a test/send fixture, "data.params.sdp" style */
+static gchar *
+fixture_string(const gchar *name, const gchar *path)
+{
+  JsonParser *parser = json_parser_new();
+  JsonObject *obj;
+  gchar **names;
+  gchar *file;
+  gchar *res = NULL;
+  GError *lerr = NULL;
+  guint i;
+
+  file = fixture_path("send", name);
+  if (!json_parser_load_from_file(parser, file, &lerr)) {
+    g_error("Failed to load %s: %s", file, lerr->message);
+  }
+
+  obj = json_node_get_object(json_parser_get_root(parser));
+  names = g_strsplit(path, ".", -1);
+
+  for (i = 0; obj != NULL && names[i + 1] != NULL; i++) {
+    obj = json_object_get_object_member(obj, names[i]);
+  }
+
+  if (obj != NULL && json_object_has_member(obj, names[i])) {
+    res = g_strdup(json_object_get_string_member(obj, names[i]));
+  }
+
+  if (res == NULL) {
+    g_error("%s has no string %s", file, path);
+  }
+
+  g_strfreev(names);
+  g_object_unref(parser);
+  g_free(file);
+
+  return res;
+}
+
+static void
+op_parse(gconstpointer data)
+{
+  message_t *msg = message_parse((GBytes *) data, NULL);
+
+  message_free(msg);
+}
+
+static void
+op_reply(gconstpointer data)
+{
+  g_free(message_create_reply((message_t *) data, args.token));
+}
+
+static void
+op_hello(G_GNUC_UNUSED gconstpointer data)
+{
+  g_free(message_create_hello(args.token));
+}
+
+static void
+op_stream_filter(G_GNUC_UNUSED gconstpointer data)
+{
+  g_free(message_create_stream_filter());
+}
+
+static void
+op_init_session(G_GNUC_UNUSED gconstpointer data)
+{
+  g_free(message_create_init_session(args.target,
+                                     args.session_id,
+                                     args.settings,
+                                     args.token));
+}
+
+static void
+op_sdp_answer(G_GNUC_UNUSED gconstpointer data)
+{
+  g_free(message_create_sdp_answer(args.target,
+                                   args.session_id,
+                                   args.sdp,
+                                   args.token));
+}
+
+static void
+op_ice_candidate(G_GNUC_UNUSED gconstpointer data)
+{
+  g_free(message_create_ice_candidate(args.target,
+                                      args.session_id,
+                                      args.candidate,
+                                      0,
+                                      args.token));
+}
+
+static void
+op_update_session(G_GNUC_UNUSED gconstpointer data)
+{
+  g_free(message_create_update_session(args.target,
+                                       args.session_id,
+                                       1500,
+                                       args.token));
+}
+
+static void
+add_bench(GArray *benches,
+          gchar *name,
+          void (*op)(gconstpointer data),
+          gconstpointer data)
+{
+  struct bench b = { name, op, data };
+
+  g_array_append_val(benches, b);
+}
+
+static gint
+compare_names(gconstpointer a, gconstpointer b)
+{
+  return g_strcmp0(*(const gchar *const *) a, *(const gchar *const *) b);
+}
+
+/* One parse, and one reply if the message gets one, per incoming fixture */
+static void
+add_incoming(GArray *benches, GPtrArray *owned)
+{
+  gchar *dirname = fixture_path("incoming", NULL);
+  GPtrArray *names = g_ptr_array_new_with_free_func(g_free);
+  const gchar *entry;
+  GDir *dir;
+
+  dir = g_dir_open(dirname, 0, NULL);
+  if (dir == NULL) {
+    g_error("No fixtures in %s", dirname);
+  }
+  while ((entry = g_dir_read_name(dir)) != NULL) {
+    if (g_str_has_suffix(entry, ".json")) {
+      g_ptr_array_add(names, g_strndup(entry, strlen(entry) - 5));
+    }
+  }
+  g_dir_close(dir);
+  g_ptr_array_sort(names, compare_names);
+
+  for (guint i = 0; i < names->len; i++) {
+    const gchar *name = names->pdata[i];
+    gchar *file = g_strdup_printf("%s/%s.json", dirname, name);
+    gchar *content;
+    gsize size;
+    GBytes *json;
+    message_t *msg;
+    gchar *reply;
+
+    if (!g_file_get_contents(file, &content, &size, NULL)) {
+      g_error("Failed to load %s", file);
+    }
+    g_free(file);
+
+    json = g_bytes_new_take(content, size);
+    g_ptr_array_add(owned, json);
+
+    msg = message_parse(json, NULL);
+    if (msg == NULL) {
+      g_warning("%s does not parse, skipped", name);
+      continue;
+    }
+
+    add_bench(benches, g_strdup_printf("parse/%s", name), op_parse, json);
+
+    reply = message_create_reply(msg, args.token);
+    if (reply != NULL) {
+      add_bench(benches, g_strdup_printf("reply/%s", name), op_reply, msg);
+      g_free(reply);
+    } else {
+      message_free(msg);
+    }
+  }
+
+  g_ptr_array_unref(names);
+  g_free(dirname);
+}
+
+static void
+run(const struct bench *b, guint64 iterations, struct result *res)
+{
+  struct rusage usage;
+  guint64 start_allocs;
+  gint64 start;
+
+  for (guint64 i = 0; i < iterations / WARMUP_DIVISOR; i++) {
+    b->op(b->data);
+  }
+
+  start_allocs = alloc_count();
+  start = g_get_monotonic_time();
+  for (guint64 i = 0; i < iterations; i++) {
+    b->op(b->data);
+  }
+  res->elapsed = MAX(g_get_monotonic_time() - start, 1);
+  res->allocs = alloc_count() - start_allocs;
+  res->iterations = iterations;
+
+  getrusage(RUSAGE_SELF, &usage);
+  res->peak_rss = usage.ru_maxrss;
+}
+
+static void
+add_result(JsonBuilder *builder, const gchar *name, const struct result *res)
+{
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "name");
+  json_builder_add_string_value(builder, name);
+  json_builder_set_member_name(builder, "iterations");
+  json_builder_add_int_value(builder, res->iterations);
+  json_builder_set_member_name(builder, "elapsed_us");
+  json_builder_add_int_value(builder, res->elapsed);
+  json_builder_set_member_name(builder, "ops_per_sec");
+  json_builder_add_double_value(builder,
+                                res->iterations * 1e6 / res->elapsed);
+  json_builder_set_member_name(builder, "ns_per_op");
+  json_builder_add_double_value(builder,
+                                res->elapsed * 1e3 / res->iterations);
+  json_builder_set_member_name(builder, "allocs_per_op");
+#ifdef __GLIBC__
+  json_builder_add_double_value(builder,
+                                (gdouble) res->allocs / res->iterations);
+#else
+  json_builder_add_null_value(builder);
+#endif
+  json_builder_set_member_name(builder, "peak_rss_kb");
+  json_builder_add_int_value(builder, res->peak_rss);
+  json_builder_end_object(builder);
+}
+
+int
+main(int argc, char *argv[])
+{
+  gint64 iterations = DEFAULT_ITERATIONS;
+  gchar *json_path = NULL;
+  gchar *filter = NULL;
+  GOptionContext *context;
+  GArray *benches;
+  GPtrArray *owned;
+  GPtrArray *replies;
+  JsonBuilder *builder;
+  JsonGenerator *generator;
+  JsonNode *root;
+  GError *lerr = NULL;
+
+  /* clang-format off */
+  GOptionEntry entries[] = {
+    { "iterations", 'n', 0, G_OPTION_ARG_INT64, &iterations, "Operations per benchmark", "N" },
+    { "json", 'j', 0, G_OPTION_ARG_FILENAME, &json_path, "Where to write the results, messages-bench.json in the build directory by default", "FILE" },
+    { "filter", 'f', 0, G_OPTION_ARG_STRING, &filter, "Only run benchmarks whose name starts with PREFIX", "PREFIX" },
+    G_OPTION_ENTRY_NULL
+  };
+  /* clang-format on */
+
+  context = g_option_context_new("- benchmark the signaling message codec");
+  g_option_context_add_main_entries(context, entries, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &lerr)) {
+    g_print("option parsing failed: %s\n", lerr->message);
+    return 1;
+  }
+  g_option_context_free(context);
+
+  if (iterations <= 0) {
+    g_print("Iterations must be positive\n");
+    return 1;
+  }
+
+  if (json_path == NULL) {
+    const gchar *builddir = g_getenv("G_TEST_BUILDDIR");
+
+    json_path = g_build_filename(builddir != NULL ? builddir : ".",
+                                 "messages-bench.json",
+                                 NULL);
+  }
+
+  args.target = fixture_string("init_session.json", "targetId");
+  args.session_id = fixture_string("init_session.json", "data.sessionId");
+  args.token = fixture_string("init_session.json", "accessToken");
+  args.sdp = fixture_string("sdp_answer.json", "data.params.sdp");
+  args.candidate = fixture_string("add_ice_candidate.json",
+                                  "data.params.candidate");
+  args.settings = webrtc_settings_new();
+
+  benches = g_array_new(FALSE, FALSE, sizeof(struct bench));
+  owned = g_ptr_array_new_with_free_func((GDestroyNotify) g_bytes_unref);
+  replies = g_ptr_array_new();
+
+  add_incoming(benches, owned);
+  add_bench(benches, g_strdup("create/hello"), op_hello, NULL);
+  add_bench(benches, g_strdup("create/stream_filter"), op_stream_filter, NULL);
+  add_bench(benches, g_strdup("create/init_session"), op_init_session, NULL);
+  add_bench(benches, g_strdup("create/sdp_answer"), op_sdp_answer, NULL);
+  add_bench(benches,
+            g_strdup("create/add_ice_candidate"),
+            op_ice_candidate,
+            NULL);
+  add_bench(benches,
+            g_strdup("create/update_session"),
+            op_update_session,
+            NULL);
+
+  builder = json_builder_new();
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "benchmark");
+  json_builder_add_string_value(builder, "messages");
+  json_builder_set_member_name(builder, "iterations");
+  json_builder_add_int_value(builder, iterations);
+  json_builder_set_member_name(builder, "results");
+  json_builder_begin_array(builder);
+
+  g_print("%-28s %12s %10s %10s %12s\n",
+          "benchmark",
+          "ops/s",
+          "ns/op",
+          "allocs/op",
+          "peak RSS kB");
+
+  for (guint i = 0; i < benches->len; i++) {
+    const struct bench *b = &g_array_index(benches, struct bench, i);
+    struct result res;
+
+    if (b->op == op_reply) {
+      g_ptr_array_add(replies, (gpointer) b->data);
+    }
+
+    if (filter != NULL && !g_str_has_prefix(b->name, filter)) {
+      continue;
+    }
+
+    run(b, iterations, &res);
+    add_result(builder, b->name, &res);
+
+    g_print("%-28s %12.0f %10.1f %10.1f %12ld\n",
+            b->name,
+            res.iterations * 1e6 / res.elapsed,
+            res.elapsed * 1e3 / res.iterations,
+            (gdouble) res.allocs / res.iterations,
+            res.peak_rss);
+  }
+
+  json_builder_end_array(builder);
+  json_builder_end_object(builder);
+
+  root = json_builder_get_root(builder);
+  generator = json_generator_new();
+  json_generator_set_root(generator, root);
+  json_generator_set_pretty(generator, TRUE);
+  if (!json_generator_to_file(generator, json_path, &lerr)) {
+    g_warning("Failed to write %s: %s", json_path, lerr->message);
+    g_clear_error(&lerr);
+  } else {
+    g_print("Results written to %s\n", json_path);
+  }
+
+  g_object_unref(generator);
+  json_node_unref(root);
+  g_object_unref(builder);
+
+  for (guint i = 0; i < benches->len; i++) {
+    g_free(g_array_index(benches, struct bench, i).name);
+  }
+  g_array_unref(benches);
+  g_ptr_array_foreach(replies, (GFunc) message_free, NULL);
+  g_ptr_array_unref(replies);
+  g_ptr_array_unref(owned);
+  g_object_unref(args.settings);
+  g_free(args.target);
+  g_free(args.session_id);
+  g_free(args.token);
+  g_free(args.sdp);
+  g_free(args.candidate);
+  g_free(json_path);
+  g_free(filter);
+
+  return 0;
+}
@@ -0,0 +1,91 @@
+#include <glib.h>
+#include <string.h>
+
+#include "webrtc_metadata.h"
+
+void
+test_schema(void)
+{
+  struct webrtc_metadata_schema *schema;
+
+  schema = webrtc_metadata_schema_new("time:u64, lat:f64,lon:f64,speed:F32",
+                                      NULL);
+  g_assert_nonnull(schema);
+  g_assert_cmpuint(28, ==, webrtc_metadata_schema_size(schema));
+  g_assert_cmpuint(4, ==, webrtc_metadata_schema_n_fields(schema));
+  g_assert_cmpstr("lat", ==, webrtc_metadata_schema_field(schema, 1));
+  webrtc_metadata_schema_free(schema);
+}
+
+void
+test_invalid(void)
+{
+  const gchar *specs[] = {
+    "", "lat", ":f64", "lat:f128", "lat:f64,", "la t:u8", "a=b:u8",
+  };
+
+  for (guint i = 0; i < G_N_ELEMENTS(specs); i++) {
+    GError *lerr = NULL;
+
+    g_assert_null(webrtc_metadata_schema_new(specs[i], &lerr));
+    g_assert_error(lerr, WEBRTC_METADATA_ERROR, WEBRTC_METADATA_ERROR_INVALID);
+    g_clear_error(&lerr);
+  }
+}
+
+void
+test_decode(void)
+{
+  struct webrtc_metadata_schema *schema;
+  /* Network byte order, not aligned */
+  const guint8 record[] = {
+    0x07,                                           /* 7 */
+    0xff, 0xfe,                                     /* -2 */
+    0x00, 0x00, 0x01, 0x8b, 0xcf, 0xe5, 0x68, 0x00, /* 1700000000000 */
+    0x40, 0x4d, 0xaa, 0xd3, 0xe0, 0xbd, 0x44, 0x9a, /* 59.334591 */
+    0x41, 0x48, 0x00, 0x00,                         /* 12.5 */
+  };
+  gdouble values[5];
+  gchar text[128];
+  gchar small[12];
+  gsize len;
+
+  schema = webrtc_metadata_schema_new("type:u8,delta:i16,time:u64,lat:f64,"
+                                      "speed:f32",
+                                      NULL);
+  g_assert_nonnull(schema);
+  g_assert_cmpuint(sizeof(record), ==, webrtc_metadata_schema_size(schema));
+
+  webrtc_metadata_decode(schema, record, values);
+  g_assert_cmpfloat(7.0, ==, values[0]);
+  g_assert_cmpfloat(-2.0, ==, values[1]);
+  g_assert_cmpfloat(1700000000000.0, ==, values[2]);
+  g_assert_cmpfloat_with_epsilon(59.334591, values[3], 1e-9);
+  g_assert_cmpfloat(12.5, ==, values[4]);
+
+  len = webrtc_metadata_format(schema, values, text, sizeof(text));
+  g_assert_cmpstr("type=7 delta=-2 time=1700000000000 lat=59.334591 "
+                  "speed=12.5",
+                  ==,
+                  text);
+  g_assert_cmpuint(strlen(text), ==, len);
+
+  /* Truncated, still terminated */
+  len = webrtc_metadata_format(schema, values, small, sizeof(small));
+  g_assert_cmpstr("type=7 delt", ==, small);
+  g_assert_cmpuint(11, ==, len);
+
+  webrtc_metadata_schema_free(schema);
+}
+
+int
+main(int argc, char *argv[])
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/metadata/schema", test_schema);
+  g_test_add_func("/metadata/invalid", test_invalid);
+  g_test_add_func("/metadata/decode", test_decode);
+
+  return g_test_run();
+}
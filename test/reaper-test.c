@@ -0,0 +1,75 @@
+#include <glib.h>
+#include <gst/gst.h>
+
+#include "webrtc_reaper.h"
+
+static void
+count_done(gpointer data)
+{
+  guint *done = data;
+
+  (*done)++;
+}
+
+void
+test_drain(void)
+{
+  struct webrtc_reaper_metrics before;
+  struct webrtc_reaper_metrics after;
+  GstElement *pipeline;
+  guint done = 0;
+
+  pipeline = gst_parse_launch("fakesrc is-live=true ! fakesink", NULL);
+  g_assert_nonnull(pipeline);
+  gst_element_set_state(pipeline, GST_STATE_PLAYING);
+  gst_element_get_state(pipeline, NULL, NULL, GST_CLOCK_TIME_NONE);
+
+  webrtc_reaper_get_metrics(&before);
+  webrtc_reaper_push(pipeline, "drain", TRUE, count_done, &done);
+  webrtc_reaper_wait();
+  webrtc_reaper_get_metrics(&after);
+
+  g_assert_cmpuint(1, ==, done);
+  g_assert_cmpuint(0, ==, after.pending);
+  g_assert_cmpuint(before.total + 1, ==, after.total);
+  g_assert_cmpuint(before.drained + 1, ==, after.drained);
+  g_assert_cmpuint(after.max_teardown, >=, after.last_teardown);
+}
+
+void
+test_not_playing(void)
+{
+  struct webrtc_reaper_metrics before;
+  struct webrtc_reaper_metrics after;
+  GstElement *pipeline;
+  guint done = 0;
+
+  /* Nothing to drain, stopped right away */
+  webrtc_reaper_get_metrics(&before);
+  for (guint i = 0; i < 3; i++) {
+    pipeline = gst_parse_launch("fakesrc ! fakesink", NULL);
+    webrtc_reaper_push(pipeline, "ready", i > 0, count_done, &done);
+  }
+  webrtc_reaper_push(gst_pipeline_new(NULL), "no-done", FALSE, NULL, NULL);
+  webrtc_reaper_wait();
+  webrtc_reaper_get_metrics(&after);
+
+  g_assert_cmpuint(3, ==, done);
+  g_assert_cmpuint(0, ==, after.pending);
+  g_assert_cmpuint(before.total + 4, ==, after.total);
+  g_assert_cmpuint(before.drained, ==, after.drained);
+  g_assert_cmpuint(before.drain_timeouts, ==, after.drain_timeouts);
+  g_assert_cmpuint(before.not_playing + 2, ==, after.not_playing);
+}
+
+int
+main(int argc, char *argv[])
+{
+  gst_init(&argc, &argv);
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/reaper/drain", test_drain);
+  g_test_add_func("/reaper/not_playing", test_not_playing);
+
+  return g_test_run();
+}
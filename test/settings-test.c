@@ -0,0 +1,317 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "webrtc_settings.h"
+
+static gchar *
+config_path(const gchar *name)
+{
+  return g_strdup_printf("%s/config/%s.conf", g_getenv("G_TEST_SRCDIR"), name);
+}
+
+static gboolean
+has_change(GPtrArray *changed, const gchar *name)
+{
+  for (guint i = 0; i < changed->len; i++) {
+    if (g_strcmp0(changed->pdata[i], name) == 0) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+void
+test_load_file(void)
+{
+  WebrtcSettings *settings;
+  const gchar *const *servers;
+  const gchar *const *priorities;
+  GError *lerr = NULL;
+  gchar *path;
+
+  settings = webrtc_settings_new();
+  path = config_path("writer");
+
+  g_assert_true(webrtc_settings_load_file(settings, path, NULL, &lerr));
+  g_assert_no_error(lerr);
+
+  g_assert_cmpint(WEBRTC_SETTINGS_VIDEO_CODEC_H265,
+                  ==,
+                  webrtc_settings_video_codec(settings));
+  g_assert_cmpint(WEBRTC_SETTINGS_AUDIO_CODEC_NONE,
+                  ==,
+                  webrtc_settings_audio_codec(settings));
+  g_assert_cmpint(WEBRTC_SETTINGS_LATENCY_PROFILE_ARCHIVAL,
+                  ==,
+                  webrtc_settings_latency_profile(settings));
+  g_assert_cmpint(3000, ==, webrtc_settings_video_max_bitrate(settings));
+  g_assert_true(webrtc_settings_fec(settings));
+  g_assert_cmpint(20000, ==, webrtc_settings_bandwidth(settings));
+
+  g_assert_cmpstr("Camera", ==, webrtc_settings_get_target(settings));
+  g_assert_cmpstr("/var/lib/recordings",
+                  ==,
+                  webrtc_settings_get_output(settings));
+
+  servers = webrtc_settings_get_servers(settings);
+  g_assert_cmpuint(2, ==, g_strv_length((gchar **) servers));
+  g_assert_cmpstr("alice:secret@bwc1.example.com", ==, servers[0]);
+
+  priorities = webrtc_settings_priorities(settings);
+  g_assert_cmpuint(2, ==, g_strv_length((gchar **) priorities));
+  g_assert_cmpuint(10,
+                   ==,
+                   webrtc_settings_priority(settings, "BWC-7", "emergency"));
+  g_assert_cmpuint(3,
+                   ==,
+                   webrtc_settings_priority(settings, "Camera-HQ-2", NULL));
+  g_assert_cmpuint(1, ==, webrtc_settings_priority(settings, "Other", NULL));
+
+  g_assert_cmpint(12, ==, webrtc_settings_admission(settings)->max_sessions);
+  g_assert_cmpint(2, ==, webrtc_settings_admission(settings)->max_starting);
+  g_assert_cmpint(0, ==, webrtc_settings_admission(settings)->max_cpu);
+  g_assert_cmpint(2048, ==, webrtc_settings_admission(settings)->min_free);
+  g_assert_cmpstr("/var/lib/recordings-spare",
+                  ==,
+                  webrtc_settings_get_fallback_output(settings));
+  g_assert_cmpstr("/var/lib/recordings/catalog.tab",
+                  ==,
+                  webrtc_settings_get_catalog(settings));
+  g_assert_cmpstr("signaling=debug,pipeline=warning",
+                  ==,
+                  webrtc_settings_get_log(settings));
+  g_assert_cmpuint(500, ==, webrtc_settings_get_trace(settings));
+  g_assert_true(webrtc_settings_get_telemetry(settings));
+  g_assert_cmpuint(96, ==, webrtc_settings_memory(settings));
+  g_assert_cmpstr("time:u64,lat:f64,lon:f64",
+                  ==,
+                  webrtc_settings_get_metadata(settings));
+
+  g_free(path);
+  g_object_unref(settings);
+}
+
+void
+test_reload_changes(void)
+{
+  WebrtcSettings *settings;
+  GPtrArray *changed;
+  gchar *path;
+
+  settings = webrtc_settings_new();
+  changed = g_ptr_array_new();
+
+  path = config_path("writer");
+  g_assert_true(webrtc_settings_load_file(settings, path, NULL, NULL));
+  g_free(path);
+
+  /* Loading the same file again changes nothing */
+  path = config_path("writer");
+  g_assert_true(webrtc_settings_load_file(settings, path, changed, NULL));
+  g_assert_cmpuint(0, ==, changed->len);
+  g_free(path);
+
+  path = config_path("writer_changed");
+  g_assert_true(webrtc_settings_load_file(settings, path, changed, NULL));
+  g_free(path);
+
+  g_assert_cmpuint(3, ==, changed->len);
+  g_assert_true(has_change(changed, "audio-codec"));
+  g_assert_true(has_change(changed, "servers"));
+  g_assert_true(has_change(changed, "max-sessions"));
+
+  g_assert_cmpint(WEBRTC_SETTINGS_SCOPE_NEW_SESSION,
+                  ==,
+                  webrtc_settings_scope("audio-codec"));
+  g_assert_cmpint(WEBRTC_SETTINGS_SCOPE_PROCESS,
+                  ==,
+                  webrtc_settings_scope("servers"));
+  g_assert_cmpint(WEBRTC_SETTINGS_SCOPE_PROCESS,
+                  ==,
+                  webrtc_settings_scope("telemetry"));
+  g_assert_cmpint(WEBRTC_SETTINGS_SCOPE_NOW,
+                  ==,
+                  webrtc_settings_scope("max-sessions"));
+  g_assert_cmpint(WEBRTC_SETTINGS_SCOPE_NOW,
+                  ==,
+                  webrtc_settings_scope("min-free"));
+  g_assert_cmpint(WEBRTC_SETTINGS_SCOPE_NOW,
+                  ==,
+                  webrtc_settings_scope("log"));
+
+  g_assert_cmpint(16, ==, webrtc_settings_admission(settings)->max_sessions);
+
+  g_ptr_array_unref(changed);
+  g_object_unref(settings);
+}
+
+void
+test_reload(void)
+{
+  WebrtcSettings *settings;
+  GPtrArray *changed;
+  gchar *contents;
+  gchar *dir;
+  gchar *path;
+  gchar *conf;
+  gchar *argv[] = {
+    "settings-test", "--config", NULL, "--max-sessions", "4", "--audio", "aac",
+    NULL,
+  };
+
+  dir = g_dir_make_tmp("settings-XXXXXX", NULL);
+  g_assert_nonnull(dir);
+  conf = g_build_filename(dir, "writer.conf", NULL);
+  argv[2] = conf;
+
+  path = config_path("writer");
+  g_assert_true(g_file_get_contents(path, &contents, NULL, NULL));
+  g_assert_true(g_file_set_contents(conf, contents, -1, NULL));
+  g_free(contents);
+  g_free(path);
+
+  settings = webrtc_settings_new();
+  g_assert_cmpint(-1,
+                  ==,
+                  webrtc_settings_parse_opts(settings,
+                                             G_N_ELEMENTS(argv) - 1,
+                                             argv));
+  g_assert_cmpint(4, ==, webrtc_settings_admission(settings)->max_sessions);
+  g_assert_cmpuint(96, ==, webrtc_settings_memory(settings));
+
+  /* Keys gone from the file are back to their defaults, the command line
+   * still wins */
+  path = config_path("writer_changed");
+  g_assert_true(g_file_get_contents(path, &contents, NULL, NULL));
+  g_assert_true(g_file_set_contents(conf, contents, -1, NULL));
+  g_free(contents);
+  g_free(path);
+
+  changed = g_ptr_array_new();
+  g_assert_true(webrtc_settings_reload(settings, changed, NULL));
+  g_assert_true(has_change(changed, "servers"));
+  g_assert_true(has_change(changed, "memory"));
+  g_assert_true(has_change(changed, "catalog"));
+  g_assert_true(has_change(changed, "telemetry"));
+  g_assert_true(has_change(changed, "metadata"));
+  g_assert_false(has_change(changed, "max-sessions"));
+  g_assert_false(has_change(changed, "audio-codec"));
+  g_assert_cmpuint(5, ==, changed->len);
+
+  g_assert_cmpint(4, ==, webrtc_settings_admission(settings)->max_sessions);
+  g_assert_cmpint(WEBRTC_SETTINGS_AUDIO_CODEC_AAC,
+                  ==,
+                  webrtc_settings_audio_codec(settings));
+  g_assert_cmpuint(WEBRTC_SETTINGS_DEFAULT_MEMORY,
+                   ==,
+                   webrtc_settings_memory(settings));
+  g_assert_null(webrtc_settings_get_catalog(settings));
+  g_assert_false(webrtc_settings_get_telemetry(settings));
+
+  g_ptr_array_unref(changed);
+  g_object_unref(settings);
+  g_remove(conf);
+  g_rmdir(dir);
+  g_free(conf);
+  g_free(dir);
+}
+
+void
+test_reload_defaults(void)
+{
+  WebrtcSettings *settings;
+  GPtrArray *changed;
+  gchar *dir;
+  gchar *conf;
+  gchar *argv[] = { "settings-test", "--config", NULL, NULL };
+
+  dir = g_dir_make_tmp("settings-XXXXXX", NULL);
+  g_assert_nonnull(dir);
+  conf = g_build_filename(dir, "writer.conf", NULL);
+  argv[2] = conf;
+  g_assert_true(
+          g_file_set_contents(conf, "[writer]\ntarget=Camera\n", -1, NULL));
+
+  /* As the writer does, the file does not mention the profile */
+  settings = webrtc_settings_new();
+  g_object_set(settings,
+               "latency_profile",
+               WEBRTC_SETTINGS_LATENCY_PROFILE_ARCHIVAL,
+               NULL);
+  g_assert_cmpint(-1,
+                  ==,
+                  webrtc_settings_parse_opts(settings,
+                                             G_N_ELEMENTS(argv) - 1,
+                                             argv));
+
+  changed = g_ptr_array_new();
+  g_assert_true(webrtc_settings_reload(settings, changed, NULL));
+  g_assert_cmpuint(0, ==, changed->len);
+  g_assert_cmpint(WEBRTC_SETTINGS_LATENCY_PROFILE_ARCHIVAL,
+                  ==,
+                  webrtc_settings_latency_profile(settings));
+
+  g_ptr_array_unref(changed);
+  g_object_unref(settings);
+  g_remove(conf);
+  g_rmdir(dir);
+  g_free(conf);
+  g_free(dir);
+}
+
+void
+test_load_invalid(void)
+{
+  WebrtcSettings *settings;
+  GError *lerr = NULL;
+  gchar *path;
+
+  settings = webrtc_settings_new();
+  path = config_path("invalid");
+
+  g_assert_false(webrtc_settings_load_file(settings, path, NULL, &lerr));
+  g_assert_error(lerr, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE);
+
+  /* Nothing from a bad file is applied */
+  g_assert_cmpint(WEBRTC_SETTINGS_VIDEO_CODEC_H264,
+                  ==,
+                  webrtc_settings_video_codec(settings));
+  g_assert_cmpint(0, ==, webrtc_settings_admission(settings)->max_sessions);
+
+  g_clear_error(&lerr);
+  g_free(path);
+  g_object_unref(settings);
+}
+
+void
+test_invalid_option(void)
+{
+  WebrtcSettings *settings;
+  gchar *argv[] = { "settings-test", "--target", "any", "--latency", "fast",
+                    NULL };
+
+  /* Like an invalid value in the file */
+  settings = webrtc_settings_new();
+  g_assert_cmpint(1,
+                  ==,
+                  webrtc_settings_parse_opts(settings,
+                                             G_N_ELEMENTS(argv) - 1,
+                                             argv));
+  g_object_unref(settings);
+}
+
+int
+main(int argc, char *argv[])
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/settings/load_file", test_load_file);
+  g_test_add_func("/settings/reload_changes", test_reload_changes);
+  g_test_add_func("/settings/reload", test_reload);
+  g_test_add_func("/settings/reload_defaults", test_reload_defaults);
+  g_test_add_func("/settings/load_invalid", test_load_invalid);
+  g_test_add_func("/settings/invalid_option", test_invalid_option);
+
+  return g_test_run();
+}
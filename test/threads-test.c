@@ -0,0 +1,127 @@
+#include <glib.h>
+#include <gst/gst.h>
+
+#include "webrtc_threads.h"
+
+static GstBusSyncReply
+count_tasks(G_GNUC_UNUSED GstBus *bus,
+            GstMessage *msg,
+            G_GNUC_UNUSED gpointer user_data)
+{
+  if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_STREAM_STATUS) {
+    webrtc_threads_stream_status(msg);
+  }
+
+  return GST_BUS_DROP;
+}
+
+/* Tasks count themselves from their own threads */
+static guint
+wait_for_tasks(guint expected)
+{
+  struct webrtc_threads_metrics metrics;
+
+  for (guint i = 0; i < 100; i++) {
+    webrtc_threads_get_metrics(&metrics);
+    if (metrics.tasks == expected) {
+      break;
+    }
+    g_usleep(10000);
+  }
+
+  return metrics.tasks;
+}
+
+void
+test_tasks(void)
+{
+  GstElement *pipeline;
+  GstBus *bus;
+
+  /* The source and the queue have a task each */
+  pipeline = gst_parse_launch("fakesrc is-live=true ! queue ! fakesink", NULL);
+  g_assert_nonnull(pipeline);
+  bus = gst_element_get_bus(pipeline);
+  gst_bus_set_sync_handler(bus, count_tasks, NULL, NULL);
+  gst_object_unref(bus);
+
+  gst_element_set_state(pipeline, GST_STATE_PLAYING);
+  g_assert_cmpuint(2, ==, wait_for_tasks(2));
+
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  g_assert_cmpuint(0, ==, wait_for_tasks(0));
+  gst_object_unref(pipeline);
+}
+
+void
+test_metrics(void)
+{
+  struct webrtc_threads_metrics metrics;
+
+  webrtc_threads_get_metrics(&metrics);
+  g_assert_cmpuint(metrics.threads, >=, 1);
+  g_assert_cmpuint(metrics.voluntary_switches +
+                           metrics.involuntary_switches,
+                   >,
+                   0);
+  g_assert_cmpuint(0, ==, metrics.decoders);
+}
+
+void
+test_decoders(void)
+{
+  struct webrtc_threads_metrics metrics;
+  guint cores = g_get_num_processors();
+  GstElement *first;
+  GstElement *second;
+  gint threads;
+
+  first = gst_element_factory_make("avdec_h264", NULL);
+  if (first == NULL) {
+    g_test_skip("avdec_h264 is not installed");
+    return;
+  }
+  second = gst_element_factory_make("avdec_h264", NULL);
+  gst_object_ref_sink(first);
+  gst_object_ref_sink(second);
+
+  webrtc_threads_budget_decoder(first);
+  webrtc_threads_budget_decoder(second);
+  webrtc_threads_get_metrics(&metrics);
+  g_assert_cmpuint(2, ==, metrics.decoders);
+  g_assert_cmpuint(MAX(1, cores / 2), ==, metrics.decoder_threads);
+  g_object_get(first, "max-threads", &threads, NULL);
+  g_assert_cmpint(MAX(1, cores / 2), ==, threads);
+
+  /* A running decoder keeps its share, the next one gets the share of
+   * the one gone */
+  gst_object_unref(second);
+  webrtc_threads_get_metrics(&metrics);
+  g_assert_cmpuint(1, ==, metrics.decoders);
+  g_object_get(first, "max-threads", &threads, NULL);
+  g_assert_cmpint(MAX(1, cores / 2), ==, threads);
+
+  second = gst_element_factory_make("avdec_h264", NULL);
+  gst_object_ref_sink(second);
+  webrtc_threads_budget_decoder(second);
+  g_object_get(second, "max-threads", &threads, NULL);
+  g_assert_cmpint(MAX(1, cores / 2), ==, threads);
+  gst_object_unref(second);
+
+  gst_object_unref(first);
+  webrtc_threads_get_metrics(&metrics);
+  g_assert_cmpuint(0, ==, metrics.decoders);
+}
+
+int
+main(int argc, char *argv[])
+{
+  gst_init(&argc, &argv);
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/threads/tasks", test_tasks);
+  g_test_add_func("/threads/decoders", test_decoders);
+  g_test_add_func("/threads/metrics", test_metrics);
+
+  return g_test_run();
+}
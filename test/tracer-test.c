@@ -0,0 +1,136 @@
+#include <glib.h>
+#include <gst/gst.h>
+
+#include "webrtc_tracer.h"
+
+static struct webrtc_tracer_element *
+find_element(GPtrArray *report, const gchar *name)
+{
+  for (guint i = 0; i < report->len; i++) {
+    struct webrtc_tracer_element *e = report->pdata[i];
+
+    if (g_strcmp0(e->name, name) == 0) {
+      return e;
+    }
+  }
+
+  return NULL;
+}
+
+static void
+run_to_eos(GstElement *pipeline)
+{
+  GstBus *bus;
+  GstMessage *msg;
+
+  bus = gst_element_get_bus(pipeline);
+  gst_element_set_state(pipeline, GST_STATE_PLAYING);
+  msg = gst_bus_timed_pop_filtered(bus,
+                                   10 * GST_SECOND,
+                                   GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  g_assert_nonnull(msg);
+  g_assert_cmpint(GST_MESSAGE_EOS, ==, GST_MESSAGE_TYPE(msg));
+  gst_message_unref(msg);
+  gst_object_unref(bus);
+}
+
+void
+test_elements(void)
+{
+  struct webrtc_tracer_element *e;
+  GstElement *pipeline;
+  GPtrArray *report;
+
+  webrtc_tracer_enable();
+  g_assert_true(webrtc_tracer_enabled());
+
+  /* The queue fills up in front of the slow element */
+  pipeline = gst_parse_launch("fakesrc num-buffers=100 sizetype=fixed ! "
+                              "queue name=q max-size-buffers=10 "
+                              "max-size-bytes=0 max-size-time=0 ! "
+                              "identity name=slow sleep-time=2000 ! "
+                              "fakesink name=sink",
+                              NULL);
+  g_assert_nonnull(pipeline);
+  webrtc_tracer_tag_pipeline(pipeline, "session-a");
+  run_to_eos(pipeline);
+
+  report = webrtc_tracer_collect("session-a");
+  g_assert_nonnull(report);
+
+  /* Slowest first, times are the upper bounds of power of 2 buckets */
+  e = report->pdata[0];
+  g_assert_cmpstr("slow", ==, e->name);
+  g_assert_cmpuint(100, ==, e->buffers);
+  g_assert_cmpuint(e->time_p50, >=, 2048);
+  g_assert_cmpuint(e->time_max, >=, 2000);
+  g_assert_cmpint(-1, ==, e->fill_max);
+
+  e = find_element(report, "q");
+  g_assert_nonnull(e);
+  g_assert_cmpuint(100, ==, e->buffers);
+  g_assert_cmpint(e->fill_max, >=, 50);
+  g_assert_cmpint(e->fill_max, <=, 100);
+  g_assert_cmpuint(0, ==, e->time_max);
+
+  e = find_element(report, "sink");
+  g_assert_nonnull(e);
+  g_assert_cmpuint(e->time_p99, <, 2048);
+  g_ptr_array_unref(report);
+
+  /* Collecting resets, nothing flowed since */
+  g_assert_null(webrtc_tracer_collect("session-a"));
+  g_assert_null(webrtc_tracer_collect("session-b"));
+
+  /* The same session in a new pipeline starts over */
+  webrtc_tracer_untag_pipeline(pipeline);
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(pipeline);
+
+  pipeline = gst_parse_launch("fakesrc num-buffers=10 ! "
+                              "fakesink name=sink",
+                              NULL);
+  g_assert_nonnull(pipeline);
+  webrtc_tracer_tag_pipeline(pipeline, "session-a");
+  run_to_eos(pipeline);
+
+  report = webrtc_tracer_collect("session-a");
+  g_assert_nonnull(report);
+  g_assert_null(find_element(report, "slow"));
+  e = find_element(report, "sink");
+  g_assert_nonnull(e);
+  g_assert_cmpuint(10, ==, e->buffers);
+  g_ptr_array_unref(report);
+
+  webrtc_tracer_untag_pipeline(pipeline);
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(pipeline);
+}
+
+void
+test_untagged(void)
+{
+  GstElement *pipeline;
+
+  webrtc_tracer_enable();
+
+  pipeline = gst_parse_launch("fakesrc num-buffers=10 ! fakesink", NULL);
+  g_assert_nonnull(pipeline);
+  run_to_eos(pipeline);
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(pipeline);
+
+  g_assert_null(webrtc_tracer_collect("session-a"));
+}
+
+int
+main(int argc, char *argv[])
+{
+  gst_init(&argc, &argv);
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/tracer/elements", test_elements);
+  g_test_add_func("/tracer/untagged", test_untagged);
+
+  return g_test_run();
+}